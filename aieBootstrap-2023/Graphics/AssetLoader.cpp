@@ -0,0 +1,126 @@
+#include "AssetLoader.h"
+#include "OBJMesh.h"
+#include "Texture.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+namespace aie {
+
+AssetLoader::AssetLoader(unsigned int threadCount /* = 0 */) {
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+	m_workers.reserve(threadCount);
+	for (unsigned int i = 0; i < threadCount; ++i)
+		m_workers.emplace_back(&AssetLoader::runWorker, this);
+}
+
+AssetLoader::~AssetLoader() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+
+	// workers finish the asset they're on, but nothing more
+	for (auto& worker : m_workers)
+		worker.join();
+
+	for (auto& job : m_jobs)
+		job.state->store(ASSET_FAILED);
+	for (auto& job : m_uploads)
+		job.state->store(ASSET_FAILED);
+}
+
+AssetHandle AssetLoader::loadMesh(OBJMesh* mesh, const char* filename, bool loadTextures /* = true */,
+								  bool flipTextureV /* = false */, eVertexFormat vertexFormat /* = VERTEX_FORMAT_FULL */,
+								  bool generateLods /* = true */) {
+	// the caller's string may be gone by the time a worker gets to it
+	std::string file = filename;
+	return queue([=]() { return mesh->prepare(file.c_str(), loadTextures, flipTextureV, vertexFormat, generateLods); },
+				 [=]() { return mesh->uploadNext(); });
+}
+
+AssetHandle AssetLoader::loadTexture(Texture* texture, const char* filename) {
+	std::string file = filename;
+	return queue([=]() { return texture->decode(file.c_str()); },
+				 [=]() { texture->upload(); return true; });
+}
+
+AssetHandle AssetLoader::queue(std::function<bool()> prepare, std::function<bool()> upload) {
+	Job job;
+	job.prepare = prepare;
+	job.upload = upload;
+	job.state = std::make_shared<std::atomic<unsigned int>>(ASSET_PENDING);
+
+	AssetHandle handle;
+	handle.m_state = job.state;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(std::move(job));
+		++m_pendingCount;
+	}
+	m_wake.notify_one();
+	return handle;
+}
+
+void AssetLoader::update(float budget) {
+	typedef std::chrono::high_resolution_clock Clock;
+	Clock::time_point start = Clock::now();
+
+	do {
+		Job job;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_uploads.empty())
+				return;
+			job = std::move(m_uploads.front());
+			m_uploads.pop_front();
+		}
+
+		bool done = job.upload();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (done) {
+			job.state->store(ASSET_READY);
+			--m_pendingCount;
+		}
+		else {
+			// finish one asset before starting the next, so each is usable sooner
+			m_uploads.push_front(std::move(job));
+		}
+	} while (std::chrono::duration<float>(Clock::now() - start).count() < budget);
+}
+
+unsigned int AssetLoader::getPendingCount() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pendingCount;
+}
+
+void AssetLoader::runWorker() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;) {
+		m_wake.wait(lock, [this]() { return m_quit || m_jobs.empty() == false; });
+		if (m_quit)
+			return;
+
+		Job job = std::move(m_jobs.front());
+		m_jobs.pop_front();
+
+		lock.unlock();
+		bool success = job.prepare();
+		lock.lock();
+
+		if (success) {
+			m_uploads.push_back(std::move(job));
+		}
+		else {
+			job.state->store(ASSET_FAILED);
+			--m_pendingCount;
+		}
+	}
+}
+
+} // namespace aie
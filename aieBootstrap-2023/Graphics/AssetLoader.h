@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "VertexPacking.h"
+
+namespace aie {
+
+class OBJMesh;
+class Texture;
+
+enum eAssetState : unsigned int {
+	ASSET_PENDING,
+	ASSET_READY,
+	ASSET_FAILED,
+};
+
+// held by whatever uses an asset while it loads, to find out when it can be
+// drawn. An empty handle, for an asset that was loaded up front, is ready
+class AssetHandle {
+public:
+
+	eAssetState getState() const { return m_state ? (eAssetState)m_state->load() : ASSET_READY; }
+	bool isPending() const { return getState() == ASSET_PENDING; }
+	bool isReady() const { return getState() == ASSET_READY; }
+	bool hasFailed() const { return getState() == ASSET_FAILED; }
+
+protected:
+
+	friend class AssetLoader;
+
+	std::shared_ptr<std::atomic<unsigned int>> m_state;
+};
+
+// loads assets in the background. Reading, parsing and decoding run on a
+// pool of worker threads, then the opengl uploads they need are run a
+// piece at a time on the gl thread by update, within a per frame budget
+class AssetLoader {
+public:
+
+	// a threadCount of 0 uses one thread per core, less the gl thread's
+	AssetLoader(unsigned int threadCount = 0);
+	~AssetLoader();
+
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	// as OBJMesh::load and Texture::load, but returning straight away. The
+	// asset must outlive the loader, and mustn't be touched until its handle
+	// stops pending
+	AssetHandle loadMesh(OBJMesh* mesh, const char* filename, bool loadTextures = true, bool flipTextureV = false,
+						 eVertexFormat vertexFormat = VERTEX_FORMAT_FULL, bool generateLods = true);
+	AssetHandle loadTexture(Texture* texture, const char* filename);
+
+	// runs waiting uploads, on the thread that owns the gl context, until
+	// budget seconds have passed. At least one runs if any are waiting, so
+	// loading always moves on however small the budget
+	void update(float budget);
+
+	// loads still being read or uploaded
+	unsigned int getPendingCount() const;
+
+protected:
+
+	struct Job {
+		std::function<bool()>	prepare;	// on a worker, false if the asset failed to load
+		std::function<bool()>	upload;		// on the gl thread, again and again until it returns true
+		std::shared_ptr<std::atomic<unsigned int>> state;
+	};
+
+	AssetHandle queue(std::function<bool()> prepare, std::function<bool()> upload);
+	void runWorker();
+
+	std::vector<std::thread>	m_workers;
+	std::deque<Job>				m_jobs;		// waiting for a worker
+	std::deque<Job>				m_uploads;	// prepared, waiting for the gl thread
+	unsigned int				m_pendingCount = 0;
+	bool						m_quit = false;
+
+	mutable std::mutex			m_mutex;
+	std::condition_variable		m_wake;
+};
+
+} // namespace aie
@@ -2,6 +2,7 @@
 
 #include <glm/ext.hpp>
 #include <imgui.h>
+#include <cfloat>
 
 BaseCamera::BaseCamera()
 {
@@ -13,6 +14,9 @@ BaseCamera::BaseCamera()
 	GetWorldTransform();
 
 	m_color = glm::vec4(.7f, .5f, 0, 1);
+
+	m_hierarchy = nullptr;
+	m_node = TransformHierarchy::NO_NODE;
 }
 
 void BaseCamera::Update(float deltaTime)
@@ -27,6 +31,51 @@ void BaseCamera::Update(float deltaTime)
 		glm::rotate(glm::mat4(1), glm::radians(forward.z), vec3(0, 0, 1)) *
 		glm::rotate(glm::mat4(1), glm::radians(forward.y), vec3(0, 1, 0)) *
 		glm::rotate(glm::mat4(1), glm::radians(forward.x), vec3(1, 0, 0));
+
+	if (m_hierarchy)
+		m_hierarchy->SetLocal(m_node, m_worldTranform);
+}
+
+void BaseCamera::Attach(TransformHierarchy* hierarchy, TransformHierarchy::Node parent)
+{
+	m_hierarchy = hierarchy;
+	m_node = hierarchy->AddNode(m_worldTranform, parent);
+}
+
+void BaseCamera::SyncTransform()
+{
+	if (m_hierarchy == nullptr || !m_hierarchy->IsChanged(m_node))
+		return;
+
+	m_worldTranform = m_hierarchy->GetWorld(m_node);
+
+	TransformHierarchy::Node parent = m_hierarchy->GetParent(m_node);
+	if (parent == TransformHierarchy::NO_NODE)
+		return;
+
+	// look the same way as before, but from the parent's space
+	mat4 parentWorld = m_hierarchy->GetWorld(parent);
+	float thetaR = glm::radians(m_theta);
+	float phiR = glm::radians(m_phi);
+	glm::vec3 forward(glm::cos(phiR) * glm::cos(thetaR), glm::sin(phiR),
+		glm::cos(phiR) * glm::sin(thetaR));
+
+	vec3 position = vec3(parentWorld * vec4(m_position, 1));
+	vec3 target = vec3(parentWorld * vec4(m_position + forward, 1));
+	vec3 up = glm::mat3(parentWorld) * vec3(0, 1, 0);
+	m_viewTransform = glm::lookAt(position, target, up);
+}
+
+float BaseCamera::GetProjectedRadius(vec3 center, float radius)
+{
+	// the view matrix is right whether or not the camera has a parent
+	float distance = glm::length(vec3(m_viewTransform * vec4(center, 1)));
+	if (distance <= radius)
+		return FLT_MAX;
+
+	// the sphere's silhouette, scaled by the projection's focal length
+	// from its -1 to 1 range to the screen's 0 to 1
+	return radius / glm::sqrt(distance * distance - radius * radius) * m_projectionTransform[1][1] * 0.5f;
 }
 
 void BaseCamera::Draw()
@@ -36,7 +85,7 @@ void BaseCamera::Draw()
 	glm::vec3 forward(glm::cos(phiR) * glm::cos(thetaR), glm::sin(phiR),
 		glm::cos(phiR) * glm::sin(thetaR));
 
-	aie::Gizmos::addCylinderFilled(vec3(0), .25f, .25f, 8, m_color, &GetWorldTransform());
+	aie::Gizmos::addCylinderFilledInstanced(vec3(0), .25f, .25f, m_color, &GetWorldTransform());
 	aie::Gizmos::addLine(m_position, m_position + forward, glm::vec4(1, 0, 0, 1));
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Gizmos.h"
+#include "TransformHierarchy.h"
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
@@ -19,6 +20,13 @@ public:
 	void Draw();
 
 	void ImGui();
+
+	// puts the camera in the hierarchy so it can follow a parent node. Its
+	// position and rotation then become relative to that parent
+	void Attach(TransformHierarchy* hierarchy,
+		TransformHierarchy::Node parent = TransformHierarchy::NO_NODE);
+	// picks up the camera's world transform once the hierarchy has updated
+	void SyncTransform();
 	
 	// Getters
 	vec3 GetPosition() 
@@ -26,13 +34,16 @@ public:
 	mat4 GetWorldTransform()
 		{ return m_worldTranform; }
 	mat4 GetProjectionViewMatrix() 
-		{ return m_projectionViewTransform; }
+		{ return m_projectionTransform * m_viewTransform; }
 	mat4 GetProjectionMatrix()
 		{ return m_projectionTransform; }
 	mat4 GetViewMatrix() 
 		{ return m_viewTransform; }
 	float GetAspectRatio() 
 		{ return m_aspectRatio; }
+	// how much of the screen's height a sphere's radius covers, from 0 to 1
+	// when it fits on screen. Unbounded once the camera is inside the sphere
+	float GetProjectedRadius(vec3 center, float radius);
 
 	// Setters
 	void SetPosition(vec3 position) 
@@ -48,7 +59,6 @@ public:
 		{ m_color = color; }
 
 protected:
-	mat4 m_projectionViewTransform;
 	mat4 m_projectionTransform;
 	mat4 m_worldTranform;
 	mat4 m_viewTransform;
@@ -62,5 +72,8 @@ protected:
 	vec2 m_lastMouse;
 
 	vec4 m_color;
+
+	TransformHierarchy* m_hierarchy;
+	TransformHierarchy::Node m_node;
 };
 
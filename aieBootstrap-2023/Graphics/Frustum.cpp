@@ -0,0 +1,111 @@
+#include "Frustum.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define FRUSTUM_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+void Frustum::Extract(const glm::mat4& projectionView)
+{
+	// each plane is the fourth row of the matrix plus or minus one of the
+	// others, glm stores columns so row i is m[0][i], m[1][i], m[2][i], m[3][i]
+	const glm::mat4& m = projectionView;
+	glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	m_planes[LEFT] = row3 + row0;
+	m_planes[RIGHT] = row3 - row0;
+	m_planes[BOTTOM] = row3 + row1;
+	m_planes[TOP] = row3 - row1;
+	m_planes[NEAR_PLANE] = row3 + row2;
+	m_planes[FAR_PLANE] = row3 - row2;
+
+	for (int i = 0; i < PLANE_COUNT; i++)
+	{
+		float length = glm::length(glm::vec3(m_planes[i]));
+		if (length > 0)
+			m_planes[i] /= length;
+	}
+}
+
+bool Frustum::TestSphere(const glm::vec3& center, float radius) const
+{
+	for (int i = 0; i < PLANE_COUNT; i++)
+	{
+		const glm::vec4& plane = m_planes[i];
+		// grouped like the SSE path so both agree on spheres touching a plane
+		float distance = (center.x * plane.x + center.y * plane.y) + (center.z * plane.z + plane.w);
+		if (distance < -radius)
+			return false;
+	}
+	return true;
+}
+
+int Frustum::CullSpheresScalar(const float* x, const float* y, const float* z, const float* radius,
+	int count, unsigned char* visible) const
+{
+	int visibleCount = 0;
+	for (int i = 0; i < count; i++)
+	{
+		visible[i] = TestSphere(glm::vec3(x[i], y[i], z[i]), radius[i]) ? 1 : 0;
+		visibleCount += visible[i];
+	}
+	return visibleCount;
+}
+
+#ifdef FRUSTUM_USE_SSE
+
+int Frustum::CullSpheres(const float* x, const float* y, const float* z, const float* radius,
+	int count, unsigned char* visible) const
+{
+	// splat each plane once, then every packet is 6 multiply-adds per sphere
+	__m128 planeX[PLANE_COUNT], planeY[PLANE_COUNT], planeZ[PLANE_COUNT], planeW[PLANE_COUNT];
+	for (int p = 0; p < PLANE_COUNT; p++)
+	{
+		planeX[p] = _mm_set1_ps(m_planes[p].x);
+		planeY[p] = _mm_set1_ps(m_planes[p].y);
+		planeZ[p] = _mm_set1_ps(m_planes[p].z);
+		planeW[p] = _mm_set1_ps(m_planes[p].w);
+	}
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+
+	int visibleCount = 0;
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(x + i);
+		__m128 cy = _mm_loadu_ps(y + i);
+		__m128 cz = _mm_loadu_ps(z + i);
+		__m128 negRadius = _mm_xor_ps(_mm_loadu_ps(radius + i), signBit);
+
+		// lanes set here are outside at least one plane
+		__m128 outside = _mm_setzero_ps();
+		for (int p = 0; p < PLANE_COUNT; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, planeX[p]), _mm_mul_ps(cy, planeY[p])),
+				_mm_add_ps(_mm_mul_ps(cz, planeZ[p]), planeW[p]));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negRadius));
+		}
+
+		int mask = _mm_movemask_ps(outside);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			visible[i + lane] = (mask & (1 << lane)) ? 0 : 1;
+			visibleCount += visible[i + lane];
+		}
+	}
+
+	return visibleCount + CullSpheresScalar(x + i, y + i, z + i, radius + i, count - i, visible + i);
+}
+
+#else
+
+int Frustum::CullSpheres(const float* x, const float* y, const float* z, const float* radius,
+	int count, unsigned char* visible) const
+{
+	return CullSpheresScalar(x, y, z, radius, count, visible);
+}
+
+#endif
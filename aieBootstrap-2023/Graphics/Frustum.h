@@ -0,0 +1,33 @@
+#pragma once
+#include <glm/glm.hpp>
+
+// The six planes of a camera's view volume, pulled from its projection view
+// matrix. Planes face inwards and are normalised so a sphere's distance can
+// be compared directly with its radius. Only needs glm, so it can be used and
+// tested without a GL context.
+class Frustum
+{
+public:
+	enum Plane { LEFT, RIGHT, BOTTOM, TOP, NEAR_PLANE, FAR_PLANE, PLANE_COUNT };
+
+	Frustum() {}
+	Frustum(const glm::mat4& projectionView) { Extract(projectionView); }
+
+	void Extract(const glm::mat4& projectionView);
+
+	bool TestSphere(const glm::vec3& center, float radius) const;
+
+	// Tests count spheres given as structure-of-arrays, four at a time with
+	// SSE where available. Writes 1 to visible for spheres that touch the
+	// frustum and 0 for those outside, and returns how many are visible.
+	int CullSpheres(const float* x, const float* y, const float* z, const float* radius,
+		int count, unsigned char* visible) const;
+	int CullSpheresScalar(const float* x, const float* y, const float* z, const float* radius,
+		int count, unsigned char* visible) const;
+
+	// Getters
+	const glm::vec4& GetPlane(int plane) const { return m_planes[plane]; }
+
+protected:
+	glm::vec4 m_planes[PLANE_COUNT];	// xyz normal, w distance
+};
@@ -1,6 +1,7 @@
 #include "GraphicsApp.h"
 #include "Gizmos.h"
 #include "Input.h"
+#include "TextureCache.h"
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
@@ -30,6 +31,21 @@ bool GraphicsApp::startup()
 	// initialise gizmo primitive counts
 	Gizmos::create(10000, 10000, 10000, 10000);
 
+	// the grid and axis never change, so they're kept across clears
+	Gizmos::beginRetained();
+	vec4 white(1);
+	vec4 black(0, 0, 0, 1);
+	for (int i = 0; i < 21; ++i) {
+		Gizmos::addLine(vec3(-10 + i, 0, 10),
+						vec3(-10 + i, 0, -10),
+						i == 10 ? white : black);
+		Gizmos::addLine(vec3(10, 0, -10 + i),
+						vec3(-10, 0, -10 + i),
+						i == 10 ? white : black);
+	}
+	Gizmos::addTransform(mat4(1));
+	Gizmos::endRetained();
+
 #pragma region CreateCameras
 	// Create a user controlled fly camera
 	m_flyCamera = new FlyCamera();
@@ -60,6 +76,11 @@ bool GraphicsApp::startup()
 		getWindowHeight(), 0.1, 1000);
 	m_topCamera->SetColor(vec4(0, 1, 0, 1));
 
+	m_flyCamera->Attach(&m_hierarchy);
+	m_frontCamera->Attach(&m_hierarchy);
+	m_rightCamera->Attach(&m_hierarchy);
+	m_topCamera->Attach(&m_hierarchy);
+
 	// Sets the current camera to the user controlled fly camera
 	m_curCamera = m_flyCamera;
 #pragma endregion
@@ -75,13 +96,18 @@ bool GraphicsApp::startup()
 	light.color = { 1, 1, 1 };
 	light.direction = { 1, -1, 1 };
 
-	m_emitter = new ParticleEmitter();
-	m_emitter->Initialise(1000, 500, .1f, 1.0f, .5f, 2.5f, .5f, .05f,
+	// every emitter's particles share one pool and update across the cores
+	m_jobSystem = new aie::JobSystem();
+	m_particleSystem = new ParticleSystem(1 << 16, m_jobSystem);
+	m_emitter = m_particleSystem->CreateEmitter(1000, 500, .1f, 1.0f, .5f, 2.5f, .5f, .05f,
 		glm::vec4(0, 0, 1, 1), glm::vec4(0, 1, 0, 1));
 
+	// the models load on its workers while the first frames are drawn
+	m_assetLoader = new aie::AssetLoader();
+
 #pragma region CreateScene
 	m_scene = new Scene(m_curCamera, glm::vec2(getWindowWidth(),
-		getWindowHeight()), light, m_ambientLight);
+		getWindowHeight()), light, m_ambientLight, &m_hierarchy);
 
 	m_scene->AddPointLight(vec3(0), vec3(0, 1, 0), 50);
 	m_scene->AddPointLight(vec3(5, 3, 0), vec3(1, 0, 0), 50);
@@ -93,32 +119,22 @@ bool GraphicsApp::startup()
 
 void GraphicsApp::shutdown() 
 {
+	// stop the workers before the meshes they're loading in to go
+	delete m_assetLoader;
+	delete m_particleSystem;
+	delete m_jobSystem;
 	Gizmos::destroy();
 	delete m_scene;
 }
 
 void GraphicsApp::update(float deltaTime) 
 {
+	m_assetLoader->update(m_assetUploadBudget);
 	m_scene->SetCamera(m_curCamera);
 	
 	// wipe the gizmos clean for this frame
 	Gizmos::clear();
 
-	// draw a simple grid with gizmos
-	vec4 white(1);
-	vec4 black(0, 0, 0, 1);
-	for (int i = 0; i < 21; ++i) {
-		Gizmos::addLine(vec3(-10 + i, 0, 10),
-						vec3(-10 + i, 0, -10),
-						i == 10 ? white : black);
-		Gizmos::addLine(vec3(10, 0, -10 + i),
-						vec3(-10, 0, -10 + i),
-						i == 10 ? white : black);
-	}
-
-	// add a transform so that we can see the axis
-	Gizmos::addTransform(mat4(1));
-
 	// Solar system
 	if (m_planetsVisible)
 		m_sun->Update(deltaTime);
@@ -141,7 +157,7 @@ void GraphicsApp::update(float deltaTime)
 #pragma region ParticleEmitter
 	m_emitter->SetPosition(m_scene->GetPointLightPos(0));
 	m_emitter->SetColor(glm::vec4(m_scene->GetPointLightColor(0), 1));
-	m_emitter->Update(deltaTime, m_curCamera->GetWorldTransform());
+	m_particleSystem->Update(deltaTime);
 #pragma endregion
 
 	if (FlyCamera* flyCamera = dynamic_cast<FlyCamera*>(m_curCamera))
@@ -149,6 +165,13 @@ void GraphicsApp::update(float deltaTime)
 	else
 		m_curCamera->Update(deltaTime);
 
+	// Work out every world transform that changed this frame
+	m_hierarchy.Update();
+	m_flyCamera->SyncTransform();
+	m_frontCamera->SyncTransform();
+	m_rightCamera->SyncTransform();
+	m_topCamera->SyncTransform();
+
 	// quit if we press escape
 	aie::Input* input = aie::Input::getInstance();
 	if (input->isKeyDown(aie::INPUT_KEY_ESCAPE))
@@ -211,7 +234,11 @@ void GraphicsApp::draw() {
 
 	m_particleShader.bind();
 	m_particleShader.bindUniform("ProjectionViewModel", pv * m_particleEmitTransform);
-	m_emitter->Draw();
+	m_particleShader.bindUniform("CameraPosition", glm::vec3(m_curCamera->GetWorldTransform()[3]));
+	m_particleShader.bindUniform("CameraUp", glm::vec3(m_curCamera->GetWorldTransform()[1]));
+	m_particleSystem->Draw(m_curCamera->GetWorldTransform());
+	if (m_emitter->IsVisible())
+		Gizmos::addCylinderFilledInstanced(m_emitter->GetPosition(), 0.2f, .5, m_emitter->GetStartColor());
 
 	Gizmos::draw(m_projectionMatrix * m_viewMatrix);
 
@@ -252,6 +279,8 @@ void GraphicsApp::InitialisePlanets()
 	m_sun->AddChild(new Planet("Neptune", 5.7f, 0.5f, 0.18233f, vec4(0, 0.7f, 1, 1)));
 
 	earth->AddChild(new Planet("Earth's Moon", 0.25f, 0.1f, 1.023f, vec4(0.9f, 0.9f, 1, 1)));
+
+	m_sun->Attach(&m_hierarchy);
 }
 
 bool GraphicsApp::LaunchShaders()
@@ -275,6 +304,8 @@ bool GraphicsApp::LaunchShaders()
 			m_normalLitShader.getLastError());
 		return false;
 	}
+	m_normalLitShader.bindUniformBlock("FrameData", FRAME_UNIFORM_BINDING);
+	m_normalLitShader.bindUniformBlock("DrawData", DRAW_UNIFORM_BINDING);
 
 	// Untextured Mesh Shader
 	m_phongShader.loadShader(aie::eShaderStage::VERTEX, "./shaders/phong.vert");
@@ -284,6 +315,37 @@ bool GraphicsApp::LaunchShaders()
 		printf("Color Shader Error: %s\n", m_phongShader.getLastError());
 		return false;
 	}
+	m_phongShader.bindUniformBlock("FrameData", FRAME_UNIFORM_BINDING);
+	m_phongShader.bindUniformBlock("DrawData", DRAW_UNIFORM_BINDING);
+
+	// Instanced variants of the lit shaders, the scene draws instances
+	// sharing a mesh with these
+	m_normalLitInstancedShader.loadShader(aie::eShaderStage::VERTEX,
+		"./shaders/normalLitInstanced.vert");
+	m_normalLitInstancedShader.loadShader(aie::eShaderStage::FRAGMENT,
+		"./shaders/normalLit.frag");
+	if (m_normalLitInstancedShader.link() == false)
+	{
+		printf("Normal Lit Instanced Shader Error: %s\n",
+			m_normalLitInstancedShader.getLastError());
+		return false;
+	}
+	m_normalLitInstancedShader.bindUniformBlock("FrameData", FRAME_UNIFORM_BINDING);
+	m_normalLitInstancedShader.bindUniformBlock("DrawData", DRAW_UNIFORM_BINDING);
+	m_scene->SetInstancedShader(&m_normalLitShader, &m_normalLitInstancedShader);
+
+	m_phongInstancedShader.loadShader(aie::eShaderStage::VERTEX,
+		"./shaders/phongInstanced.vert");
+	m_phongInstancedShader.loadShader(aie::eShaderStage::FRAGMENT,
+		"./shaders/phong.frag");
+	if (m_phongInstancedShader.link() == false)
+	{
+		printf("Phong Instanced Shader Error: %s\n",
+			m_phongInstancedShader.getLastError());
+		return false;
+	}
+	m_phongInstancedShader.bindUniformBlock("FrameData", FRAME_UNIFORM_BINDING);
+	m_scene->SetInstancedShader(&m_phongShader, &m_phongInstancedShader);
 
 	// Simple Untextured Mesh Shader
 	m_simpleShader.loadShader(aie::eShaderStage::VERTEX,
@@ -332,25 +394,24 @@ bool GraphicsApp::LaunchShaders()
 	m_fullScreenQuad.InitialiseFullscreenQuad();
 	
 #pragma region LoadingOBJMeshes
-	// Used for loading in a OBJ bunny
+	// Used for loading in a OBJ bunny, the meshes are quantised
+	// to a third of their full vertex size and load in the background
 	//if (!BunnyLoader())
 	//	return false;
-	if (!ObjLoader(m_bunnyMesh, m_bunnyTransform, .1,
-		"./stanford/Bunny.obj", "Bunny", true))
-		return false;
+	m_bunnyAsset = AsyncObjLoader(m_bunnyMesh, m_bunnyTransform, .1,
+		"./stanford/Bunny.obj", true, aie::VERTEX_FORMAT_QUANTISED);
 
 	// Used for loading in a OBJ spear
-	if (!ObjLoader(m_spearMesh, m_spearTransform, 1,
-		"./soulspear/soulspear.obj", "Spear", true))
-		return false;
+	m_spearAsset = AsyncObjLoader(m_spearMesh, m_spearTransform, 1,
+		"./soulspear/soulspear.obj", true, aie::VERTEX_FORMAT_QUANTISED);
 
 	// Used for loading in a OBJ kama dagger
-	if (!ObjLoader(m_kamadaggarMesh, m_kamadaggarTransform, 0.005,
-		"./kamadagger/kamadagger.obj", "Kama Dagger", true))
-		return false;
+	m_kamadaggarAsset = AsyncObjLoader(m_kamadaggarMesh, m_kamadaggarTransform, 0.005,
+		"./kamadagger/kamadagger.obj", true, aie::VERTEX_FORMAT_QUANTISED);
 #pragma endregion
 
 #pragma region LoadingPrimitiveMeshes
+	// The primitives are uploaded packed, the simple shader only reads positions
 	// Used for loading in a primitive square
 	if (!SquareLoader())
 		return false;
@@ -370,11 +431,11 @@ bool GraphicsApp::LaunchShaders()
 	
 #pragma region InstanceOBJs
 	// Spear Model
-	m_scene->AddInstance(new Instance(m_spearTransform, &m_spearMesh, &m_normalLitShader, "Soul Spear", true));
+	m_scene->AddInstance(m_spearTransform, &m_spearMesh, &m_normalLitShader, "Soul Spear", true, m_spearAsset);
 	// Kama Dagger Model
-	m_scene->AddInstance(new Instance(m_kamadaggarTransform, &m_kamadaggarMesh, &m_normalLitShader, "Kama Dagger", true));
+	m_scene->AddInstance(m_kamadaggarTransform, &m_kamadaggarMesh, &m_normalLitShader, "Kama Dagger", true, m_kamadaggarAsset);
 	// Bunny Model
-	m_scene->AddInstance(new Instance(m_bunnyTransform, &m_bunnyMesh, &m_normalLitShader, "Bunny", false));
+	m_scene->AddInstance(m_bunnyTransform, &m_bunnyMesh, &m_normalLitShader, "Bunny", false, m_bunnyAsset);
 
 #pragma endregion
 
@@ -389,6 +450,10 @@ void GraphicsApp::ImGUIRefresher()
 	ImGui::Checkbox("Toggle Primitive Shapes", &m_primitiveShapesVisible);
 	ImGui::Checkbox("Toggle Models", &m_modelsVisible);
 	ImGui::Checkbox("Toggle Particle System", m_emitter->Visible());
+	ImGui::Checkbox("Sort Particles", m_particleSystem->Sorting());
+	ImGui::Checkbox("Amortise Particle Sort", m_particleSystem->AmortisedSorting());
+	ImGui::Text("Particles: %u / %u, Draw Calls: %u", m_particleSystem->GetParticleCount(),
+		m_particleSystem->GetCapacity(), m_particleSystem->GetDrawCalls());
 	ImGui::End();
 #pragma endregion
 #pragma region Camera Settings
@@ -439,6 +504,40 @@ void GraphicsApp::ImGUIRefresher()
 	if (m_modelsVisible)
 	{
 		ImGui::Begin("Models Settings");
+		const RenderStats& stats = m_scene->GetRenderStats();
+		bool frustumCulling = m_scene->GetFrustumCulling();
+		if (ImGui::Checkbox("Frustum Culling", &frustumCulling))
+			m_scene->SetFrustumCulling(frustumCulling);
+		ImGui::Text("Draw Calls: %u, Instances: %u, Culled: %u", stats.drawCalls, stats.instances, stats.culled);
+		ImGui::Text("Shader Changes: %u, Texture Binds: %u, Vertex Array Binds: %u",
+			stats.shaderChanges, stats.textureBinds, stats.vertexArrayBinds);
+		ImGui::Text("Triangles: %u", stats.triangles);
+		ImGui::Text("Assets Loading: %u, Placeholders: %u", m_assetLoader->getPendingCount(), stats.placeholders);
+		aie::TextureCache::Stats textureStats = aie::TextureCache::getStats();
+		ImGui::Text("Textures: %u (%.1f MB), Cache Hits: %u, Misses: %u", textureStats.textureCount,
+			textureStats.bytesResident / (1024.0f * 1024.0f), textureStats.hits, textureStats.misses);
+		Gizmos::Stats gizmoStats = Gizmos::getStats();
+		ImGui::Text("Gizmos Streamed: %.1f KB, Overflow: %u, Fence Waits: %u, Buffer Growths: %u",
+			gizmoStats.bytesStreamed / 1024.0f, gizmoStats.overflow, gizmoStats.fenceWaits, gizmoStats.ringGrowths);
+		ImGui::DragFloat("Upload Budget (seconds)", &m_assetUploadBudget, .0001f, 0, .016f, "%.4f");
+		int forcedLod = m_scene->GetForcedLod();
+		if (ImGui::SliderInt("Forced LOD (-1 for auto)", &forcedLod, -1, aie::OBJMesh::MAX_LODS - 1))
+			m_scene->SetForcedLod(forcedLod);
+		float lodThreshold = m_scene->GetLodThreshold();
+		if (ImGui::DragFloat("LOD Threshold (pixels)", &lodThreshold, .05f, .1f, 50))
+			m_scene->SetLodThreshold(lodThreshold);
+		if (ImGui::CollapsingHeader("Mesh Cache Statistics"))
+		{
+			// a mesh is only safe to read once it has loaded
+			if (m_spearAsset.isReady())
+				MeshStatsImGui("Soul Spear", m_spearMesh.getUnoptimisedStats(), m_spearMesh.getOptimisedStats());
+			if (m_kamadaggarAsset.isReady())
+				MeshStatsImGui("Kama Dagger", m_kamadaggarMesh.getUnoptimisedStats(), m_kamadaggarMesh.getOptimisedStats());
+			if (m_bunnyAsset.isReady())
+				MeshStatsImGui("Bunny", m_bunnyMesh.getUnoptimisedStats(), m_bunnyMesh.getOptimisedStats());
+			MeshStatsImGui("Sphere", m_sphereMesh.GetUnoptimisedStats(), m_sphereMesh.GetOptimisedStats());
+			MeshStatsImGui("Cylinder", m_cylinderMesh.GetUnoptimisedStats(), m_cylinderMesh.GetOptimisedStats());
+		}
 		for each (Instance * instance in m_scene->GetInstances())
 		{
 			instance->ImGui();
@@ -529,8 +628,10 @@ bool GraphicsApp::QuadTextureLoader()
 			m_textureShader.getLastError());
 		return false;
 	}
+	m_textureShader.bindUniformBlock("DrawData", DRAW_UNIFORM_BINDING);
 
-	if (m_gridTexture.load("./textures/numbered_grid.tga") == false)
+	if (m_gridTexture.load("./textures/numbered_grid.tga",
+		aie::Texture::LOAD_MIPMAPS | aie::Texture::LOAD_COMPRESS | aie::Texture::LOAD_CACHE | aie::Texture::LOAD_FREE_PIXELS) == false)
 	{
 		printf("Failed to load the grid texture correctly!\n");
 		return false;
@@ -554,7 +655,7 @@ void GraphicsApp::QuadTexturedDraw(glm::mat4 pvm)
 	m_textureShader.bind();
 
 	// Bind the transform
-	m_textureShader.bindUniform("ProjectionViewModel", pvm);
+	m_scene->BindDrawUniforms(pvm, glm::mat4(1), true);
 
 	// Bind the texture location
 	m_textureShader.bindUniform("diffuseTexture", 0);
@@ -597,7 +698,7 @@ void GraphicsApp::BunnyDraw(glm::mat4 pvm)
 	m_colorShader.bindUniform("BaseColor", vec4(1));
 
 	// Draw the bunny using the Mesh's draw
-	m_bunnyMesh.draw();
+	m_bunnyMesh.draw(&m_colorShader);
 }
 
 void GraphicsApp::PhongDraw(glm::mat4 pvm, glm::mat4 transform)
@@ -605,23 +706,12 @@ void GraphicsApp::PhongDraw(glm::mat4 pvm, glm::mat4 transform)
 	// Bind the phong shader
 	m_phongShader.bind();
 
-	// Bind the camera position
-	m_phongShader.bindUniform("CameraPosition",
-		vec3(glm::inverse(m_viewMatrix)[3]));
-
-	// Bind the directional light we defined
-	m_phongShader.bindUniform("LightDirection", m_light.direction);
-	m_phongShader.bindUniform("LightColor", m_light.color);
-	m_phongShader.bindUniform("AmbientColor", m_ambientLight);
-
-	// Bind the pvm using the one provided
-	m_phongShader.bindUniform("ProjectionViewModel", pvm);
-
-	// Bind the transform using the one provided
-	m_phongShader.bindUniform("ModelMatrix", transform);
+	// The camera and lights come from the scene's FrameData block,
+	// so only the pvm and transform provided need binding
+	m_scene->BindDrawUniforms(pvm, transform, false);
 
 	// Draw the bunny using the Mesh's draw
-	m_spearMesh.draw();
+	m_spearMesh.draw(&m_phongShader);
 }
 
 bool GraphicsApp::SpearLoader()
@@ -679,9 +769,9 @@ bool GraphicsApp::ObjLoader(aie::OBJMesh& objMesh, glm::mat4& transform, float s
 	return true;
 }
 bool GraphicsApp::ObjLoader(aie::OBJMesh& objMesh, glm::mat4& transform, float scale, 
-	const char* filepath, const char* filename, bool flipTexture)
+	const char* filepath, const char* filename, bool flipTexture, aie::eVertexFormat vertexFormat)
 {
-	if (objMesh.load(filepath, true, flipTexture) == false)
+	if (objMesh.load(filepath, true, flipTexture, vertexFormat) == false)
 	{
 		std::string errorMessage = filename;
 		errorMessage += " Mesh Error!\n";
@@ -699,31 +789,40 @@ bool GraphicsApp::ObjLoader(aie::OBJMesh& objMesh, glm::mat4& transform, float s
 	return true;
 }
 
+aie::AssetHandle GraphicsApp::AsyncObjLoader(aie::OBJMesh& objMesh, glm::mat4& transform, float scale,
+	const char* filepath, bool flipTexture, aie::eVertexFormat vertexFormat)
+{
+	transform = {
+		scale, 0,     0,     0,
+		0,     scale, 0,     0,
+		0,     0,     scale, 0,
+		0,     0,     0,     1
+	};
+
+	return m_assetLoader->loadMesh(&objMesh, filepath, true, flipTexture, vertexFormat);
+}
+
 void GraphicsApp::ObjDraw(glm::mat4 pv, glm::mat4 transform, aie::OBJMesh* objMesh, aie::ShaderProgram* shader)
 {
 	// Bind the shader
 	shader->bind();
 
-	// Bind the camera position
-	shader->bindUniform("CameraPosition",
-		vec3(glm::inverse(m_viewMatrix)[3]));
-
-	// Bind the directional light we defined
-	shader->bindUniform("LightDirection", m_light.direction);
-	shader->bindUniform("LightColor", m_light.color);
-	shader->bindUniform("AmbientColor", m_ambientLight);
-
 	// Bind the texture location
 	shader->bindUniform("diffuseTexture", 0);
 
-	// Bind the pvm using the one provided
-	shader->bindUniform("ProjectionViewModel", pv * transform);
-
-	// Bind the transform using the one provided
-	shader->bindUniform("ModelMatrix", transform);
+	// The camera and lights come from the scene's FrameData block,
+	// so only the pvm and transform provided need binding
+	m_scene->BindDrawUniforms(pv * transform, transform, true);
 
 	// Draw the spear using the Mesh's draw
-	objMesh->draw();
+	objMesh->draw(shader);
+}
+
+void GraphicsApp::MeshStatsImGui(const char* name, const aie::MeshOptimiser::Stats& unoptimised,
+	const aie::MeshOptimiser::Stats& optimised)
+{
+	ImGui::Text("%s: %u tris, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", name, optimised.triangleCount,
+		unoptimised.getACMR(), optimised.getACMR(), unoptimised.getATVR(), optimised.getATVR());
 }
 
 bool GraphicsApp::SquareLoader()
@@ -742,7 +841,7 @@ bool GraphicsApp::SquareLoader()
 
 	unsigned int indices[36] = { 0,2,1, 1,2,3, 0,1,4, 4,1,5, 1,3,5, 5,3,7, 3,2,7, 7,2,6, 2,0,6, 6,0,4, 4,5,6, 6,5,7 };
 
-	m_squareMesh.Initailise(8, vertices, 36, indices);
+	m_squareMesh.Initailise(8, vertices, 36, indices, true);
 
 	// This is a 10 'unit' wide square
 	m_squareTransform = {
@@ -795,7 +894,7 @@ bool GraphicsApp::CylinderLoader(float radius, float height, int segments)
 		indicesIndex += 12;
 	}
 
-	m_cylinderMesh.Initailise(segments * 2 + 2, vertices, segments * 12, indices);
+	m_cylinderMesh.Initailise(segments * 2 + 2, vertices, segments * 12, indices, true);
 
 	// This is a 10 'unit' wide square
 	m_cylinderTransform = {
@@ -819,7 +918,7 @@ bool GraphicsApp::PyramidLoader(float width, float height)
 
 	unsigned int indices[18] = { 4,3,2, 2,3,1, 1,2,0, 2,4,0, 4,3,0, 3,1,0};
 
-	m_pyramidMesh.Initailise(5, vertices, 18, indices);
+	m_pyramidMesh.Initailise(5, vertices, 18, indices, true);
 
 	// This is a 10 'unit' wide square
 	m_pyramidTransform = {
@@ -909,7 +1008,7 @@ bool GraphicsApp::SphereLoader(float segments, float rings, float radius)
 	}
 
 	m_sphereMesh.Initailise((segments * (rings - 1)) + 2, vertices, 
-		((segments * 2) + ((rings - 2) * segments * 2)) * 3, indices);
+		((segments * 2) + ((rings - 2) * segments * 2)) * 3, indices, true);
 
 	// This is a 10 'unit' wide square
 	m_sphereTransform = {
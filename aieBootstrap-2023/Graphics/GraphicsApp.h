@@ -5,15 +5,18 @@
 #include "Shader.h"
 #include "Mesh.h"
 #include "OBJMesh.h"
+#include "AssetLoader.h"
 #include "SimpleCamera.h"
 #include "FlyCamera.h"
 #include "StationaryCamera.h"
 
 #include "Scene.h"
 #include "Instance.h"
+#include "TransformHierarchy.h"
 
 #include "RenderTarget.h"
-#include "ParticleEmitter.h"
+#include "ParticleSystem.h"
+#include "JobSystem.h"
 
 #include <glm/mat4x4.hpp>
 
@@ -57,10 +60,19 @@ protected:
 		float scale, const char* filepath, bool flipTexture);
 	bool ObjLoader(aie::OBJMesh& objMesh, glm::mat4& transform,
 		float scale, const char* filepath, const char* filename, 
-		bool flipTexture);
+		bool flipTexture, aie::eVertexFormat vertexFormat = aie::VERTEX_FORMAT_FULL);
+
+	// queues the obj on the asset loader rather than loading it before the
+	// first frame, the scene draws a placeholder until it has uploaded
+	aie::AssetHandle AsyncObjLoader(aie::OBJMesh& objMesh, glm::mat4& transform, float scale,
+		const char* filepath, bool flipTexture, aie::eVertexFormat vertexFormat = aie::VERTEX_FORMAT_FULL);
 
 	// for textured OBJs
 	void ObjDraw(glm::mat4 pv, glm::mat4 transform, aie::OBJMesh* objMesh, aie::ShaderProgram* shader);
+
+	// shows a mesh's vertex cache use before and after load time optimisation
+	void MeshStatsImGui(const char* name, const aie::MeshOptimiser::Stats& unoptimised,
+		const aie::MeshOptimiser::Stats& optimised);
 	
 	int m_postProcessTarget = 11;
 
@@ -74,6 +86,9 @@ protected:
 
 	Scene*		m_scene;
 
+	aie::AssetLoader* m_assetLoader;
+	float m_assetUploadBudget = 0.002f;	// seconds of each frame spent uploading loaded assets
+
 	// camera transforms
 	glm::mat4	m_viewMatrix;
 	glm::mat4	m_projectionMatrix;
@@ -82,11 +97,16 @@ protected:
 
 	Planet* m_sun;
 
+	// shared by the planets, the scene's instances and the cameras
+	TransformHierarchy m_hierarchy;
+
 	aie::ShaderProgram m_simpleShader;
 	aie::ShaderProgram m_colorShader;
 	aie::ShaderProgram m_phongShader;
+	aie::ShaderProgram m_phongInstancedShader;
 	aie::ShaderProgram m_textureShader;
 	aie::ShaderProgram m_normalLitShader;
+	aie::ShaderProgram m_normalLitInstancedShader;
 	aie::ShaderProgram m_postProcessShader;
 	aie::ShaderProgram m_particleShader;
 
@@ -97,6 +117,7 @@ protected:
 	glm::mat4		   m_quadTransform;
 
 	aie::OBJMesh	   m_bunnyMesh;
+	aie::AssetHandle   m_bunnyAsset;
 	glm::mat4		   m_bunnyTransform;
 	float m_bunnyScale = 1;
 	float m_prevBunnyScale = 1;
@@ -104,9 +125,11 @@ protected:
 	glm::vec3 m_prevBunnyRotation = glm::vec3(0);
 
 	aie::OBJMesh	   m_spearMesh;
+	aie::AssetHandle   m_spearAsset;
 	glm::mat4		   m_spearTransform;
 
 	aie::OBJMesh	   m_kamadaggarMesh;
+	aie::AssetHandle   m_kamadaggarAsset;
 	glm::mat4		   m_kamadaggarTransform;
 
 	Mesh			   m_squareMesh;
@@ -136,6 +159,8 @@ protected:
 	Light m_light;
 	glm::vec3 m_ambientLight;
 
+	aie::JobSystem* m_jobSystem;
+	ParticleSystem* m_particleSystem;
 	ParticleEmitter* m_emitter;
 	glm::mat4 m_particleEmitTransform;
 
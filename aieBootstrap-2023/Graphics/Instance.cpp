@@ -1,64 +1,13 @@
 #include "Instance.h"
-#include <glm/ext.hpp>
-#include "Scene.h"
 #include "OBJMesh.h"
-#include "Texture.h"
-#include "BaseCamera.h"
-#include "GraphicsApp.h"
+#include <glm/ext.hpp>
 
 #include <imgui.h>
 
-Instance::Instance(glm::mat4 transform, aie::OBJMesh* mesh, aie::ShaderProgram* shader, 
-	std::string name, bool hasTexture)
+Instance::Instance(Scene* scene, InstanceHandle handle, std::string name) :
+	m_scene(scene), m_handle(handle), m_name(name)
 {
-	m_transform = transform;
-	m_mesh = mesh;
-	m_shader = shader;
 
-	m_name = name;
-	m_hasTexture = hasTexture;
-}
-
-Instance::Instance(glm::vec3 position, glm::vec3 eulerAngles, glm::vec3 scale, 
-	aie::OBJMesh* mesh, aie::ShaderProgram* shader, std::string name, bool hasTexture) :
-	m_mesh(mesh), m_shader(shader), m_name(name), m_hasTexture(hasTexture)
-{
-	m_transform = MakeTransform(position, eulerAngles, scale);
-}
-
-void Instance::Draw(Scene* scene)
-{
-	if (!m_visible)
-		return;
-
-	// Set the shader pipeline
-	m_shader->bind();
-
-	// Bind all relevent uniforms for our shaders
-	auto pvm = scene->GetCamera()->GetProjectionMatrix() * 
-		scene->GetCamera()->GetViewMatrix() * m_transform;
-	m_shader->bindUniform("ProjectionViewModel", pvm);
-	m_shader->bindUniform("ModelMatrix", m_transform);
-
-	m_shader->bindUniform("hasTexture", m_hasTexture);
-
-	// Bind the camera position
-	m_shader->bindUniform("CameraPosition", scene->GetCamera()->GetPosition());
-
-	// Bind the point lights
-	int numberofLights = scene->GetNumberOfLights();
-	m_shader->bindUniform("numLights", numberofLights);
-	m_shader->bindUniform("PointLightPositions", numberofLights, 
-		scene->GetPointLightPositions());
-	m_shader->bindUniform("PointLightColors", numberofLights, 
-		scene->GetPointLightColors());
-
-	// Bind the directional light we defined
-	m_shader->bindUniform("LightDirection", scene->GetLight().direction);
-	m_shader->bindUniform("LightColor", scene->GetLight().color);
-	m_shader->bindUniform("AmbientColor", scene->GetAmbientLightColor());
-
-	m_mesh->draw();
 }
 
 glm::mat4 Instance::MakeTransform(glm::vec3 position, glm::vec3 eulerAngles, glm::vec3 scale)
@@ -74,21 +23,44 @@ void Instance::ImGui()
 {
 	if (ImGui::CollapsingHeader(m_name.c_str()))
 	{
-		ImGui::Checkbox(("Toggle " + m_name).c_str(), &m_visible);
-		ImGui::DragFloat3((m_name + ": Position").c_str(), &m_transform[3][0], .01);
+		// edit copies so the scene hears about every change
+		bool visible = IsVisible();
+		if (ImGui::Checkbox(("Toggle " + m_name).c_str(), &visible))
+			SetVisible(visible);
+		bool transparent = IsTransparent();
+		if (ImGui::Checkbox((m_name + ": Transparent").c_str(), &transparent))
+			SetTransparent(transparent);
+
+		if (IsLoaded())
+		{
+			int lod = GetLodOverride();
+			int lodCount = (int)GetMesh()->getLodCount();
+			if (ImGui::SliderInt((m_name + ": LOD").c_str(), &lod, -1, lodCount - 1))
+				SetLodOverride(lod);
+			ImGui::Text("Drawing LOD %u of %d", GetLod(), lodCount);
+		}
+		else
+			ImGui::Text(GetAsset().hasFailed() ? "Failed to load" : "Loading...");
+
+		glm::mat4 transform = GetTransform();
+		bool changed = ImGui::DragFloat3((m_name + ": Position").c_str(), &transform[3][0], .01);
 		if (ImGui::DragFloat((m_name + ": Scale").c_str(), &m_curScale, .01, .01, 100))
 		{
 			float diff = m_curScale / m_prevScale;
-			m_transform = glm::scale(m_transform, vec3(diff));
+			transform = glm::scale(transform, glm::vec3(diff));
 			m_prevScale = m_curScale;
+			changed = true;
 		}
 		if (ImGui::DragFloat3((m_name + ": Rotation").c_str(), &m_curRotation[0], .01))
 		{
-			vec3 diff = m_prevRotation - m_curRotation;
-			m_transform = glm::rotate(m_transform, diff[0], vec3(1, 0, 0));
-			m_transform = glm::rotate(m_transform, diff[1], vec3(0, 1, 0));
-			m_transform = glm::rotate(m_transform, diff[2], vec3(0, 0, 1));
+			glm::vec3 diff = m_prevRotation - m_curRotation;
+			transform = glm::rotate(transform, diff[0], glm::vec3(1, 0, 0));
+			transform = glm::rotate(transform, diff[1], glm::vec3(0, 1, 0));
+			transform = glm::rotate(transform, diff[2], glm::vec3(0, 0, 1));
 			m_prevRotation = m_curRotation;
+			changed = true;
 		}
+		if (changed)
+			SetTransform(transform);
 	}
 }
@@ -1,43 +1,57 @@
 #pragma once
 #include <glm/glm.hpp>
 #include <string>
-
-class Scene;
-struct Light;
+#include "Scene.h"
 
 namespace aie {
 	class OBJMesh;
 	class ShaderProgram;
 }
 
+// A named instance in a Scene. The transform, mesh, shader and flags live in
+// the scene's packed arrays, an Instance reaches them through its handle and
+// keeps only what the editor needs.
 class Instance {
 public:
-	Instance(glm::mat4 transform, aie::OBJMesh* mesh, 
-		aie::ShaderProgram* shader, std::string name, bool hasTexture);
-	Instance(glm::vec3 position, glm::vec3 eulerAngles, glm::vec3 scale, 
-		aie::OBJMesh* mesh, aie::ShaderProgram* shader, std::string name, bool hasTexture);
+	Instance(Scene* scene, InstanceHandle handle, std::string name);
 	~Instance() {};
 
-	void Draw(Scene* scene);
-
 	static glm::mat4 MakeTransform(glm::vec3 position, 
 		glm::vec3 eulerAngles, glm::vec3 scale);
 
 	void ImGui();
 
 	// Getters
-	glm::mat4 GetTransform() { return m_transform; }
+	const std::string& GetName() { return m_name; }
+	InstanceHandle GetHandle() { return m_handle; }
+	// relative to the parent, or the world if there isn't one
+	const glm::mat4& GetTransform() { return m_scene->GetInstanceTransform(m_handle); }
+	const glm::mat4& GetWorldTransform() { return m_scene->GetInstanceWorldTransform(m_handle); }
+	TransformHierarchy::Node GetNode() { return m_scene->GetInstanceNode(m_handle); }
+	// only touch the mesh once it has loaded
+	aie::OBJMesh* GetMesh() { return m_scene->GetInstanceMesh(m_handle); }
+	const aie::AssetHandle& GetAsset() { return m_scene->GetInstanceAsset(m_handle); }
+	bool IsLoaded() { return GetAsset().isReady(); }
+	aie::ShaderProgram* GetShader() { return m_scene->GetInstanceShader(m_handle); }
+	bool IsVisible() { return m_scene->GetInstanceFlag(m_handle, INSTANCE_VISIBLE); }
+	bool HasTexture() { return m_scene->GetInstanceFlag(m_handle, INSTANCE_HAS_TEXTURE); }
+	bool IsTransparent() { return m_scene->GetInstanceFlag(m_handle, INSTANCE_TRANSPARENT); }
+	unsigned int GetLod() { return m_scene->GetInstanceLod(m_handle); }
+	int GetLodOverride() { return m_scene->GetInstanceLodOverride(m_handle); }
 
 	// Setters
-	void SetTransform(glm::mat4 transform) { m_transform = transform; }
+	void SetTransform(const glm::mat4& transform) { m_scene->SetInstanceTransform(m_handle, transform); }
+	void SetParent(Instance* parent)
+		{ m_scene->SetInstanceParent(m_handle, parent ? parent->GetNode() : TransformHierarchy::NO_NODE); }
+	void SetVisible(bool visible) { m_scene->SetInstanceFlag(m_handle, INSTANCE_VISIBLE, visible); }
+	// transparent instances are blended, drawn after the opaque ones from back to front
+	void SetTransparent(bool transparent) { m_scene->SetInstanceFlag(m_handle, INSTANCE_TRANSPARENT, transparent); }
+	// -1 lets the scene pick the level of detail by screen size again
+	void SetLodOverride(int lod) { m_scene->SetInstanceLodOverride(m_handle, lod); }
 
 protected:
-	glm::mat4 m_transform;
-	aie::OBJMesh* m_mesh;
-	aie::ShaderProgram* m_shader;
-
-	bool m_visible = true;
-	bool m_hasTexture;
+	Scene* m_scene;
+	InstanceHandle m_handle;
 
 	float m_curScale = 1;
 	float m_prevScale = 1;
@@ -47,4 +61,3 @@ protected:
 
 	std::string m_name;
 };
-
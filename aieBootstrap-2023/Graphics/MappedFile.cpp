@@ -0,0 +1,110 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace aie {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : m_data(nullptr), m_size(0), m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr) {}
+
+bool MappedFile::open(const char* filename) {
+	close();
+
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+							  OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(file, &size) == FALSE || size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		CloseHandle(file);
+		return false;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	m_file = file;
+	m_mapping = mapping;
+	m_data = (const unsigned char*)view;
+	m_size = (size_t)size.QuadPart;
+	return true;
+}
+
+void MappedFile::close() {
+	if (m_data != nullptr)
+		UnmapViewOfFile(m_data);
+	if (m_mapping != nullptr)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+
+	m_data = nullptr;
+	m_size = 0;
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile() : m_data(nullptr), m_size(0) {}
+
+bool MappedFile::open(const char* filename) {
+	close();
+
+	int file = ::open(filename, O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0) {
+		::close(file);
+		return false;
+	}
+
+	// the mapping keeps the file alive, so the descriptor isn't needed after this
+	void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (view == MAP_FAILED)
+		return false;
+
+	m_data = (const unsigned char*)view;
+	m_size = (size_t)info.st_size;
+	return true;
+}
+
+void MappedFile::close() {
+	if (m_data != nullptr)
+		munmap((void*)m_data, m_size);
+
+	m_data = nullptr;
+	m_size = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+} // namespace aie
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+
+namespace aie {
+
+// a read-only view of a whole file mapped in to memory, so its contents can
+// be handed straight to opengl without copying them through a buffer first
+class MappedFile {
+public:
+
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// fails for missing or empty files
+	bool open(const char* filename);
+	void close();
+
+	bool isOpen() const { return m_data != nullptr; }
+
+	const unsigned char* getData() const { return m_data; }
+	size_t getSize() const { return m_size; }
+
+protected:
+
+	const unsigned char*	m_data;
+	size_t					m_size;
+
+#ifdef _WIN32
+	void*					m_file;
+	void*					m_mapping;
+#endif
+};
+
+} // namespace aie
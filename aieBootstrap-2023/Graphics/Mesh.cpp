@@ -1,5 +1,7 @@
 #include <gl_core_4_4.h>
 #include "Mesh.h"
+#include "VertexPacking.h"
+#include <vector>
 
 Mesh::~Mesh()
 {
@@ -115,11 +117,35 @@ void Mesh::InitialiseFullscreenQuad()
 
 }
 
-void Mesh::Initailise(unsigned int vertexCount, const Vertex* vertices, unsigned int indexCount, unsigned int* indices)
+void Mesh::Initailise(unsigned int vertexCount, const Vertex* vertices, unsigned int indexCount, unsigned int* indices,
+	bool packed)
 {
 	// Check if mesh is not initialised already
 	assert(m_vao == 0);
 
+	// Work on copies, giving unindexed meshes an index per vertex
+	std::vector<Vertex> vertexData(vertices, vertices + vertexCount);
+	std::vector<unsigned int> indexData;
+	if (indexCount != 0)
+		indexData.assign(indices, indices + indexCount);
+	else
+	{
+		indexData.resize(vertexCount);
+		for (unsigned int i = 0; i < vertexCount; i++)
+			indexData[i] = i;
+	}
+	m_unoptimisedStats = aie::MeshOptimiser::analyse(indexData.data(), (unsigned int)indexData.size(), vertexCount);
+
+	// Merge repeated vertices, then reorder for the vertex cache, overdraw and fetching
+	vertexData.resize(aie::MeshOptimiser::deduplicateVertices(vertexData.data(), vertexCount, sizeof(Vertex),
+		indexData.data(), (unsigned int)indexData.size()));
+	aie::MeshOptimiser::optimise(vertexData, indexData);
+	m_optimisedStats = aie::MeshOptimiser::analyse(indexData.data(), (unsigned int)indexData.size(),
+		(unsigned int)vertexData.size());
+
+	vertexCount = (unsigned int)vertexData.size();
+	indexCount = (unsigned int)indexData.size();
+
 	// Generate buffers
 	glGenBuffers(1, &m_vbo);
 	glGenVertexArrays(1, &m_vao);
@@ -130,41 +156,71 @@ void Mesh::Initailise(unsigned int vertexCount, const Vertex* vertices, unsigned
 	// Bind the vertex buffer
 	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
 
-	// Fill the vertex buffer
-	glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex),
-		vertices, GL_STATIC_DRAW);
-
-	// Enable the first element as the position
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
-
-	//Enable the second element as the normal
 	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_TRUE, sizeof(Vertex), (void*)16);
-
-	//Enable the third element as the texture coordinate
 	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)32);
 
-	// Bind the indices if there are any defined
-	if (indexCount != 0)
+	if (packed)
 	{
-		glGenBuffers(1, &m_ibo);
+		// The normal's w of 1 tells the shaders it is octahedral
+		std::vector<PackedVertex> packedData(vertexCount);
+		for (unsigned int i = 0; i < vertexCount; i++)
+		{
+			packedData[i].position[0] = vertexData[i].position.x;
+			packedData[i].position[1] = vertexData[i].position.y;
+			packedData[i].position[2] = vertexData[i].position.z;
+			packedData[i].normal = aie::packDirection(glm::vec3(vertexData[i].normal), 1);
+			packedData[i].texCoord = aie::packTexCoord(vertexData[i].texCoord);
+		}
+		m_vertexSize = sizeof(PackedVertex);
 
-		// Bind the vertex buffer
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+		// Fill the vertex buffer
+		glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(PackedVertex),
+			packedData.data(), GL_STATIC_DRAW);
+
+		// Position, normal and texture coordinate
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), 0);
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)12);
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)16);
+	}
+	else
+	{
+		m_vertexSize = sizeof(Vertex);
 
 		// Fill the vertex buffer
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * 
-			sizeof(unsigned int), indices, GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex),
+			vertexData.data(), GL_STATIC_DRAW);
 
-		m_triCount = indexCount / 3;
+		// Position, normal and texture coordinate
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_TRUE, sizeof(Vertex), (void*)16);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)32);
+	}
+
+	// Bind the indices
+	glGenBuffers(1, &m_ibo);
+
+	// Bind the index buffer
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+
+	// Fill the index buffer, with 16 bit indices if they can reach every vertex
+	if (aie::MeshOptimiser::canUseShortIndices(vertexCount))
+	{
+		std::vector<unsigned short> shortIndices =
+			aie::MeshOptimiser::packShortIndices(indexData.data(), indexCount);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount *
+			sizeof(unsigned short), shortIndices.data(), GL_STATIC_DRAW);
+		m_indexType = GL_UNSIGNED_SHORT;
 	}
 	else
 	{
-		m_triCount = vertexCount / 3;
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount *
+			sizeof(unsigned int), indexData.data(), GL_STATIC_DRAW);
+		m_indexType = GL_UNSIGNED_INT;
 	}
 
+	m_triCount = indexCount / 3;
+
 	// Unbind our buffers
 	glBindVertexArray(0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -179,7 +235,7 @@ void Mesh::Draw()
 	if (m_ibo != 0)
 	{
 		glDrawElements(GL_TRIANGLES,
-			3 * m_triCount, GL_UNSIGNED_INT, 0);
+			3 * m_triCount, m_indexType, 0);
 	}
 	else
 		glDrawArrays(GL_TRIANGLES, 0, 3 * m_triCount);
@@ -1,12 +1,13 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include "MeshOptimiser.h"
 
 class Mesh
 {
 public:
 
-	Mesh() : m_triCount(0), m_vao(0), m_vbo(0), m_ibo(0) {}
+	Mesh() : m_triCount(0), m_vao(0), m_vbo(0), m_ibo(0), m_indexType(0) {}
 	virtual ~Mesh();
 
 	struct Vertex
@@ -16,20 +17,42 @@ public:
 		glm::vec2 texCoord;
 	};
 
+	// Half the size of a Vertex, see VertexPacking.h
+	struct PackedVertex
+	{
+		float position[3];
+		unsigned int normal; // Octahedral 10_10_10_2
+		unsigned int texCoord; // Two half floats
+	};
+
 	void InitialiseQuad(); // Will be used to make a simple quad
 	void InitialiseFullscreenQuad(); // Will be used for Post Processing
 	
+	// The vertices are deduplicated and reordered for the vertex cache before
+	// upload, so the mesh is always drawn indexed. Packed meshes are uploaded
+	// as PackedVertex
 	void Initailise(unsigned int vertexCount, const Vertex* vertices,
-		unsigned int indexCount = 0, unsigned int* indices = nullptr); // Will be used for implemeting a primitive
+		unsigned int indexCount = 0, unsigned int* indices = nullptr,
+		bool packed = false); // Will be used for implemeting a primitive
 
 	virtual void Draw();
 
+	// Getters
+	const aie::MeshOptimiser::Stats& GetUnoptimisedStats() const { return m_unoptimisedStats; }
+	const aie::MeshOptimiser::Stats& GetOptimisedStats() const { return m_optimisedStats; }
+	unsigned int GetVertexSize() const { return m_vertexSize; }
+
 protected:
 
 	unsigned int m_triCount;
 	unsigned int m_vao; // The Vertex Array Object
 	unsigned int m_vbo; // The Vertex Buffer Object
 	unsigned int m_ibo; // The Index Buffer Object
+	unsigned int m_indexType; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	unsigned int m_vertexSize = sizeof(Vertex); // Bytes per vertex in the vertex buffer
+
+	aie::MeshOptimiser::Stats m_unoptimisedStats;
+	aie::MeshOptimiser::Stats m_optimisedStats;
 
 };
 
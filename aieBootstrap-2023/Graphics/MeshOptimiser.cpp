@@ -0,0 +1,327 @@
+#include "MeshOptimiser.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+
+namespace aie {
+
+MeshOptimiser::Stats& MeshOptimiser::Stats::operator+=(const Stats& other) {
+	triangleCount += other.triangleCount;
+	vertexCount += other.vertexCount;
+	transformCount += other.transformCount;
+	return *this;
+}
+
+// a fifo cache kept as the time each vertex last entered it, so clearing it
+// is just moving the clock on
+class CacheSimulator {
+public:
+
+	CacheSimulator(unsigned int vertexCount, unsigned int cacheSize)
+		: m_entered(vertexCount, 0), m_cacheSize(cacheSize), m_time(cacheSize + 1) {}
+
+	// returns true on a miss
+	bool use(unsigned int vertex) {
+		if (m_time - m_entered[vertex] <= m_cacheSize)
+			return false;
+		m_entered[vertex] = m_time++;
+		return true;
+	}
+
+	bool isCached(unsigned int vertex) const { return m_time - m_entered[vertex] <= m_cacheSize; }
+	unsigned int getAge(unsigned int vertex) const { return m_time - m_entered[vertex]; }
+
+	void clear() { m_time += m_cacheSize + 1; }
+
+private:
+
+	std::vector<unsigned int>	m_entered;
+	unsigned int				m_cacheSize;
+	unsigned int				m_time;
+};
+
+MeshOptimiser::Stats MeshOptimiser::analyse(const unsigned int* indices, unsigned int indexCount, unsigned int vertexCount,
+											unsigned int cacheSize /* = CACHE_SIZE */) {
+	Stats stats;
+	stats.triangleCount = indexCount / 3;
+
+	CacheSimulator cache(vertexCount, cacheSize);
+	std::vector<bool> used(vertexCount, false);
+	for (unsigned int i = 0; i < stats.triangleCount * 3; ++i) {
+		unsigned int v = indices[i];
+		if (cache.use(v))
+			stats.transformCount++;
+		if (used[v] == false) {
+			used[v] = true;
+			stats.vertexCount++;
+		}
+	}
+	return stats;
+}
+
+// hashes and compares whole vertices by their bytes
+struct VertexBytes {
+	const unsigned char*	data;
+	unsigned int			size;
+
+	size_t operator()(unsigned int vertex) const {
+		const unsigned char* bytes = data + (size_t)vertex * size;
+		size_t hash = 2166136261u;
+		for (unsigned int i = 0; i < size; ++i)
+			hash = (hash ^ bytes[i]) * 16777619u;
+		return hash;
+	}
+
+	bool operator()(unsigned int a, unsigned int b) const {
+		return memcmp(data + (size_t)a * size, data + (size_t)b * size, size) == 0;
+	}
+};
+
+unsigned int MeshOptimiser::deduplicateVertices(void* vertices, unsigned int vertexCount, unsigned int vertexSize,
+												unsigned int* indices, unsigned int indexCount) {
+	unsigned char* data = (unsigned char*)vertices;
+	VertexBytes bytes = { data, vertexSize };
+	std::unordered_set<unsigned int, VertexBytes, VertexBytes> unique(vertexCount, bytes, bytes);
+	std::vector<unsigned int> remap(vertexCount);
+
+	// each vertex is moved down to the next free slot before looking it up,
+	// so the set only ever refers to slots that won't be written again
+	unsigned int uniqueCount = 0;
+	for (unsigned int i = 0; i < vertexCount; ++i) {
+		if (uniqueCount != i)
+			memcpy(data + (size_t)uniqueCount * vertexSize, data + (size_t)i * vertexSize, vertexSize);
+
+		auto result = unique.insert(uniqueCount);
+		remap[i] = *result.first;
+		if (result.second)
+			uniqueCount++;
+	}
+
+	for (unsigned int i = 0; i < indexCount; ++i)
+		indices[i] = remap[indices[i]];
+
+	return uniqueCount;
+}
+
+void MeshOptimiser::optimiseVertexCache(unsigned int* indices, unsigned int indexCount, unsigned int vertexCount,
+										std::vector<unsigned int>* clusters /* = nullptr */,
+										unsigned int cacheSize /* = CACHE_SIZE */) {
+	unsigned int triangleCount = indexCount / 3;
+	if (clusters != nullptr) {
+		clusters->clear();
+		clusters->push_back(0);
+	}
+	if (triangleCount == 0)
+		return;
+
+	// the triangles using each vertex, and how many of them are still to be emitted
+	std::vector<unsigned int> liveCount(vertexCount, 0);
+	for (unsigned int i = 0; i < triangleCount * 3; ++i)
+		liveCount[indices[i]]++;
+
+	std::vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+	for (unsigned int v = 0; v < vertexCount; ++v)
+		firstTriangle[v + 1] = firstTriangle[v] + liveCount[v];
+
+	std::vector<unsigned int> adjacency(triangleCount * 3);
+	std::vector<unsigned int> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+	for (unsigned int i = 0; i < triangleCount * 3; ++i)
+		adjacency[fill[indices[i]]++] = i / 3;
+
+	CacheSimulator cache(vertexCount, cacheSize);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> deadEnd;
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> output;
+	deadEnd.reserve(triangleCount * 3);
+	output.reserve(triangleCount * 3);
+
+	unsigned int cursor = 0;
+	int fanning = (int)indices[0];
+	while (fanning >= 0) {
+
+		// emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (unsigned int a = firstTriangle[fanning]; a < firstTriangle[fanning + 1]; ++a) {
+			unsigned int t = adjacency[a];
+			if (emitted[t])
+				continue;
+			emitted[t] = true;
+
+			for (unsigned int k = 0; k < 3; ++k) {
+				unsigned int v = indices[t * 3 + k];
+				output.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveCount[v]--;
+				cache.use(v);
+			}
+		}
+
+		// fan around the oldest vertex that will still be cached once its
+		// triangles are emitted, or failing that any that has triangles left
+		int next = -1;
+		int bestPriority = -1;
+		for (unsigned int v : candidates) {
+			if (liveCount[v] == 0)
+				continue;
+
+			int priority = 0;
+			if (cache.getAge(v) + 2 * liveCount[v] <= cacheSize)
+				priority = (int)cache.getAge(v);
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				next = (int)v;
+			}
+		}
+
+		if (next < 0) {
+			// a dead end, go back to a recently used vertex or failing that the next one in order
+			while (deadEnd.empty() == false && next < 0) {
+				unsigned int v = deadEnd.back();
+				deadEnd.pop_back();
+				if (liveCount[v] > 0)
+					next = (int)v;
+			}
+			while (next < 0 && cursor < vertexCount) {
+				if (liveCount[cursor] > 0)
+					next = (int)cursor;
+				else
+					cursor++;
+			}
+
+			if (next >= 0 && clusters != nullptr)
+				clusters->push_back((unsigned int)output.size() / 3);
+		}
+
+		fanning = next;
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+static glm::vec3 getPosition(const unsigned char* vertices, unsigned int vertexSize, unsigned int vertex) {
+	glm::vec3 position;
+	memcpy(&position, vertices + (size_t)vertex * vertexSize, sizeof(glm::vec3));
+	return position;
+}
+
+void MeshOptimiser::optimiseOverdraw(unsigned int* indices, unsigned int indexCount,
+									 const void* vertices, unsigned int vertexCount, unsigned int vertexSize,
+									 const std::vector<unsigned int>& clusters, float threshold /* = 1.05f */,
+									 unsigned int cacheSize /* = CACHE_SIZE */) {
+	unsigned int triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	// break the clusters up wherever the cache has warmed up enough that
+	// starting cold again costs little
+	float meshACMR = analyse(indices, indexCount, vertexCount, cacheSize).getACMR();
+
+	std::vector<unsigned int> boundaries;
+	CacheSimulator cache(vertexCount, cacheSize);
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+		unsigned int start = clusters[c];
+		unsigned int misses = 0;
+
+		boundaries.push_back(start);
+		cache.clear();
+		for (unsigned int t = start; t < end; ++t) {
+			for (unsigned int k = 0; k < 3; ++k)
+				misses += cache.use(indices[t * 3 + k]) ? 1 : 0;
+
+			if (t + 1 < end && misses <= threshold * meshACMR * (t + 1 - start)) {
+				boundaries.push_back(t + 1);
+				cache.clear();
+				start = t + 1;
+				misses = 0;
+			}
+		}
+	}
+
+	// each cluster's area weighted centre and facing
+	const unsigned char* data = (const unsigned char*)vertices;
+	size_t clusterCount = boundaries.size();
+	std::vector<glm::vec3> centres(clusterCount, glm::vec3(0));
+	std::vector<glm::vec3> normals(clusterCount, glm::vec3(0));
+	glm::vec3 meshCentre(0);
+	float meshArea = 0;
+
+	for (size_t c = 0; c < clusterCount; ++c) {
+		unsigned int end = c + 1 < clusterCount ? boundaries[c + 1] : triangleCount;
+		float clusterArea = 0;
+		for (unsigned int t = boundaries[c]; t < end; ++t) {
+			glm::vec3 p0 = getPosition(data, vertexSize, indices[t * 3 + 0]);
+			glm::vec3 p1 = getPosition(data, vertexSize, indices[t * 3 + 1]);
+			glm::vec3 p2 = getPosition(data, vertexSize, indices[t * 3 + 2]);
+
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float area = glm::length(normal);
+			centres[c] += (p0 + p1 + p2) * (area / 3);
+			normals[c] += normal;
+			clusterArea += area;
+		}
+
+		meshCentre += centres[c];
+		meshArea += clusterArea;
+		if (clusterArea > 0)
+			centres[c] /= clusterArea;
+	}
+	if (meshArea > 0)
+		meshCentre /= meshArea;
+
+	std::vector<float> sortKeys(clusterCount);
+	for (size_t c = 0; c < clusterCount; ++c) {
+		float length = glm::length(normals[c]);
+		sortKeys[c] = length > 0 ? glm::dot(centres[c] - meshCentre, normals[c] / length) : 0;
+	}
+
+	std::vector<unsigned int> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; ++c)
+		order[c] = (unsigned int)c;
+	std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+		return sortKeys[a] > sortKeys[b];
+	});
+
+	std::vector<unsigned int> output;
+	output.reserve(triangleCount * 3);
+	for (unsigned int c : order) {
+		unsigned int end = c + 1 < clusterCount ? boundaries[c + 1] : triangleCount;
+		output.insert(output.end(), indices + boundaries[c] * 3, indices + end * 3);
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+unsigned int MeshOptimiser::optimiseVertexFetch(void* vertices, unsigned int vertexCount, unsigned int vertexSize,
+												unsigned int* indices, unsigned int indexCount) {
+	std::vector<unsigned int> remap(vertexCount, ~0u);
+	unsigned int usedCount = 0;
+	for (unsigned int i = 0; i < indexCount; ++i) {
+		unsigned int& v = remap[indices[i]];
+		if (v == ~0u)
+			v = usedCount++;
+		indices[i] = v;
+	}
+
+	unsigned char* data = (unsigned char*)vertices;
+	std::vector<unsigned char> source(data, data + (size_t)vertexCount * vertexSize);
+	for (unsigned int v = 0; v < vertexCount; ++v) {
+		if (remap[v] != ~0u)
+			memcpy(data + (size_t)remap[v] * vertexSize, source.data() + (size_t)v * vertexSize, vertexSize);
+	}
+
+	return usedCount;
+}
+
+std::vector<unsigned short> MeshOptimiser::packShortIndices(const unsigned int* indices, unsigned int indexCount) {
+	std::vector<unsigned short> packed(indexCount);
+	for (unsigned int i = 0; i < indexCount; ++i)
+		packed[i] = (unsigned short)indices[i];
+	return packed;
+}
+
+} // namespace aie
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+namespace aie {
+
+// load time reordering of indexed triangle lists so they render faster:
+// fewer vertices transformed through the post-transform cache, less pixel
+// overdraw, and vertex memory read in order
+class MeshOptimiser {
+public:
+
+	enum { CACHE_SIZE = 16 };
+
+	// post-transform cache use of an index buffer, found by simulating a fifo cache
+	struct Stats {
+		unsigned int triangleCount = 0;
+		unsigned int vertexCount = 0;		// vertices the indices use
+		unsigned int transformCount = 0;	// cache misses
+
+		// vertices transformed per triangle, 3 at worst and around 0.5 at best
+		float getACMR() const { return triangleCount > 0 ? (float)transformCount / triangleCount : 0; }
+		// vertices transformed per vertex, 1 at best
+		float getATVR() const { return vertexCount > 0 ? (float)transformCount / vertexCount : 0; }
+
+		Stats& operator+=(const Stats& other);
+	};
+
+	static Stats analyse(const unsigned int* indices, unsigned int indexCount, unsigned int vertexCount,
+						 unsigned int cacheSize = CACHE_SIZE);
+
+	// merges vertices whose bytes are identical, compacting the vertices and
+	// remapping the indices. Returns the new vertex count
+	static unsigned int deduplicateVertices(void* vertices, unsigned int vertexCount, unsigned int vertexSize,
+											unsigned int* indices, unsigned int indexCount);
+
+	// reorders triangles for the post-transform cache using Tipsify
+	// (Sander, Nehab and Barczak 2007). clusters, if given, receives the first
+	// triangle of each run that starts with a cold cache
+	static void optimiseVertexCache(unsigned int* indices, unsigned int indexCount, unsigned int vertexCount,
+									std::vector<unsigned int>* clusters = nullptr,
+									unsigned int cacheSize = CACHE_SIZE);
+
+	// splits the clusters further where the cache has warmed up to within
+	// threshold of the whole mesh's ACMR, then draws the clusters that face
+	// away from the mesh's centre first, as they are the ones most likely to
+	// hide the rest. The first three floats of a vertex must be its position
+	static void optimiseOverdraw(unsigned int* indices, unsigned int indexCount,
+								 const void* vertices, unsigned int vertexCount, unsigned int vertexSize,
+								 const std::vector<unsigned int>& clusters, float threshold = 1.05f,
+								 unsigned int cacheSize = CACHE_SIZE);
+
+	// reorders vertices to the order the indices first use them, dropping
+	// unused ones. Returns the new vertex count
+	static unsigned int optimiseVertexFetch(void* vertices, unsigned int vertexCount, unsigned int vertexSize,
+											unsigned int* indices, unsigned int indexCount);
+
+	// runs the cache, overdraw and fetch passes in that order
+	template <typename Vertex>
+	static void optimise(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+		if (indices.empty())
+			return;
+
+		std::vector<unsigned int> clusters;
+		optimiseVertexCache(indices.data(), (unsigned int)indices.size(), (unsigned int)vertices.size(), &clusters);
+		optimiseOverdraw(indices.data(), (unsigned int)indices.size(),
+						 vertices.data(), (unsigned int)vertices.size(), sizeof(Vertex), clusters);
+		vertices.resize(optimiseVertexFetch(vertices.data(), (unsigned int)vertices.size(), sizeof(Vertex),
+											indices.data(), (unsigned int)indices.size()));
+	}
+
+	// 16 bit indices halve the index buffer when they can address every vertex
+	static bool canUseShortIndices(unsigned int vertexCount) { return vertexCount < 65536; }
+	static std::vector<unsigned short> packShortIndices(const unsigned int* indices, unsigned int indexCount);
+};
+
+} // namespace aie
@@ -0,0 +1,382 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+
+namespace aie {
+
+// the summed, weighted, squared distances to a set of planes, kept as a
+// symmetric matrix, a vector and a constant
+struct Quadric {
+	float a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+	float b0 = 0, b1 = 0, b2 = 0;
+	float c = 0;
+	float weight = 0;
+
+	// the plane through point with the given unit normal
+	void addPlane(const glm::vec3& normal, const glm::vec3& point, float w) {
+		float d = -glm::dot(normal, point);
+		a00 += w * normal.x * normal.x;
+		a11 += w * normal.y * normal.y;
+		a22 += w * normal.z * normal.z;
+		a01 += w * normal.x * normal.y;
+		a02 += w * normal.x * normal.z;
+		a12 += w * normal.y * normal.z;
+		b0 += w * normal.x * d;
+		b1 += w * normal.y * d;
+		b2 += w * normal.z * d;
+		c += w * d * d;
+		weight += w;
+	}
+
+	Quadric& operator+=(const Quadric& other) {
+		a00 += other.a00; a11 += other.a11; a22 += other.a22;
+		a01 += other.a01; a02 += other.a02; a12 += other.a12;
+		b0 += other.b0; b1 += other.b1; b2 += other.b2;
+		c += other.c;
+		weight += other.weight;
+		return *this;
+	}
+
+	float evaluate(const glm::vec3& p) const {
+		float x = a00 * p.x + a01 * p.y + a02 * p.z + b0;
+		float y = a01 * p.x + a11 * p.y + a12 * p.z + b1;
+		float z = a02 * p.x + a12 * p.y + a22 * p.z + b2;
+		return glm::abs(p.x * x + p.y * y + p.z * z + b0 * p.x + b1 * p.y + b2 * p.z + c);
+	}
+};
+
+enum eVertexKind : unsigned char {
+	VERTEX_MANIFOLD = 0,	// collapses on to any neighbour
+	VERTEX_BORDER,			// collapses along its border only
+	VERTEX_SEAM,			// two vertices share the position, both collapse along the seam
+	VERTEX_LOCKED,			// never moves
+};
+
+// border and seam planes are weighted well above the surface's so they keep their shape
+static const float BORDER_WEIGHT = 10.0f;
+
+// hashes and compares vertices by their positions alone
+struct VertexPosition {
+	const glm::vec3* positions;
+
+	size_t operator()(unsigned int vertex) const {
+		unsigned int bits[3];
+		memcpy(bits, &positions[vertex], sizeof(bits));
+		return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+	}
+
+	bool operator()(unsigned int a, unsigned int b) const {
+		return memcmp(&positions[a], &positions[b], sizeof(glm::vec3)) == 0;
+	}
+};
+
+struct Collapse {
+	unsigned int	from, to;	// vertices
+	float			cost;
+};
+
+// the triangles using each position, rebuilt for every pass
+struct PositionAdjacency {
+	std::vector<unsigned int> first;
+	std::vector<unsigned int> triangles;
+
+	void build(const std::vector<unsigned int>& corners, unsigned int positionCount) {
+		first.assign(positionCount + 1, 0);
+		for (unsigned int p : corners)
+			first[p + 1]++;
+		for (unsigned int p = 0; p < positionCount; ++p)
+			first[p + 1] += first[p];
+
+		triangles.resize(corners.size());
+		std::vector<unsigned int> fill(first.begin(), first.end() - 1);
+		for (size_t i = 0; i < corners.size(); ++i)
+			triangles[fill[corners[i]]++] = (unsigned int)(i / 3);
+	}
+
+	// counts the triangles other than exclude with the directed edge a to b.
+	// corner, if given, receives the last one found's corner at a
+	unsigned int countEdge(const std::vector<unsigned int>& corners, unsigned int a, unsigned int b,
+						   unsigned int exclude, unsigned int* corner = nullptr) const {
+		unsigned int count = 0;
+		for (unsigned int i = first[a]; i < first[a + 1]; ++i) {
+			unsigned int t = triangles[i];
+			if (t == exclude)
+				continue;
+			for (unsigned int k = 0; k < 3; ++k) {
+				if (corners[t * 3 + k] == a && corners[t * 3 + (k + 1) % 3] == b) {
+					count++;
+					if (corner != nullptr)
+						*corner = t * 3 + k;
+				}
+			}
+		}
+		return count;
+	}
+};
+
+unsigned int MeshSimplifier::simplify(unsigned int* destination, const unsigned int* indices, unsigned int indexCount,
+									  const void* vertices, unsigned int vertexCount, unsigned int vertexSize,
+									  unsigned int targetIndexCount, float maxError, float* error /* = nullptr */) {
+	indexCount -= indexCount % 3;
+	std::vector<unsigned int> result(indices, indices + indexCount);
+	if (error != nullptr)
+		*error = 0;
+
+	// work in a unit cube so the quadrics keep their precision on any scale of mesh
+	const unsigned char* data = (const unsigned char*)vertices;
+	std::vector<glm::vec3> positions(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; ++v)
+		memcpy(&positions[v], data + (size_t)v * vertexSize, sizeof(glm::vec3));
+
+	glm::vec3 minimum(0), maximum(0);
+	if (vertexCount > 0)
+		minimum = maximum = positions[0];
+	for (const glm::vec3& p : positions) {
+		minimum = glm::min(minimum, p);
+		maximum = glm::max(maximum, p);
+	}
+	glm::vec3 size = maximum - minimum;
+	float extent = glm::max(size.x, glm::max(size.y, size.z));
+	if (extent <= 0)
+		extent = 1;
+	for (glm::vec3& p : positions)
+		p = (p - minimum) / extent;
+
+	// vertices that only differ by their attributes share a position, and a quadric
+	VertexPosition hasher = { positions.data() };
+	std::unordered_set<unsigned int, VertexPosition, VertexPosition> unique(vertexCount, hasher, hasher);
+	std::vector<unsigned int> positionOf(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; ++v)
+		positionOf[v] = *unique.insert(v).first;
+
+	std::vector<unsigned int> corners(indexCount);
+	PositionAdjacency adjacency;
+	std::vector<Quadric> quadrics(vertexCount);
+	std::vector<eVertexKind> kinds(vertexCount);
+	std::vector<unsigned int> copies(vertexCount * 2);
+	std::vector<unsigned char> borderEdge(indexCount);
+	std::vector<unsigned char> seamEdge(indexCount);
+	std::vector<unsigned int> remap(vertexCount);
+	std::vector<unsigned char> touched(vertexCount);
+	std::vector<Collapse> collapses;
+
+	float maxCost = (maxError / extent) * (maxError / extent);
+	float worstCost = 0;
+
+	for (bool firstPass = true; result.size() > targetIndexCount; firstPass = false) {
+		unsigned int triangleCount = (unsigned int)result.size() / 3;
+		for (size_t i = 0; i < result.size(); ++i)
+			corners[i] = positionOf[result[i]];
+		adjacency.build(corners, vertexCount);
+
+		// a position with two vertices in use is a seam, more than that is where seams meet
+		std::fill(kinds.begin(), kinds.end(), VERTEX_MANIFOLD);
+		std::fill(copies.begin(), copies.end(), ~0u);
+		for (unsigned int v : result) {
+			unsigned int p = positionOf[v];
+			if (copies[p * 2] == ~0u || copies[p * 2] == v)
+				copies[p * 2] = v;
+			else if (copies[p * 2 + 1] == ~0u || copies[p * 2 + 1] == v) {
+				copies[p * 2 + 1] = v;
+				if (kinds[p] == VERTEX_MANIFOLD)
+					kinds[p] = VERTEX_SEAM;
+			}
+			else
+				kinds[p] = VERTEX_LOCKED;
+		}
+
+		// an edge with no twin is a border, one whose twin has other vertices is
+		// a seam, and one used more than twice is locked in place
+		for (unsigned int t = 0; t < triangleCount; ++t) {
+			for (unsigned int k = 0; k < 3; ++k) {
+				unsigned int a = corners[t * 3 + k];
+				unsigned int b = corners[t * 3 + (k + 1) % 3];
+				borderEdge[t * 3 + k] = 0;
+				seamEdge[t * 3 + k] = 0;
+
+				if (adjacency.countEdge(corners, a, b, t) > 0) {
+					kinds[a] = kinds[b] = VERTEX_LOCKED;
+					continue;
+				}
+
+				// where a seam ends inside the surface its last vertex isn't split, and can't move
+				unsigned int twin = 0;
+				if (adjacency.countEdge(corners, b, a, ~0u, &twin) > 0) {
+					unsigned int twinNext = twin - twin % 3 + (twin + 1) % 3;
+					seamEdge[t * 3 + k] = result[twin] != result[t * 3 + (k + 1) % 3] ||
+						result[twinNext] != result[t * 3 + k];
+					if (seamEdge[t * 3 + k]) {
+						for (unsigned int p : { a, b }) {
+							if (kinds[p] != VERTEX_SEAM)
+								kinds[p] = VERTEX_LOCKED;
+						}
+					}
+					continue;
+				}
+
+				// a seam that reaches a border can't slide along both
+				borderEdge[t * 3 + k] = 1;
+				for (unsigned int p : { a, b }) {
+					if (kinds[p] == VERTEX_MANIFOLD)
+						kinds[p] = VERTEX_BORDER;
+					else if (kinds[p] == VERTEX_SEAM)
+						kinds[p] = VERTEX_LOCKED;
+				}
+			}
+		}
+
+		if (firstPass) {
+			for (unsigned int t = 0; t < triangleCount; ++t) {
+				const glm::vec3& p0 = positions[corners[t * 3 + 0]];
+				const glm::vec3& p1 = positions[corners[t * 3 + 1]];
+				const glm::vec3& p2 = positions[corners[t * 3 + 2]];
+				glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+				float area = glm::length(normal);
+				if (area <= 0)
+					continue;
+				normal /= area;
+
+				for (unsigned int k = 0; k < 3; ++k)
+					quadrics[corners[t * 3 + k]].addPlane(normal, p0, area * 0.5f);
+
+				// a plane standing on each border and seam edge holds them in place
+				for (unsigned int k = 0; k < 3; ++k) {
+					if (borderEdge[t * 3 + k] == 0 && seamEdge[t * 3 + k] == 0)
+						continue;
+					unsigned int a = corners[t * 3 + k];
+					unsigned int b = corners[t * 3 + (k + 1) % 3];
+					glm::vec3 edge = positions[b] - positions[a];
+					float length = glm::length(edge);
+					if (length <= 0)
+						continue;
+					glm::vec3 side = glm::normalize(glm::cross(edge, normal));
+					quadrics[a].addPlane(side, positions[a], length * length * BORDER_WEIGHT);
+					quadrics[b].addPlane(side, positions[a], length * length * BORDER_WEIGHT);
+				}
+			}
+		}
+
+		// every allowed collapse along every edge, cheapest first
+		collapses.clear();
+		for (unsigned int t = 0; t < triangleCount; ++t) {
+			for (unsigned int k = 0; k < 3; ++k) {
+				unsigned int v0 = result[t * 3 + k];
+				unsigned int v1 = result[t * 3 + (k + 1) % 3];
+				bool border = borderEdge[t * 3 + k] != 0;
+				bool seam = seamEdge[t * 3 + k] != 0;
+
+				for (int direction = 0; direction < 2; ++direction) {
+					unsigned int from = direction == 0 ? v0 : v1;
+					unsigned int to = direction == 0 ? v1 : v0;
+					eVertexKind kind = kinds[positionOf[from]];
+					if (kind == VERTEX_LOCKED ||
+						(kind == VERTEX_BORDER && border == false) ||
+						(kind == VERTEX_SEAM && seam == false))
+						continue;
+
+					const Quadric& q0 = quadrics[positionOf[from]];
+					const Quadric& q1 = quadrics[positionOf[to]];
+					const glm::vec3& target = positions[to];
+					float weight = q0.weight + q1.weight;
+					Collapse collapse = { from, to, weight > 0 ? (q0.evaluate(target) + q1.evaluate(target)) / weight : 0 };
+					collapses.push_back(collapse);
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+			return a.cost < b.cost;
+		});
+
+		// take the cheapest collapses that don't touch each other or fold a triangle over
+		unsigned int goal = (unsigned int)(result.size() - targetIndexCount) / 3;
+		unsigned int removed = 0;
+		unsigned int applied = 0;
+		for (unsigned int v = 0; v < vertexCount; ++v)
+			remap[v] = v;
+		std::fill(touched.begin(), touched.end(), 0);
+
+		for (const Collapse& collapse : collapses) {
+			if (collapse.cost > maxCost || removed >= goal)
+				break;
+
+			unsigned int from = positionOf[collapse.from];
+			unsigned int to = positionOf[collapse.to];
+			if (touched[from] || touched[to])
+				continue;
+
+			bool folds = false;
+			for (unsigned int i = adjacency.first[from]; i < adjacency.first[from + 1] && folds == false; ++i) {
+				unsigned int t = adjacency.triangles[i];
+				unsigned int k = corners[t * 3 + 0] == from ? 0 : corners[t * 3 + 1] == from ? 1 : 2;
+				unsigned int b = corners[t * 3 + (k + 1) % 3];
+				unsigned int c = corners[t * 3 + (k + 2) % 3];
+				if (b == to || c == to)
+					continue;
+
+				const glm::vec3& pb = positions[positionOf[remap[result[t * 3 + (k + 1) % 3]]]];
+				const glm::vec3& pc = positions[positionOf[remap[result[t * 3 + (k + 2) % 3]]]];
+				glm::vec3 before = glm::cross(pb - positions[from], pc - positions[from]);
+				glm::vec3 after = glm::cross(pb - positions[to], pc - positions[to]);
+				folds = glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after);
+			}
+			if (folds)
+				continue;
+
+			// both sides of a seam move, each on to the vertex its side has at the target
+			if (kinds[from] == VERTEX_SEAM) {
+				unsigned int targets[2] = { ~0u, ~0u };
+				for (unsigned int i = adjacency.first[from]; i < adjacency.first[from + 1]; ++i) {
+					unsigned int t = adjacency.triangles[i];
+					unsigned int k = corners[t * 3 + 0] == from ? 0 : corners[t * 3 + 1] == from ? 1 : 2;
+					unsigned int side = result[t * 3 + k] == copies[from * 2] ? 0 : 1;
+					for (unsigned int j = 0; j < 3; ++j) {
+						if (corners[t * 3 + j] == to)
+							targets[side] = result[t * 3 + j];
+					}
+				}
+				if (targets[0] == ~0u || targets[1] == ~0u)
+					continue;
+				remap[copies[from * 2]] = targets[0];
+				remap[copies[from * 2 + 1]] = targets[1];
+			}
+			else
+				remap[collapse.from] = collapse.to;
+
+			touched[from] = touched[to] = 1;
+			quadrics[to] += quadrics[from];
+			worstCost = glm::max(worstCost, collapse.cost);
+			removed += kinds[from] == VERTEX_BORDER ? 1 : 2;
+			applied++;
+		}
+
+		if (applied == 0)
+			break;
+
+		// drop the triangles that collapsed to nothing
+		size_t kept = 0;
+		for (size_t i = 0; i < result.size(); i += 3) {
+			unsigned int a = remap[result[i + 0]];
+			unsigned int b = remap[result[i + 1]];
+			unsigned int c = remap[result[i + 2]];
+			if (positionOf[a] == positionOf[b] || positionOf[b] == positionOf[c] || positionOf[c] == positionOf[a])
+				continue;
+			result[kept++] = a;
+			result[kept++] = b;
+			result[kept++] = c;
+		}
+		result.resize(kept);
+	}
+
+	if (error != nullptr)
+		*error = glm::sqrt(worstCost) * extent;
+
+	std::copy(result.begin(), result.end(), destination);
+	return (unsigned int)result.size();
+}
+
+} // namespace aie
@@ -0,0 +1,24 @@
+#pragma once
+
+namespace aie {
+
+// reduces the triangle count of an indexed mesh for levels of detail. Edges
+// are collapsed cheapest first by the quadric error metric (Garland and
+// Heckbert 1997), and a vertex only ever moves on to one of its neighbours,
+// so the simplified indices still index the original vertices
+class MeshSimplifier {
+public:
+
+	// writes at most indexCount indices to destination, stopping once there
+	// are targetIndexCount or fewer, or when every collapse left would move
+	// the surface further than maxError. error, if given, receives how far
+	// the surface moved. The first three floats of a vertex must be its
+	// position. Borders, and seams where a position is split in two by
+	// differing attributes (uvs, hard normals), can only slide along
+	// themselves. Returns the new index count
+	static unsigned int simplify(unsigned int* destination, const unsigned int* indices, unsigned int indexCount,
+								 const void* vertices, unsigned int vertexCount, unsigned int vertexSize,
+								 unsigned int targetIndexCount, float maxError, float* error = nullptr);
+};
+
+} // namespace aie
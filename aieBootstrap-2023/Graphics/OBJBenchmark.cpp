@@ -0,0 +1,132 @@
+#include "OBJBenchmark.h"
+#include "OBJParser.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// loads of each model per parser, after one untimed load that brings the
+// file in to the OS's cache
+#define TIMED_LOADS 5
+
+static const char* MODELS[] = {
+	"./soulspear/soulspear.obj",
+	"./kamadagger/kamadagger.obj",
+	"./stanford/Bunny.obj",
+	"./stanford/Dragon.obj",
+	"./stanford/Buddha.obj",
+	"./stanford/Lucy.obj",
+};
+
+struct LoadTimes
+{
+	double best = 0;
+	bool success = false;
+};
+
+typedef bool (*LoadFunction)(std::vector<tinyobj::shape_t>& shapes,
+	std::vector<tinyobj::material_t>& materials, std::string& error,
+	const char* filename, const char* folder);
+
+static bool LoadTinyObj(std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& materials,
+	std::string& error, const char* filename, const char* folder)
+{
+	return tinyobj::LoadObj(shapes, materials, error, filename, folder);
+}
+
+static bool LoadSingleThreaded(std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& materials,
+	std::string& error, const char* filename, const char* folder)
+{
+	return aie::OBJParser::load(shapes, materials, error, filename, folder, 1);
+}
+
+static bool LoadMultiThreaded(std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& materials,
+	std::string& error, const char* filename, const char* folder)
+{
+	return aie::OBJParser::load(shapes, materials, error, filename, folder, 0);
+}
+
+static LoadTimes TimeLoads(LoadFunction load, const char* filename, const char* folder,
+	std::vector<tinyobj::shape_t>& shapes)
+{
+	LoadTimes times;
+	std::vector<tinyobj::material_t> materials;
+	std::string error;
+
+	for (int i = -1; i < TIMED_LOADS; i++)
+	{
+		shapes.clear();
+		materials.clear();
+		error.clear();
+
+		auto start = std::chrono::high_resolution_clock::now();
+		bool success = load(shapes, materials, error, filename, folder);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		if (success == false)
+		{
+			printf("  failed: %s\n", error.c_str());
+			return times;
+		}
+		if (i < 0)
+			continue;
+
+		double ms = std::chrono::duration<double, std::milli>(end - start).count();
+		times.best = i == 0 || ms < times.best ? ms : times.best;
+	}
+
+	times.success = true;
+	return times;
+}
+
+// the shapes should match exactly, apart from the order vertices were
+// deduplicated in, so compare their sizes rather than their contents
+static bool SameShapes(const std::vector<tinyobj::shape_t>& a, const std::vector<tinyobj::shape_t>& b)
+{
+	if (a.size() != b.size())
+		return false;
+
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		if (a[i].name != b[i].name ||
+			a[i].mesh.indices.size() != b[i].mesh.indices.size() ||
+			a[i].mesh.positions.size() != b[i].mesh.positions.size() ||
+			a[i].mesh.material_ids != b[i].mesh.material_ids)
+			return false;
+	}
+	return true;
+}
+
+void RunOBJBenchmark()
+{
+	printf("OBJ loading, best of %d loads\n", TIMED_LOADS);
+	printf("%-30s %14s %14s %14s %10s\n", "model", "tinyobj (ms)", "1 thread (ms)", "threaded (ms)", "speedup");
+
+	for (const char* filename : MODELS)
+	{
+		FILE* file = fopen(filename, "rb");
+		if (file == nullptr)
+		{
+			printf("%-30s not found, skipped\n", filename);
+			continue;
+		}
+		fclose(file);
+
+		std::string path = filename;
+		std::string folder = path.substr(0, path.find_last_of('/') + 1);
+
+		std::vector<tinyobj::shape_t> tinyShapes, parserShapes, threadedShapes;
+		LoadTimes tiny = TimeLoads(LoadTinyObj, filename, folder.c_str(), tinyShapes);
+		LoadTimes single = TimeLoads(LoadSingleThreaded, filename, folder.c_str(), parserShapes);
+		LoadTimes threaded = TimeLoads(LoadMultiThreaded, filename, folder.c_str(), threadedShapes);
+		if (!tiny.success || !single.success || !threaded.success)
+			continue;
+
+		printf("%-30s %14.2f %14.2f %14.2f %9.1fx\n", filename, tiny.best, single.best, threaded.best,
+			tiny.best / threaded.best);
+
+		if (!SameShapes(tinyShapes, parserShapes) || !SameShapes(tinyShapes, threadedShapes))
+			printf("  OBJParser's shapes differ from tinyobj's!\n");
+	}
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Times tinyobj::LoadObj against aie::OBJParser::load on the obj models in
+// the working directory, skipping any that aren't there, and checks both give
+// the same shapes. Run with the -objbenchmark argument instead of the app.
+void RunOBJBenchmark();
@@ -1,13 +1,53 @@
 #include "OBJMesh.h"
+#include "MappedFile.h"
+#include "MeshSimplifier.h"
+#include "OBJParser.h"
+#include "Shader.h"
+#include "TextureCache.h"
 #include "gl_core_4_4.h"
+#include <cassert>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include <glm/common.hpp>
+#include <glm/exponential.hpp>
 #include <glm/geometric.hpp>
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
-
 namespace aie {
 
+struct OBJMesh::PendingUpload {
+	MappedFile				cache;	// the chunks point in to it when read from the cache
+	std::vector<ChunkData>	chunks;	// or in to these when parsed
+
+	struct ChunkSource {
+		const void*		vertices;
+		unsigned int	vertexCount;
+		const void*		indices;
+	};
+	std::vector<ChunkSource>	sources;	// one per mesh chunk
+	std::vector<Texture*>		textures;
+	size_t						nextTexture = 0;
+	size_t						nextChunk = 0;
+};
+
+OBJMesh::OBJMesh() {
+}
+
 OBJMesh::~OBJMesh() {
+	// a later mesh's material may reuse the address
+	forgetBoundMaterials();
+
+	for (auto& m : m_materials) {
+		TextureCache::release(m.diffuseTexture);
+		TextureCache::release(m.alphaTexture);
+		TextureCache::release(m.ambientTexture);
+		TextureCache::release(m.specularTexture);
+		TextureCache::release(m.specularHighlightTexture);
+		TextureCache::release(m.normalTexture);
+		TextureCache::release(m.displacementTexture);
+	}
+
 	for (auto& c : m_meshChunks) {
 		glDeleteVertexArrays(1, &c.vao);
 		glDeleteBuffers(1, &c.vbo);
@@ -15,25 +55,50 @@ OBJMesh::~OBJMesh() {
 	}
 }
 
-bool OBJMesh::load(const char* filename, bool loadTextures /* = true */, bool flipTextureV /* = false */) {
+bool OBJMesh::load(const char* filename, bool loadTextures /* = true */, bool flipTextureV /* = false */,
+				   eVertexFormat vertexFormat /* = VERTEX_FORMAT_FULL */, bool generateLods /* = true */) {
 
-	if (m_meshChunks.empty() == false) {
+	if (prepare(filename, loadTextures, flipTextureV, vertexFormat, generateLods) == false)
+		return false;
+
+	while (uploadNext() == false) {}
+	return true;
+}
+
+bool OBJMesh::prepare(const char* filename, bool loadTextures /* = true */, bool flipTextureV /* = false */,
+					  eVertexFormat vertexFormat /* = VERTEX_FORMAT_FULL */, bool generateLods /* = true */) {
+
+	if (m_meshChunks.empty() == false || m_pending != nullptr) {
 		printf("Mesh already initialised, can't re-initialise!\n");
 		return false;
 	}
+	m_pending.reset(new PendingUpload());
+
+	std::string file = filename;
+	std::string folder = file.substr(0, file.find_last_of('/') + 1);
+	std::string cacheFile = file + ".meshcache";
+	m_vertexFormat = vertexFormat;
+
+	// a cache built from this exact obj skips parsing entirely
+	SourceStamp stamp;
+	bool hasStamp = getSourceStamp(filename, flipTextureV, vertexFormat, generateLods, stamp);
+	if (hasStamp && readCache(cacheFile.c_str(), folder, stamp)) {
+		calculateMeshLods();
+		m_filename = filename;
+		return true;
+	}
+	m_pending->cache.close();
 
 	std::vector<tinyobj::shape_t> shapes;
 	std::vector<tinyobj::material_t> materials;
 	std::string error = "";
 
-	std::string file = filename;
-	std::string folder = file.substr(0, file.find_last_of('/') + 1);
-
-	bool success = tinyobj::LoadObj(shapes, materials, error,
-									filename, folder.c_str());
+	bool success = OBJParser::load(shapes, materials, error,
+								   filename, folder.c_str());
 
 	if (success == false) {
 		printf("%s\n", error.c_str());
+		m_pending.reset();
 		return false;
 	}
 
@@ -41,6 +106,8 @@ bool OBJMesh::load(const char* filename, bool loadTextures /* = true */, bool fl
 
 	// copy materials
 	m_materials.resize(materials.size());
+	std::vector<std::string> textureNames;
+	textureNames.reserve(materials.size() * TEXTURE_SLOT_COUNT);
 	int index = 0;
 	for (auto& m : materials) {
 
@@ -51,43 +118,30 @@ bool OBJMesh::load(const char* filename, bool loadTextures /* = true */, bool fl
 		m_materials[index].specularPower = m.shininess;
 		m_materials[index].opacity = m.dissolve;
 
-		// textures
-		m_materials[index].alphaTexture.load((folder + m.alpha_texname).c_str());
-		m_materials[index].ambientTexture.load((folder + m.ambient_texname).c_str());
-		m_materials[index].diffuseTexture.load((folder + m.diffuse_texname).c_str());
-		m_materials[index].specularTexture.load((folder + m.specular_texname).c_str());
-		m_materials[index].specularHighlightTexture.load((folder + m.specular_highlight_texname).c_str());
-		m_materials[index].normalTexture.load((folder + m.bump_texname).c_str());
-		m_materials[index].displacementTexture.load((folder + m.displacement_texname).c_str());
+		// textures, in slot order
+		textureNames.push_back(m.diffuse_texname);
+		textureNames.push_back(m.alpha_texname);
+		textureNames.push_back(m.ambient_texname);
+		textureNames.push_back(m.specular_texname);
+		textureNames.push_back(m.specular_highlight_texname);
+		textureNames.push_back(m.bump_texname);
+		textureNames.push_back(m.displacement_texname);
+		loadMaterialTextures(m_materials[index], folder, &textureNames[index * TEXTURE_SLOT_COUNT]);
 
 		++index;
 	}
 
 	// copy shapes
+	std::vector<ChunkData>& chunks = m_pending->chunks;
+	chunks.resize(shapes.size());
 	m_meshChunks.reserve(shapes.size());
+	index = 0;
 	for (auto& s : shapes) {
 
-		MeshChunk chunk;
-
-		// generate buffers
-		glGenBuffers(1, &chunk.vbo);
-		glGenBuffers(1, &chunk.ibo);
-		glGenVertexArrays(1, &chunk.vao);
-
-		// bind vertex array aka a mesh wrapper
-		glBindVertexArray(chunk.vao);
-
-		// set the index buffer data
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk.ibo);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-					 s.mesh.indices.size() * sizeof(unsigned int),
-					 s.mesh.indices.data(), GL_STATIC_DRAW);
-
-		// store index count for rendering
-		chunk.indexCount = (unsigned int)s.mesh.indices.size();
+		ChunkData& chunk = chunks[index++];
 
 		// create vertex data
-		std::vector<Vertex> vertices;
+		std::vector<Vertex>& vertices = chunk.vertices;
 		vertices.resize(s.mesh.positions.size() / 3);
 		size_t vertCount = vertices.size();
 
@@ -106,47 +160,596 @@ bool OBJMesh::load(const char* filename, bool loadTextures /* = true */, bool fl
 				vertices[i].texcoord = glm::vec2(s.mesh.texcoords[i * 2 + 0], flipTextureV ? 1.0f - s.mesh.texcoords[i * 2 + 1] : s.mesh.texcoords[i * 2 + 1]);
 		}
 
-		// calculate for normal mapping
-		if (hasNormal && hasTexture)
-			calculateTangents(vertices, s.mesh.indices);
+		chunk.indices.swap(s.mesh.indices);
+		unsigned int indexCount = (unsigned int)chunk.indices.size();
+		m_unoptimisedStats += MeshOptimiser::analyse(chunk.indices.data(), indexCount, (unsigned int)vertices.size());
 
-		// bind vertex buffer
-		glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+		// obj vertices are unique by their indices, not always by their values
+		vertices.resize(MeshOptimiser::deduplicateVertices(vertices.data(), (unsigned int)vertices.size(), sizeof(Vertex),
+														   chunk.indices.data(), indexCount));
 
-		// fill vertex buffer
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+		// calculate for normal mapping
+		if (hasNormal && hasTexture)
+			calculateTangents(vertices, chunk.indices);
 
-		// enable first element as positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
+		MeshOptimiser::optimise(vertices, chunk.indices);
+		m_optimisedStats += MeshOptimiser::analyse(chunk.indices.data(), indexCount, (unsigned int)vertices.size());
 
-		// enable normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 4, GL_FLOAT, GL_TRUE, sizeof(Vertex), (void*)(sizeof(glm::vec4) * 1));
+		chunk.bounds = calculateBounds(vertices);
 
-		// enable texture coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(sizeof(glm::vec4) * 2));
+		// the full chunk is the first level of detail
+		chunk.lods[0].firstIndex = 0;
+		chunk.lods[0].indexCount = indexCount;
+		chunk.lods[0].error = 0;
+		chunk.lodCount = 1;
+		if (generateLods)
+			generateChunkLods(chunk);
+		indexCount = (unsigned int)chunk.indices.size();
 
-		// enable tangents
-		glEnableVertexAttribArray(3);
-		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(sizeof(glm::vec4) * 2 + sizeof(glm::vec2)));
+		if (MeshOptimiser::canUseShortIndices((unsigned int)vertices.size()))
+			chunk.shortIndices = MeshOptimiser::packShortIndices(chunk.indices.data(), indexCount);
 
-		// bind 0 for safety
-		glBindVertexArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		if (m_vertexFormat != VERTEX_FORMAT_FULL)
+			packVertices(chunk);
 
 		// set chunk material
 		chunk.materialID = s.mesh.material_ids.empty() ? -1 : s.mesh.material_ids[0];
 
-		m_meshChunks.push_back(chunk);
+		createChunk(chunk.getVertexData(), (unsigned int)vertices.size(),
+					chunk.getIndexData(), indexCount, chunk.getIndexSize(),
+					chunk.lods, chunk.lodCount, chunk.materialID, chunk.bounds);
 	}
+
+	calculateMeshBounds();
+	calculateMeshLods();
+
+	// a failed write only costs the next load a parse
+	if (hasStamp && writeCache(cacheFile.c_str(), stamp, chunks, textureNames) == false)
+		printf("Failed to write mesh cache %s\n", cacheFile.c_str());
 	
 	// load obj
 	return true;
 }
 
+bool OBJMesh::uploadNext() {
+	if (m_pending == nullptr)
+		return true;
+
+	// textures first, they're needed by any chunk that uses them. One shared
+	// with another mesh may already have been uploaded by it
+	if (m_pending->nextTexture < m_pending->textures.size()) {
+		Texture* texture = m_pending->textures[m_pending->nextTexture++];
+		if (texture->getHandle() == 0)
+			texture->upload();
+	}
+	else if (m_pending->nextChunk < m_meshChunks.size()) {
+		const PendingUpload::ChunkSource& source = m_pending->sources[m_pending->nextChunk];
+		uploadChunk(m_meshChunks[m_pending->nextChunk++], source.vertices, source.vertexCount, source.indices);
+	}
+
+	if (m_pending->nextTexture < m_pending->textures.size() ||
+		m_pending->nextChunk < m_meshChunks.size())
+		return false;
+
+	// the cpu copies, and the mapped cache, aren't needed any more
+	m_pending.reset();
+	return true;
+}
+
+unsigned int OBJMesh::getVertexSize() const {
+	switch (m_vertexFormat) {
+	case VERTEX_FORMAT_PACKED:		return sizeof(PackedVertex);
+	case VERTEX_FORMAT_QUANTISED:	return sizeof(QuantisedVertex);
+	default:						return sizeof(Vertex);
+	}
+}
+
+unsigned int OBJMesh::getTriangleCount(unsigned int lod /* = 0 */) const {
+	unsigned int count = 0;
+	for (auto& c : m_meshChunks)
+		count += c.lods[lod < c.lodCount ? lod : c.lodCount - 1].indexCount / 3;
+	return count;
+}
+
+// levels stop once the simplifier can't take away a quarter of the triangles
+// or a level would be small enough that drawing it costs no more than the last
+static const unsigned int MIN_LOD_TRIANGLES = 64;
+static const float MIN_LOD_REDUCTION = 0.75f;
+// the most a level may move the surface, relative to the chunk's radius
+static const float MAX_LOD_ERROR = 0.1f;
+
+void OBJMesh::generateChunkLods(ChunkData& chunk) {
+	std::vector<unsigned int> simplified;
+	float maxError = chunk.bounds.radius * MAX_LOD_ERROR;
+
+	while (chunk.lodCount < MAX_LODS) {
+		const Lod& previous = chunk.lods[chunk.lodCount - 1];
+		if (previous.indexCount / 3 < MIN_LOD_TRIANGLES * 2)
+			break;
+
+		// each level simplifies the one before, so their errors add up
+		simplified.resize(previous.indexCount);
+		float error = 0;
+		unsigned int indexCount = MeshSimplifier::simplify(simplified.data(), chunk.indices.data() + previous.firstIndex,
+														   previous.indexCount, chunk.vertices.data(),
+														   (unsigned int)chunk.vertices.size(), sizeof(Vertex),
+														   previous.indexCount / 2, maxError, &error);
+		if (indexCount == 0 || indexCount > previous.indexCount * MIN_LOD_REDUCTION)
+			break;
+
+		MeshOptimiser::optimiseVertexCache(simplified.data(), indexCount, (unsigned int)chunk.vertices.size());
+
+		Lod& lod = chunk.lods[chunk.lodCount++];
+		lod.firstIndex = (unsigned int)chunk.indices.size();
+		lod.indexCount = indexCount;
+		lod.error = previous.error + error;
+		chunk.indices.insert(chunk.indices.end(), simplified.begin(), simplified.begin() + indexCount);
+	}
+}
+
+// quantised positions cover the chunk's box, a flat axis decodes to its one value
+static glm::vec3 getPositionScale(const OBJMesh::Bounds& bounds) {
+	return bounds.max - bounds.min;
+}
+
+void OBJMesh::packVertices(ChunkData& chunk) const {
+	size_t vertexCount = chunk.vertices.size();
+	chunk.packedVertices.resize(vertexCount * getVertexSize());
+
+	glm::vec3 scale = getPositionScale(chunk.bounds);
+	for (size_t i = 0; i < vertexCount; ++i) {
+		const Vertex& v = chunk.vertices[i];
+		unsigned int normal = packDirection(glm::vec3(v.normal), 1);
+		unsigned int texcoord = packTexCoord(v.texcoord);
+		unsigned int tangent = packDirection(glm::vec3(v.tangent), v.tangent.w < 0 ? -1.0f : 1.0f);
+
+		if (m_vertexFormat == VERTEX_FORMAT_PACKED) {
+			PackedVertex& packed = ((PackedVertex*)chunk.packedVertices.data())[i];
+			packed.position[0] = v.position.x;
+			packed.position[1] = v.position.y;
+			packed.position[2] = v.position.z;
+			packed.normal = normal;
+			packed.texcoord = texcoord;
+			packed.tangent = tangent;
+		}
+		else {
+			QuantisedVertex& packed = ((QuantisedVertex*)chunk.packedVertices.data())[i];
+			quantisePosition(glm::vec3(v.position), chunk.bounds.min, scale, packed.position);
+			packed.position[3] = 0;
+			packed.normal = normal;
+			packed.texcoord = texcoord;
+			packed.tangent = tangent;
+		}
+	}
+}
+
+// every slot gets a mip chain, block compression, cached on disk, and no
+// cpu copy once it's uploaded. Normal maps use BC7, BC1 would band their directions
+static unsigned int getTextureLoadFlags(int slot) {
+	unsigned int flags = Texture::LOAD_MIPMAPS | Texture::LOAD_COMPRESS | Texture::LOAD_CACHE | Texture::LOAD_FREE_PIXELS;
+	if (slot == 5)
+		flags |= Texture::LOAD_BC7;
+	return flags;
+}
+
+void OBJMesh::loadMaterialTextures(Material& material, const std::string& folder, const std::string* textureNames) {
+	Texture** textures[TEXTURE_SLOT_COUNT] = {
+		&material.diffuseTexture,
+		&material.alphaTexture,
+		&material.ambientTexture,
+		&material.specularTexture,
+		&material.specularHighlightTexture,
+		&material.normalTexture,
+		&material.displacementTexture,
+	};
+
+	for (int slot = 0; slot < TEXTURE_SLOT_COUNT; ++slot) {
+		if (textureNames[slot].empty())
+			continue;
+
+		*textures[slot] = TextureCache::acquire(folder + textureNames[slot], getTextureLoadFlags(slot));
+		if (*textures[slot] != nullptr)
+			m_pending->textures.push_back(*textures[slot]);
+	}
+}
+
+void OBJMesh::createChunk(const void* vertices, unsigned int vertexCount,
+						  const void* indices, unsigned int indexCount, unsigned int indexSize,
+						  const Lod* lods, unsigned int lodCount, int materialID, const Bounds& bounds) {
+
+	MeshChunk chunk;
+
+	// the opengl objects come later, in uploadChunk
+	chunk.vao = chunk.vbo = chunk.ibo = 0;
+
+	// store index count and type for rendering
+	chunk.indexCount = indexCount;
+	chunk.indexType = indexSize == sizeof(unsigned short) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	chunk.indexSize = indexSize;
+	chunk.lodCount = lodCount;
+	memcpy(chunk.lods, lods, lodCount * sizeof(Lod));
+
+	chunk.materialID = materialID;
+	chunk.bounds = bounds;
+
+	// only quantised positions need decoding, the rest pass through unchanged
+	if (m_vertexFormat == VERTEX_FORMAT_QUANTISED) {
+		chunk.positionScale = getPositionScale(bounds);
+		chunk.positionOffset = bounds.min;
+	}
+	else {
+		chunk.positionScale = glm::vec3(1);
+		chunk.positionOffset = glm::vec3(0);
+	}
+
+	m_meshChunks.push_back(chunk);
+
+	PendingUpload::ChunkSource source = { vertices, vertexCount, indices };
+	m_pending->sources.push_back(source);
+}
+
+void OBJMesh::uploadChunk(MeshChunk& chunk, const void* vertices, unsigned int vertexCount, const void* indices) {
+
+	// generate buffers
+	glGenBuffers(1, &chunk.vbo);
+	glGenBuffers(1, &chunk.ibo);
+	glGenVertexArrays(1, &chunk.vao);
+
+	// bind vertex array aka a mesh wrapper
+	glBindVertexArray(chunk.vao);
+
+	// set the index buffer data
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk.ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, chunk.indexCount * chunk.indexSize, indices, GL_STATIC_DRAW);
+
+	// bind vertex buffer
+	glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+
+	// fill vertex buffer
+	glBufferData(GL_ARRAY_BUFFER, vertexCount * getVertexSize(), vertices, GL_STATIC_DRAW);
+
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glEnableVertexAttribArray(3);
+
+	// positions, normals, texture coords and tangents
+	if (m_vertexFormat == VERTEX_FORMAT_FULL) {
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_TRUE, sizeof(Vertex), (void*)(sizeof(glm::vec4) * 1));
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(sizeof(glm::vec4) * 2));
+		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(sizeof(glm::vec4) * 2 + sizeof(glm::vec2)));
+	}
+	else if (m_vertexFormat == VERTEX_FORMAT_PACKED) {
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texcoord));
+		glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, tangent));
+	}
+	else {
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantisedVertex), (void*)offsetof(QuantisedVertex, position));
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(QuantisedVertex), (void*)offsetof(QuantisedVertex, normal));
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(QuantisedVertex), (void*)offsetof(QuantisedVertex, texcoord));
+		glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(QuantisedVertex), (void*)offsetof(QuantisedVertex, tangent));
+	}
+
+	// bind 0 for safety
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void OBJMesh::calculateMeshBounds() {
+	// the whole mesh's box holds every chunk's box, and its sphere every chunk's sphere
+	if (m_meshChunks.empty() == false) {
+		m_bounds = m_meshChunks[0].bounds;
+		for (auto& c : m_meshChunks) {
+			m_bounds.min = glm::min(m_bounds.min, c.bounds.min);
+			m_bounds.max = glm::max(m_bounds.max, c.bounds.max);
+		}
+		m_bounds.center = (m_bounds.min + m_bounds.max) * 0.5f;
+		m_bounds.radius = 0;
+		for (auto& c : m_meshChunks)
+			m_bounds.radius = glm::max(m_bounds.radius, glm::length(c.bounds.center - m_bounds.center) + c.bounds.radius);
+	}
+}
+
+void OBJMesh::calculateMeshLods() {
+	m_lodCount = 1;
+	for (auto& c : m_meshChunks)
+		m_lodCount = glm::max(m_lodCount, c.lodCount);
+
+	// a chunk with fewer levels draws its coarsest for the rest
+	for (unsigned int lod = 0; lod < m_lodCount; ++lod) {
+		m_lodErrors[lod] = 0;
+		for (auto& c : m_meshChunks)
+			m_lodErrors[lod] = glm::max(m_lodErrors[lod], c.lods[lod < c.lodCount ? lod : c.lodCount - 1].error);
+	}
+}
+
+// mesh cache layout, all offsets from the start of the file:
+//	CacheHeader
+//	CacheMaterial[materialCount]
+//	CacheChunk[chunkCount]
+//	texture names, null terminated
+//	vertex and index data of each chunk, 16 byte aligned
+// the structs are written as they are in memory, so a cache is only read
+// back by a build with the same version and vertex layout
+static const char s_cacheMagic[4] = { 'O', 'B', 'J', 'C' };
+static const unsigned int s_cacheVersion = 3;
+static const unsigned int NO_TEXTURE_NAME = 0xffffffff;
+
+struct CacheHeader {
+	char				magic[4];
+	unsigned int		version;
+	unsigned int		vertexSize;
+	unsigned int		flags;
+	unsigned long long	sourceSize;
+	long long			sourceModified;
+	unsigned int		materialCount;
+	unsigned int		chunkCount;
+	unsigned long long	namesOffset;
+	unsigned long long	namesSize;
+	OBJMesh::Bounds		bounds;
+	MeshOptimiser::Stats	unoptimisedStats;
+	MeshOptimiser::Stats	optimisedStats;
+};
+
+struct CacheMaterial {
+	glm::vec3			ambient;
+	glm::vec3			diffuse;
+	glm::vec3			specular;
+	glm::vec3			emissive;
+	float				specularPower;
+	float				opacity;
+	unsigned int		textureNames[7];	// offsets in to the names block
+};
+
+struct CacheChunk {
+	unsigned long long	vertexOffset;
+	unsigned long long	indexOffset;
+	unsigned int		vertexCount;
+	unsigned int		indexCount;
+	unsigned int		indexSize;
+	int					materialID;
+	OBJMesh::Bounds		bounds;
+	unsigned int		lodCount;
+	OBJMesh::Lod		lods[OBJMesh::MAX_LODS];
+};
+
+static unsigned long long alignCacheOffset(unsigned long long offset) {
+	return (offset + 15) & ~15ull;
+}
+
+bool OBJMesh::getSourceStamp(const char* filename, bool flipTextureV, eVertexFormat vertexFormat, bool generateLods,
+							 SourceStamp& stamp) {
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(filename, &info) != 0)
+		return false;
+#else
+	struct stat info;
+	if (stat(filename, &info) != 0)
+		return false;
+#endif
+
+	stamp.size = (unsigned long long)info.st_size;
+	stamp.modified = (long long)info.st_mtime;
+	stamp.flags = (flipTextureV ? 1 : 0) | (vertexFormat << 1) | (generateLods ? 1 << 3 : 0);
+	return true;
+}
+
+bool OBJMesh::readCache(const char* cacheFile, const std::string& folder, const SourceStamp& stamp) {
+
+	// kept open until the chunks, which point straight in to it, are uploaded
+	MappedFile& mapped = m_pending->cache;
+	if (mapped.open(cacheFile) == false)
+		return false;
+
+	const unsigned char* data = mapped.getData();
+	unsigned long long size = mapped.getSize();
+	if (size < sizeof(CacheHeader))
+		return false;
+
+	// anything that doesn't match means the obj, or this build, has changed since it was written
+	const CacheHeader* header = (const CacheHeader*)data;
+	if (memcmp(header->magic, s_cacheMagic, sizeof(s_cacheMagic)) != 0 ||
+		header->version != s_cacheVersion ||
+		header->vertexSize != getVertexSize() ||
+		header->flags != stamp.flags ||
+		header->sourceSize != stamp.size ||
+		header->sourceModified != stamp.modified)
+		return false;
+
+	// make sure every table and block lies inside the file before touching any of it
+	unsigned long long tablesSize = sizeof(CacheHeader) +
+		(unsigned long long)header->materialCount * sizeof(CacheMaterial) +
+		(unsigned long long)header->chunkCount * sizeof(CacheChunk);
+	if (tablesSize > size ||
+		header->namesOffset < tablesSize ||
+		header->namesOffset + header->namesSize > size)
+		return false;
+
+	const CacheMaterial* materials = (const CacheMaterial*)(data + sizeof(CacheHeader));
+	const CacheChunk* chunks = (const CacheChunk*)(materials + header->materialCount);
+	const char* names = (const char*)(data + header->namesOffset);
+
+	for (unsigned int i = 0; i < header->materialCount; ++i) {
+		for (int slot = 0; slot < TEXTURE_SLOT_COUNT; ++slot) {
+			unsigned int name = materials[i].textureNames[slot];
+			if (name != NO_TEXTURE_NAME &&
+				(name >= header->namesSize || memchr(names + name, 0, (size_t)(header->namesSize - name)) == nullptr))
+				return false;
+		}
+	}
+	for (unsigned int i = 0; i < header->chunkCount; ++i) {
+		const CacheChunk& c = chunks[i];
+		if (c.vertexOffset + (unsigned long long)c.vertexCount * header->vertexSize > size ||
+			(c.indexSize != sizeof(unsigned short) && c.indexSize != sizeof(unsigned int)) ||
+			c.indexOffset + (unsigned long long)c.indexCount * c.indexSize > size ||
+			c.materialID >= (int)header->materialCount ||
+			c.lodCount == 0 || c.lodCount > MAX_LODS)
+			return false;
+		for (unsigned int lod = 0; lod < c.lodCount; ++lod) {
+			if ((unsigned long long)c.lods[lod].firstIndex + c.lods[lod].indexCount > c.indexCount)
+				return false;
+		}
+	}
+
+	// copy materials
+	m_materials.resize(header->materialCount);
+	for (unsigned int i = 0; i < header->materialCount; ++i) {
+		const CacheMaterial& m = materials[i];
+		m_materials[i].ambient = m.ambient;
+		m_materials[i].diffuse = m.diffuse;
+		m_materials[i].specular = m.specular;
+		m_materials[i].emissive = m.emissive;
+		m_materials[i].specularPower = m.specularPower;
+		m_materials[i].opacity = m.opacity;
+
+		std::string textureNames[TEXTURE_SLOT_COUNT];
+		for (int slot = 0; slot < TEXTURE_SLOT_COUNT; ++slot) {
+			if (m.textureNames[slot] != NO_TEXTURE_NAME)
+				textureNames[slot] = names + m.textureNames[slot];
+		}
+		loadMaterialTextures(m_materials[i], folder, textureNames);
+	}
+
+	// the mapped data is already in its final layout, so it goes straight to opengl once uploaded
+	m_meshChunks.reserve(header->chunkCount);
+	for (unsigned int i = 0; i < header->chunkCount; ++i) {
+		const CacheChunk& c = chunks[i];
+		createChunk(data + c.vertexOffset, c.vertexCount,
+					data + c.indexOffset, c.indexCount, c.indexSize,
+					c.lods, c.lodCount, c.materialID, c.bounds);
+	}
+
+	m_bounds = header->bounds;
+	m_unoptimisedStats = header->unoptimisedStats;
+	m_optimisedStats = header->optimisedStats;
+	return true;
+}
+
+bool OBJMesh::writeCache(const char* cacheFile, const SourceStamp& stamp, const std::vector<ChunkData>& chunks,
+						 const std::vector<std::string>& textureNames) const {
+
+	CacheHeader header = {};
+	memcpy(header.magic, s_cacheMagic, sizeof(s_cacheMagic));
+	header.version = s_cacheVersion;
+	header.vertexSize = getVertexSize();
+	header.flags = stamp.flags;
+	header.sourceSize = stamp.size;
+	header.sourceModified = stamp.modified;
+	header.materialCount = (unsigned int)m_materials.size();
+	header.chunkCount = (unsigned int)chunks.size();
+	header.bounds = m_bounds;
+	header.unoptimisedStats = m_unoptimisedStats;
+	header.optimisedStats = m_optimisedStats;
+
+	// gather the texture names in to one block, skipping empty ones
+	std::vector<char> names;
+	std::vector<CacheMaterial> materials(m_materials.size());
+	for (size_t i = 0; i < m_materials.size(); ++i) {
+		const Material& m = m_materials[i];
+		materials[i].ambient = m.ambient;
+		materials[i].diffuse = m.diffuse;
+		materials[i].specular = m.specular;
+		materials[i].emissive = m.emissive;
+		materials[i].specularPower = m.specularPower;
+		materials[i].opacity = m.opacity;
+
+		for (int slot = 0; slot < TEXTURE_SLOT_COUNT; ++slot) {
+			const std::string& name = textureNames[i * TEXTURE_SLOT_COUNT + slot];
+			if (name.empty()) {
+				materials[i].textureNames[slot] = NO_TEXTURE_NAME;
+				continue;
+			}
+			materials[i].textureNames[slot] = (unsigned int)names.size();
+			names.insert(names.end(), name.c_str(), name.c_str() + name.size() + 1);
+		}
+	}
+
+	header.namesOffset = sizeof(CacheHeader) + materials.size() * sizeof(CacheMaterial) +
+		chunks.size() * sizeof(CacheChunk);
+	header.namesSize = names.size();
+
+	// lay out the geometry after the tables
+	std::vector<CacheChunk> chunkTable(chunks.size());
+	unsigned long long offset = header.namesOffset + header.namesSize;
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		CacheChunk& c = chunkTable[i];
+		memset(&c, 0, sizeof(CacheChunk));
+		c.vertexCount = (unsigned int)chunks[i].vertices.size();
+		c.indexCount = (unsigned int)chunks[i].indices.size();
+		c.indexSize = chunks[i].getIndexSize();
+		c.materialID = chunks[i].materialID;
+		c.bounds = chunks[i].bounds;
+		c.lodCount = chunks[i].lodCount;
+		memcpy(c.lods, chunks[i].lods, c.lodCount * sizeof(Lod));
+
+		c.vertexOffset = offset = alignCacheOffset(offset);
+		offset += c.vertexCount * header.vertexSize;
+		c.indexOffset = offset = alignCacheOffset(offset);
+		offset += c.indexCount * c.indexSize;
+	}
+
+	FILE* file = fopen(cacheFile, "wb");
+	if (file == nullptr)
+		return false;
+
+	bool success = fwrite(&header, sizeof(CacheHeader), 1, file) == 1;
+	if (materials.empty() == false)
+		success = success && fwrite(materials.data(), sizeof(CacheMaterial), materials.size(), file) == materials.size();
+	if (chunkTable.empty() == false)
+		success = success && fwrite(chunkTable.data(), sizeof(CacheChunk), chunkTable.size(), file) == chunkTable.size();
+	if (names.empty() == false)
+		success = success && fwrite(names.data(), 1, names.size(), file) == names.size();
+
+	static const char padding[16] = {};
+	unsigned long long written = header.namesOffset + header.namesSize;
+	for (size_t i = 0; i < chunks.size() && success; ++i) {
+		const CacheChunk& c = chunkTable[i];
+		success = fwrite(padding, 1, (size_t)(c.vertexOffset - written), file) == c.vertexOffset - written &&
+			fwrite(chunks[i].getVertexData(), header.vertexSize, c.vertexCount, file) == c.vertexCount;
+		written = c.vertexOffset + c.vertexCount * header.vertexSize;
+		success = success &&
+			fwrite(padding, 1, (size_t)(c.indexOffset - written), file) == c.indexOffset - written &&
+			fwrite(chunks[i].getIndexData(), c.indexSize, c.indexCount, file) == c.indexCount;
+		written = c.indexOffset + c.indexCount * c.indexSize;
+	}
+
+	fclose(file);
+
+	// never leave a half written cache behind
+	if (success == false)
+		remove(cacheFile);
+	return success;
+}
+
+static const char* s_textureUniformNames[] = {
+	"diffuseTexture",			// slot 0
+	"alphaTexture",				// slot 1
+	"ambientTexture",			// slot 2
+	"specularTexture",			// slot 3
+	"specularHighlightTexture",	// slot 4
+	"normalTexture",			// slot 5
+	"displacementTexture",		// slot 6
+};
+
+static const Texture* getSlotTexture(const OBJMesh::Material& material, int slot) {
+	switch (slot) {
+	case 0:	return material.diffuseTexture;
+	case 1:	return material.alphaTexture;
+	case 2:	return material.ambientTexture;
+	case 3:	return material.specularTexture;
+	case 4:	return material.specularHighlightTexture;
+	case 5:	return material.normalTexture;
+	default:	return material.displacementTexture;
+	}
+}
+
+std::unordered_map<unsigned int, OBJMesh::ProgramCache> OBJMesh::s_programCache;
+
 void OBJMesh::draw(bool usePatches /* = false */) {
 
 	int program = -1;
@@ -158,36 +761,136 @@ void OBJMesh::draw(bool usePatches /* = false */) {
 	}
 
 	// pull uniforms from the shader
-	int kaUniform = glGetUniformLocation(program, "Ka");
-	int kdUniform = glGetUniformLocation(program, "Kd");
-	int ksUniform = glGetUniformLocation(program, "Ks");
-	int keUniform = glGetUniformLocation(program, "Ke");
-	int opacityUniform = glGetUniformLocation(program, "opacity");
-	int specPowUniform = glGetUniformLocation(program, "specularPower");
-
-	int alphaTexUniform = glGetUniformLocation(program, "alphaTexture");
-	int ambientTexUniform = glGetUniformLocation(program, "ambientTexture");
-	int diffuseTexUniform = glGetUniformLocation(program, "diffuseTexture");
-	int specTexUniform = glGetUniformLocation(program, "specularTexture");
-	int specHighlightTexUniform = glGetUniformLocation(program, "specularHighlightTexture");
-	int normalTexUniform = glGetUniformLocation(program, "normalTexture");
-	int dispTexUniform = glGetUniformLocation(program, "displacementTexture");
+	MaterialUniforms uniforms;
+	uniforms.ka = glGetUniformLocation(program, "Ka");
+	uniforms.kd = glGetUniformLocation(program, "Kd");
+	uniforms.ks = glGetUniformLocation(program, "Ks");
+	uniforms.ke = glGetUniformLocation(program, "Ke");
+	uniforms.opacity = glGetUniformLocation(program, "opacity");
+	uniforms.specularPower = glGetUniformLocation(program, "specularPower");
+	uniforms.positionScale = glGetUniformLocation(program, "PositionScale");
+	uniforms.positionOffset = glGetUniformLocation(program, "PositionOffset");
 
 	// set texture slots (these don't change per material)
-	if (diffuseTexUniform >= 0)
-		glUniform1i(diffuseTexUniform, 0);
-	if (alphaTexUniform >= 0)
-		glUniform1i(alphaTexUniform, 1);
-	if (ambientTexUniform >= 0)
-		glUniform1i(ambientTexUniform, 2);
-	if (specTexUniform >= 0)
-		glUniform1i(specTexUniform, 3);
-	if (specHighlightTexUniform >= 0)
-		glUniform1i(specHighlightTexUniform, 4);
-	if (normalTexUniform >= 0)
-		glUniform1i(normalTexUniform, 5);
-	if (dispTexUniform >= 0)
-		glUniform1i(dispTexUniform, 6);
+	for (int slot = 0; slot < TEXTURE_SLOT_COUNT; ++slot) {
+		uniforms.textures[slot] = glGetUniformLocation(program, s_textureUniformNames[slot]);
+		if (uniforms.textures[slot] >= 0)
+			glUniform1i(uniforms.textures[slot], slot);
+	}
+
+	const Material* boundMaterial = nullptr;
+	drawChunks(uniforms, boundMaterial, usePatches);
+
+	// the program's material uniforms have been changed behind its cache
+	auto cache = s_programCache.find((unsigned int)program);
+	if (cache != s_programCache.end())
+		cache->second.boundMaterial = nullptr;
+}
+
+void OBJMesh::draw(ShaderProgram* shader, bool usePatches /* = false */, unsigned int lod /* = 0 */,
+				   DrawState* state /* = nullptr */) {
+	ProgramCache& cache = getProgramCache(shader);
+	drawChunks(cache.uniforms, cache.boundMaterial, usePatches, lod, 0, 0, state);
+}
+
+OBJMesh::Material& OBJMesh::getMaterial(size_t index) {
+	forgetBoundMaterials();
+	return m_materials[index];
+}
+
+void OBJMesh::drawInstanced(ShaderProgram* shader, unsigned int instanceBuffer,
+							unsigned int firstInstance, unsigned int instanceCount, unsigned int lod /* = 0 */,
+							DrawState* state /* = nullptr */) {
+	if (instanceCount == 0)
+		return;
+
+	if (m_instanceBuffer != instanceBuffer) {
+		attachInstanceBuffer(instanceBuffer);
+		if (state != nullptr)
+			state->vao = 0;
+	}
+
+	ProgramCache& cache = getProgramCache(shader);
+	drawChunks(cache.uniforms, cache.boundMaterial, false, lod, firstInstance, instanceCount, state);
+}
+
+void OBJMesh::attachInstanceBuffer(unsigned int instanceBuffer) {
+	m_instanceBuffer = instanceBuffer;
+
+	// an integer attribute that advances once per instance
+	for (auto& c : m_meshChunks) {
+		glBindVertexArray(c.vao);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		glEnableVertexAttribArray(INSTANCE_ATTRIB_LOCATION);
+		glVertexAttribIPointer(INSTANCE_ATTRIB_LOCATION, 1, GL_UNSIGNED_INT, sizeof(unsigned int), 0);
+		glVertexAttribDivisor(INSTANCE_ATTRIB_LOCATION, 1);
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+OBJMesh::ProgramCache& OBJMesh::getProgramCache(ShaderProgram* shader) {
+	assert(shader != nullptr && shader->getHandle() > 0 && "Invalid shader program");
+
+	ProgramCache& cache = s_programCache[shader->getHandle()];
+	if (cache.linkID != shader->getLinkID()) {
+		// first time we've seen this program, or its handle has been reused
+		cache.linkID = shader->getLinkID();
+		cache.boundMaterial = nullptr;
+		cache.materialWrites = 0;
+
+		MaterialUniforms& uniforms = cache.uniforms;
+		uniforms.ka = shader->getUniform("Ka");
+		uniforms.kd = shader->getUniform("Kd");
+		uniforms.ks = shader->getUniform("Ks");
+		uniforms.ke = shader->getUniform("Ke");
+		uniforms.opacity = shader->getUniform("opacity");
+		uniforms.specularPower = shader->getUniform("specularPower");
+		uniforms.positionScale = shader->getUniform("PositionScale");
+		uniforms.positionOffset = shader->getUniform("PositionOffset");
+
+		// texture slots are program state, so they only need setting once
+		for (int slot = 0; slot < TEXTURE_SLOT_COUNT; ++slot) {
+			uniforms.textures[slot] = shader->getUniform(s_textureUniformNames[slot]);
+			if (uniforms.textures[slot] >= 0)
+				glUniform1i(uniforms.textures[slot], slot);
+		}
+	}
+
+	// bindUniform calls on the program may have overwritten the bound material
+	unsigned int materialWrites = getMaterialWrites(shader, cache.uniforms);
+	if (cache.materialWrites != materialWrites) {
+		cache.materialWrites = materialWrites;
+		cache.boundMaterial = nullptr;
+	}
+
+	return cache;
+}
+
+unsigned int OBJMesh::getMaterialWrites(const ShaderProgram* shader, const MaterialUniforms& uniforms) {
+	return shader->getUniformWrites(uniforms.ka) + shader->getUniformWrites(uniforms.kd) +
+		shader->getUniformWrites(uniforms.ks) + shader->getUniformWrites(uniforms.ke) +
+		shader->getUniformWrites(uniforms.opacity) + shader->getUniformWrites(uniforms.specularPower);
+}
+
+void OBJMesh::forgetBoundMaterials() {
+	if (m_materials.empty())
+		return;
+
+	for (auto& entry : s_programCache) {
+		const Material* bound = entry.second.boundMaterial;
+		if (bound >= &m_materials.front() && bound <= &m_materials.back())
+			entry.second.boundMaterial = nullptr;
+	}
+}
+
+void OBJMesh::drawChunks(const MaterialUniforms& uniforms, const Material*& boundMaterial, bool usePatches,
+						 unsigned int lod /* = 0 */, unsigned int firstInstance /* = 0 */,
+						 unsigned int instanceCount /* = 0 */, DrawState* state /* = nullptr */) {
+
+	DrawState localState;
+	if (state == nullptr)
+		state = &localState;
 
 	int currentMaterial = -1;
 
@@ -195,71 +898,87 @@ void OBJMesh::draw(bool usePatches /* = false */) {
 	for (auto& c : m_meshChunks) {
 
 		// bind material
-		if (currentMaterial != c.materialID) {
+		if (currentMaterial != c.materialID && c.materialID >= 0) {
 			currentMaterial = c.materialID;
-			if (kaUniform >= 0)
-				glUniform3fv(kaUniform, 1, &m_materials[currentMaterial].ambient[0]);
-			if (kdUniform >= 0)
-				glUniform3fv(kdUniform, 1, &m_materials[currentMaterial].diffuse[0]);
-			if (ksUniform >= 0)
-				glUniform3fv(ksUniform, 1, &m_materials[currentMaterial].specular[0]);
-			if (keUniform >= 0)
-				glUniform3fv(keUniform, 1, &m_materials[currentMaterial].emissive[0]);
-			if (opacityUniform >= 0)
-				glUniform1f(opacityUniform, m_materials[currentMaterial].opacity);
-			if (specPowUniform >= 0)
-				glUniform1f(specPowUniform, m_materials[currentMaterial].specularPower);
-
-			glActiveTexture(GL_TEXTURE0);
-			if (m_materials[currentMaterial].diffuseTexture.getHandle() > 0)
-				glBindTexture(GL_TEXTURE_2D, m_materials[currentMaterial].diffuseTexture.getHandle());
-			else if (diffuseTexUniform >= 0)
-				glBindTexture(GL_TEXTURE_2D, 0);
-
-			glActiveTexture(GL_TEXTURE1);
-			if (m_materials[currentMaterial].alphaTexture.getHandle() > 0)
-				glBindTexture(GL_TEXTURE_2D, m_materials[currentMaterial].alphaTexture.getHandle());
-			else if (alphaTexUniform >= 0)
-				glBindTexture(GL_TEXTURE_2D, 0);
-
-			glActiveTexture(GL_TEXTURE2);
-			if (m_materials[currentMaterial].ambientTexture.getHandle() > 0)
-				glBindTexture(GL_TEXTURE_2D, m_materials[currentMaterial].ambientTexture.getHandle());
-			else if (ambientTexUniform >= 0)
-				glBindTexture(GL_TEXTURE_2D, 0);
-
-			glActiveTexture(GL_TEXTURE3);
-			if (m_materials[currentMaterial].specularTexture.getHandle() > 0)
-				glBindTexture(GL_TEXTURE_2D, m_materials[currentMaterial].specularTexture.getHandle());
-			else if (specTexUniform >= 0)
-				glBindTexture(GL_TEXTURE_2D, 0);
-
-			glActiveTexture(GL_TEXTURE4);
-			if (m_materials[currentMaterial].specularHighlightTexture.getHandle() > 0)
-				glBindTexture(GL_TEXTURE_2D, m_materials[currentMaterial].specularHighlightTexture.getHandle());
-			else if (specHighlightTexUniform >= 0)
-				glBindTexture(GL_TEXTURE_2D, 0);
-
-			glActiveTexture(GL_TEXTURE5);
-			if (m_materials[currentMaterial].normalTexture.getHandle() > 0)
-				glBindTexture(GL_TEXTURE_2D, m_materials[currentMaterial].normalTexture.getHandle());
-			else if (normalTexUniform >= 0)
-				glBindTexture(GL_TEXTURE_2D, 0);
-
-			glActiveTexture(GL_TEXTURE6);
-			if (m_materials[currentMaterial].displacementTexture.getHandle() > 0)
-				glBindTexture(GL_TEXTURE_2D, m_materials[currentMaterial].displacementTexture.getHandle());
-			else if (dispTexUniform >= 0)
-				glBindTexture(GL_TEXTURE_2D, 0);
+			const Material& material = m_materials[currentMaterial];
+
+			// uniform values stay with the program, skip them if they're already set
+			if (boundMaterial != &material) {
+				boundMaterial = &material;
+				if (uniforms.ka >= 0)
+					glUniform3fv(uniforms.ka, 1, &material.ambient[0]);
+				if (uniforms.kd >= 0)
+					glUniform3fv(uniforms.kd, 1, &material.diffuse[0]);
+				if (uniforms.ks >= 0)
+					glUniform3fv(uniforms.ks, 1, &material.specular[0]);
+				if (uniforms.ke >= 0)
+					glUniform3fv(uniforms.ke, 1, &material.emissive[0]);
+				if (uniforms.opacity >= 0)
+					glUniform1f(uniforms.opacity, material.opacity);
+				if (uniforms.specularPower >= 0)
+					glUniform1f(uniforms.specularPower, material.specularPower);
+			}
+
+			// texture bindings are context state, only trusted for as long as the draw state
+			for (int slot = 0; slot < TEXTURE_SLOT_COUNT; ++slot) {
+				const Texture* texture = getSlotTexture(material, slot);
+				unsigned int handle = texture != nullptr ? texture->getHandle() : 0;
+				if ((handle > 0 || uniforms.textures[slot] >= 0) && state->textures[slot] != handle) {
+					glActiveTexture(GL_TEXTURE0 + slot);
+					glBindTexture(GL_TEXTURE_2D, handle);
+					state->textures[slot] = handle;
+					state->textureBinds++;
+				}
+			}
 		}
 
+		// another mesh may have left the program decoding its positions
+		if (uniforms.positionScale >= 0)
+			glUniform3fv(uniforms.positionScale, 1, &c.positionScale[0]);
+		if (uniforms.positionOffset >= 0)
+			glUniform3fv(uniforms.positionOffset, 1, &c.positionOffset[0]);
+
 		// bind and draw geometry
-		glBindVertexArray(c.vao);
-		if (usePatches)
-			glDrawElements(GL_PATCHES, c.indexCount, GL_UNSIGNED_INT, 0);
+		const Lod& l = c.lods[lod < c.lodCount ? lod : c.lodCount - 1];
+		void* first = (void*)((size_t)l.firstIndex * c.indexSize);
+		if (state->vao != c.vao) {
+			glBindVertexArray(c.vao);
+			state->vao = c.vao;
+			state->vertexArrayBinds++;
+		}
+		if (instanceCount > 0)
+			glDrawElementsInstancedBaseInstance(GL_TRIANGLES, l.indexCount, c.indexType, first,
+												instanceCount, firstInstance);
+		else if (usePatches)
+			glDrawElements(GL_PATCHES, l.indexCount, c.indexType, first);
 		else
-			glDrawElements(GL_TRIANGLES, c.indexCount, GL_UNSIGNED_INT, 0);
+			glDrawElements(GL_TRIANGLES, l.indexCount, c.indexType, first);
+	}
+}
+
+OBJMesh::Bounds OBJMesh::calculateBounds(const std::vector<Vertex>& vertices) {
+	Bounds bounds;
+	bounds.min = bounds.max = bounds.center = glm::vec3(0);
+	bounds.radius = 0;
+	if (vertices.empty())
+		return bounds;
+
+	bounds.min = bounds.max = glm::vec3(vertices[0].position);
+	for (auto& v : vertices) {
+		bounds.min = glm::min(bounds.min, glm::vec3(v.position));
+		bounds.max = glm::max(bounds.max, glm::vec3(v.position));
+	}
+
+	// centred on the box, but sized to the furthest vertex rather than the
+	// box's corner, which is usually a good deal tighter
+	bounds.center = (bounds.min + bounds.max) * 0.5f;
+	float radiusSq = 0;
+	for (auto& v : vertices) {
+		glm::vec3 offset = glm::vec3(v.position) - bounds.center;
+		radiusSq = glm::max(radiusSq, glm::dot(offset, offset));
 	}
+	bounds.radius = glm::sqrt(radiusSq);
+	return bounds;
 }
 
 void OBJMesh::calculateTangents(std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices) {
@@ -3,12 +3,18 @@
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
+#include "MeshOptimiser.h"
 #include "Texture.h"
+#include "VertexPacking.h"
 
 namespace aie {
 
+class ShaderProgram;
+
 // a simple triangle mesh wrapper
 class OBJMesh {
 public:
@@ -23,11 +29,40 @@ public:
 		glm::vec4 tangent;	// added to attrib location 3
 	};
 
+	// VERTEX_FORMAT_PACKED, 24 bytes rather than 56
+	struct PackedVertex {
+		float			position[3];	// w read as 1
+		unsigned int	normal;			// octahedral 10_10_10_2
+		unsigned int	texcoord;		// two half floats
+		unsigned int	tangent;		// octahedral 10_10_10_2, handedness in w
+	};
+
+	// VERTEX_FORMAT_QUANTISED, 20 bytes. Positions are 16 bit across the
+	// chunk's bounds, the shaders decode them with the PositionScale and
+	// PositionOffset uniforms that drawing sets
+	struct QuantisedVertex {
+		unsigned short	position[4];	// w unused
+		unsigned int	normal;
+		unsigned int	texcoord;
+		unsigned int	tangent;
+	};
+
+	enum { MAX_LODS = 8 };
+
+	// the part of a chunk's indices drawn at one level of detail
+	struct Lod {
+		unsigned int	firstIndex;
+		unsigned int	indexCount;
+		float			error;	// furthest the surface moved from the full chunk, in model space
+	};
+
 	// a basic material
 	class Material {
 	public:
 
-		Material() : ambient(1), diffuse(1), specular(0), emissive(0), specularPower(1), opacity(1) {}
+		Material() : ambient(1), diffuse(1), specular(0), emissive(0), specularPower(1), opacity(1),
+			diffuseTexture(nullptr), alphaTexture(nullptr), ambientTexture(nullptr), specularTexture(nullptr),
+			specularHighlightTexture(nullptr), normalTexture(nullptr), displacementTexture(nullptr) {}
 		~Material() {}
 
 		glm::vec3 ambient;
@@ -38,44 +73,230 @@ public:
 		float specularPower;
 		float opacity;
 
-		Texture diffuseTexture;				// bound slot 0
-		Texture alphaTexture;				// bound slot 1
-		Texture ambientTexture;				// bound slot 2
-		Texture specularTexture;			// bound slot 3
-		Texture specularHighlightTexture;	// bound slot 4
-		Texture normalTexture;				// bound slot 5
-		Texture displacementTexture;		// bound slot 6
+		// shared through TextureCache, nullptr where the material has none
+		Texture* diffuseTexture;			// bound slot 0
+		Texture* alphaTexture;				// bound slot 1
+		Texture* ambientTexture;			// bound slot 2
+		Texture* specularTexture;			// bound slot 3
+		Texture* specularHighlightTexture;	// bound slot 4
+		Texture* normalTexture;				// bound slot 5
+		Texture* displacementTexture;		// bound slot 6
+	};
+
+	// model space bounds, a box and the sphere around it
+	struct Bounds {
+		glm::vec3 min;
+		glm::vec3 max;
+		glm::vec3 center;
+		float radius;
 	};
 
-	OBJMesh() {}
+	OBJMesh();
 	~OBJMesh();
 
-	// will fail if a mesh has already been loaded in to this instance
-	bool load(const char* filename, bool loadTextures = true, bool flipTextureV = false);
+	// will fail if a mesh has already been loaded in to this instance.
+	// each chunk's vertices are deduplicated and its triangles and vertices
+	// reordered by MeshOptimiser before upload, using 16 bit indices when it
+	// has few enough vertices, and the vertices are stored in vertexFormat.
+	// generateLods adds up to MAX_LODS - 1 simplified levels of detail to
+	// each chunk, each with around half the triangles of the one before.
+	// The result is cached in a binary file next to the obj (filename +
+	// ".meshcache") and later loads read that instead, until the obj changes
+	bool load(const char* filename, bool loadTextures = true, bool flipTextureV = false,
+			  eVertexFormat vertexFormat = VERTEX_FORMAT_FULL, bool generateLods = true);
+
+	// the two halves of load, for loading in the background. prepare does
+	// the reading, parsing and texture decoding and can run on any thread,
+	// though nothing else may touch the mesh until it returns. uploadNext
+	// then creates one texture's or chunk's opengl objects per call on the
+	// gl thread, returning true once they all exist and the mesh can be drawn
+	bool prepare(const char* filename, bool loadTextures = true, bool flipTextureV = false,
+				 eVertexFormat vertexFormat = VERTEX_FORMAT_FULL, bool generateLods = true);
+	bool uploadNext();
+
+	enum { TEXTURE_SLOT_COUNT = 7 };
+
+	// the texture and vertex array bindings left by a run of draws, so each
+	// draw only binds what differs from the one before. It is only valid
+	// while nothing else binds textures or vertex arrays in between
+	struct DrawState {
+		unsigned int	textures[TEXTURE_SLOT_COUNT];	// ~0u until the slot is bound
+		unsigned int	vao;
+		unsigned int	textureBinds;
+		unsigned int	vertexArrayBinds;
+
+		DrawState() : vao(~0u), textureBinds(0), vertexArrayBinds(0) {
+			for (auto& texture : textures)
+				texture = ~0u;
+		}
+	};
 
 	// allow option to draw as patches for tessellation
+	// queries the bound program and its uniforms from opengl on every call
 	void draw(bool usePatches = false);
 
+	// as above, but for an already bound program whose material uniform
+	// locations and texture slots are cached the first time it is seen
+	// chunks with fewer levels of detail than lod draw their coarsest
+	void draw(ShaderProgram* shader, bool usePatches = false, unsigned int lod = 0,
+			  DrawState* state = nullptr);
+
+	// draws instanceCount copies of every chunk in one call per chunk. Each
+	// instance reads an unsigned int from instanceBuffer, starting at
+	// firstInstance, into attrib location 4
+	void drawInstanced(ShaderProgram* shader, unsigned int instanceBuffer,
+					   unsigned int firstInstance, unsigned int instanceCount, unsigned int lod = 0,
+					   DrawState* state = nullptr);
+
+	enum { INSTANCE_ATTRIB_LOCATION = 4 };
+
+	// each chunk is drawn with its own draw call
+	size_t getChunkCount() const { return m_meshChunks.size(); }
+
+	// bounds of the whole mesh, and of each chunk, found at load time
+	const Bounds& getBounds() const { return m_bounds; }
+	const Bounds& getChunkBounds(size_t index) const { return m_meshChunks[index].bounds; }
+
+	// post-transform cache statistics over every chunk, in the order the obj
+	// gave the triangles and after optimising them
+	const MeshOptimiser::Stats& getUnoptimisedStats() const { return m_unoptimisedStats; }
+	const MeshOptimiser::Stats& getOptimisedStats() const { return m_optimisedStats; }
+
+	// levels of detail across the chunks, 1 if none were generated. A level's
+	// error is the largest of any chunk's at that level
+	unsigned int getLodCount() const { return m_lodCount; }
+	float getLodError(unsigned int lod) const { return m_lodErrors[lod < m_lodCount ? lod : m_lodCount - 1]; }
+	unsigned int getTriangleCount(unsigned int lod = 0) const;
+
+	eVertexFormat getVertexFormat() const { return m_vertexFormat; }
+	unsigned int getVertexSize() const;
+
 	// access to the filename that was loaded
 	const std::string& getFilename() const { return m_filename; }
 
-	// material access
+	// material access, the returned material may be edited so programs forget it is bound
 	size_t getMaterialCount() const { return m_materials.size();  }
-	Material& getMaterial(size_t index) { return m_materials[index];  }
+	Material& getMaterial(size_t index);
 
 private:
 
+	// material uniform locations for a single program, -1 if unused
+	struct MaterialUniforms {
+		int ka, kd, ks, ke;
+		int opacity, specularPower;
+		int positionScale, positionOffset;
+		int textures[TEXTURE_SLOT_COUNT];
+	};
+
+	struct ProgramCache {
+		unsigned int		linkID;
+		MaterialUniforms	uniforms;
+		const Material*		boundMaterial;	// material uniforms currently set on the program
+		unsigned int		materialWrites;	// bindUniform writes to the material uniforms when bound
+	};
+
+	// sum of the program's bindUniform writes to the material uniforms
+	static unsigned int getMaterialWrites(const ShaderProgram* shader, const MaterialUniforms& uniforms);
+
+	// clears boundMaterial from any program that has one of this mesh's materials bound
+	void forgetBoundMaterials();
+
+	ProgramCache& getProgramCache(ShaderProgram* shader);
+
+	// instanceCount of 0 draws each chunk once without instancing, a null
+	// state only skips binds repeated within this draw
+	void drawChunks(const MaterialUniforms& uniforms, const Material*& boundMaterial, bool usePatches,
+					unsigned int lod = 0, unsigned int firstInstance = 0, unsigned int instanceCount = 0,
+					DrawState* state = nullptr);
+
+	// points each chunk's instance attribute at the buffer
+	void attachInstanceBuffer(unsigned int instanceBuffer);
+
 	void calculateTangents(std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices);
 
+	// final vertex and index data of a chunk, kept after parsing to write the cache
+	struct ChunkData {
+		std::vector<Vertex>			vertices;
+		std::vector<unsigned char>	packedVertices;	// used instead of vertices when not empty
+		std::vector<unsigned int>	indices;
+		std::vector<unsigned short>	shortIndices;	// used instead of indices when not empty
+		int							materialID;
+		Bounds						bounds;
+		Lod							lods[MAX_LODS];
+		unsigned int				lodCount;
+
+		const void* getVertexData() const { return packedVertices.empty() ? (const void*)vertices.data() : packedVertices.data(); }
+		const void* getIndexData() const { return shortIndices.empty() ? (const void*)indices.data() : shortIndices.data(); }
+		unsigned int getIndexSize() const { return shortIndices.empty() ? sizeof(unsigned int) : sizeof(unsigned short); }
+	};
+
+	// identifies the exact obj, and load options, a cache was built from
+	struct SourceStamp {
+		unsigned long long	size;
+		long long			modified;
+		unsigned int		flags;
+	};
+
+	static bool getSourceStamp(const char* filename, bool flipTextureV, eVertexFormat vertexFormat, bool generateLods,
+							   SourceStamp& stamp);
+
+	bool readCache(const char* cacheFile, const std::string& folder, const SourceStamp& stamp);
+
+	// textureNames holds TEXTURE_SLOT_COUNT names per material, in slot order
+	bool writeCache(const char* cacheFile, const SourceStamp& stamp, const std::vector<ChunkData>& chunks,
+					const std::vector<std::string>& textureNames) const;
+
+	// simplifies the chunk's indices again and again, appending each level of detail to them
+	static void generateChunkLods(ChunkData& chunk);
+
+	// converts the chunk's vertices to m_vertexFormat
+	void packVertices(ChunkData& chunk) const;
+
+	// acquires the textures from TextureCache, skipping empty names, and
+	// leaves any new ones waiting for upload
+	void loadMaterialTextures(Material& material, const std::string& folder, const std::string* textureNames);
+
+	// adds a chunk whose buffers and vao are created by uploadNext from the
+	// given data, which must stay alive until then
+	void createChunk(const void* vertices, unsigned int vertexCount,
+					 const void* indices, unsigned int indexCount, unsigned int indexSize,
+					 const Lod* lods, unsigned int lodCount, int materialID, const Bounds& bounds);
+
+	void calculateMeshBounds();
+	void calculateMeshLods();
+
+	static std::unordered_map<unsigned int, ProgramCache> s_programCache;
+
 	struct MeshChunk {
 		unsigned int	vao, vbo, ibo;
 		unsigned int	indexCount;
+		unsigned int	indexType;	// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+		unsigned int	indexSize;
+		Lod				lods[MAX_LODS];
+		unsigned int	lodCount;
 		int				materialID;
+		Bounds			bounds;
+		glm::vec3		positionScale, positionOffset;	// decodes quantised positions
 	};
 
+	void uploadChunk(MeshChunk& chunk, const void* vertices, unsigned int vertexCount, const void* indices);
+
+	// what prepare leaves for uploadNext, freed once it's all uploaded
+	struct PendingUpload;
+
+	static Bounds calculateBounds(const std::vector<Vertex>& vertices);
+
 	std::string				m_filename;
 	std::vector<MeshChunk>	m_meshChunks;
 	std::vector<Material>	m_materials;
+	Bounds					m_bounds;
+	MeshOptimiser::Stats	m_unoptimisedStats;
+	MeshOptimiser::Stats	m_optimisedStats;
+	float					m_lodErrors[MAX_LODS] = {};
+	unsigned int			m_lodCount = 1;
+	eVertexFormat			m_vertexFormat = VERTEX_FORMAT_FULL;
+	unsigned int			m_instanceBuffer = 0;	// buffer the chunk vaos read instance transforms from
+	std::unique_ptr<PendingUpload>	m_pending;
 };
 
 } // namespace aie
\ No newline at end of file
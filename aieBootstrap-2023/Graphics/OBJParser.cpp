@@ -0,0 +1,553 @@
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "OBJParser.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <thread>
+#include <unordered_map>
+
+namespace aie {
+
+// below this many bytes per chunk the thread start-up costs more than it saves
+#define MIN_CHUNK_SIZE (256 * 1024)
+
+// a face corner, zero based indices in to the file's positions, texcoords
+// and normals. -1 if the corner doesn't use one
+struct Corner {
+	int v, vt, vn;
+};
+
+// statements that split faces in to shapes, and where they came in the chunk
+struct Statement {
+	enum Type { USEMTL, MTLLIB, GROUP, OBJECT };
+
+	Type			type;
+	unsigned int	face;	// number of faces in the chunk before the statement
+	std::string		name;
+};
+
+// everything parsed from one chunk of the file. Relative indices can only be
+// resolved once the number of elements in earlier chunks is known, so they
+// are stored against the chunk's own counts and listed for fixing up
+struct ParsedChunk {
+	const char*					begin;
+	const char*					end;
+
+	std::vector<float>			positions;
+	std::vector<float>			normals;
+	std::vector<float>			texcoords;
+
+	std::vector<Corner>			corners;
+	std::vector<unsigned int>	faces;		// first corner of each face, plus one past the last
+	std::vector<unsigned int>	relative;	// corner * 3 + component of relative indices
+	std::vector<Statement>		statements;
+
+	size_t						positionBase, normalBase, texcoordBase;
+};
+
+// a run of faces that become one shape
+struct FaceGroup {
+	struct Span {
+		unsigned int chunk, firstFace, lastFace;
+	};
+
+	std::vector<Span>	spans;
+	int					material;
+	std::string			name;
+};
+
+// runs work on threadCount threads, including the calling one. The work
+// pulls its own tasks so uneven ones are shared out evenly
+static void runParallel(unsigned int threadCount, const std::function<void()>& work) {
+	std::vector<std::thread> workers;
+	workers.reserve(threadCount > 0 ? threadCount - 1 : 0);
+	for (unsigned int i = 1; i < threadCount; ++i)
+		workers.emplace_back(work);
+
+	work();
+
+	for (auto& worker : workers)
+		worker.join();
+}
+
+static void forEachTask(unsigned int taskCount, unsigned int threadCount, const std::function<void(unsigned int)>& task) {
+	std::atomic<unsigned int> next(0);
+	runParallel(std::min(threadCount, taskCount), [&]() {
+		for (unsigned int i = next++; i < taskCount; i = next++)
+			task(i);
+	});
+}
+
+static inline bool isSpace(char c) {
+	return c == ' ' || c == '\t';
+}
+
+static inline bool isDigit(char c) {
+	return (unsigned char)(c - '0') < 10;
+}
+
+static inline const char* skipSpace(const char* text, const char* end) {
+	while (text < end && isSpace(*text))
+		++text;
+	return text;
+}
+
+static inline const char* skipToken(const char* text, const char* end) {
+	while (text < end && isSpace(*text) == false)
+		++text;
+	return text;
+}
+
+// powers of ten that a double holds exactly
+static const double s_powersOf10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+float OBJParser::parseFloat(const char*& text, const char* end) {
+	const char* p = text;
+
+	bool negative = false;
+	if (p < end && (*p == '+' || *p == '-'))
+		negative = *p++ == '-';
+
+	// up to 19 digits fit in the mantissa, later ones only scale it
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool hasDigits = false;
+	for (; p < end && isDigit(*p); ++p) {
+		hasDigits = true;
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa != 0;
+		}
+		else
+			++exponent;
+	}
+	if (p < end && *p == '.') {
+		for (++p; p < end && isDigit(*p); ++p) {
+			hasDigits = true;
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+				--exponent;
+			}
+		}
+	}
+	if (hasDigits == false)
+		return 0;
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char* e = p + 1;
+		bool negativeExponent = false;
+		if (e < end && (*e == '+' || *e == '-'))
+			negativeExponent = *e++ == '-';
+		if (e < end && isDigit(*e)) {
+			int value = 0;
+			for (; e < end && isDigit(*e); ++e)
+				value = std::min(value * 10 + (*e - '0'), 100000);
+			exponent += negativeExponent ? -value : value;
+			p = e;
+		}
+	}
+
+	text = p;
+
+	// a mantissa and power of ten that are both exact give a correctly rounded double
+	double result = (double)mantissa;
+	if (mantissa == 0)
+		result = 0;
+	else if (mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22)
+		result = exponent < 0 ? result / s_powersOf10[-exponent] : result * s_powersOf10[exponent];
+	else
+		result *= std::pow(10.0, exponent);
+
+	return (float)(negative ? -result : result);
+}
+
+// the next whitespace separated value on a line, 0 if there isn't one
+static inline float readFloat(const char*& text, const char* end) {
+	text = skipSpace(text, end);
+	const char* p = text;
+	float value = OBJParser::parseFloat(p, end);
+	text = skipToken(p, end);
+	return value;
+}
+
+static inline std::string readName(const char* text, const char* end) {
+	text = skipSpace(text, end);
+	return std::string(text, skipToken(text, end));
+}
+
+// atoi, stopping at the end of the line
+static inline int readInt(const char*& text, const char* end) {
+	bool negative = false;
+	if (text < end && (*text == '+' || *text == '-'))
+		negative = *text++ == '-';
+
+	int value = 0;
+	for (; text < end && isDigit(*text); ++text)
+		value = value * 10 + (*text - '0');
+	return negative ? -value : value;
+}
+
+// makes an index zero based, recording it for fixing up if it's relative
+static inline int readIndex(const char*& text, const char* end, size_t count, ParsedChunk& chunk, int component) {
+	int index = readInt(text, end);
+	while (text < end && *text != '/' && isSpace(*text) == false)
+		++text;
+
+	if (index > 0)
+		return index - 1;
+	if (index == 0)
+		return 0;
+
+	chunk.relative.push_back((unsigned int)chunk.corners.size() * 3 + component);
+	return (int)count + index;
+}
+
+static inline bool isStatement(const char* text, const char* end, const char* keyword, size_t length) {
+	return (size_t)(end - text) > length && strncmp(text, keyword, length) == 0 && isSpace(text[length]);
+}
+
+static void parseLine(const char* text, const char* end, ParsedChunk& chunk) {
+	text = skipSpace(text, end);
+	if (text == end || *text == '#')
+		return;
+
+	size_t length = end - text;
+
+	if (text[0] == 'v' && length > 1) {
+		// vertex
+		if (isSpace(text[1])) {
+			text += 2;
+			float x = readFloat(text, end);
+			float y = readFloat(text, end);
+			float z = readFloat(text, end);
+			chunk.positions.push_back(x);
+			chunk.positions.push_back(y);
+			chunk.positions.push_back(z);
+			return;
+		}
+
+		// normal
+		if (text[1] == 'n' && length > 2 && isSpace(text[2])) {
+			text += 3;
+			float x = readFloat(text, end);
+			float y = readFloat(text, end);
+			float z = readFloat(text, end);
+			chunk.normals.push_back(x);
+			chunk.normals.push_back(y);
+			chunk.normals.push_back(z);
+			return;
+		}
+
+		// texcoord
+		if (text[1] == 't' && length > 2 && isSpace(text[2])) {
+			text += 3;
+			float x = readFloat(text, end);
+			float y = readFloat(text, end);
+			chunk.texcoords.push_back(x);
+			chunk.texcoords.push_back(y);
+			return;
+		}
+		return;
+	}
+
+	// face, corners are v, v/vt, v//vn or v/vt/vn
+	if (text[0] == 'f' && length > 1 && isSpace(text[1])) {
+		chunk.faces.push_back((unsigned int)chunk.corners.size());
+
+		text = skipSpace(text + 2, end);
+		while (text < end) {
+			Corner corner = { -1, -1, -1 };
+			corner.v = readIndex(text, end, chunk.positions.size() / 3, chunk, 0);
+			if (text < end && *text == '/') {
+				++text;
+				if (text < end && *text != '/')
+					corner.vt = readIndex(text, end, chunk.texcoords.size() / 2, chunk, 1);
+				if (text < end && *text == '/') {
+					++text;
+					corner.vn = readIndex(text, end, chunk.normals.size() / 3, chunk, 2);
+				}
+			}
+			chunk.corners.push_back(corner);
+
+			text = skipToken(text, end);
+			text = skipSpace(text, end);
+		}
+		return;
+	}
+
+	Statement statement;
+	statement.face = (unsigned int)chunk.faces.size();
+	if (isStatement(text, end, "usemtl", 6)) {
+		statement.type = Statement::USEMTL;
+		statement.name = readName(text + 7, end);
+	}
+	else if (isStatement(text, end, "mtllib", 6)) {
+		statement.type = Statement::MTLLIB;
+		statement.name = readName(text + 7, end);
+	}
+	else if (text[0] == 'g' && length > 1 && isSpace(text[1])) {
+		statement.type = Statement::GROUP;
+		statement.name = readName(text + 2, end);
+	}
+	else if (text[0] == 'o' && length > 1 && isSpace(text[1])) {
+		statement.type = Statement::OBJECT;
+		statement.name = readName(text + 2, end);
+	}
+	else
+		return;	// ignore unknown statements
+
+	chunk.statements.push_back(statement);
+}
+
+static void parseChunk(ParsedChunk& chunk) {
+	const char* text = chunk.begin;
+	while (text < chunk.end) {
+		const char* lineEnd = (const char*)memchr(text, '\n', chunk.end - text);
+		const char* next = lineEnd != nullptr ? lineEnd + 1 : chunk.end;
+		if (lineEnd == nullptr)
+			lineEnd = chunk.end;
+		if (lineEnd > text && lineEnd[-1] == '\r')
+			--lineEnd;
+
+		parseLine(text, lineEnd, chunk);
+		text = next;
+	}
+
+	chunk.faces.push_back((unsigned int)chunk.corners.size());
+}
+
+struct CornerHash {
+	size_t operator()(const Corner& c) const {
+		size_t hash = (size_t)(unsigned int)c.v * 0x9E3779B1u;
+		hash ^= (size_t)(unsigned int)c.vt * 0x85EBCA77u + (hash << 6) + (hash >> 2);
+		hash ^= (size_t)(unsigned int)c.vn * 0xC2B2AE3Du + (hash << 6) + (hash >> 2);
+		return hash;
+	}
+};
+
+struct CornerEqual {
+	bool operator()(const Corner& a, const Corner& b) const {
+		return a.v == b.v && a.vt == b.vt && a.vn == b.vn;
+	}
+};
+
+// triangulates a group's faces as fans, giving each distinct corner one vertex
+static bool buildShape(const FaceGroup& group, const std::vector<ParsedChunk>& chunks,
+					   const std::vector<float>& positions, const std::vector<float>& normals,
+					   const std::vector<float>& texcoords, tinyobj::shape_t& shape) {
+
+	size_t cornerCount = 0;
+	for (auto& span : group.spans) {
+		const ParsedChunk& chunk = chunks[span.chunk];
+		cornerCount += chunk.faces[span.lastFace] - chunk.faces[span.firstFace];
+	}
+
+	std::unordered_map<Corner, unsigned int, CornerHash, CornerEqual> vertexCache;
+	vertexCache.reserve(cornerCount);
+
+	tinyobj::mesh_t& mesh = shape.mesh;
+	mesh.indices.reserve(cornerCount * 3);
+
+	int positionCount = (int)(positions.size() / 3);
+	int normalCount = (int)(normals.size() / 3);
+	int texcoordCount = (int)(texcoords.size() / 2);
+
+	auto addVertex = [&](const Corner& c, unsigned int& index) {
+		auto result = vertexCache.emplace(c, (unsigned int)(mesh.positions.size() / 3));
+		index = result.first->second;
+		if (result.second == false)
+			return true;
+
+		if (c.v < 0 || c.v >= positionCount)
+			return false;
+		mesh.positions.insert(mesh.positions.end(), &positions[c.v * 3], &positions[c.v * 3] + 3);
+		if (c.vn >= 0 && c.vn < normalCount)
+			mesh.normals.insert(mesh.normals.end(), &normals[c.vn * 3], &normals[c.vn * 3] + 3);
+		if (c.vt >= 0 && c.vt < texcoordCount)
+			mesh.texcoords.insert(mesh.texcoords.end(), &texcoords[c.vt * 2], &texcoords[c.vt * 2] + 2);
+		return true;
+	};
+
+	for (auto& span : group.spans) {
+		const ParsedChunk& chunk = chunks[span.chunk];
+		for (unsigned int face = span.firstFace; face < span.lastFace; ++face) {
+			const Corner* corners = &chunk.corners[chunk.faces[face]];
+			unsigned int count = chunk.faces[face + 1] - chunk.faces[face];
+			for (unsigned int k = 2; k < count; ++k) {
+				unsigned int v0, v1, v2;
+				if (addVertex(corners[0], v0) == false ||
+					addVertex(corners[k - 1], v1) == false ||
+					addVertex(corners[k], v2) == false)
+					return false;
+
+				mesh.indices.push_back(v0);
+				mesh.indices.push_back(v1);
+				mesh.indices.push_back(v2);
+				mesh.num_vertices.push_back(3);
+				mesh.material_ids.push_back(group.material);
+			}
+		}
+	}
+
+	shape.name = group.name;
+	return true;
+}
+
+bool OBJParser::load(std::vector<tinyobj::shape_t>& shapes,
+					 std::vector<tinyobj::material_t>& materials,
+					 std::string& error, const char* filename,
+					 const char* mtlBasePath /* = nullptr */, unsigned int threadCount /* = 0 */) {
+
+	shapes.clear();
+
+	MappedFile file;
+	if (file.open(filename) == false) {
+		error = std::string("Cannot open file [") + filename + "]\n";
+		return false;
+	}
+
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+	// split the file in to a few chunks per thread, each ending on a new line
+	const char* data = (const char*)file.getData();
+	const char* dataEnd = data + file.getSize();
+	size_t chunkCount = std::min((size_t)threadCount * 4, file.getSize() / MIN_CHUNK_SIZE);
+	chunkCount = std::max(chunkCount, (size_t)1);
+
+	std::vector<ParsedChunk> chunks(chunkCount);
+	const char* begin = data;
+	for (size_t i = 0; i < chunkCount; ++i) {
+		const char* end = i + 1 == chunkCount ? dataEnd : data + file.getSize() * (i + 1) / chunkCount;
+		if (end < begin)
+			end = begin;
+		const char* lineEnd = (const char*)memchr(end, '\n', dataEnd - end);
+		end = lineEnd != nullptr ? lineEnd + 1 : dataEnd;
+
+		chunks[i].begin = begin;
+		chunks[i].end = end;
+		begin = end;
+	}
+
+	forEachTask((unsigned int)chunkCount, threadCount, [&](unsigned int i) {
+		parseChunk(chunks[i]);
+	});
+
+	// each chunk's elements follow on from the ones before it
+	size_t positionCount = 0, normalCount = 0, texcoordCount = 0;
+	for (auto& chunk : chunks) {
+		chunk.positionBase = positionCount;
+		chunk.normalBase = normalCount;
+		chunk.texcoordBase = texcoordCount;
+		positionCount += chunk.positions.size() / 3;
+		normalCount += chunk.normals.size() / 3;
+		texcoordCount += chunk.texcoords.size() / 2;
+	}
+
+	std::vector<float> positions(positionCount * 3);
+	std::vector<float> normals(normalCount * 3);
+	std::vector<float> texcoords(texcoordCount * 2);
+
+	forEachTask((unsigned int)chunkCount, threadCount, [&](unsigned int i) {
+		ParsedChunk& chunk = chunks[i];
+		std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.positionBase * 3);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.normalBase * 3);
+		std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), texcoords.begin() + chunk.texcoordBase * 2);
+		std::vector<float>().swap(chunk.positions);
+		std::vector<float>().swap(chunk.normals);
+		std::vector<float>().swap(chunk.texcoords);
+
+		for (unsigned int r : chunk.relative) {
+			Corner& corner = chunk.corners[r / 3];
+			switch (r % 3) {
+			case 0:	corner.v += (int)chunk.positionBase; break;
+			case 1:	corner.vt += (int)chunk.texcoordBase; break;
+			default:	corner.vn += (int)chunk.normalBase; break;
+			}
+		}
+	});
+
+	// replay the statements in file order to find the shapes, the same way tinyobj does
+	std::vector<FaceGroup> groups;
+	std::map<std::string, int> materialMap;
+	tinyobj::MaterialFileReader readMaterials(mtlBasePath != nullptr ? mtlBasePath : "");
+
+	FaceGroup group;
+	group.material = -1;
+	auto flush = [&](unsigned int chunk, unsigned int face) {
+		// close the open span, which is always in the current chunk, dropping the group if it has no faces
+		FaceGroup::Span& span = group.spans.back();
+		span.lastFace = face;
+		if (span.firstFace == span.lastFace)
+			group.spans.pop_back();
+		if (group.spans.empty() == false)
+			groups.push_back(group);
+
+		group.spans.clear();
+		group.spans.push_back({ chunk, face, face });
+	};
+
+	group.spans.push_back({ 0, 0, 0 });
+	for (unsigned int c = 0; c < chunkCount; ++c) {
+		ParsedChunk& chunk = chunks[c];
+
+		// a group carries on from the last chunk
+		if (c > 0) {
+			FaceGroup::Span& span = group.spans.back();
+			span.lastFace = (unsigned int)chunks[span.chunk].faces.size() - 1;
+			if (span.firstFace == span.lastFace)
+				group.spans.pop_back();
+			group.spans.push_back({ c, 0, 0 });
+		}
+
+		for (auto& statement : chunk.statements) {
+			switch (statement.type) {
+			case Statement::USEMTL: {
+				flush(c, statement.face);
+				auto iter = materialMap.find(statement.name);
+				group.material = iter != materialMap.end() ? iter->second : -1;
+				break;
+			}
+			case Statement::MTLLIB: {
+				std::string mtlError;
+				readMaterials(statement.name, materials, materialMap, mtlError);
+				error += mtlError;
+				break;
+			}
+			case Statement::GROUP:
+			case Statement::OBJECT:
+				flush(c, statement.face);
+				group.name = statement.name;
+				break;
+			}
+		}
+	}
+	flush((unsigned int)chunkCount - 1, (unsigned int)chunks.back().faces.size() - 1);
+
+	// shapes don't share vertices, so each is built on its own
+	shapes.resize(groups.size());
+	std::atomic<bool> valid(true);
+	forEachTask((unsigned int)groups.size(), threadCount, [&](unsigned int i) {
+		if (buildShape(groups[i], chunks, positions, normals, texcoords, shapes[i]) == false)
+			valid = false;
+	});
+
+	if (valid == false) {
+		shapes.clear();
+		error += "Face index out of range in [" + std::string(filename) + "]\n";
+		return false;
+	}
+
+	return true;
+}
+
+} // namespace aie
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "tiny_obj_loader.h"
+
+namespace aie {
+
+// a multithreaded drop in for tinyobj::LoadObj, giving the same shapes and
+// materials. The file is mapped in to memory and split in to line aligned
+// chunks that are parsed in parallel, the chunks are then stitched back
+// together and each shape has its vertices deduplicated on its own thread
+class OBJParser {
+public:
+
+	// a threadCount of 0 uses one thread per core. Polygons are always triangulated
+	static bool load(std::vector<tinyobj::shape_t>& shapes,
+					 std::vector<tinyobj::material_t>& materials,
+					 std::string& error, const char* filename,
+					 const char* mtlBasePath = nullptr, unsigned int threadCount = 0);
+
+	// parses a float the way std::from_chars would, stopping at the first
+	// character that can't be part of the number. Returns 0 if there's no number
+	static float parseFloat(const char*& text, const char* end);
+};
+
+} // namespace aie
@@ -1,42 +1,46 @@
 #include "ParticleEmitter.h"
-#include "Gizmos.h"
 #include <glm/glm.hpp>
+#include <cstring>
 
-ParticleEmitter::ParticleEmitter() :
-	m_particles(nullptr), m_firstDead(0), m_maxParticles(0), 
-	m_position(0,0,0), m_vao(0), m_vbo(0), m_ibo(0), m_vertexData(nullptr)
+#if defined(_M_X64) || defined(__SSE2__)
+#define PARTICLES_USE_SSE
+#include <emmintrin.h>
+#endif
+
+// a colour in [0, 1] as rgba8, red in the lowest byte to match GL_UNSIGNED_BYTE
+static unsigned int PackColor(const glm::vec4& color)
 {
+	glm::vec4 c = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+	return (unsigned int)c.r | ((unsigned int)c.g << 8) |
+		((unsigned int)c.b << 16) | ((unsigned int)c.a << 24);
+}
 
+ParticleEmitter::ParticleEmitter() :
+	m_instanceData(nullptr), m_firstDead(0), m_maxParticles(0), m_position(0,0,0),
+	m_emitTimer(0), m_emitRate(0)
+{
+	memset(&m_particles, 0, sizeof(m_particles));
 }
 
-ParticleEmitter::ParticleEmitter(unsigned int _maxParticles, unsigned int _emitRate, 
-	float _lifespanMin, float _lifespanMax, float _velocityMin, float _velocityMax, 
+ParticleEmitter::ParticleEmitter(unsigned int _maxParticles, unsigned int _emitRate,
+	float _lifespanMin, float _lifespanMax, float _velocityMin, float _velocityMax,
 	float _startSize, float _endSize, const glm::vec4& _startColor, const glm::vec4& _endColor) :
-	m_maxParticles(_maxParticles), m_lifespanMin(_lifespanMin), m_lifespanMax(_lifespanMax),
-	m_velocityMin(_velocityMin), m_velocityMax(_velocityMax), m_startSize(_startSize),
-	m_endSize(_endSize), m_startColor(_startColor), m_endColor(_endColor)
+	ParticleEmitter()
 {
-	// Set up emit timers
-	m_emitRate = 1.0 / _emitRate;
-	m_emitTimer = 0;
+	Initialise(_maxParticles, _emitRate, _lifespanMin, _lifespanMax, _velocityMin,
+		_velocityMax, _startSize, _endSize, _startColor, _endColor);
 }
 
 ParticleEmitter::~ParticleEmitter()
 {
-	delete[] m_particles;
-	delete[] m_vertexData;
-
-	glDeleteVertexArrays(1, &m_vao);
-	glDeleteBuffers(1, &m_vbo);
-	glDeleteBuffers(1, &m_ibo);
 }
 
-void ParticleEmitter::Initialise(unsigned int _maxParticles, unsigned int _emitRate, 
-	float _lifespanMin, float _lifespanMax, float _velocityMin, float _velocityMax, 
+void ParticleEmitter::Initialise(unsigned int _maxParticles, unsigned int _emitRate,
+	float _lifespanMin, float _lifespanMax, float _velocityMin, float _velocityMax,
 	float _startSize, float _endSize, const glm::vec4& _startColor, const glm::vec4& _endColor)
 {
 	// Set up emit timers
-	m_emitRate = 1.0 / _emitRate;
+	m_emitRate = 1.0f / _emitRate;
 	m_emitTimer = 0;
 
 	// Store tthe variables that we pass in
@@ -53,189 +57,185 @@ void ParticleEmitter::Initialise(unsigned int _maxParticles, unsigned int _emitR
 	m_endColor = _endColor;
 
 	m_maxParticles = _maxParticles;
-
-	// Create a particle array
-	m_particles = new Particle[m_maxParticles];
 	m_firstDead = 0;
+}
 
-	// We need to create an array of vertices for the particles
-	// There needs to be four (4) vertices per particle to make a quad
-	// This will be generated as we update an emitter
-	m_vertexData = new ParticleVertex[m_maxParticles * 4];
-
-	// Indices that will be used for all required vertices
-	unsigned int* indexdata = new unsigned int[m_maxParticles * 6];
-	for (unsigned int i = 0; i < m_maxParticles; i++)
-	{
-		indexdata[i * 6 + 0] = i * 4 + 0;
-		indexdata[i * 6 + 1] = i * 4 + 1;
-		indexdata[i * 6 + 2] = i * 4 + 2;
-		indexdata[i * 6 + 3] = i * 4 + 0;
-		indexdata[i * 6 + 4] = i * 4 + 2;
-		indexdata[i * 6 + 5] = i * 4 + 3;
-	}
-
-	// Time to create the OpenGL buffers!
-
-	glGenVertexArrays(1, &m_vao);
-	glBindVertexArray(m_vao);
-
-	glGenBuffers(1, &m_vbo);
-	glGenBuffers(1, &m_ibo);
-
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-	glBufferData(GL_ARRAY_BUFFER, m_maxParticles * 4 * sizeof(ParticleVertex), 
-		m_vertexData, GL_DYNAMIC_DRAW);
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_maxParticles * 6 * sizeof(unsigned int),
-		indexdata, GL_STATIC_DRAW);
-
-	// This is the position of the particle for their shader
-	glEnableVertexAttribArray(0);
-
-	// This is the color of the particle for their shader
-	glEnableVertexAttribArray(1);
-
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleVertex), 0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleVertex), ((char*)0) + 16);
-
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-	delete[] indexdata;
+void ParticleEmitter::SetStorage(const ParticleArrays& _particles, ParticleInstance* _instances)
+{
+	m_particles = _particles;
+	m_instanceData = _instances;
+	m_firstDead = 0;
 }
 
-void ParticleEmitter::Emit()
+void ParticleEmitter::Emit(float _elapsed)
 {
 	// Check if there are any available particles for the system to emit
-	if (m_firstDead >= m_maxParticles)
+	if (m_firstDead >= m_maxParticles || m_instanceData == nullptr)
 		return;
 
-	// Return a dead particle to our available list
-	Particle& particle = m_particles[m_firstDead++];
-
-	// Reset the position of the returned particle
-	particle.position = m_position;
+	float lifespan = Random() * (m_lifespanMax - m_lifespanMin) + m_lifespanMin;
 
-	// Reset the lifspan of the returned particle
-	particle.lifetime = 0;
-	particle.lifespan = (rand() / (float)RAND_MAX) * 
-		(m_lifespanMax - m_lifespanMin) + m_lifespanMin;
+	// It would already have died
+	if (_elapsed >= lifespan)
+		return;
 
-	// Reset the velocity of the returned particle
-	float velocity = (rand() / (float)RAND_MAX) *
-		(m_velocityMax - m_velocityMin) + m_velocityMin;
+	// Return a dead particle to our available list
+	unsigned int i = m_firstDead++;
+
+	float velocity = Random() * (m_velocityMax - m_velocityMin) + m_velocityMin;
+
+	glm::vec3 direction(Random() * 2 - 1, Random() * 2 - 1, Random() * 2 - 1);
+	float length = glm::length(direction);
+	direction = length > 0 ? direction * (velocity / length) : glm::vec3(0, velocity, 0);
+	direction += m_gravity * _elapsed;
+
+	glm::vec3 position = m_position + direction * _elapsed;
+
+	m_particles.positionX[i] = position.x;
+	m_particles.positionY[i] = position.y;
+	m_particles.positionZ[i] = position.z;
+	m_particles.velocityX[i] = direction.x;
+	m_particles.velocityY[i] = direction.y;
+	m_particles.velocityZ[i] = direction.z;
+	m_particles.ageRate[i] = 1.0f / glm::max(lifespan, 0.0001f);
+	m_particles.age[i] = _elapsed * m_particles.ageRate[i];
+
+	float age = m_particles.age[i];
+	m_instanceData[i].position = position;
+	m_instanceData[i].size = glm::mix(m_startSize, m_endSize, age);
+	m_instanceData[i].color = PackColor(glm::mix(m_startColor, m_endColor, age));
+}
 
-	// Reset the color of the returned particle
-	particle.color = m_startColor;
+void ParticleEmitter::Update(float _dt)
+{
+	// This will move and update all of the alive particles, writing each
+	// one's instance as it goes. Then it will remove the dead particles
+	// and emit every particle that came due during the frame
 
-	// Reset the size of the returned particle
-	particle.size = m_startSize;
+	// It has no storage until a particle system gives it some
+	if (m_instanceData == nullptr)
+		return;
 
-	particle.velocity.x = (rand() / (float)RAND_MAX) * 2 - 1;
-	particle.velocity.y = (rand() / (float)RAND_MAX) * 2 - 1;
-	particle.velocity.z = (rand() / (float)RAND_MAX) * 2 - 1;
+	ParticleArrays& p = m_particles;
 
-	particle.velocity = glm::normalize(particle.velocity) * velocity;
-}
+#ifdef PARTICLES_USE_SSE
+	const __m128 dt = _mm_set1_ps(_dt);
+	const __m128 gravityX = _mm_set1_ps(m_gravity.x * _dt);
+	const __m128 gravityY = _mm_set1_ps(m_gravity.y * _dt);
+	const __m128 gravityZ = _mm_set1_ps(m_gravity.z * _dt);
 
-void ParticleEmitter::Update(float _dt, const glm::mat4& _cameraTransform)
-{
-	// This will move t=and update all of the alive particles
-	// This it will remove the dead particles
-	// It will then emit the particles based on the emitter's provided rate
-	// Finally we will then update the vertex array and setup our billboarding
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1);
 
-	m_emitTimer += _dt;
+	const __m128 startSize = _mm_set1_ps(m_startSize);
+	const __m128 sizeRange = _mm_set1_ps(m_endSize - m_startSize);
 
-	// Spawn the paricles
-	if (m_emitTimer >= m_emitRate)
+	// the colour mixed straight in to [0, 255]
+	glm::vec4 startColor = glm::clamp(m_startColor, 0.0f, 1.0f) * 255.0f + 0.5f;
+	glm::vec4 colorRange = (glm::clamp(m_endColor, 0.0f, 1.0f) - glm::clamp(m_startColor, 0.0f, 1.0f)) * 255.0f;
+	__m128 startChannel[4], channelRange[4];
+	for (int c = 0; c < 4; c++)
 	{
-		Emit();
-		m_emitTimer -= m_emitRate;
+		startChannel[c] = _mm_set1_ps(startColor[c]);
+		channelRange[c] = _mm_set1_ps(colorRange[c]);
 	}
 
-	unsigned int quad = 0;
-
-	// This will update all the particles and make sure they work as billboarding quads
-
-	for (unsigned int i = 0; i < m_firstDead; i++)
+	for (unsigned int i = 0; i < m_firstDead; i += 4)
 	{
-		Particle* particle = &m_particles[i];
+		__m128 age = _mm_add_ps(_mm_loadu_ps(p.age + i), _mm_mul_ps(_mm_loadu_ps(p.ageRate + i), dt));
+		_mm_storeu_ps(p.age + i, age);
 
-		particle->lifetime += _dt;
-		if (particle->lifetime >= particle->lifespan)
+		__m128 vx = _mm_loadu_ps(p.velocityX + i);
+		__m128 vy = _mm_loadu_ps(p.velocityY + i);
+		__m128 vz = _mm_loadu_ps(p.velocityZ + i);
+		if (m_hasGravity)
 		{
-			*particle = m_particles[m_firstDead - 1];
-			m_firstDead--;
+			vx = _mm_add_ps(vx, gravityX);
+			vy = _mm_add_ps(vy, gravityY);
+			vz = _mm_add_ps(vz, gravityZ);
+			_mm_storeu_ps(p.velocityX + i, vx);
+			_mm_storeu_ps(p.velocityY + i, vy);
+			_mm_storeu_ps(p.velocityZ + i, vz);
 		}
-		else
-		{
-			// This will need to be changed to use gravity
-			particle->position += particle->velocity * _dt;
-
-			// Set the scale of the particle
-			particle->size = glm::mix(m_startSize, m_endSize, 
-				particle->lifetime / particle->lifespan);
-
-			// Set the color of the particle
-			particle->color = glm::mix(m_startColor, m_endColor, 
-				particle->lifetime / particle->lifespan);
-
-			// Finally to set up the quad using correct position, color and scale
-			float halfSize = particle->size * 0.5f;
-
-			m_vertexData[quad * 4].position = glm::vec4(halfSize, halfSize, 0, 1);
-			m_vertexData[quad * 4].color = particle->color;
 
-			m_vertexData[quad * 4 + 1].position = glm::vec4(-halfSize, halfSize, 0, 1);
-			m_vertexData[quad * 4 + 1].color = particle->color;
+		__m128 px = _mm_add_ps(_mm_loadu_ps(p.positionX + i), _mm_mul_ps(vx, dt));
+		__m128 py = _mm_add_ps(_mm_loadu_ps(p.positionY + i), _mm_mul_ps(vy, dt));
+		__m128 pz = _mm_add_ps(_mm_loadu_ps(p.positionZ + i), _mm_mul_ps(vz, dt));
+		_mm_storeu_ps(p.positionX + i, px);
+		_mm_storeu_ps(p.positionY + i, py);
+		_mm_storeu_ps(p.positionZ + i, pz);
 
-			m_vertexData[quad * 4 + 2].position = glm::vec4(-halfSize, -halfSize, 0, 1);
-			m_vertexData[quad * 4 + 2].color = particle->color;
+		// Dead particles are past 1, clamped so their colour stays in range
+		__m128 t = _mm_min_ps(_mm_max_ps(age, zero), one);
+		__m128 size = _mm_add_ps(startSize, _mm_mul_ps(sizeRange, t));
 
-			m_vertexData[quad * 4 + 3].position = glm::vec4(halfSize, -halfSize, 0, 1);
-			m_vertexData[quad * 4 + 3].color = particle->color;
-
-			// Set up our billboard's transform
-			glm::vec3 zAxis = glm::normalize(glm::vec3(_cameraTransform[3]) - particle->position);
-			glm::vec3 xAxis = glm::cross(glm::vec3(_cameraTransform[1]), zAxis);
-			glm::vec3 yAxis = glm::cross(zAxis, xAxis);
+		__m128i color = _mm_setzero_si128();
+		for (int c = 0; c < 4; c++)
+		{
+			__m128i channel = _mm_cvttps_epi32(_mm_add_ps(startChannel[c], _mm_mul_ps(channelRange[c], t)));
+			color = _mm_or_si128(color, _mm_slli_epi32(channel, c * 8));
+		}
 
-			glm::mat4 billboard(glm::vec4(xAxis, 0),
-								glm::vec4(yAxis, 0),
-								glm::vec4(zAxis, 0),
-								glm::vec4(0, 0, 0, 1));
+		// Rows of x, y, z and size become a vec4 per particle
+		_MM_TRANSPOSE4_PS(px, py, pz, size);
+		ParticleInstance* instance = m_instanceData + i;
+		_mm_storeu_ps(&instance[0].position.x, px);
+		_mm_storeu_ps(&instance[1].position.x, py);
+		_mm_storeu_ps(&instance[2].position.x, pz);
+		_mm_storeu_ps(&instance[3].position.x, size);
+
+		unsigned int colors[4];
+		_mm_storeu_si128((__m128i*)colors, color);
+		instance[0].color = colors[0];
+		instance[1].color = colors[1];
+		instance[2].color = colors[2];
+		instance[3].color = colors[3];
+	}
+#else
+	glm::vec3 gravity = m_gravity * _dt;
 
-			m_vertexData[quad * 4].position = billboard *
-				m_vertexData[quad * 4].position + glm::vec4(particle->position, 0);
-			m_vertexData[quad * 4 + 1].position = billboard *
-				m_vertexData[quad * 4 + 1].position + glm::vec4(particle->position, 0);
-			m_vertexData[quad * 4 + 2].position = billboard *
-				m_vertexData[quad * 4 + 2].position + glm::vec4(particle->position, 0);
-			m_vertexData[quad * 4 + 3].position = billboard *
-				m_vertexData[quad * 4 + 3].position + glm::vec4(particle->position, 0);
+	for (unsigned int i = 0; i < m_firstDead; i++)
+	{
+		p.age[i] += p.ageRate[i] * _dt;
 
-			++quad;
+		if (m_hasGravity)
+		{
+			p.velocityX[i] += gravity.x;
+			p.velocityY[i] += gravity.y;
+			p.velocityZ[i] += gravity.z;
 		}
-	}
 
+		p.positionX[i] += p.velocityX[i] * _dt;
+		p.positionY[i] += p.velocityY[i] * _dt;
+		p.positionZ[i] += p.velocityZ[i] * _dt;
 
-}
+		float t = glm::clamp(p.age[i], 0.0f, 1.0f);
+		m_instanceData[i].position = glm::vec3(p.positionX[i], p.positionY[i], p.positionZ[i]);
+		m_instanceData[i].size = glm::mix(m_startSize, m_endSize, t);
+		m_instanceData[i].color = PackColor(glm::mix(m_startColor, m_endColor, t));
+	}
+#endif
 
-void ParticleEmitter::Draw()
-{
-	if (!m_visible)
-		return;
+	// Remove the dead particles, the last live one takes each one's place
+	for (unsigned int i = 0; i < m_firstDead;)
+	{
+		if (p.age[i] >= 1)
+			MoveParticle(--m_firstDead, i);
+		else
+			i++;
+	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, m_firstDead * 4 * sizeof(ParticleVertex), m_vertexData);
-	glBindVertexArray(m_vao);
-	glDrawElements(GL_TRIANGLES, m_firstDead * 6, GL_UNSIGNED_INT, 0);
+	// Spawn the particles, oldest first, each moved on by how long ago it
+	// was due so a high rate gives a stream rather than a burst per frame
+	m_emitTimer += _dt;
+	if (m_emitTimer >= m_emitRate)
+	{
+		unsigned int due = (unsigned int)(m_emitTimer / m_emitRate);
+		m_emitTimer -= due * m_emitRate;
 
-	aie::Gizmos::addCylinderFilled(m_position, 0.2f, .5, 8, m_startColor);
+		for (unsigned int i = 0; i < due && m_firstDead < m_maxParticles; i++)
+			Emit(m_emitTimer + (due - 1 - i) * m_emitRate);
+	}
 }
 
 void ParticleEmitter::SetColor(glm::vec4 color)
@@ -250,3 +250,21 @@ void ParticleEmitter::SetColor(glm::vec4 color)
 	m_startColor = tempColor;
 	m_endColor = tempColor;
 }
+
+void ParticleEmitter::MoveParticle(unsigned int _from, unsigned int _to)
+{
+	float** arrays = (float**)&m_particles;
+	for (unsigned int a = 0; a < PARTICLE_ARRAY_COUNT; a++)
+		arrays[a][_to] = arrays[a][_from];
+
+	m_instanceData[_to] = m_instanceData[_from];
+}
+
+float ParticleEmitter::Random()
+{
+	// xorshift32
+	m_randomState ^= m_randomState << 13;
+	m_randomState ^= m_randomState >> 17;
+	m_randomState ^= m_randomState << 5;
+	return (m_randomState >> 8) * (1.0f / 16777215.0f);
+}
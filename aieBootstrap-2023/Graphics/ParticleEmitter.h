@@ -2,25 +2,44 @@
 #define GLM_ENABLE_EXPERIMENTAL
 
 #include <glm/ext.hpp>
-#include <gl_core_4_4.h>
 
-struct Particle {
-	glm::vec3 position;
-	glm::vec3 velocity;
-	glm::vec4 color;
+// how an emitter's particles are blended, the particle system draws each
+// with one call
+enum eParticleBlend : unsigned int {
+	PARTICLE_BLEND_ALPHA,		// sorted back to front when the system sorts
+	PARTICLE_BLEND_ADDITIVE,	// order doesn't matter, so never sorted
+	PARTICLE_BLEND_COUNT
+};
 
-	float size;
-	float lifespan;
-	float lifetime;
+// the particles' state, an array per attribute so they can be updated four
+// at a time. Size and colour come from age, so they aren't stored
+struct ParticleArrays {
+	float* positionX;
+	float* positionY;
+	float* positionZ;
+	float* velocityX;
+	float* velocityY;
+	float* velocityZ;
+	float* age;		// 0 when emitted, dead at 1
+	float* ageRate;	// 1 / lifespan
 };
 
-struct ParticleVertex {
-	glm::vec4 position;
-	glm::vec4 color;
+static const unsigned int PARTICLE_ARRAY_COUNT = sizeof(ParticleArrays) / sizeof(float*);
+
+// what each live particle uploads, the vertex shader expands it in to a quad
+// facing the camera
+struct ParticleInstance {
+	glm::vec3 position;
+	float size;
+	unsigned int color;	// rgba8
 };
 
+// simulates a stream of particles. Their storage belongs to the
+// ParticleSystem that creates the emitter, which also draws them
 class ParticleEmitter
 {
+	friend class ParticleSystem;
+
 public:
 	ParticleEmitter();
 	ParticleEmitter(unsigned int _maxParticles, unsigned int _emitRate,
@@ -34,27 +53,45 @@ public:
 		float _velocityMax, float _startSize, float _endSize,
 		const glm::vec4& _startColor, const glm::vec4& _endColor);
 
-	void Emit();
-	void Update(float _dt, const glm::mat4& _cameraTransform);
-	void Draw();
+	// emits one particle, moved on by how long ago it was due
+	void Emit(float _elapsed = 0);
+
+	// ages and moves the particles, then emits every one due this frame
+	void Update(float _dt);
 
 	// Setters
 	void SetPosition(glm::vec3 position) { m_position = position; }
 	void SetColor(glm::vec4 color);
+	void SetGravity(glm::vec3 gravity) { m_gravity = gravity; m_hasGravity = gravity != glm::vec3(0); }
+	void SetBlend(eParticleBlend blend) { m_blend = blend; }
 
 	// Getters
 	bool* Visible() { return &m_visible; }
+	bool IsVisible() const { return m_visible; }
+	glm::vec3 GetPosition() const { return m_position; }
+	glm::vec4 GetStartColor() const { return m_startColor; }
+	eParticleBlend GetBlend() const { return m_blend; }
+	unsigned int GetParticleCount() const { return m_firstDead; }
+	unsigned int GetMaxParticles() const { return m_maxParticles; }
 
 protected:
-	Particle* m_particles;
+	// points the emitter at its part of the system's pool, room for
+	// m_maxParticles rounded up to a multiple of 4
+	void SetStorage(const ParticleArrays& _particles, ParticleInstance* _instances);
+
+	// moves particle from in to slot to
+	void MoveParticle(unsigned int _from, unsigned int _to);
+
+	// a fast generator in [0, 1], rand is too slow at the rates this emits
+	float Random();
+
+	ParticleArrays m_particles;
+	ParticleInstance* m_instanceData;
 	unsigned int m_firstDead;
 	unsigned int m_maxParticles;
 
-	unsigned int m_vao, m_vbo, m_ibo;
-	ParticleVertex* m_vertexData;
-
 	glm::vec3 m_position;
-	
+
 	float m_emitTimer;
 	float m_emitRate;
 
@@ -73,5 +110,9 @@ protected:
 	glm::vec3 m_gravity = { 0, 0, 0 };
 	bool m_hasGravity = false;
 
+	eParticleBlend m_blend = PARTICLE_BLEND_ALPHA;
+
 	bool m_visible = true;
-};
\ No newline at end of file
+
+	unsigned int m_randomState = 0x9E3779B9u;
+};
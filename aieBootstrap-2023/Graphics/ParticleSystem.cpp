@@ -0,0 +1,301 @@
+#include "ParticleSystem.h"
+#include "JobSystem.h"
+#include <gl_core_4_4.h>
+#include <algorithm>
+#include <cstring>
+
+// particles per gather task, enough that each is worth handing to a thread
+static const unsigned int GATHER_CHUNK_SIZE = 16384;
+
+ParticleSystem::ParticleSystem(unsigned int _capacity, aie::JobSystem* _jobSystem) :
+	m_jobSystem(_jobSystem), m_vao(0), m_vbo(0)
+{
+	// Every emitter's slice starts on a multiple of 4 so they can all
+	// update four at a time
+	m_capacity = (_capacity + 3) & ~3u;
+	m_particleData = new float[m_capacity * PARTICLE_ARRAY_COUNT]();
+	m_instanceData = new ParticleInstance[m_capacity]();
+
+	FreeRange all = { 0, m_capacity };
+	m_freeRanges.push_back(all);
+
+	// One buffer shared by every emitter, refilled each frame
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+
+	glGenBuffers(1, &m_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, m_capacity * sizeof(ParticleInstance), nullptr, GL_STREAM_DRAW);
+
+	// The position and size of the particle for their shader
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), 0);
+	glVertexAttribDivisor(0, 1);
+
+	// The color of the particle for their shader
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ParticleInstance), ((char*)0) + 16);
+	glVertexAttribDivisor(1, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+ParticleSystem::~ParticleSystem()
+{
+	for each (const EmitterSlot& slot in m_emitters)
+		delete slot.emitter;
+
+	delete[] m_particleData;
+	delete[] m_instanceData;
+
+	glDeleteVertexArrays(1, &m_vao);
+	glDeleteBuffers(1, &m_vbo);
+}
+
+ParticleEmitter* ParticleSystem::CreateEmitter(unsigned int _maxParticles, unsigned int _emitRate,
+	float _lifespanMin, float _lifespanMax, float _velocityMin, float _velocityMax,
+	float _startSize, float _endSize, const glm::vec4& _startColor, const glm::vec4& _endColor,
+	eParticleBlend _blend)
+{
+	unsigned int size = (_maxParticles + 3) & ~3u;
+	unsigned int offset = 0;
+	if (size == 0 || !Allocate(size, offset))
+		return nullptr;
+
+	ParticleEmitter* emitter = new ParticleEmitter(_maxParticles, _emitRate, _lifespanMin, _lifespanMax,
+		_velocityMin, _velocityMax, _startSize, _endSize, _startColor, _endColor);
+	emitter->SetBlend(_blend);
+
+	// Its slice of each of the pool's arrays
+	ParticleArrays arrays;
+	float** array = (float**)&arrays;
+	for (unsigned int a = 0; a < PARTICLE_ARRAY_COUNT; a++)
+		array[a] = m_particleData + a * m_capacity + offset;
+	emitter->SetStorage(arrays, m_instanceData + offset);
+
+	EmitterSlot slot = { emitter, offset, size };
+	m_emitters.push_back(slot);
+
+	return emitter;
+}
+
+void ParticleSystem::DestroyEmitter(ParticleEmitter* _emitter)
+{
+	for (auto it = m_emitters.begin(); it != m_emitters.end(); ++it)
+	{
+		if (it->emitter == _emitter)
+		{
+			Free(it->offset, it->size);
+			delete it->emitter;
+			m_emitters.erase(it);
+			return;
+		}
+	}
+}
+
+void ParticleSystem::Update(float _dt)
+{
+	// Emitters only touch their own slice, so they can all update at once
+	ParallelFor((unsigned int)m_emitters.size(), [&](unsigned int i) {
+		m_emitters[i].emitter->Update(_dt);
+	});
+}
+
+void ParticleSystem::Draw(const glm::mat4& _cameraTransform)
+{
+	m_drawCalls = 0;
+
+	unsigned int total = 0;
+	for each (const EmitterSlot& slot in m_emitters)
+	{
+		if (slot.emitter->IsVisible())
+			total += slot.emitter->GetParticleCount();
+	}
+	if (total == 0)
+		return;
+
+	glm::vec3 cameraPosition = glm::vec3(_cameraTransform[3]);
+	glm::vec3 cameraForward = -glm::vec3(_cameraTransform[2]);
+
+	// Invalidated so the driver hands back fresh memory rather than waiting
+	// for last frame's draw to finish with it
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	ParticleInstance* buffer = (ParticleInstance*)glMapBufferRange(GL_ARRAY_BUFFER, 0,
+		total * sizeof(ParticleInstance), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (buffer == nullptr)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return;
+	}
+
+	// Each blend mode's particles one after the other
+	unsigned int first[PARTICLE_BLEND_COUNT], count[PARTICLE_BLEND_COUNT];
+	unsigned int offset = 0;
+	for (unsigned int b = 0; b < PARTICLE_BLEND_COUNT; b++)
+	{
+		first[b] = offset;
+		count[b] = Gather(buffer + offset, (eParticleBlend)b,
+			m_sorting && b == PARTICLE_BLEND_ALPHA, cameraPosition, cameraForward);
+		offset += count[b];
+	}
+
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Blended over what's drawn, without hiding each other
+	GLboolean blendEnabled = glIsEnabled(GL_BLEND);
+	GLboolean depthMask = GL_TRUE;
+	int src = GL_ONE, dst = GL_ZERO;
+	glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+	glGetIntegerv(GL_BLEND_SRC, &src);
+	glGetIntegerv(GL_BLEND_DST, &dst);
+
+	if (blendEnabled == GL_FALSE)
+		glEnable(GL_BLEND);
+	glDepthMask(GL_FALSE);
+
+	// Four corners per particle, the vertex shader builds each quad
+	glBindVertexArray(m_vao);
+	for (unsigned int b = 0; b < PARTICLE_BLEND_COUNT; b++)
+	{
+		if (count[b] == 0)
+			continue;
+
+		if (b == PARTICLE_BLEND_ADDITIVE)
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+		else
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+		glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4, count[b], first[b]);
+		m_drawCalls++;
+	}
+	glBindVertexArray(0);
+
+	glDepthMask(depthMask);
+	glBlendFunc(src, dst);
+	if (blendEnabled == GL_FALSE)
+		glDisable(GL_BLEND);
+}
+
+unsigned int ParticleSystem::GetParticleCount() const
+{
+	unsigned int count = 0;
+	for each (const EmitterSlot& slot in m_emitters)
+		count += slot.emitter->GetParticleCount();
+	return count;
+}
+
+bool ParticleSystem::Allocate(unsigned int _size, unsigned int& _offset)
+{
+	for (auto it = m_freeRanges.begin(); it != m_freeRanges.end(); ++it)
+	{
+		if (it->size < _size)
+			continue;
+
+		_offset = it->offset;
+		it->offset += _size;
+		it->size -= _size;
+		if (it->size == 0)
+			m_freeRanges.erase(it);
+		return true;
+	}
+	return false;
+}
+
+void ParticleSystem::Free(unsigned int _offset, unsigned int _size)
+{
+	// Kept in order so neighbouring ranges can merge
+	auto it = m_freeRanges.begin();
+	while (it != m_freeRanges.end() && it->offset < _offset)
+		++it;
+
+	FreeRange range = { _offset, _size };
+	it = m_freeRanges.insert(it, range);
+
+	auto next = it + 1;
+	if (next != m_freeRanges.end() && it->offset + it->size == next->offset)
+	{
+		it->size += next->size;
+		m_freeRanges.erase(next);
+	}
+	if (it != m_freeRanges.begin())
+	{
+		auto previous = it - 1;
+		if (previous->offset + previous->size == it->offset)
+		{
+			previous->size += it->size;
+			m_freeRanges.erase(it);
+		}
+	}
+}
+
+void ParticleSystem::ParallelFor(unsigned int _count, const std::function<void(unsigned int)>& _task)
+{
+	if (m_jobSystem != nullptr)
+	{
+		m_jobSystem->parallelFor(_count, _task);
+		return;
+	}
+
+	for (unsigned int i = 0; i < _count; i++)
+		_task(i);
+}
+
+unsigned int ParticleSystem::Gather(ParticleInstance* _buffer, eParticleBlend _blend,
+	bool _sort, const glm::vec3& _cameraPosition, const glm::vec3& _cameraForward)
+{
+	// Where each visible emitter's particles go, in runs for the threads
+	m_gatherTasks.clear();
+	unsigned int count = 0;
+	for each (const EmitterSlot& slot in m_emitters)
+	{
+		if (!slot.emitter->IsVisible() || slot.emitter->GetBlend() != _blend)
+			continue;
+
+		unsigned int particles = slot.emitter->GetParticleCount();
+		for (unsigned int start = 0; start < particles; start += GATHER_CHUNK_SIZE)
+		{
+			GatherTask task = { slot.offset + start, count + start,
+				std::min(GATHER_CHUNK_SIZE, particles - start) };
+			m_gatherTasks.push_back(task);
+		}
+		count += particles;
+	}
+
+	if (!_sort)
+	{
+		ParallelFor((unsigned int)m_gatherTasks.size(), [&](unsigned int t) {
+			const GatherTask& task = m_gatherTasks[t];
+			memcpy(_buffer + task.destination, m_instanceData + task.source, task.count * sizeof(ParticleInstance));
+		});
+		return count;
+	}
+
+	// The distance of each along the view, then the farthest drawn first
+	glm::vec4 depthPlane(_cameraForward, -glm::dot(_cameraForward, _cameraPosition));
+	m_sortKeys.resize(m_capacity);
+	m_sortSources.resize(count);
+	ParallelFor((unsigned int)m_gatherTasks.size(), [&](unsigned int t) {
+		const GatherTask& task = m_gatherTasks[t];
+		aie::DepthSort::computeKeys(&m_instanceData[task.source].position.x, sizeof(ParticleInstance),
+			task.count, depthPlane, m_sortKeys.data() + task.source);
+		for (unsigned int i = 0; i < task.count; i++)
+			m_sortSources[task.destination + i] = task.source + i;
+	});
+
+	// Sorted by slot, so the last frame's order still fits after particles
+	// die or are swapped in to their emitter's gaps
+	const unsigned int* order = m_amortisedSorting ?
+		m_depthSort.resort(m_sortKeys.data(), m_sortSources.data(), count, m_resortBudget) :
+		m_depthSort.sort(m_sortKeys.data(), m_sortSources.data(), count);
+
+	unsigned int chunks = (count + GATHER_CHUNK_SIZE - 1) / GATHER_CHUNK_SIZE;
+	ParallelFor(chunks, [&](unsigned int c) {
+		unsigned int end = std::min((c + 1) * GATHER_CHUNK_SIZE, count);
+		for (unsigned int i = c * GATHER_CHUNK_SIZE; i < end; i++)
+			_buffer[i] = m_instanceData[order[i]];
+	});
+
+	return count;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "ParticleEmitter.h"
+#include "DepthSort.h"
+#include <functional>
+#include <vector>
+
+namespace aie { class JobSystem; }
+
+// owns every emitter's particles in one pool, and draws them all from one
+// streaming buffer with a draw call per blend mode
+class ParticleSystem
+{
+public:
+	// capacity is the particles shared between all the emitters. Emitters
+	// update on the job system's threads when there is one
+	ParticleSystem(unsigned int _capacity, aie::JobSystem* _jobSystem = nullptr);
+	virtual ~ParticleSystem();
+
+	// an emitter with its particles in the pool, or nullptr if there isn't
+	// room left for them. The system owns it
+	ParticleEmitter* CreateEmitter(unsigned int _maxParticles, unsigned int _emitRate,
+		float _lifespanMin, float _lifespanMax, float _velocityMin,
+		float _velocityMax, float _startSize, float _endSize,
+		const glm::vec4& _startColor, const glm::vec4& _endColor,
+		eParticleBlend _blend = PARTICLE_BLEND_ALPHA);
+	void DestroyEmitter(ParticleEmitter* _emitter);
+
+	void Update(float _dt);
+
+	// gathers the visible emitters' particles in to the buffer, the alpha
+	// blended ones sorted back to front across emitters when sorting is on,
+	// and draws them. The particle shader must be bound with CameraPosition
+	// and CameraUp
+	void Draw(const glm::mat4& _cameraTransform);
+
+	// Setters
+	void SetSorting(bool sorting) { m_sorting = sorting; }
+
+	// rather than sort from scratch each frame, refine the last frame's
+	// order moving at most the budget's particles. The order is kept by
+	// pool slot, which a particle holds until one in its emitter dies and
+	// the emitter's last particle is moved in to the gap, so it stays close
+	void SetAmortisedSorting(bool amortised) { m_amortisedSorting = amortised; }
+	void SetResortBudget(unsigned int budget) { m_resortBudget = budget; }
+
+	// Getters
+	bool* Sorting() { return &m_sorting; }
+	bool* AmortisedSorting() { return &m_amortisedSorting; }
+	unsigned int GetParticleCount() const;
+	unsigned int GetCapacity() const { return m_capacity; }
+	unsigned int GetDrawCalls() const { return m_drawCalls; }
+
+protected:
+	struct EmitterSlot {
+		ParticleEmitter* emitter;
+		unsigned int offset;	// in to the pool
+		unsigned int size;
+	};
+
+	// a run of particles to gather, emitters are split in to several so
+	// one big emitter still spreads over the threads
+	struct GatherTask {
+		unsigned int source;		// in to the pool
+		unsigned int destination;	// in to this frame's buffer
+		unsigned int count;
+	};
+
+	struct FreeRange {
+		unsigned int offset;
+		unsigned int size;
+	};
+
+	// first fit from the free ranges, returning false if none is big enough
+	bool Allocate(unsigned int _size, unsigned int& _offset);
+	void Free(unsigned int _offset, unsigned int _size);
+
+	// on the job system when there is one, otherwise in order
+	void ParallelFor(unsigned int _count, const std::function<void(unsigned int)>& _task);
+
+	// writes the particles of one blend mode in to the mapped buffer,
+	// returning how many there were
+	unsigned int Gather(ParticleInstance* _buffer, eParticleBlend _blend,
+		bool _sort, const glm::vec3& _cameraPosition, const glm::vec3& _cameraForward);
+
+	aie::JobSystem* m_jobSystem;
+
+	unsigned int m_capacity;
+	float* m_particleData;
+	ParticleInstance* m_instanceData;
+
+	std::vector<EmitterSlot> m_emitters;
+	std::vector<FreeRange> m_freeRanges;
+	std::vector<GatherTask> m_gatherTasks;
+
+	// the depth of each sorted particle by pool slot, and the slots gathered
+	aie::DepthSort m_depthSort;
+	std::vector<float> m_sortKeys;
+	std::vector<unsigned int> m_sortSources;
+
+	unsigned int m_vao, m_vbo;
+
+	bool m_sorting = true;
+	bool m_amortisedSorting = false;
+	unsigned int m_resortBudget = 1 << 16;
+	unsigned int m_drawCalls = 0;
+};
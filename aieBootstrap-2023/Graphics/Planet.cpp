@@ -1,6 +1,7 @@
 #include "Planet.h"
 
 #include <imgui.h>
+#include <cassert>
 
 using glm::vec3;
 using glm::vec4;
@@ -23,7 +24,9 @@ Planet::Planet(const char* planetName, float distanceFromParent,
 	m_colour = colour;
 
 	m_parent = nullptr;
-	m_transform = mat4(1);
+	m_hierarchy = nullptr;
+	m_node = TransformHierarchy::NO_NODE;
+	m_spin = mat4(1);
 
 	m_hasRing = false;
 	m_ringInnerRadius = 0;
@@ -39,15 +42,18 @@ Planet::~Planet()
 
 void Planet::Update(float deltaTime)
 {
+	assert(m_hierarchy != nullptr && "Planet must be attached to a hierarchy");
+
 	m_rotation += deltaTime * m_orbitSpeed;
 
+	// the hierarchy adds the parent's position
 	if (m_parent)
-		m_transform[3] = glm::translate(glm::translate(mat4(1), m_parent->GetPosition()),
+		m_hierarchy->SetLocal(m_node, glm::translate(mat4(1),
 			vec3(m_distanceFromParent * sin(m_rotation) * cos(m_orbitAngle),
 				 m_distanceFromParent * sin(m_rotation) * sin(m_orbitAngle),
-				 m_distanceFromParent * cos(m_rotation)))[3];
+				 m_distanceFromParent * cos(m_rotation))));
 
-	m_transform = glm::rotate(m_transform, deltaTime * m_rotationSpeed * 0.2f, vec3(1, 0, 0));
+	m_spin = glm::rotate(m_spin, deltaTime * m_rotationSpeed * 0.2f, vec3(1, 0, 0));
 
 	for each (Planet* child in m_children)
 	{
@@ -59,11 +65,12 @@ void Planet::Draw()
 {
 	if (m_visible)
 	{
-		vec3 pos = GetPosition();
+		mat4 transform = GetTransform();
+		vec3 pos = transform[3];
 
-		Gizmos::addSphere(pos, m_radius, 8, 8, m_colour, &m_transform);
+		Gizmos::addSphereInstanced(pos, m_radius, m_colour, &transform);
 		if (m_hasRing)
-			Gizmos::addRing(pos, m_ringInnerRadius, m_ringOuterRadius, 9, m_ringColour, &m_transform);
+			Gizmos::addRingInstanced(pos, m_ringInnerRadius, m_ringOuterRadius, m_ringColour, &transform);
 	}
 
 	for each (Planet * child in m_children)
@@ -84,6 +91,19 @@ void Planet::AddChild(Planet* child)
 {
 	m_children.push_back(child);
 	child->SetParent(this);
+	if (m_hierarchy)
+		child->Attach(m_hierarchy, m_node);
+}
+
+void Planet::Attach(TransformHierarchy* hierarchy, TransformHierarchy::Node parent)
+{
+	m_hierarchy = hierarchy;
+	m_node = hierarchy->AddNode(mat4(1), parent);
+
+	for each (Planet* child in m_children)
+	{
+		child->Attach(hierarchy, m_node);
+	}
 }
 
 void Planet::ImGui()
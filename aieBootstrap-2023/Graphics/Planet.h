@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Gizmos.h"
+#include "TransformHierarchy.h"
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 #include <vector>
@@ -20,16 +21,22 @@ public:
 
 	void AddChild(Planet* child);
 
+	// gives this planet and its children nodes in the hierarchy, which then
+	// works out their positions. Children added later are attached as well
+	void Attach(TransformHierarchy* hierarchy,
+		TransformHierarchy::Node parent = TransformHierarchy::NO_NODE);
+
 	void ImGui();
 
 	// Getters
-	glm::vec3 GetPosition() { return m_transform[3]; }
+	glm::vec3 GetPosition() { return m_hierarchy->GetWorld(m_node)[3]; }
+	TransformHierarchy::Node GetNode() { return m_node; }
 	std::string GetName() { return m_planetName; }
 	bool HasRing() { return m_hasRing; }
 
 	// Setters
 	void SetParent(Planet* parent) { m_parent = parent; }
-	glm::mat4 GetTransform() { return m_transform; }
+	glm::mat4 GetTransform() { return m_hierarchy->GetWorld(m_node) * m_spin; }
 
 protected:
 	std::string m_planetName;
@@ -37,7 +44,9 @@ protected:
 	std::vector<Planet*> m_children;
 	Planet* m_parent;
 
-	glm::mat4 m_transform;
+	TransformHierarchy* m_hierarchy;
+	TransformHierarchy::Node m_node;	// only moves with the orbit, children orbit it
+	glm::mat4 m_spin;					// the planet's own rotation, not passed on to children
 	float m_radius;
 	float m_distanceFromParent;
 
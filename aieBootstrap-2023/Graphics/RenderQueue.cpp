@@ -0,0 +1,101 @@
+#include "RenderQueue.h"
+#include <cstring>
+
+static const uint64_t DEPTH_MASK = (1 << 24) - 1;
+
+void RenderQueue::Add(uint64_t key, unsigned int index)
+{
+	Item item;
+	item.key = key;
+	item.index = index;
+	m_items.push_back(item);
+}
+
+void RenderQueue::Sort()
+{
+	size_t count = m_items.size();
+	if (count < 2)
+		return;
+
+	// count every byte of every key in one sweep
+	unsigned int histogram[8][256];
+	memset(histogram, 0, sizeof(histogram));
+	for (size_t i = 0; i < count; i++)
+	{
+		uint64_t key = m_items[i].key;
+		for (int pass = 0; pass < 8; pass++)
+			histogram[pass][(key >> (pass * 8)) & 0xff]++;
+	}
+
+	m_scratch.resize(count);
+	Item* source = m_items.data();
+	Item* destination = m_scratch.data();
+
+	for (int pass = 0; pass < 8; pass++)
+	{
+		unsigned int* counts = histogram[pass];
+		int shift = pass * 8;
+
+		// every key has the same byte here, so this pass wouldn't move anything
+		if (counts[(source[0].key >> shift) & 0xff] == count)
+			continue;
+
+		unsigned int offsets[256];
+		unsigned int total = 0;
+		for (int digit = 0; digit < 256; digit++)
+		{
+			offsets[digit] = total;
+			total += counts[digit];
+		}
+
+		for (size_t i = 0; i < count; i++)
+			destination[offsets[(source[i].key >> shift) & 0xff]++] = source[i];
+
+		Item* temp = source;
+		source = destination;
+		destination = temp;
+	}
+
+	if (source != m_items.data())
+		m_items.swap(m_scratch);
+}
+
+uint64_t RenderQueue::MakeOpaqueKey(unsigned int shader, unsigned int material,
+	unsigned int mesh, float depth)
+{
+	return ((uint64_t)(shader & (MAX_SHADERS - 1)) << 48)
+		| ((uint64_t)(material & (MAX_MATERIALS - 1)) << 40)
+		| ((uint64_t)(mesh & (MAX_MESHES - 1)) << 24)
+		| QuantiseDepth(depth);
+}
+
+uint64_t RenderQueue::MakeTransparentKey(unsigned int shader, unsigned int material,
+	unsigned int mesh, float depth)
+{
+	// inverting the depth puts the furthest draws first
+	return ((uint64_t)1 << 63)
+		| ((uint64_t)(DEPTH_MASK - QuantiseDepth(depth)) << 39)
+		| ((uint64_t)(shader & (MAX_SHADERS - 1)) << 24)
+		| ((uint64_t)(material & (MAX_MATERIALS - 1)) << 16)
+		| (uint64_t)(mesh & (MAX_MESHES - 1));
+}
+
+uint64_t RenderQueue::GetState(uint64_t key)
+{
+	if (IsTransparent(key))
+		return key & ~(DEPTH_MASK << 39);
+	return key & ~DEPTH_MASK;
+}
+
+uint32_t RenderQueue::QuantiseDepth(float depth)
+{
+	// behind the camera sorts as the nearest depth
+	if (!(depth > 0))
+		return 0;
+
+	// positive floats order the same as their bit patterns, so the top
+	// 24 of the 31 non-sign bits keep the order at any scale
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	return bits >> 7;
+}
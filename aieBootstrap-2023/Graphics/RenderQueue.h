@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A list of draws ordered by 64 bit sort keys. Opaque keys sort by shader,
+// then material, then mesh and finally front-to-back depth. Transparent keys
+// come after every opaque key and sort back-to-front before anything else.
+//
+// opaque:      | 0 | shader:15 | material:8 | mesh:16 | depth:24         |
+// transparent: | 1 | ~depth:24         | shader:15 | material:8 | mesh:16 |
+class RenderQueue
+{
+public:
+	struct Item
+	{
+		uint64_t key;
+		unsigned int index;	// the caller's draw this item stands for
+	};
+
+	void Clear() { m_items.clear(); }
+	void Add(uint64_t key, unsigned int index);
+
+	// LSD radix sort on the keys, a byte per pass
+	void Sort();
+
+	// Getters
+	const std::vector<Item>& GetItems() const { return m_items; }
+	std::size_t GetCount() const { return m_items.size(); }
+
+	static uint64_t MakeOpaqueKey(unsigned int shader, unsigned int material,
+		unsigned int mesh, float depth);
+	static uint64_t MakeTransparentKey(unsigned int shader, unsigned int material,
+		unsigned int mesh, float depth);
+
+	// the key with its depth removed, draws with equal state can share binds
+	static uint64_t GetState(uint64_t key);
+	static bool IsTransparent(uint64_t key) { return (key >> 63) != 0; }
+
+	// maps a view depth to 24 bits that keep its order, without needing a far plane
+	static uint32_t QuantiseDepth(float depth);
+
+	static const unsigned int MAX_SHADERS = 1 << 15;
+	static const unsigned int MAX_MATERIALS = 1 << 8;
+	static const unsigned int MAX_MESHES = 1 << 16;
+
+protected:
+	std::vector<Item> m_items;
+	std::vector<Item> m_scratch;
+};
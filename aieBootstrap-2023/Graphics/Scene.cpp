@@ -1,27 +1,304 @@
 #include "Scene.h"
 #include "Instance.h"
+#include "BaseCamera.h"
+#include "OBJMesh.h"
+#include "Shader.h"
 
 #include "Gizmos.h"
+#include "gl_core_4_4.h"
+#include <algorithm>
+#include <cassert>
+
+// instances whose mesh is still loading are drawn as a box this size,
+// in world units, around their origin
+static const float PLACEHOLDER_EXTENT = 0.5f;
+static const glm::vec4 PLACEHOLDER_COLOR(1, 0, 1, 1);
 
 Scene::Scene(BaseCamera* camera, glm::vec2 windowSize,
-	Light& light, glm::vec3 ambientLightColor) : 
+	Light& light, glm::vec3 ambientLightColor, TransformHierarchy* hierarchy) : 
 	m_camera(camera), m_windowSize(windowSize), m_light(light), 
-	m_ambientLightColor(ambientLightColor)
+	m_ambientLightColor(ambientLightColor), m_hierarchy(hierarchy)
 {
+	m_frameUniforms.create(sizeof(FrameUniforms));
+	m_drawUniforms.create(aie::UniformBuffer::alignSize(sizeof(DrawUniforms)) * 64);
 
+	glGenBuffers(1, &m_instanceBuffer);
+	glGenBuffers(1, &m_transformBuffer);
+	glGenTextures(1, &m_transformTexture);
 }
 
 Scene::~Scene()
 {
-	for (auto it = m_instances.begin(); it != m_instances.end(); it++)
+	for each (Instance* instance in m_instanceObjects)
+	{
+		delete instance;
+	}
+
+	glDeleteBuffers(1, &m_instanceBuffer);
+	glDeleteBuffers(1, &m_transformBuffer);
+	glDeleteTextures(1, &m_transformTexture);
+}
+
+Instance* Scene::AddInstance(glm::mat4 transform, aie::OBJMesh* mesh,
+	aie::ShaderProgram* shader, std::string name, bool hasTexture, aie::AssetHandle asset)
+{
+	InstanceHandle handle;
+	if (m_freeSlots.empty())
+	{
+		handle.slot = (unsigned int)m_slots.size();
+		m_slots.push_back(InstanceSlot());
+		m_slots.back().generation = 0;
+	}
+	else
+	{
+		handle.slot = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+
+	unsigned int index = (unsigned int)m_transforms.size();
+	m_slots[handle.slot].index = index;
+	handle.generation = m_slots[handle.slot].generation;
+
+	Instance* instance = new Instance(this, handle, name);
+
+	unsigned int meshID = GetMeshID(mesh);
+	if (asset.isReady() == false)
+	{
+		m_meshAssets[meshID] = asset;
+		m_meshStates[meshID] = (unsigned char)asset.getState();
+	}
+
+	// the world transform arrives when the hierarchy next updates
+	m_transforms.push_back(transform);
+	m_instanceNodes.push_back(m_hierarchy->AddNode(transform));
+	m_instanceMeshes.push_back((unsigned short)meshID);
+	m_instanceShaders.push_back((unsigned short)GetShaderID(shader));
+	m_flags.push_back(INSTANCE_VISIBLE | (hasTexture ? INSTANCE_HAS_TEXTURE : 0));
+	m_boundsX.push_back(0);
+	m_boundsY.push_back(0);
+	m_boundsZ.push_back(0);
+	m_boundsRadius.push_back(0);
+	m_instanceLods.push_back(0);
+	m_lodOverrides.push_back(-1);
+	m_instanceObjects.push_back(instance);
+	m_instanceSlots.push_back(handle.slot);
+
+	return instance;
+}
+
+Instance* Scene::AddInstance(glm::vec3 position, glm::vec3 eulerAngles, glm::vec3 scale,
+	aie::OBJMesh* mesh, aie::ShaderProgram* shader, std::string name, bool hasTexture, aie::AssetHandle asset)
+{
+	return AddInstance(Instance::MakeTransform(position, eulerAngles, scale),
+		mesh, shader, name, hasTexture, asset);
+}
+
+void Scene::RemoveInstance(InstanceHandle handle)
+{
+	unsigned int index = GetInstanceIndex(handle);
+	unsigned int last = (unsigned int)m_transforms.size() - 1;
+
+	delete m_instanceObjects[index];
+	m_hierarchy->RemoveNode(m_instanceNodes[index]);
+
+	// fill the hole with the last instance so the arrays stay packed
+	if (index != last)
+	{
+		m_transforms[index] = m_transforms[last];
+		m_instanceNodes[index] = m_instanceNodes[last];
+		m_instanceMeshes[index] = m_instanceMeshes[last];
+		m_instanceShaders[index] = m_instanceShaders[last];
+		// keep the hole's dirty bit, it already has an entry in m_dirty
+		m_flags[index] = (m_flags[last] & ~INSTANCE_DIRTY) | (m_flags[index] & INSTANCE_DIRTY);
+		m_boundsX[index] = m_boundsX[last];
+		m_boundsY[index] = m_boundsY[last];
+		m_boundsZ[index] = m_boundsZ[last];
+		m_boundsRadius[index] = m_boundsRadius[last];
+		m_instanceLods[index] = m_instanceLods[last];
+		m_lodOverrides[index] = m_lodOverrides[last];
+		m_instanceObjects[index] = m_instanceObjects[last];
+		m_instanceSlots[index] = m_instanceSlots[last];
+		m_slots[m_instanceSlots[index]].index = index;
+
+		// its GPU copy is now in the wrong place
+		MarkDirty(index);
+	}
+
+	m_transforms.pop_back();
+	m_instanceNodes.pop_back();
+	m_instanceMeshes.pop_back();
+	m_instanceShaders.pop_back();
+	m_flags.pop_back();
+	m_boundsX.pop_back();
+	m_boundsY.pop_back();
+	m_boundsZ.pop_back();
+	m_boundsRadius.pop_back();
+	m_instanceLods.pop_back();
+	m_lodOverrides.pop_back();
+	m_instanceObjects.pop_back();
+	m_instanceSlots.pop_back();
+
+	// the last index may still be waiting in the dirty list
+	for (size_t i = 0; i < m_dirty.size();)
+	{
+		if (m_dirty[i] == last)
+		{
+			m_dirty[i] = m_dirty.back();
+			m_dirty.pop_back();
+		}
+		else
+			i++;
+	}
+
+	m_slots[handle.slot].generation++;
+	m_freeSlots.push_back(handle.slot);
+}
+
+bool Scene::IsValid(InstanceHandle handle)
+{
+	return handle.slot < m_slots.size() && m_slots[handle.slot].generation == handle.generation;
+}
+
+unsigned int Scene::GetInstanceIndex(InstanceHandle handle)
+{
+	assert(IsValid(handle) && "Instance handle is stale");
+	return m_slots[handle.slot].index;
+}
+
+void Scene::SetInstanceTransform(InstanceHandle handle, const glm::mat4& transform)
+{
+	m_hierarchy->SetLocal(GetInstanceNode(handle), transform);
+}
+
+void Scene::SetInstanceParent(InstanceHandle handle, TransformHierarchy::Node parent)
+{
+	m_hierarchy->SetParent(GetInstanceNode(handle), parent);
+}
+
+void Scene::SyncHierarchy()
+{
+	// picks up every update since the last sync, the hierarchy may have
+	// been updated more than once in between
+	unsigned int lastSync = m_hierarchyUpdate;
+	if (lastSync == m_hierarchy->GetUpdateCount())
+		return;
+	m_hierarchyUpdate = m_hierarchy->GetUpdateCount();
+
+	unsigned int count = (unsigned int)m_transforms.size();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (m_hierarchy->IsChangedSince(m_instanceNodes[i], lastSync))
+		{
+			m_transforms[i] = m_hierarchy->GetWorld(m_instanceNodes[i]);
+			MarkDirty(i);
+		}
+	}
+}
+
+void Scene::UpdateMeshAssets()
+{
+	unsigned int count = (unsigned int)m_transforms.size();
+	for (unsigned int id = 0; id < m_meshes.size(); id++)
 	{
-		delete* it;
+		if (m_meshStates[id] != aie::ASSET_PENDING)
+			continue;
+
+		m_meshStates[id] = (unsigned char)m_meshAssets[id].getState();
+		if (m_meshStates[id] == aie::ASSET_PENDING)
+			continue;
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (m_instanceMeshes[i] == id)
+				MarkDirty(i);
+		}
 	}
 }
 
-void Scene::AddInstance(Instance* instance)
+void Scene::SetInstanceFlag(InstanceHandle handle, InstanceFlags flag, bool value)
 {
-	m_instances.push_back(instance);
+	assert(flag != INSTANCE_DIRTY && "Dirty is tracked by the scene");
+	unsigned int index = GetInstanceIndex(handle);
+	if (value)
+		m_flags[index] |= flag;
+	else
+		m_flags[index] &= ~flag;
+}
+
+void Scene::MarkDirty(unsigned int index)
+{
+	if (m_flags[index] & INSTANCE_DIRTY)
+		return;
+	m_flags[index] |= INSTANCE_DIRTY;
+	m_dirty.push_back(index);
+}
+
+void Scene::UpdateDirtyInstances()
+{
+	// a bigger buffer starts empty, so everything goes up again
+	unsigned int count = (unsigned int)m_transforms.size();
+	if (count > m_transformCapacity)
+	{
+		m_transformCapacity = glm::max(count * 2, 64u);
+		glBindBuffer(GL_TEXTURE_BUFFER, m_transformBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, m_transformCapacity * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, m_transformTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_transformBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+		for (unsigned int i = 0; i < count; i++)
+			MarkDirty(i);
+	}
+
+	if (m_dirty.empty())
+		return;
+
+	std::sort(m_dirty.begin(), m_dirty.end());
+
+	for each (unsigned int index in m_dirty)
+	{
+		const glm::mat4& transform = m_transforms[index];
+		m_flags[index] &= ~INSTANCE_DIRTY;
+
+		// nothing is known of a mesh until it has loaded, so bound its placeholder
+		if (m_meshStates[m_instanceMeshes[index]] != aie::ASSET_READY)
+		{
+			m_boundsX[index] = transform[3].x;
+			m_boundsY[index] = transform[3].y;
+			m_boundsZ[index] = transform[3].z;
+			m_boundsRadius[index] = PLACEHOLDER_EXTENT * glm::sqrt(3.0f);
+			continue;
+		}
+
+		const aie::OBJMesh::Bounds& bounds = m_meshes[m_instanceMeshes[index]]->getBounds();
+		glm::vec3 center = glm::vec3(transform * glm::vec4(bounds.center, 1));
+
+		// a non-uniform scale stretches the sphere by its largest axis
+		float scale = glm::max(glm::length(glm::vec3(transform[0])),
+			glm::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+		m_boundsX[index] = center.x;
+		m_boundsY[index] = center.y;
+		m_boundsZ[index] = center.z;
+		m_boundsRadius[index] = bounds.radius * scale;
+	}
+
+	// upload runs of neighbouring dirty transforms with one call each
+	glBindBuffer(GL_TEXTURE_BUFFER, m_transformBuffer);
+	for (size_t first = 0; first < m_dirty.size();)
+	{
+		size_t last = first + 1;
+		while (last < m_dirty.size() && m_dirty[last] == m_dirty[last - 1] + 1)
+			last++;
+
+		unsigned int index = m_dirty[first];
+		glBufferSubData(GL_TEXTURE_BUFFER, index * sizeof(glm::mat4),
+			(last - first) * sizeof(glm::mat4), &m_transforms[index]);
+		first = last;
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	m_dirty.clear();
 }
 
 void Scene::Draw()
@@ -37,14 +314,353 @@ void Scene::Draw()
 			color = m_pointLights[i].color;
 		else
 			color = glm::vec3(m_pointLights[i].color[0] / scale, m_pointLights[i].color[1] / scale, m_pointLights[i].color[2] / scale);
-		aie::Gizmos::addSphere(m_pointLights[i].direction, 0.4f, 6, 8, glm::vec4(color, 1));
+		aie::Gizmos::addSphereInstanced(m_pointLights[i].direction, 0.4f, glm::vec4(color, 1));
 	}
 
-	for (auto it = m_instances.begin(); it != m_instances.end(); it++)
+	UpdateFrameUniforms();
+
+	glm::mat4 projectionView = m_camera->GetProjectionMatrix() * m_camera->GetViewMatrix();
+
+	m_renderStats = RenderStats();
+	SyncHierarchy();
+	UpdateMeshAssets();
+	UpdateDirtyInstances();
+	BuildDrawGroups(projectionView);
+
+	if (m_drawGroups.empty())
+		return;
+
+	// every group's DrawData and instance indices go up in one go
+	unsigned int stride = aie::UniformBuffer::alignSize(sizeof(DrawUniforms));
+	unsigned int offset = m_drawUniforms.append(m_drawData.data(), (unsigned int)m_drawData.size());
+	UploadInstanceIndices();
+
+	glActiveTexture(GL_TEXTURE0 + INSTANCE_TRANSFORM_SLOT);
+	glBindTexture(GL_TEXTURE_BUFFER, m_transformTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	SubmitDrawGroups(offset, stride);
+}
+
+unsigned int Scene::SelectLod(unsigned int index)
+{
+	aie::OBJMesh* mesh = m_meshes[m_instanceMeshes[index]];
+	unsigned int lodCount = mesh->getLodCount();
+
+	if (m_lodOverrides[index] >= 0)
+		return glm::min((unsigned int)m_lodOverrides[index], lodCount - 1);
+	if (m_forcedLod >= 0)
+		return glm::min((unsigned int)m_forcedLod, lodCount - 1);
+
+	float meshRadius = mesh->getBounds().radius;
+	if (lodCount == 1 || meshRadius <= 0)
+		return 0;
+
+	// the errors are in model space, the bounds were scaled in to world space with them
+	glm::vec3 center(m_boundsX[index], m_boundsY[index], m_boundsZ[index]);
+	float pixelsPerError = m_camera->GetProjectedRadius(center, m_boundsRadius[index]) *
+		m_windowSize.y / meshRadius;
+
+	unsigned int lod = glm::min((unsigned int)m_instanceLods[index], lodCount - 1);
+	if (mesh->getLodError(lod) * pixelsPerError > m_lodThreshold * (1 + m_lodHysteresis))
+	{
+		while (lod > 0 && mesh->getLodError(lod) * pixelsPerError > m_lodThreshold)
+			lod--;
+	}
+	else
+	{
+		while (lod + 1 < lodCount && mesh->getLodError(lod + 1) * pixelsPerError <= m_lodThreshold * (1 - m_lodHysteresis))
+			lod++;
+	}
+
+	m_instanceLods[index] = (unsigned char)lod;
+	return lod;
+}
+
+void Scene::BuildDrawGroups(const glm::mat4& projectionView)
+{
+	m_renderQueue.Clear();
+	m_drawList.clear();
+	m_drawLods.clear();
+	m_drawGroups.clear();
+	m_drawData.clear();
+	m_instanceIndices.clear();
+
+	unsigned int count = (unsigned int)m_transforms.size();
+	if (m_frustumCulling)
 	{
-		Instance* instance = *it;
-		instance->Draw(this);
+		Frustum frustum(projectionView);
+		m_cullVisible.resize(count);
+		frustum.CullSpheres(m_boundsX.data(), m_boundsY.data(), m_boundsZ.data(),
+			m_boundsRadius.data(), (int)count, m_cullVisible.data());
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (!(m_flags[i] & INSTANCE_VISIBLE))
+				continue;
+			if (m_cullVisible[i])
+				m_drawList.push_back(i);
+			else
+				m_renderStats.culled++;
+		}
+	}
+	else
+	{
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (m_flags[i] & INSTANCE_VISIBLE)
+				m_drawList.push_back(i);
+		}
 	}
+
+	glm::mat4 view = m_camera->GetViewMatrix();
+
+	for (unsigned int i = 0; i < m_drawList.size(); i++)
+	{
+		unsigned int index = m_drawList[i];
+		unsigned int meshState = m_meshStates[m_instanceMeshes[index]];
+		if (meshState != aie::ASSET_READY)
+		{
+			// the queue never sees it, a failed mesh isn't drawn at all
+			if (meshState == aie::ASSET_PENDING)
+			{
+				aie::Gizmos::addAABB(glm::vec3(m_transforms[index][3]), glm::vec3(PLACEHOLDER_EXTENT), PLACEHOLDER_COLOR);
+				m_renderStats.placeholders++;
+			}
+			m_drawLods.push_back(0);
+			continue;
+		}
+
+		unsigned int shader = m_instanceShaders[index];
+		unsigned int lod = SelectLod(index);
+		m_drawLods.push_back((unsigned char)lod);
+
+		// each level of detail is its own mesh as far as grouping goes
+		unsigned int mesh = m_instanceMeshes[index] * aie::OBJMesh::MAX_LODS + lod;
+		unsigned int material = (m_flags[index] & INSTANCE_HAS_TEXTURE) ? 1 : 0;
+		float depth = -(view * m_transforms[index][3]).z;
+
+		uint64_t key = (m_flags[index] & INSTANCE_TRANSPARENT)
+			? RenderQueue::MakeTransparentKey(shader, material, mesh, depth)
+			: RenderQueue::MakeOpaqueKey(shader, material, mesh, depth);
+
+		m_renderQueue.Add(key, i);
+	}
+	m_renderQueue.Sort();
+
+	// neighbouring items with the same state become a group, in queue
+	// order, so instancing keeps the depth ordering inside each group
+	const std::vector<RenderQueue::Item>& items = m_renderQueue.GetItems();
+	unsigned int stride = aie::UniformBuffer::alignSize(sizeof(DrawUniforms));
+	unsigned int drawCount = 0;
+
+	for (unsigned int first = 0; first < items.size();)
+	{
+		uint64_t state = RenderQueue::GetState(items[first].key);
+		unsigned int last = first + 1;
+		while (last < items.size() && RenderQueue::GetState(items[last].key) == state)
+			last++;
+
+		unsigned int index = m_drawList[items[first].index];
+
+		DrawGroup group;
+		group.mesh = m_meshes[m_instanceMeshes[index]];
+		group.shader = m_shaders[m_instanceShaders[index]];
+		group.instancedShader = GetInstancedShader(group.shader);
+		group.hasTexture = (m_flags[index] & INSTANCE_HAS_TEXTURE) != 0;
+		group.transparent = RenderQueue::IsTransparent(state);
+		group.lod = m_drawLods[items[first].index];
+		group.first = first;
+		group.count = last - first;
+		group.drawIndex = drawCount;
+		group.firstInstance = (unsigned int)m_instanceIndices.size();
+
+		if (group.instancedShader != nullptr)
+		{
+			// a single DrawData for the group, the transforms come from the buffer texture
+			m_drawData.resize((drawCount + 1) * stride);
+			DrawUniforms& uniforms = *(DrawUniforms*)&m_drawData[drawCount++ * stride];
+			uniforms.projectionViewModel = projectionView;
+			uniforms.modelMatrix = glm::mat4(1);
+			uniforms.hasTexture = group.hasTexture;
+
+			for (unsigned int i = first; i < last; i++)
+				m_instanceIndices.push_back(m_drawList[items[i].index]);
+		}
+		else
+		{
+			m_drawData.resize((drawCount + group.count) * stride);
+			for (unsigned int i = first; i < last; i++)
+			{
+				const glm::mat4& transform = m_transforms[m_drawList[items[i].index]];
+				DrawUniforms& uniforms = *(DrawUniforms*)&m_drawData[drawCount++ * stride];
+				uniforms.projectionViewModel = projectionView * transform;
+				uniforms.modelMatrix = transform;
+				uniforms.hasTexture = group.hasTexture;
+			}
+		}
+
+		m_drawGroups.push_back(group);
+		first = last;
+	}
+}
+
+void Scene::SubmitDrawGroups(unsigned int drawOffset, unsigned int drawStride)
+{
+	aie::ShaderProgram* boundShader = nullptr;
+	aie::OBJMesh::DrawState drawState;
+
+	// blend state to restore once the transparent draws are done
+	bool blending = false;
+	GLboolean blendEnabled = GL_FALSE;
+	GLboolean depthMask = GL_TRUE;
+	int src = GL_ONE, dst = GL_ZERO;
+
+	for each (const DrawGroup& group in m_drawGroups)
+	{
+		if (group.transparent && !blending)
+		{
+			blending = true;
+			blendEnabled = glIsEnabled(GL_BLEND);
+			glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+			glGetIntegerv(GL_BLEND_SRC, &src);
+			glGetIntegerv(GL_BLEND_DST, &dst);
+
+			if (blendEnabled == GL_FALSE)
+				glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glDepthMask(GL_FALSE);
+		}
+
+		aie::ShaderProgram* shader = group.instancedShader != nullptr ? group.instancedShader : group.shader;
+		if (shader != boundShader)
+		{
+			shader->bind();
+			boundShader = shader;
+			m_renderStats.shaderChanges++;
+		}
+
+		unsigned int chunks = (unsigned int)group.mesh->getChunkCount();
+		m_renderStats.instances += group.count;
+		m_renderStats.triangles += group.mesh->getTriangleCount(group.lod) * group.count;
+
+		if (group.instancedShader != nullptr)
+		{
+			m_drawUniforms.bindRange(DRAW_UNIFORM_BINDING, drawOffset + group.drawIndex * drawStride, sizeof(DrawUniforms));
+			group.mesh->drawInstanced(shader, m_instanceBuffer, group.firstInstance, group.count, group.lod, &drawState);
+			m_renderStats.drawCalls += chunks;
+			continue;
+		}
+
+		for (unsigned int i = 0; i < group.count; i++)
+		{
+			m_drawUniforms.bindRange(DRAW_UNIFORM_BINDING, drawOffset + (group.drawIndex + i) * drawStride, sizeof(DrawUniforms));
+			group.mesh->draw(shader, false, group.lod, &drawState);
+		}
+		m_renderStats.drawCalls += chunks * group.count;
+	}
+	m_renderStats.textureBinds += drawState.textureBinds;
+	m_renderStats.vertexArrayBinds += drawState.vertexArrayBinds;
+
+	if (blending)
+	{
+		glDepthMask(depthMask);
+		glBlendFunc(src, dst);
+		if (blendEnabled == GL_FALSE)
+			glDisable(GL_BLEND);
+	}
+}
+
+void Scene::UploadInstanceIndices()
+{
+	if (m_instanceIndices.empty())
+		return;
+
+	unsigned int size = (unsigned int)(m_instanceIndices.size() * sizeof(unsigned int));
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+	if (size > m_instanceBufferSize)
+		m_instanceBufferSize = size * 2;
+
+	// orphan last frame's indices rather than wait on draws still reading them
+	glBufferData(GL_ARRAY_BUFFER, m_instanceBufferSize, nullptr, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size, m_instanceIndices.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+unsigned int Scene::GetShaderID(aie::ShaderProgram* shader)
+{
+	auto it = m_shaderIDs.find(shader);
+	if (it != m_shaderIDs.end())
+		return it->second;
+
+	unsigned int id = (unsigned int)m_shaders.size();
+	m_shaderIDs[shader] = id;
+	m_shaders.push_back(shader);
+	return id;
+}
+
+unsigned int Scene::GetMeshID(aie::OBJMesh* mesh)
+{
+	auto it = m_meshIDs.find(mesh);
+	if (it != m_meshIDs.end())
+		return it->second;
+
+	unsigned int id = (unsigned int)m_meshes.size();
+	assert(id < RenderQueue::MAX_MESHES / aie::OBJMesh::MAX_LODS && "Too many meshes for the sort keys");
+	m_meshIDs[mesh] = id;
+	m_meshes.push_back(mesh);
+	m_meshAssets.push_back(aie::AssetHandle());
+	m_meshStates.push_back(aie::ASSET_READY);
+	return id;
+}
+
+void Scene::SetInstancedShader(aie::ShaderProgram* shader, aie::ShaderProgram* instancedShader)
+{
+	m_instancedShaders[shader] = instancedShader;
+
+	// the sampler is program state, so it only needs pointing at its slot once
+	instancedShader->bind();
+	instancedShader->bindUniform("InstanceTransforms", (int)INSTANCE_TRANSFORM_SLOT);
+}
+
+aie::ShaderProgram* Scene::GetInstancedShader(aie::ShaderProgram* shader)
+{
+	auto it = m_instancedShaders.find(shader);
+	return it == m_instancedShaders.end() ? nullptr : it->second;
+}
+
+void Scene::UpdateFrameUniforms()
+{
+	FrameUniforms frame;
+	frame.projectionView = m_camera->GetProjectionMatrix() * m_camera->GetViewMatrix();
+	frame.cameraPosition = m_camera->GetPosition();
+	frame.numLights = glm::min(GetNumberOfLights(), MAX_LIGHTS);
+	frame.ambientColor = m_ambientLightColor;
+	frame.lightDirection = m_light.direction;
+	frame.lightColor = m_light.color;
+	for (int i = 0; i < frame.numLights; i++)
+	{
+		frame.pointLightPositions[i] = glm::vec4(m_pointLightPositions[i], 1);
+		frame.pointLightColors[i] = glm::vec4(m_pointLightColors[i], 0);
+	}
+
+	m_frameUniforms.update(&frame, sizeof(FrameUniforms));
+	m_frameUniforms.bind(FRAME_UNIFORM_BINDING);
+
+	// last frame's draw data is no longer needed
+	m_drawUniforms.reset();
+}
+
+void Scene::BindDrawUniforms(const glm::mat4& projectionViewModel, const glm::mat4& modelMatrix, bool hasTexture)
+{
+	DrawUniforms draw;
+	draw.projectionViewModel = projectionViewModel;
+	draw.modelMatrix = modelMatrix;
+	draw.hasTexture = hasTexture;
+
+	unsigned int offset = m_drawUniforms.append(&draw, sizeof(DrawUniforms));
+	m_drawUniforms.bindRange(DRAW_UNIFORM_BINDING, offset, sizeof(DrawUniforms));
 }
 
 glm::vec2 Scene::GetWindowSize()
@@ -1,13 +1,88 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <string>
 #include <vector>
-#include <list>
+#include <unordered_map>
+#include "AssetLoader.h"
+#include "UniformBuffer.h"
+#include "RenderQueue.h"
+#include "Frustum.h"
+#include "TransformHierarchy.h"
 
 class BaseCamera;
 class Instance;
 
+namespace aie {
+	class OBJMesh;
+	class ShaderProgram;
+}
+
 const int MAX_LIGHTS = 4;
 
+// uniform block binding points shared by every shader that reads the
+// FrameData and DrawData blocks
+const unsigned int FRAME_UNIFORM_BINDING = 0;
+const unsigned int DRAW_UNIFORM_BINDING = 1;
+
+// texture unit the instanced shaders read instance transforms from, after
+// the seven OBJMesh material slots
+const unsigned int INSTANCE_TRANSFORM_SLOT = 7;
+
+// matches the std140 FrameData block, filled once per frame
+struct FrameUniforms
+{
+	glm::mat4 projectionView;
+	glm::vec3 cameraPosition;
+	int numLights;
+	glm::vec3 ambientColor;
+	float pad0;
+	glm::vec3 lightDirection;
+	float pad1;
+	glm::vec3 lightColor;
+	float pad2;
+	glm::vec4 pointLightPositions[MAX_LIGHTS];	// vec3 arrays have a 16 byte stride
+	glm::vec4 pointLightColors[MAX_LIGHTS];
+};
+
+// matches the std140 DrawData block, one per draw
+struct DrawUniforms
+{
+	glm::mat4 projectionViewModel;
+	glm::mat4 modelMatrix;
+	int hasTexture;
+	int pad[3];
+};
+
+// what the render queue submitted last frame
+struct RenderStats
+{
+	unsigned int drawCalls = 0;			// one per mesh chunk drawn, instanced or not
+	unsigned int instances = 0;			// drawn after culling
+	unsigned int culled = 0;			// outside the camera's frustum
+	unsigned int triangles = 0;			// at the levels of detail drawn
+	unsigned int placeholders = 0;		// boxes drawn for instances whose mesh is still loading
+	unsigned int shaderChanges = 0;
+	unsigned int textureBinds = 0;		// redundant ones between consecutive draws are skipped
+	unsigned int vertexArrayBinds = 0;
+};
+
+// A stable reference to one of a scene's instances. Instances are packed
+// together and move when others are removed, a handle keeps pointing at the
+// same one and stops being valid once it has been removed.
+struct InstanceHandle
+{
+	unsigned int slot = ~0u;
+	unsigned int generation = 0;
+};
+
+enum InstanceFlags : unsigned char
+{
+	INSTANCE_VISIBLE = 1 << 0,
+	INSTANCE_HAS_TEXTURE = 1 << 1,
+	INSTANCE_TRANSPARENT = 1 << 2,
+	INSTANCE_DIRTY = 1 << 3,		// world transform changed, bounds and GPU copy are stale
+};
+
 struct Light 
 {
 	Light() 
@@ -26,12 +101,49 @@ struct Light
 
 class Scene {
 public:
+	// instance transforms are nodes in hierarchy, which must be updated
+	// before the scene is drawn
 	Scene(BaseCamera* camera, glm::vec2 windowSize,
-		Light& light, glm::vec3 ambientLightColor);
+		Light& light, glm::vec3 ambientLightColor, TransformHierarchy* hierarchy);
 	~Scene();
 
-	void AddInstance(Instance* instance);
+	// the scene owns the Instance it returns, it is deleted with RemoveInstance.
+	// A mesh still loading through an AssetLoader is passed with its handle,
+	// its instances are drawn as placeholder boxes until it's ready
+	Instance* AddInstance(glm::mat4 transform, aie::OBJMesh* mesh,
+		aie::ShaderProgram* shader, std::string name, bool hasTexture,
+		aie::AssetHandle asset = aie::AssetHandle());
+	Instance* AddInstance(glm::vec3 position, glm::vec3 eulerAngles, glm::vec3 scale,
+		aie::OBJMesh* mesh, aie::ShaderProgram* shader, std::string name, bool hasTexture,
+		aie::AssetHandle asset = aie::AssetHandle());
+	void RemoveInstance(InstanceHandle handle);
+	bool IsValid(InstanceHandle handle);
+
 	void Draw();
+
+	// fills the FrameData block from the camera and lights and binds it
+	void UpdateFrameUniforms();
+	// appends a DrawData record for a draw outside of the instance list and binds it
+	void BindDrawUniforms(const glm::mat4& projectionViewModel, const glm::mat4& modelMatrix, bool hasTexture);
+
+	// instances using shader are drawn together through instancedShader, a
+	// variant that reads each instance's index from attrib location 4 and
+	// fetches its transform from the InstanceTransforms buffer texture
+	void SetInstancedShader(aie::ShaderProgram* shader, aie::ShaderProgram* instancedShader);
+	aie::ShaderProgram* GetInstancedShader(aie::ShaderProgram* shader);
+
+	// each instance draws the coarsest level of detail of its mesh whose
+	// error, projected by the camera, covers no more than the threshold in
+	// pixels. A level is only left once its error is the hysteresis fraction
+	// past the threshold either way, so instances near it don't flicker.
+	// Overrides of -1 leave the choice to the scene, an instance's override
+	// wins over the forced level, and both are clamped to the mesh's levels
+	float GetLodThreshold() { return m_lodThreshold; }
+	float GetLodHysteresis() { return m_lodHysteresis; }
+	int GetForcedLod() { return m_forcedLod; }
+	void SetLodThreshold(float pixels) { m_lodThreshold = pixels; }
+	void SetLodHysteresis(float fraction) { m_lodHysteresis = fraction; }
+	void SetForcedLod(int lod) { m_forcedLod = lod; }
 	
 	void AddPointLight(Light light) { m_pointLights.push_back(light); }
 	void AddPointLight(glm::vec3 direction, glm::vec3 color, float intensity)
@@ -46,18 +158,80 @@ public:
 	int GetNumberOfLights() { return m_pointLights.size(); }
 	glm::vec3* GetPointLightPositions() { return &m_pointLightPositions[0]; }
 	glm::vec3* GetPointLightColors() { return &m_pointLightColors[0]; }
-	std::list<Instance*> GetInstances() { return m_instances; }
+	const std::vector<Instance*>& GetInstances() { return m_instanceObjects; }
+	Instance* GetInstance(InstanceHandle handle) { return m_instanceObjects[GetInstanceIndex(handle)]; }
+	const glm::mat4& GetInstanceTransform(InstanceHandle handle) { return m_hierarchy->GetLocal(GetInstanceNode(handle)); }
+	const glm::mat4& GetInstanceWorldTransform(InstanceHandle handle) { return m_transforms[GetInstanceIndex(handle)]; }
+	TransformHierarchy::Node GetInstanceNode(InstanceHandle handle) { return m_instanceNodes[GetInstanceIndex(handle)]; }
+	aie::OBJMesh* GetInstanceMesh(InstanceHandle handle) { return m_meshes[m_instanceMeshes[GetInstanceIndex(handle)]]; }
+	const aie::AssetHandle& GetInstanceAsset(InstanceHandle handle) { return m_meshAssets[m_instanceMeshes[GetInstanceIndex(handle)]]; }
+	aie::ShaderProgram* GetInstanceShader(InstanceHandle handle) { return m_shaders[m_instanceShaders[GetInstanceIndex(handle)]]; }
+	bool GetInstanceFlag(InstanceHandle handle, InstanceFlags flag) { return (m_flags[GetInstanceIndex(handle)] & flag) != 0; }
+	// the level of detail last drawn
+	unsigned int GetInstanceLod(InstanceHandle handle) { return m_instanceLods[GetInstanceIndex(handle)]; }
+	int GetInstanceLodOverride(InstanceHandle handle) { return m_lodOverrides[GetInstanceIndex(handle)]; }
 
 	glm::vec3 GetPointLightPos(int index) { return m_pointLights.at(index).direction; }
 	glm::vec3 GetPointLightColor(int index) { return m_pointLights.at(index).color; }
+	const RenderStats& GetRenderStats() { return m_renderStats; }
+	bool GetFrustumCulling() { return m_frustumCulling; }
 
 	// Setters
 	void SetCamera(BaseCamera* camera) { m_camera = camera; }
 	void SetPointLightPos(int index, glm::vec3 position) { m_pointLights.at(index).direction = position; }
 	void SetPointLightColor(int index, glm::vec3 color) { m_pointLights.at(index).color = color; }
+	void SetFrustumCulling(bool frustumCulling) { m_frustumCulling = frustumCulling; }
+	// the transform is relative to the instance's parent, if it has one
+	void SetInstanceTransform(InstanceHandle handle, const glm::mat4& transform);
+	// any hierarchy node can be the parent, another instance's, a planet's or a camera's
+	void SetInstanceParent(InstanceHandle handle, TransformHierarchy::Node parent);
+	void SetInstanceFlag(InstanceHandle handle, InstanceFlags flag, bool value);
+	void SetInstanceLodOverride(InstanceHandle handle, int lod) { m_lodOverrides[GetInstanceIndex(handle)] = (signed char)lod; }
 
 
 protected:
+	// visible instances that share a mesh, shader and texture flag
+	struct DrawGroup
+	{
+		aie::OBJMesh* mesh;
+		aie::ShaderProgram* shader;
+		aie::ShaderProgram* instancedShader;	// nullptr draws the group one instance at a time
+		bool hasTexture;
+		bool transparent;
+		unsigned int lod;
+		unsigned int first;			// into the render queue's items
+		unsigned int count;
+		unsigned int drawIndex;		// first DrawData record, only one when instanced
+		unsigned int firstInstance;	// into m_instanceIndices
+	};
+
+	struct InstanceSlot
+	{
+		unsigned int index;			// into the packed arrays while in use
+		unsigned int generation;	// bumped on removal so old handles fail
+	};
+
+	unsigned int GetInstanceIndex(InstanceHandle handle);
+	void MarkDirty(unsigned int index);
+
+	// copies world transforms the hierarchy recomputed and marks those instances dirty
+	void SyncHierarchy();
+	// notes meshes that finished loading and marks their instances dirty for their real bounds
+	void UpdateMeshAssets();
+	// refreshes the world bounds and GPU transforms of dirty instances only
+	void UpdateDirtyInstances();
+
+	// picks the instance's level of detail and remembers it for next frame's hysteresis
+	unsigned int SelectLod(unsigned int index);
+
+	void BuildDrawGroups(const glm::mat4& projectionView);
+	void UploadInstanceIndices();
+	void SubmitDrawGroups(unsigned int drawOffset, unsigned int drawStride);
+
+	// small ids for the sort keys and packed arrays, handed out the first time each is seen
+	unsigned int GetShaderID(aie::ShaderProgram* shader);
+	unsigned int GetMeshID(aie::OBJMesh* mesh);
+
 	BaseCamera* m_camera;
 	glm::vec2 m_windowSize;
 	
@@ -66,10 +240,65 @@ protected:
 	Light m_light;
 
 	glm::vec3 m_ambientLightColor;
-	std::list<Instance*> m_instances;
+
+	TransformHierarchy* m_hierarchy;
+	unsigned int m_hierarchyUpdate = 0;				// the hierarchy update last synced
+
+	// instances as structure-of-arrays, packed and indexed through m_slots
+	std::vector<glm::mat4> m_transforms;			// world space, copied from the hierarchy
+	std::vector<TransformHierarchy::Node> m_instanceNodes;
+	std::vector<unsigned short> m_instanceMeshes;	// into m_meshes
+	std::vector<unsigned short> m_instanceShaders;	// into m_shaders
+	std::vector<unsigned char> m_flags;
+	std::vector<float> m_boundsX;					// world space bounding spheres
+	std::vector<float> m_boundsY;
+	std::vector<float> m_boundsZ;
+	std::vector<float> m_boundsRadius;
+	std::vector<unsigned char> m_instanceLods;
+	std::vector<signed char> m_lodOverrides;
+	std::vector<Instance*> m_instanceObjects;
+	std::vector<unsigned int> m_instanceSlots;		// the slot each packed instance belongs to
+
+	std::vector<InstanceSlot> m_slots;
+	std::vector<unsigned int> m_freeSlots;
+	std::vector<unsigned int> m_dirty;				// packed indices with INSTANCE_DIRTY set
 
 	glm::vec3 m_pointLightPositions[MAX_LIGHTS];
 	glm::vec3 m_pointLightColors[MAX_LIGHTS];
 
+	aie::UniformBuffer m_frameUniforms;
+	aie::UniformBuffer m_drawUniforms;
+	std::vector<char> m_drawData;	// staging for every group's DrawData
+
+	std::unordered_map<aie::ShaderProgram*, aie::ShaderProgram*> m_instancedShaders;
+	std::unordered_map<aie::ShaderProgram*, unsigned int> m_shaderIDs;
+	std::unordered_map<aie::OBJMesh*, unsigned int> m_meshIDs;
+	std::vector<aie::ShaderProgram*> m_shaders;
+	std::vector<aie::OBJMesh*> m_meshes;
+	std::vector<aie::AssetHandle> m_meshAssets;		// indexed like m_meshes
+	std::vector<unsigned char> m_meshStates;		// eAssetState, checked once a frame so it's the same throughout
+
+	RenderQueue m_renderQueue;
+	RenderStats m_renderStats;
+	std::vector<unsigned int> m_drawList;	// packed indices of drawn instances, indexed by the queue's items
+	std::vector<unsigned char> m_drawLods;	// the level of detail of each in m_drawList
+
+	float m_lodThreshold = 1;
+	float m_lodHysteresis = 0.25f;
+	int m_forcedLod = -1;
+
+	bool m_frustumCulling = true;
+	std::vector<unsigned char> m_cullVisible;
+	std::vector<DrawGroup> m_drawGroups;
+
+	// every instance's transform stays on the GPU in a buffer texture, only
+	// dirty ones are uploaded. Each frame just the drawn indices are sent
+	std::vector<unsigned int> m_instanceIndices;
+	unsigned int m_instanceBuffer = 0;
+	unsigned int m_instanceBufferSize = 0;
+	unsigned int m_transformBuffer = 0;
+	unsigned int m_transformTexture = 0;
+	unsigned int m_transformCapacity = 0;	// in instances
+
 };
 
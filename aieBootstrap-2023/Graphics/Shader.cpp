@@ -1,5 +1,7 @@
 #include "Shader.h"
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
 #include <cassert>
 #include "gl_core_4_4.h"
 
@@ -126,191 +128,301 @@ bool ShaderProgram::link() {
 		glGetProgramInfoLog(m_program, infoLogLength, 0, m_lastError);
 		return false;
 	}
+
+	static unsigned int s_nextLinkID = 0;
+	m_linkID = ++s_nextLinkID;
+
+	reflectUniforms();
 	return true;
 }
 
+void ShaderProgram::reflectUniforms() {
+	m_uniforms.clear();
+	m_uniformLookup.clear();
+	m_uniformWrites.clear();
+
+	int uniformCount = 0, maxNameLength = 0;
+	glGetProgramiv(m_program, GL_ACTIVE_UNIFORMS, &uniformCount);
+	glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+	std::vector<char> name(maxNameLength + 1);
+	m_uniforms.reserve(uniformCount);
+	for (int i = 0; i < uniformCount; ++i) {
+		int length = 0, size = 0;
+		unsigned int type = 0;
+		glGetActiveUniform(m_program, i, (int)name.size(), &length, &size, &type, name.data());
+
+		// uniforms inside blocks have no location of their own
+		int location = glGetUniformLocation(m_program, name.data());
+		if (location < 0)
+			continue;
+
+		UniformInfo info;
+		info.name.assign(name.data(), length);
+		if (info.name.size() > 3 && info.name.compare(info.name.size() - 3, 3, "[0]") == 0)
+			info.name.resize(info.name.size() - 3);
+		info.nameHash = hashUniformName(info.name.c_str());
+		info.type = type;
+		info.location = location;
+		info.arraySize = size;
+
+		// both uniforms are kept, only lookups by hash alone can't tell them apart
+		auto existing = m_uniformLookup.find(info.nameHash);
+		if (existing != m_uniformLookup.end())
+			printf("Shader uniform [%s] hash collides with [%s], look them up by name!\n",
+				info.name.c_str(), m_uniforms[existing->second].name.c_str());
+
+		m_uniformLookup.emplace(info.nameHash, (int)m_uniforms.size());
+		m_uniforms.push_back(info);
+	}
+
+	// a write count for every location, array elements included
+	int locationCount = 0;
+	for (auto& uniform : m_uniforms)
+		locationCount = std::max(locationCount, uniform.location + uniform.arraySize);
+	m_uniformWrites.assign(locationCount, 0);
+}
+
 void ShaderProgram::bind() {
 	assert(m_program > 0 && "Invalid shader program");
 	glUseProgram(m_program);
 }
 
-int ShaderProgram::getUniform(const char* name) {
-	return glGetUniformLocation(m_program, name);
+const UniformInfo* ShaderProgram::getUniformInfo(const char* name) const {
+	// also accept the "name[0]" form GL uses for arrays
+	size_t length = strlen(name);
+	if (length > 3 && strcmp(name + length - 3, "[0]") == 0)
+		return getUniformInfo(std::string(name, length - 3).c_str());
+
+	auto range = m_uniformLookup.equal_range(hashUniformName(name));
+	for (auto iter = range.first; iter != range.second; ++iter) {
+		if (m_uniforms[iter->second].name == name)
+			return &m_uniforms[iter->second];
+	}
+	return nullptr;
+}
+
+int ShaderProgram::getUniform(const char* name) const {
+	const UniformInfo* info = getUniformInfo(name);
+	if (info != nullptr)
+		return info->location;
+
+	// "name[N]" is an element of an array uniform, whose elements are given
+	// consecutive locations from the array's own
+	size_t length = strlen(name);
+	if (length < 4 || name[length - 1] != ']')
+		return -1;
+	const char* bracket = strrchr(name, '[');
+	if (bracket == nullptr || bracket == name || bracket + 2 == name + length)
+		return -1;
+
+	info = getUniformInfo(std::string(name, bracket - name).c_str());
+	if (info == nullptr)
+		return -1;
+
+	int element = 0;
+	for (const char* digit = bracket + 1; digit < name + length - 1; ++digit) {
+		if (*digit < '0' || *digit > '9')
+			return -1;
+		element = element * 10 + (*digit - '0');
+		if (element >= info->arraySize)
+			return -1;
+	}
+	return info->location + element;
+}
+
+int ShaderProgram::getUniformByHash(unsigned int nameHash) const {
+	// a hash shared by two uniforms can't say which one is meant
+	auto iter = m_uniformLookup.find(nameHash);
+	if (iter == m_uniformLookup.end() || m_uniformLookup.count(nameHash) > 1)
+		return -1;
+	return m_uniforms[iter->second].location;
+}
+
+bool ShaderProgram::bindUniformBlock(const char* blockName, unsigned int binding) {
+	assert(m_program > 0 && "Invalid shader program");
+	unsigned int index = glGetUniformBlockIndex(m_program, blockName);
+	if (index == GL_INVALID_INDEX) {
+		printf("Shader uniform block [%s] not found! Is it being used?\n", blockName);
+		return false;
+	}
+	glUniformBlockBinding(m_program, index, binding);
+	return true;
 }
 
 bool ShaderProgram::bindUniform(const char* name, int value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
 	}
-	glUniform1i(i, value);
+	bindUniform(i, value);
 	return true;
 }
 
 bool ShaderProgram::bindUniform(const char* name, float value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
 	}
-	glUniform1f(i, value);
+	bindUniform(i, value);
 	return true;
 }
 
 bool ShaderProgram::bindUniform(const char* name, const glm::vec2& value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
 	}
-	glUniform2f(i, value.x, value.y);
+	bindUniform(i, value);
 	return true;
 }
 
 bool ShaderProgram::bindUniform(const char* name, const glm::vec3& value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
 	}
-	glUniform3f(i, value.x, value.y, value.z);
+	bindUniform(i, value);
 	return true;
 }
 
 bool ShaderProgram::bindUniform(const char* name, const glm::vec4& value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
 	}
-	glUniform4f(i, value.x, value.y, value.z, value.w);
+	bindUniform(i, value);
 	return true;
 }
 
 bool ShaderProgram::bindUniform(const char* name, const glm::mat2& value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
 	}
-	glUniformMatrix2fv(i, 1, GL_FALSE, &value[0][0]);
+	bindUniform(i, value);
 	return true;
 }
 
 bool ShaderProgram::bindUniform(const char* name, const glm::mat3& value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
 	}
-	glUniformMatrix3fv(i, 1, GL_FALSE, &value[0][0]);
+	bindUniform(i, value);
 	return true;
 }
 
 bool ShaderProgram::bindUniform(const char* name, const glm::mat4& value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
 	}
-	glUniformMatrix4fv(i, 1, GL_FALSE, &value[0][0]);
+	bindUniform(i, value);
 	return true;
 }
 
 bool ShaderProgram::bindUniform(const char* name, int count, int* value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
 	}
-	glUniform1iv(i, count, value);
+	bindUniform(i, count, value);
 	return true;
 }
 
 bool ShaderProgram::bindUniform(const char* name, int count, float* value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
 	}
-	glUniform1fv(i, count, value);
+	bindUniform(i, count, value);
 	return true;
 }
 
 bool ShaderProgram::bindUniform(const char* name, int count, const glm::vec2* value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
 	}
-	glUniform2fv(i, count, (float*)value);
+	bindUniform(i, count, value);
 	return true;
 }
 
 bool ShaderProgram::bindUniform(const char* name, int count, const glm::vec3* value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
 	}
-	glUniform3fv(i, count, (float*)value);
+	bindUniform(i, count, value);
 	return true;
 }
 
 bool ShaderProgram::bindUniform(const char* name, int count, const glm::vec4* value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
 	}
-	glUniform4fv(i, count, (float*)value);
+	bindUniform(i, count, value);
 	return true;
 }
 
 bool ShaderProgram::bindUniform(const char* name, int count, const glm::mat2* value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
 	}
-	glUniformMatrix2fv(i, count, GL_FALSE, (float*)value);
+	bindUniform(i, count, value);
 	return true;
 }
 
 bool ShaderProgram::bindUniform(const char* name, int count, const glm::mat3* value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
 	}
-	glUniformMatrix3fv(i, count, GL_FALSE, (float*)value);
+	bindUniform(i, count, value);
 	return true;
 }
 
 bool ShaderProgram::bindUniform(const char* name, int count, const glm::mat4* value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
 	}
-	glUniformMatrix4fv(i, count, GL_FALSE, (float*)value);
+	bindUniform(i, count, value);
 	return true;
 }
 
@@ -318,96 +430,112 @@ void ShaderProgram::bindUniform(int ID, int value) {
 	assert(m_program > 0 && "Invalid shader program");
 	assert(ID >= 0 && "Invalid shader uniform");
 	glUniform1i(ID, value);
+	noteUniformWrite(ID);
 }
 
 void ShaderProgram::bindUniform(int ID, float value) {
 	assert(m_program > 0 && "Invalid shader program");
 	assert(ID >= 0 && "Invalid shader uniform");
 	glUniform1f(ID, value);
+	noteUniformWrite(ID);
 }
 
 void ShaderProgram::bindUniform(int ID, const glm::vec2& value) {
 	assert(m_program > 0 && "Invalid shader program");
 	assert(ID >= 0 && "Invalid shader uniform");
 	glUniform2f(ID, value.x, value.y);
+	noteUniformWrite(ID);
 }
 
 void ShaderProgram::bindUniform(int ID, const glm::vec3& value) {
 	assert(m_program > 0 && "Invalid shader program");
 	assert(ID >= 0 && "Invalid shader uniform");
 	glUniform3f(ID, value.x, value.y, value.z);
+	noteUniformWrite(ID);
 }
 
 void ShaderProgram::bindUniform(int ID, const glm::vec4& value) {
 	assert(m_program > 0 && "Invalid shader program");
 	assert(ID >= 0 && "Invalid shader uniform");
 	glUniform4f(ID, value.x, value.y, value.z, value.w);
+	noteUniformWrite(ID);
 }
 
 void ShaderProgram::bindUniform(int ID, const glm::mat2& value) {
 	assert(m_program > 0 && "Invalid shader program");
 	assert(ID >= 0 && "Invalid shader uniform");
 	glUniformMatrix2fv(ID, 1, GL_FALSE, &value[0][0]);
+	noteUniformWrite(ID);
 }
 
 void ShaderProgram::bindUniform(int ID, const glm::mat3& value) {
 	assert(m_program > 0 && "Invalid shader program");
 	assert(ID >= 0 && "Invalid shader uniform");
 	glUniformMatrix3fv(ID, 1, GL_FALSE, &value[0][0]);
+	noteUniformWrite(ID);
 }
 
 void ShaderProgram::bindUniform(int ID, const glm::mat4& value) {
 	assert(m_program > 0 && "Invalid shader program");
 	assert(ID >= 0 && "Invalid shader uniform");
 	glUniformMatrix4fv(ID, 1, GL_FALSE, &value[0][0]);
+	noteUniformWrite(ID);
 }
 
 void ShaderProgram::bindUniform(int ID, int count, int* value) {
 	assert(m_program > 0 && "Invalid shader program");
 	assert(ID >= 0 && "Invalid shader uniform");
 	glUniform1iv(ID, count, value);
+	noteUniformWrite(ID);
 }
 
 void ShaderProgram::bindUniform(int ID, int count, float* value) {
 	assert(m_program > 0 && "Invalid shader program");
 	assert(ID >= 0 && "Invalid shader uniform");
 	glUniform1fv(ID, count, value);
+	noteUniformWrite(ID);
 }
 
 void ShaderProgram::bindUniform(int ID, int count, const glm::vec2* value) {
 	assert(m_program > 0 && "Invalid shader program");
 	assert(ID >= 0 && "Invalid shader uniform");
 	glUniform2fv(ID, count, (float*)value);
+	noteUniformWrite(ID);
 }
 
 void ShaderProgram::bindUniform(int ID, int count, const glm::vec3* value) {
 	assert(m_program > 0 && "Invalid shader program");
 	assert(ID >= 0 && "Invalid shader uniform");
 	glUniform3fv(ID, count, (float*)value);
+	noteUniformWrite(ID);
 }
 
 void ShaderProgram::bindUniform(int ID, int count, const glm::vec4* value) {
 	assert(m_program > 0 && "Invalid shader program");
 	assert(ID >= 0 && "Invalid shader uniform");
 	glUniform4fv(ID, count, (float*)value);
+	noteUniformWrite(ID);
 }
 
 void ShaderProgram::bindUniform(int ID, int count, const glm::mat2* value) {
 	assert(m_program > 0 && "Invalid shader program");
 	assert(ID >= 0 && "Invalid shader uniform");
 	glUniformMatrix2fv(ID, count, GL_FALSE, (float*)value);
+	noteUniformWrite(ID);
 }
 
 void ShaderProgram::bindUniform(int ID, int count, const glm::mat3* value) {
 	assert(m_program > 0 && "Invalid shader program");
 	assert(ID >= 0 && "Invalid shader uniform");
 	glUniformMatrix3fv(ID, count, GL_FALSE, (float*)value);
+	noteUniformWrite(ID);
 }
 
 void ShaderProgram::bindUniform(int ID, int count, const glm::mat4* value) {
 	assert(m_program > 0 && "Invalid shader program");
 	assert(ID >= 0 && "Invalid shader uniform");
 	glUniformMatrix4fv(ID, count, GL_FALSE, (float*)value);
+	noteUniformWrite(ID);
 }
 
 }
\ No newline at end of file
@@ -7,6 +7,9 @@
 #include <glm/mat3x3.hpp>
 #include <glm/mat4x4.hpp>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace aie {
 
@@ -23,6 +26,22 @@ enum eShaderStage : unsigned int {
 	SHADER_STAGE_Count,
 };
 
+// FNV-1a hash of a uniform name, usable at compile time so that hot paths can
+// look uniforms up without hashing strings every frame:
+//	constexpr unsigned int PVM = aie::hashUniformName("ProjectionViewModel");
+constexpr unsigned int hashUniformName(const char* name, unsigned int hash = 2166136261u) {
+	return *name == 0 ? hash : hashUniformName(name + 1, (hash ^ (unsigned char)*name) * 16777619u);
+}
+
+// an active uniform reflected from a linked program
+struct UniformInfo {
+	std::string		name;		// array uniforms are stored without the [0] suffix
+	unsigned int	nameHash;
+	unsigned int	type;		// GL type enum, i.e. GL_FLOAT_VEC3
+	int				location;
+	int				arraySize;
+};
+
 // individual sharable shader stages
 class Shader {
 public:
@@ -53,7 +72,7 @@ protected:
 class ShaderProgram {
 public:
 
-	ShaderProgram() : m_program(0), m_lastError(nullptr) {
+	ShaderProgram() : m_program(0), m_linkID(0), m_lastError(nullptr) {
 		m_shaders[0] = m_shaders[1] = m_shaders[2] = m_shaders[3] = m_shaders[4] = 0;
 	}
 	~ShaderProgram();
@@ -70,7 +89,23 @@ public:
 
 	unsigned int getHandle() const { return m_program; }
 
-	int getUniform(const char* name);
+	// unique for every successful link, so caches keyed on the GL handle can
+	// tell when a handle has been reused by a different program
+	unsigned int getLinkID() const { return m_linkID; }
+
+	// uniform locations are reflected once after linking, so these lookups never query GL.
+	// getUniform also resolves array elements as "name[N]", getUniformByHash returns -1
+	// for a hash that two of the program's uniforms share
+	int getUniform(const char* name) const;
+	int getUniformByHash(unsigned int nameHash) const;
+	const UniformInfo* getUniformInfo(const char* name) const;
+	const std::vector<UniformInfo>& getUniforms() const { return m_uniforms; }
+
+	// how many times bindUniform has set a location, so values cached across draws can
+	// tell when something else has overwritten them. Raw glUniform calls aren't counted
+	unsigned int getUniformWrites(int location) const {
+		return location >= 0 && location < (int)m_uniformWrites.size() ? m_uniformWrites[location] : 0;
+	}
 
 	void bindUniform(int ID, int value);
 	void bindUniform(int ID, float value);
@@ -89,7 +124,11 @@ public:
 	void bindUniform(int ID, int count, const glm::mat3* value);
 	void bindUniform(int ID, int count, const glm::mat4* value);
 
-	// these calls should be avoided, but wraps up opengl a little
+	// assigns a uniform block to a buffer binding point, as #version 410
+	// shaders can't declare the binding themselves
+	bool bindUniformBlock(const char* blockName, unsigned int binding);
+
+	// these calls look the name up in the reflected uniform table
 	bool bindUniform(const char* name, int value);
 	bool bindUniform(const char* name, float value);
 	bool bindUniform(const char* name, const glm::vec2& value);
@@ -109,7 +148,17 @@ public:
 
 private:
 
+	void reflectUniforms();
+	void noteUniformWrite(int location) {
+		if (location < (int)m_uniformWrites.size()) ++m_uniformWrites[location];
+	}
+
 	unsigned int	m_program;
+	unsigned int	m_linkID;
+
+	std::vector<UniformInfo>					m_uniforms;
+	std::unordered_multimap<unsigned int, int>	m_uniformLookup;	// name hash to m_uniforms index
+	std::vector<unsigned int>					m_uniformWrites;	// bindUniform calls per location
 
 	std::shared_ptr<Shader> m_shaders[eShaderStage::SHADER_STAGE_Count];
 
@@ -0,0 +1,120 @@
+#include "TextureCache.h"
+#include "Texture.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+namespace aie {
+
+std::mutex TextureCache::s_mutex;
+std::unordered_map<std::string, TextureCache::Entry*> TextureCache::s_entries;
+std::unordered_map<Texture*, TextureCache::Entry*> TextureCache::s_textures;
+TextureCache::Stats TextureCache::s_stats = {};
+
+Texture* TextureCache::acquire(const std::string& filename, unsigned int flags /* = 0 */) {
+	if (filename.empty())
+		return nullptr;
+
+	std::string path = canonicalPath(filename);
+	std::string key = path + '|' + std::to_string(flags);
+
+	Entry* entry = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(s_mutex);
+		auto it = s_entries.find(key);
+		if (it != s_entries.end()) {
+			entry = it->second;
+			++s_stats.hits;
+		}
+		else {
+			entry = new Entry();
+			entry->texture = new Texture();
+			entry->path = path;
+			entry->key = key;
+			entry->flags = flags;
+			entry->refCount = 0;
+			entry->decoded = false;
+			s_entries[key] = entry;
+			s_textures[entry->texture] = entry;
+			++s_stats.misses;
+		}
+		++entry->refCount;
+	}
+
+	// decoded outside the lock so other files can decode alongside it
+	std::call_once(entry->decodeOnce, [entry]() {
+		entry->decoded = entry->texture->decode(entry->path.c_str(), entry->flags);
+		if (entry->decoded) {
+			std::lock_guard<std::mutex> lock(s_mutex);
+			++s_stats.textureCount;
+			s_stats.bytesResident += entry->texture->getSize();
+		}
+	});
+
+	if (entry->decoded == false) {
+		releaseEntry(entry);
+		return nullptr;
+	}
+	return entry->texture;
+}
+
+void TextureCache::release(Texture* texture) {
+	if (texture == nullptr)
+		return;
+
+	Entry* entry = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(s_mutex);
+		auto it = s_textures.find(texture);
+		if (it == s_textures.end())
+			return;
+		entry = it->second;
+	}
+	releaseEntry(entry);
+}
+
+void TextureCache::releaseEntry(Entry* entry) {
+	{
+		std::lock_guard<std::mutex> lock(s_mutex);
+		if (--entry->refCount > 0)
+			return;
+
+		s_entries.erase(entry->key);
+		s_textures.erase(entry->texture);
+		if (entry->decoded) {
+			--s_stats.textureCount;
+			s_stats.bytesResident -= entry->texture->getSize();
+		}
+	}
+
+	delete entry->texture;
+	delete entry;
+}
+
+TextureCache::Stats TextureCache::getStats() {
+	std::lock_guard<std::mutex> lock(s_mutex);
+	return s_stats;
+}
+
+std::string TextureCache::canonicalPath(const std::string& filename) {
+	std::string path = filename;
+
+#ifdef _WIN32
+	char fullPath[_MAX_PATH];
+	if (_fullpath(fullPath, filename.c_str(), _MAX_PATH) != nullptr)
+		path = fullPath;
+	std::transform(path.begin(), path.end(), path.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+	std::replace(path.begin(), path.end(), '\\', '/');
+#else
+	// missing files keep their name, they'll fail to decode anyway
+	char* fullPath = realpath(filename.c_str(), nullptr);
+	if (fullPath != nullptr) {
+		path = fullPath;
+		free(fullPath);
+	}
+#endif
+
+	return path;
+}
+
+} // namespace aie
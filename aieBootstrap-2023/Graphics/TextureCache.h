@@ -0,0 +1,61 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace aie {
+
+class Texture;
+
+// textures shared by everything that loads them by path. A file is decoded
+// and uploaded once however many meshes use it, and is freed when the last
+// of them releases it. Safe to acquire from any thread
+class TextureCache {
+public:
+
+	struct Stats {
+		unsigned int		hits;			// acquires that found the texture already cached
+		unsigned int		misses;			// acquires that decoded it
+		unsigned int		textureCount;	// live textures
+		unsigned long long	bytesResident;	// their video memory, as Texture::getSize gives it
+	};
+
+	// returns the texture for filename, decoding it with the Texture load
+	// flags first on a miss, or nullptr for an empty name or a file that
+	// won't decode. The same file loaded with other flags is another
+	// texture. A texture still has to be uploaded on the gl thread by
+	// whoever finds its handle is 0, and every one returned must be
+	// released once
+	static Texture* acquire(const std::string& filename, unsigned int flags = 0);
+
+	// the last release deletes the texture, so it must be on the gl thread
+	static void release(Texture* texture);
+
+	static Stats getStats();
+
+	// the absolute path, with forward slashes and, on windows, in lower case,
+	// so different spellings of one file share a texture
+	static std::string canonicalPath(const std::string& filename);
+
+private:
+
+	struct Entry {
+		Texture*		texture;
+		std::string		path;
+		std::string		key;			// the path and flags
+		unsigned int	flags;
+		unsigned int	refCount;
+		std::once_flag	decodeOnce;		// later acquirers wait for the first to decode it
+		bool			decoded;
+	};
+
+	static void releaseEntry(Entry* entry);
+
+	static std::mutex								s_mutex;
+	static std::unordered_map<std::string, Entry*>	s_entries;
+	static std::unordered_map<Texture*, Entry*>		s_textures;
+	static Stats									s_stats;
+};
+
+} // namespace aie
@@ -0,0 +1,243 @@
+#include "TransformHierarchy.h"
+#include <cassert>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define HIERARCHY_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+// out = parent * local, both column major
+static inline void Multiply(const glm::mat4& parent, const glm::mat4& local, glm::mat4& out)
+{
+#ifdef HIERARCHY_USE_SSE
+	__m128 p0 = _mm_loadu_ps(&parent[0][0]);
+	__m128 p1 = _mm_loadu_ps(&parent[1][0]);
+	__m128 p2 = _mm_loadu_ps(&parent[2][0]);
+	__m128 p3 = _mm_loadu_ps(&parent[3][0]);
+
+	// each output column is the parent's columns weighted by a local column
+	for (int c = 0; c < 4; c++)
+	{
+		__m128 column = _mm_loadu_ps(&local[c][0]);
+		__m128 result = _mm_mul_ps(p0, _mm_shuffle_ps(column, column, _MM_SHUFFLE(0, 0, 0, 0)));
+		result = _mm_add_ps(result, _mm_mul_ps(p1, _mm_shuffle_ps(column, column, _MM_SHUFFLE(1, 1, 1, 1))));
+		result = _mm_add_ps(result, _mm_mul_ps(p2, _mm_shuffle_ps(column, column, _MM_SHUFFLE(2, 2, 2, 2))));
+		result = _mm_add_ps(result, _mm_mul_ps(p3, _mm_shuffle_ps(column, column, _MM_SHUFFLE(3, 3, 3, 3))));
+		_mm_storeu_ps(&out[c][0], result);
+	}
+#else
+	out = parent * local;
+#endif
+}
+
+const TransformHierarchy::Node TransformHierarchy::NO_NODE;
+
+TransformHierarchy::TransformHierarchy() : m_reorder(false), m_updateCount(0)
+{
+}
+
+TransformHierarchy::Node TransformHierarchy::AddNode(const glm::mat4& local /* = glm::mat4(1) */,
+	Node parent /* = NO_NODE */)
+{
+	Node node;
+	if (m_freeNodes.empty())
+	{
+		node = (Node)m_positions.size();
+		m_positions.push_back(0);
+	}
+	else
+	{
+		node = m_freeNodes.back();
+		m_freeNodes.pop_back();
+	}
+
+	// appending keeps the order, the parent is already somewhere before us
+	unsigned int position = (unsigned int)m_nodes.size();
+	m_positions[node] = position;
+	m_nodes.push_back(node);
+	m_parents.push_back(parent == NO_NODE ? NO_NODE : m_positions[parent]);
+	m_local.push_back(local);
+	m_world.push_back(local);
+	m_dirty.push_back(1);
+	m_changed.push_back(0);
+	m_changedUpdate.push_back(0);
+	return node;
+}
+
+void TransformHierarchy::RemoveNode(Node node)
+{
+	unsigned int position = m_positions[node];
+	unsigned int parent = m_parents[position];
+
+	// children come after us, unless a SetParent has broken the order and
+	// the Reorder that restores it hasn't happened yet
+	unsigned int start = m_reorder ? 0 : position + 1;
+	for (unsigned int i = start; i < m_nodes.size(); i++)
+	{
+		if (m_parents[i] == position)
+		{
+			m_parents[i] = parent;
+			m_dirty[i] = 1;
+		}
+	}
+
+	// leave a hole that the next Reorder removes
+	m_nodes[position] = NO_NODE;
+	m_parents[position] = NO_NODE;
+	m_dirty[position] = 0;
+	m_positions[node] = NO_NODE;
+	m_freeNodes.push_back(node);
+	m_reorder = true;
+}
+
+TransformHierarchy::Node TransformHierarchy::GetParent(Node node)
+{
+	unsigned int parent = m_parents[m_positions[node]];
+	return parent == NO_NODE ? NO_NODE : m_nodes[parent];
+}
+
+void TransformHierarchy::SetParent(Node node, Node parent)
+{
+	unsigned int position = m_positions[node];
+	unsigned int parentPosition = parent == NO_NODE ? NO_NODE : m_positions[parent];
+	assert((parentPosition == NO_NODE || !IsAncestor(position, parentPosition)) &&
+		"A node can't be parented to its own subtree");
+
+	m_parents[position] = parentPosition;
+	m_dirty[position] = 1;
+
+	// a parent later in the arrays breaks the order
+	if (parentPosition != NO_NODE && parentPosition > position)
+		m_reorder = true;
+}
+
+void TransformHierarchy::SetLocal(Node node, const glm::mat4& local)
+{
+	unsigned int position = m_positions[node];
+	m_local[position] = local;
+	m_dirty[position] = 1;
+}
+
+bool TransformHierarchy::IsAncestor(unsigned int ancestor, unsigned int position)
+{
+	for (unsigned int i = position; i != NO_NODE; i = m_parents[i])
+	{
+		if (i == ancestor)
+			return true;
+	}
+	return false;
+}
+
+void TransformHierarchy::Update()
+{
+	if (m_reorder)
+		Reorder();
+	m_updateCount++;
+
+	unsigned int count = (unsigned int)m_nodes.size();
+	const unsigned int* parents = m_parents.data();
+	const unsigned char* dirty = m_dirty.data();
+	unsigned char* changed = m_changed.data();
+	unsigned int* changedUpdate = m_changedUpdate.data();
+	const glm::mat4* local = m_local.data();
+	glm::mat4* world = m_world.data();
+
+	// parents are always earlier, so their changed flag is already final
+	// when a child reads it and a dirty node drags its whole subtree along
+	for (unsigned int i = 0; i < count; i++)
+	{
+		unsigned int parent = parents[i];
+		if (parent == NO_NODE)
+		{
+			changed[i] = dirty[i];
+			if (dirty[i])
+				world[i] = local[i];
+		}
+		else
+		{
+			changed[i] = dirty[i] | changed[parent];
+			if (changed[i])
+				Multiply(world[parent], local[i], world[i]);
+		}
+		if (changed[i])
+			changedUpdate[i] = m_updateCount;
+	}
+
+	if (count > 0)
+		memset(m_dirty.data(), 0, count);
+}
+
+void TransformHierarchy::Reorder()
+{
+	m_reorder = false;
+	unsigned int count = (unsigned int)m_nodes.size();
+
+	// children of each position as one packed list
+	m_childStart.assign(count + 1, 0);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (m_nodes[i] != NO_NODE && m_parents[i] != NO_NODE)
+			m_childStart[m_parents[i] + 1]++;
+	}
+	for (unsigned int i = 0; i < count; i++)
+		m_childStart[i + 1] += m_childStart[i];
+
+	m_children.resize(m_childStart[count]);
+	m_order.assign(m_childStart.begin(), m_childStart.end() - 1);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (m_nodes[i] != NO_NODE && m_parents[i] != NO_NODE)
+			m_children[m_order[m_parents[i]]++] = i;
+	}
+
+	// depth first from each root, so subtrees end up next to each other
+	m_order.clear();
+	for (unsigned int root = 0; root < count; root++)
+	{
+		if (m_nodes[root] == NO_NODE || m_parents[root] != NO_NODE)
+			continue;
+
+		m_stack.push_back(root);
+		while (!m_stack.empty())
+		{
+			unsigned int position = m_stack.back();
+			m_stack.pop_back();
+			m_order.push_back(position);
+
+			// pushed in reverse so they come out in their old order
+			for (unsigned int c = m_childStart[position + 1]; c > m_childStart[position]; c--)
+				m_stack.push_back(m_children[c - 1]);
+		}
+	}
+
+	// m_order holds old positions in their new order, move everything across
+	unsigned int newCount = (unsigned int)m_order.size();
+	std::vector<unsigned int> newPosition(count, NO_NODE);
+	for (unsigned int i = 0; i < newCount; i++)
+		newPosition[m_order[i]] = i;
+
+	std::vector<unsigned int> parents(newCount);
+	std::vector<glm::mat4> local(newCount);
+	std::vector<glm::mat4> world(newCount);
+	std::vector<Node> nodes(newCount);
+	for (unsigned int i = 0; i < newCount; i++)
+	{
+		unsigned int old = m_order[i];
+		parents[i] = m_parents[old] == NO_NODE ? NO_NODE : newPosition[m_parents[old]];
+		local[i] = m_local[old];
+		world[i] = m_world[old];
+		nodes[i] = m_nodes[old];
+		m_positions[nodes[i]] = i;
+	}
+
+	m_parents.swap(parents);
+	m_local.swap(local);
+	m_world.swap(world);
+	m_nodes.swap(nodes);
+
+	// moved nodes may have new parents, so recompute everything once
+	m_dirty.assign(newCount, 1);
+	m_changed.assign(newCount, 0);
+	m_changedUpdate.assign(newCount, 0);
+}
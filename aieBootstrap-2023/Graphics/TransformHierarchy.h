@@ -0,0 +1,70 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+
+// Local and world transforms for trees of nodes, stored flat. Nodes are kept
+// in topological order, every parent before its children, so all the world
+// matrices update in a single forward pass over the arrays. Only nodes whose
+// local transform changed, and everything below them, are recomputed.
+//
+// Nodes are referred to by ids that stay the same while the arrays are
+// reordered underneath them.
+class TransformHierarchy
+{
+public:
+	typedef unsigned int Node;
+	static const Node NO_NODE = ~0u;
+
+	TransformHierarchy();
+	~TransformHierarchy() {};
+
+	Node AddNode(const glm::mat4& local = glm::mat4(1), Node parent = NO_NODE);
+	// the node's children are moved up to its parent
+	void RemoveNode(Node node);
+
+	// recomputes the world matrix of every dirty node and its subtree
+	void Update();
+
+	// Getters
+	Node GetParent(Node node);
+	const glm::mat4& GetLocal(Node node) { return m_local[m_positions[node]]; }
+	// as of the last Update
+	const glm::mat4& GetWorld(Node node) { return m_world[m_positions[node]]; }
+	// whether the last Update recomputed the node's world matrix
+	bool IsChanged(Node node) { return m_changed[m_positions[node]] != 0; }
+	// whether any Update since the given update count recomputed it, for users
+	// that don't look after every Update
+	bool IsChangedSince(Node node, unsigned int updateCount) { return m_changedUpdate[m_positions[node]] > updateCount; }
+	size_t GetCount() { return m_nodes.size() - m_freeNodes.size(); }
+	// goes up by one every Update, so users can tell if they've seen the latest
+	unsigned int GetUpdateCount() { return m_updateCount; }
+
+	// Setters
+	void SetParent(Node node, Node parent);
+	void SetLocal(Node node, const glm::mat4& local);
+
+protected:
+	bool IsAncestor(unsigned int ancestor, unsigned int position);
+	// rebuilds the topological order, drops removed nodes and keeps subtrees together
+	void Reorder();
+
+	// by position
+	std::vector<unsigned int> m_parents;	// position of the parent, or NO_NODE
+	std::vector<glm::mat4> m_local;
+	std::vector<glm::mat4> m_world;
+	std::vector<unsigned char> m_dirty;		// local changed since the last Update
+	std::vector<unsigned char> m_changed;	// world recomputed by the last Update
+	std::vector<unsigned int> m_changedUpdate;	// the last Update that recomputed world
+	std::vector<Node> m_nodes;				// the node at each position, NO_NODE once removed
+
+	// by node
+	std::vector<unsigned int> m_positions;
+	std::vector<Node> m_freeNodes;
+
+	bool m_reorder;
+	unsigned int m_updateCount;
+	std::vector<unsigned int> m_childStart;	// scratch for Reorder
+	std::vector<unsigned int> m_children;
+	std::vector<unsigned int> m_stack;
+	std::vector<unsigned int> m_order;
+};
@@ -0,0 +1,85 @@
+#include "UniformBuffer.h"
+#include "gl_core_4_4.h"
+#include <cassert>
+#include <cstdio>
+
+namespace aie {
+
+UniformBuffer::~UniformBuffer() {
+	glDeleteBuffers(1, &m_handle);
+}
+
+bool UniformBuffer::create(unsigned int size) {
+	assert(m_handle == 0 && "Uniform buffer already created");
+
+	glGenBuffers(1, &m_handle);
+	if (m_handle == 0) {
+		printf("Failed to create uniform buffer!\n");
+		return false;
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_handle);
+	glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	m_size = size;
+	m_cursor = 0;
+	return true;
+}
+
+void UniformBuffer::update(const void* data, unsigned int size, unsigned int offset /* = 0 */) {
+	assert(offset + size <= m_size && "Uniform buffer update out of range");
+	glBindBuffer(GL_UNIFORM_BUFFER, m_handle);
+	glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::bind(unsigned int binding) const {
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, m_handle);
+}
+
+void UniformBuffer::bindRange(unsigned int binding, unsigned int offset, unsigned int size) const {
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, m_handle, offset, size);
+}
+
+void UniformBuffer::reset() {
+	// orphan the old storage so we don't stall on draws still reading it
+	glBindBuffer(GL_UNIFORM_BUFFER, m_handle);
+	glBufferData(GL_UNIFORM_BUFFER, m_size, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	m_cursor = 0;
+}
+
+unsigned int UniformBuffer::append(const void* data, unsigned int size) {
+	unsigned int offset = alignSize(m_cursor);
+
+	if (offset + size > m_size) {
+		// earlier ranges this frame keep the old storage alive, so grow and start again at the front
+		m_size = alignSize((offset + size) * 2);
+		glBindBuffer(GL_UNIFORM_BUFFER, m_handle);
+		glBufferData(GL_UNIFORM_BUFFER, m_size, nullptr, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		offset = 0;
+	}
+
+	update(data, size, offset);
+	m_cursor = offset + size;
+	return offset;
+}
+
+unsigned int UniformBuffer::getOffsetAlignment() {
+	static int alignment = 0;
+	if (alignment == 0) {
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		if (alignment <= 0)
+			alignment = 256;
+	}
+	return (unsigned int)alignment;
+}
+
+unsigned int UniformBuffer::alignSize(unsigned int size) {
+	unsigned int alignment = getOffsetAlignment();
+	return (size + alignment - 1) / alignment * alignment;
+}
+
+} // namespace aie
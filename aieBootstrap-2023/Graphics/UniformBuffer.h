@@ -0,0 +1,44 @@
+#pragma once
+
+namespace aie {
+
+// wraps an opengl uniform buffer object. It can be used as a plain block of
+// uniforms that is updated and bound as a whole, or as a dynamic buffer that
+// many draws append their data to during a frame and bind a range of.
+class UniformBuffer {
+public:
+
+	UniformBuffer() : m_handle(0), m_size(0), m_cursor(0) {}
+	~UniformBuffer();
+
+	bool create(unsigned int size);
+
+	// replace part of the buffer's contents
+	void update(const void* data, unsigned int size, unsigned int offset = 0);
+
+	// bind the whole buffer, or a range of it, to a uniform block binding point
+	void bind(unsigned int binding) const;
+	void bindRange(unsigned int binding, unsigned int offset, unsigned int size) const;
+
+	// dynamic use: discard last frame's contents and start appending from the front
+	void reset();
+
+	// copies data to the next aligned offset, growing the buffer if needed,
+	// and returns the offset it was written to
+	unsigned int append(const void* data, unsigned int size);
+
+	unsigned int getHandle() const { return m_handle; }
+	unsigned int getSize() const { return m_size; }
+
+	// offsets passed to bindRange must be a multiple of this
+	static unsigned int getOffsetAlignment();
+	static unsigned int alignSize(unsigned int size);
+
+protected:
+
+	unsigned int	m_handle;
+	unsigned int	m_size;
+	unsigned int	m_cursor;
+};
+
+} // namespace aie
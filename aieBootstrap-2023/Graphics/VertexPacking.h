@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glm/common.hpp>
+#include <glm/packing.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+namespace aie {
+
+// the layouts a mesh's vertices can be uploaded in
+enum eVertexFormat : unsigned int {
+	VERTEX_FORMAT_FULL = 0,		// every attribute as floats
+	VERTEX_FORMAT_PACKED,		// float3 positions, octahedral 10_10_10_2 normals and tangents, half float texcoords
+	VERTEX_FORMAT_QUANTISED,	// as packed, but positions are 16 bit across the bounds
+};
+
+// folds a direction on to an octahedron and unfolds that in to the [-1, 1]
+// square, which keeps its precision far more even than storing xyz does
+inline glm::vec2 octahedralEncode(const glm::vec3& direction) {
+	float length = glm::abs(direction.x) + glm::abs(direction.y) + glm::abs(direction.z);
+	if (length == 0)
+		return glm::vec2(0);
+
+	glm::vec3 v = direction / length;
+	if (v.z >= 0)
+		return glm::vec2(v.x, v.y);
+	return glm::vec2((1 - glm::abs(v.y)) * (v.x >= 0 ? 1.0f : -1.0f),
+					 (1 - glm::abs(v.x)) * (v.y >= 0 ? 1.0f : -1.0f));
+}
+
+inline glm::vec3 octahedralDecode(const glm::vec2& encoded) {
+	glm::vec3 v(encoded.x, encoded.y, 1 - glm::abs(encoded.x) - glm::abs(encoded.y));
+	float t = glm::max(-v.z, 0.0f);
+	v.x += v.x >= 0 ? -t : t;
+	v.y += v.y >= 0 ? -t : t;
+	return glm::normalize(v);
+}
+
+// read with GL_INT_2_10_10_10_REV, normalized. The 2 bit w holds a
+// tangent's handedness, and is 1 on normals so shaders can tell a packed
+// normal from a float one, whose w is always 0
+inline unsigned int packDirection(const glm::vec3& direction, float w) {
+	return glm::packSnorm3x10_1x2(glm::vec4(octahedralEncode(direction), 0, w));
+}
+
+// read with GL_HALF_FLOAT
+inline unsigned int packTexCoord(const glm::vec2& texCoord) {
+	return glm::packHalf2x16(texCoord);
+}
+
+// read with GL_UNSIGNED_SHORT, normalized, and decoded as offset + value * scale
+inline void quantisePosition(const glm::vec3& position, const glm::vec3& offset, const glm::vec3& scale,
+							 unsigned short* quantised) {
+	for (int i = 0; i < 3; ++i) {
+		float t = scale[i] > 0 ? (position[i] - offset[i]) / scale[i] : 0;
+		quantised[i] = (unsigned short)(glm::clamp(t, 0.0f, 1.0f) * 65535.0f + 0.5f);
+	}
+}
+
+} // namespace aie
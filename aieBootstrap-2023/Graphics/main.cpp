@@ -1,7 +1,16 @@
 #include "GraphicsApp.h"
+#include "OBJBenchmark.h"
+
+#include <cstring>
+
+int main(int argc, char* argv[]) {
+
+	// times the obj parser from the console instead of running the app
+	if (argc > 1 && strcmp(argv[1], "-objbenchmark") == 0) {
+		RunOBJBenchmark();
+		return 0;
+	}
 
-int main() {
-	
 	// allocation
 	auto app = new GraphicsApp();
 
@@ -0,0 +1,233 @@
+#include "ContactKernels.h"
+
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define CONTACTS_USE_SSE
+#include <emmintrin.h>
+#endif
+
+// The kernels below are written so that the SSE and scalar paths evaluate the
+// same expressions in the same order, which keeps their results bit identical.
+
+static inline bool CircleContact(const CircleArrays& circles, int i1, int i2, int pair, Contact& contact)
+{
+	float dx = circles.posX[i1] - circles.posX[i2];
+	float dy = circles.posY[i1] - circles.posY[i2];
+	float distanceSq = dx * dx + dy * dy;
+	float radii = circles.radius[i1] + circles.radius[i2];
+	if (!(distanceSq < radii * radii))
+		return false;
+
+	float penetration = radii - std::sqrt(distanceSq);
+	if (!(penetration > 0))
+		return false;
+
+	contact.pair = pair;
+	contact.penetration = penetration;
+	contact.point.x = (circles.posX[i1] + circles.posX[i2]) * 0.5f;
+	contact.point.y = (circles.posY[i1] + circles.posY[i2]) * 0.5f;
+	return true;
+}
+
+static inline bool PlaneContact(const PlaneArrays& planes, const CircleArrays& circles, int p, int c,
+	int pair, Contact& contact)
+{
+	float normalX = planes.normalX[p];
+	float normalY = planes.normalY[p];
+	float sphereToPlane = (circles.posX[c] * normalX + circles.posY[c] * normalY) - planes.distance[p];
+	float intersection = circles.radius[c] - sphereToPlane;
+	float velocityOutOfPlane = circles.velX[c] * normalX + circles.velY[c] * normalY;
+	if (!(intersection > 0 && velocityOutOfPlane < 0))
+		return false;
+
+	contact.pair = pair;
+	contact.penetration = intersection;
+	contact.point.x = circles.posX[c] + normalX * -circles.radius[c];
+	contact.point.y = circles.posY[c] + normalY * -circles.radius[c];
+	return true;
+}
+
+int ContactKernels::Circle2CircleScalar(const CircleArrays& circles, const int* first, const int* second,
+	int pairCount, Contact* contacts)
+{
+	int count = 0;
+	for (int i = 0; i < pairCount; i++)
+	{
+		if (CircleContact(circles, first[i], second[i], i, contacts[count]))
+			count++;
+	}
+	return count;
+}
+
+int ContactKernels::Plane2CircleScalar(const PlaneArrays& planes, const CircleArrays& circles,
+	const int* planeIndex, const int* circleIndex, int pairCount, Contact* contacts)
+{
+	int count = 0;
+	for (int i = 0; i < pairCount; i++)
+	{
+		if (PlaneContact(planes, circles, planeIndex[i], circleIndex[i], i, contacts[count]))
+			count++;
+	}
+	return count;
+}
+
+#ifdef CONTACTS_USE_SSE
+
+// candidate pairs usually come from sweeps, so the four indices of a packet are
+// often all the same or consecutive and can be loaded without a gather
+enum PacketLayout { PACKET_SCATTERED, PACKET_SAME, PACKET_CONSECUTIVE };
+
+static inline PacketLayout GetLayout(const int* index)
+{
+	if (index[0] == index[1] && index[0] == index[2] && index[0] == index[3])
+		return PACKET_SAME;
+	if (index[1] == index[0] + 1 && index[2] == index[0] + 2 && index[3] == index[0] + 3)
+		return PACKET_CONSECUTIVE;
+	return PACKET_SCATTERED;
+}
+
+static inline __m128 Gather(const float* values, const int* index, PacketLayout layout)
+{
+	switch (layout) {
+	case PACKET_SAME: return _mm_set1_ps(values[index[0]]);
+	case PACKET_CONSECUTIVE: return _mm_loadu_ps(values + index[0]);
+	default: return _mm_setr_ps(values[index[0]], values[index[1]], values[index[2]], values[index[3]]);
+	}
+}
+
+/// <summary>
+/// Tests four circle pairs per iteration. Pairs are rejected on squared distance
+/// and the square root is only taken when at least one of the four overlaps.
+/// </summary>
+int ContactKernels::Circle2Circle(const CircleArrays& circles, const int* first, const int* second,
+	int pairCount, Contact* contacts)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 half = _mm_set1_ps(0.5f);
+
+	int count = 0;
+	int i = 0;
+	for (; i + 4 <= pairCount; i += 4)
+	{
+		PacketLayout layout1 = GetLayout(first + i);
+		PacketLayout layout2 = GetLayout(second + i);
+		__m128 x1 = Gather(circles.posX, first + i, layout1);
+		__m128 y1 = Gather(circles.posY, first + i, layout1);
+		__m128 x2 = Gather(circles.posX, second + i, layout2);
+		__m128 y2 = Gather(circles.posY, second + i, layout2);
+		__m128 radii = _mm_add_ps(Gather(circles.radius, first + i, layout1),
+			Gather(circles.radius, second + i, layout2));
+
+		__m128 dx = _mm_sub_ps(x1, x2);
+		__m128 dy = _mm_sub_ps(y1, y2);
+		__m128 distanceSq = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+		__m128 hit = _mm_cmplt_ps(distanceSq, _mm_mul_ps(radii, radii));
+		if (_mm_movemask_ps(hit) == 0)
+			continue;
+
+		__m128 penetration = _mm_sub_ps(radii, _mm_sqrt_ps(distanceSq));
+		int mask = _mm_movemask_ps(_mm_and_ps(hit, _mm_cmpgt_ps(penetration, zero)));
+		if (mask == 0)
+			continue;
+
+		alignas(16) float pen[4], pointX[4], pointY[4];
+		_mm_store_ps(pen, penetration);
+		_mm_store_ps(pointX, _mm_mul_ps(_mm_add_ps(x1, x2), half));
+		_mm_store_ps(pointY, _mm_mul_ps(_mm_add_ps(y1, y2), half));
+
+		// compact the hits into the output in pair order
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (mask & (1 << lane))
+			{
+				Contact& contact = contacts[count++];
+				contact.pair = i + lane;
+				contact.penetration = pen[lane];
+				contact.point = glm::vec2(pointX[lane], pointY[lane]);
+			}
+		}
+	}
+
+	for (; i < pairCount; i++)
+	{
+		if (CircleContact(circles, first[i], second[i], i, contacts[count]))
+			count++;
+	}
+	return count;
+}
+
+/// <summary>
+/// Tests four plane/circle pairs per iteration.
+/// </summary>
+int ContactKernels::Plane2Circle(const PlaneArrays& planes, const CircleArrays& circles,
+	const int* planeIndex, const int* circleIndex, int pairCount, Contact* contacts)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+
+	int count = 0;
+	int i = 0;
+	for (; i + 4 <= pairCount; i += 4)
+	{
+		PacketLayout planeLayout = GetLayout(planeIndex + i);
+		PacketLayout circleLayout = GetLayout(circleIndex + i);
+		__m128 normalX = Gather(planes.normalX, planeIndex + i, planeLayout);
+		__m128 normalY = Gather(planes.normalY, planeIndex + i, planeLayout);
+		__m128 x = Gather(circles.posX, circleIndex + i, circleLayout);
+		__m128 y = Gather(circles.posY, circleIndex + i, circleLayout);
+		__m128 radius = Gather(circles.radius, circleIndex + i, circleLayout);
+
+		__m128 sphereToPlane = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(x, normalX), _mm_mul_ps(y, normalY)),
+			Gather(planes.distance, planeIndex + i, planeLayout));
+		__m128 intersection = _mm_sub_ps(radius, sphereToPlane);
+		__m128 velocityOutOfPlane = _mm_add_ps(
+			_mm_mul_ps(Gather(circles.velX, circleIndex + i, circleLayout), normalX),
+			_mm_mul_ps(Gather(circles.velY, circleIndex + i, circleLayout), normalY));
+
+		int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(intersection, zero),
+			_mm_cmplt_ps(velocityOutOfPlane, zero)));
+		if (mask == 0)
+			continue;
+
+		__m128 negRadius = _mm_xor_ps(radius, signBit);
+		alignas(16) float pen[4], pointX[4], pointY[4];
+		_mm_store_ps(pen, intersection);
+		_mm_store_ps(pointX, _mm_add_ps(x, _mm_mul_ps(normalX, negRadius)));
+		_mm_store_ps(pointY, _mm_add_ps(y, _mm_mul_ps(normalY, negRadius)));
+
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (mask & (1 << lane))
+			{
+				Contact& contact = contacts[count++];
+				contact.pair = i + lane;
+				contact.penetration = pen[lane];
+				contact.point = glm::vec2(pointX[lane], pointY[lane]);
+			}
+		}
+	}
+
+	for (; i < pairCount; i++)
+	{
+		if (PlaneContact(planes, circles, planeIndex[i], circleIndex[i], i, contacts[count]))
+			count++;
+	}
+	return count;
+}
+
+#else
+
+int ContactKernels::Circle2Circle(const CircleArrays& circles, const int* first, const int* second,
+	int pairCount, Contact* contacts)
+{
+	return Circle2CircleScalar(circles, first, second, pairCount, contacts);
+}
+
+int ContactKernels::Plane2Circle(const PlaneArrays& planes, const CircleArrays& circles,
+	const int* planeIndex, const int* circleIndex, int pairCount, Contact* contacts)
+{
+	return Plane2CircleScalar(planes, circles, planeIndex, circleIndex, pairCount, contacts);
+}
+
+#endif
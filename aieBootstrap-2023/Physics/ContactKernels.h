@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// A contact found by one of the packet kernels. Only pairs that touch are
+// written, packed to the front of the output array in pair order.
+struct Contact
+{
+	int pair;			// index into the candidate pair arrays
+	float penetration;
+	glm::vec2 point;	// world space contact point
+};
+
+// Circle positions, velocities and radii as structure-of-arrays, gathered once
+// per step so the kernels never touch the actors themselves.
+struct CircleArrays
+{
+	const float* posX;
+	const float* posY;
+	const float* velX;
+	const float* velY;
+	const float* radius;
+};
+
+struct PlaneArrays
+{
+	const float* normalX;
+	const float* normalY;
+	const float* distance;
+};
+
+// Contact generation for arrays of candidate pairs. The SIMD kernels test four
+// pairs at a time with squared distances and only take a square root for pairs
+// that actually overlap. The scalar kernels perform the same operations in the
+// same order, so both produce identical contacts.
+class ContactKernels
+{
+public:
+	// circles[first[i]] against circles[second[i]]
+	static int Circle2Circle(const CircleArrays& circles, const int* first, const int* second,
+		int pairCount, Contact* contacts);
+	static int Circle2CircleScalar(const CircleArrays& circles, const int* first, const int* second,
+		int pairCount, Contact* contacts);
+
+	// planes[planeIndex[i]] against circles[circleIndex[i]], only circles moving into the plane
+	static int Plane2Circle(const PlaneArrays& planes, const CircleArrays& circles,
+		const int* planeIndex, const int* circleIndex, int pairCount, Contact* contacts);
+	static int Plane2CircleScalar(const PlaneArrays& planes, const CircleArrays& circles,
+		const int* planeIndex, const int* circleIndex, int pairCount, Contact* contacts);
+};
@@ -0,0 +1,547 @@
+#include "Fluid.h"
+#include "PhysicsScene.h"
+#include "Plane.h"
+#include "Box.h"
+
+#include <Gizmos.h>
+#include <JobSystem.h>
+
+#include <emmintrin.h>
+#include <algorithm>
+#include <chrono>
+
+// below this many particles per worker handing out the work costs more than it saves
+#define MIN_PARTICLES_PER_CHUNK 2048
+// caps the neighbour grid when a particle escapes far from the rest of the fluid
+#define MAX_GRID_DIMENSION 2048
+
+static const float PI_F = 3.14159265359f;
+
+static inline float HorizontalSum(__m128 v)
+{
+	__m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+	__m128 sums = _mm_add_ps(v, shuffled);
+	shuffled = _mm_movehl_ps(shuffled, sums);
+	return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+}
+
+Fluid::Fluid(PhysicsScene* scene, float smoothingRadius, float restDensity,
+	float stiffness, float viscosity, float elasticity, glm::vec4 color) :
+	PhysicsObject(FLUID, elasticity, color)
+{
+	m_scene = scene;
+
+	m_smoothingRadius = smoothingRadius;
+	m_particleRadius = smoothingRadius * 0.5f;
+	m_stiffness = stiffness;
+	m_viscosity = viscosity;
+
+	// 2D Muller kernels
+	float h = smoothingRadius;
+	m_poly6 = 4.0f / (PI_F * powf(h, 8));
+	m_spikyGrad = 30.0f / (PI_F * powf(h, 5));
+	m_viscLaplacian = 40.0f / (PI_F * powf(h, 5));
+
+	SetRestDensity(restDensity);
+
+	m_gridOrigin = glm::vec2(0);
+	m_gridWidth = 0;
+	m_gridHeight = 0;
+
+	m_threadCount = 0;
+	m_jobSystem = nullptr;
+	m_lastStepTime = 0;
+}
+
+Fluid::~Fluid()
+{
+	delete m_jobSystem;
+}
+
+void Fluid::SetRestDensity(float restDensity)
+{
+	m_restDensity = restDensity;
+
+	// particles are spawned half a smoothing radius apart, so pick the mass
+	// that gives exactly the rest density on that lattice
+	float h = m_smoothingRadius;
+	float kernelSum = 0;
+	for (int y = -2; y <= 2; y++)
+	{
+		for (int x = -2; x <= 2; x++)
+		{
+			float t = h * h - (x * x + y * y) * m_particleRadius * m_particleRadius;
+			if (t > 0)
+				kernelSum += t * t * t;
+		}
+	}
+	m_particleMass = restDensity / (m_poly6 * kernelSum);
+}
+
+void Fluid::SetThreadCount(int threadCount)
+{
+	if (threadCount == m_threadCount)
+		return;
+
+	// rebuilt with the new count when it's next needed
+	m_threadCount = threadCount;
+	delete m_jobSystem;
+	m_jobSystem = nullptr;
+}
+
+void Fluid::ParallelFor(int count, int chunkCount, const std::function<void(int, int, int)>& func)
+{
+	if (chunkCount <= 1)
+	{
+		func(0, count, 0);
+		return;
+	}
+
+	m_jobSystem->parallelFor(chunkCount, [count, chunkCount, &func](unsigned int chunk) {
+		int begin = (int)((long long)count * chunk / chunkCount);
+		int end = (int)((long long)count * (chunk + 1) / chunkCount);
+		func(begin, end, chunk);
+	});
+}
+
+/// <summary>
+/// Adds a single particle to the fluid.
+/// </summary>
+/// <param name="position">: The world position of the particle </param>
+/// <param name="velocity">: The starting velocity of the particle </param>
+void Fluid::AddParticle(glm::vec2 position, glm::vec2 velocity)
+{
+	m_posX.push_back(position.x);
+	m_posY.push_back(position.y);
+	m_velX.push_back(velocity.x);
+	m_velY.push_back(velocity.y);
+	m_accX.push_back(0);
+	m_accY.push_back(0);
+	m_density.push_back(m_restDensity);
+	m_pressure.push_back(0);
+}
+
+/// <summary>
+/// Fills a rectangle with particles spaced at their rest distance.
+/// </summary>
+/// <param name="min">: The bottom left corner of the block </param>
+/// <param name="max">: The top right corner of the block </param>
+/// <param name="velocity">: The starting velocity of every particle in the block </param>
+void Fluid::AddBlock(glm::vec2 min, glm::vec2 max, glm::vec2 velocity)
+{
+	float spacing = m_particleRadius;
+	int columns = (int)((max.x - min.x) / spacing) + 1;
+	int rows = (int)((max.y - min.y) / spacing) + 1;
+
+	size_t newCount = m_posX.size() + columns * rows;
+	m_posX.reserve(newCount);
+	m_posY.reserve(newCount);
+	m_velX.reserve(newCount);
+	m_velY.reserve(newCount);
+	m_accX.reserve(newCount);
+	m_accY.reserve(newCount);
+	m_density.reserve(newCount);
+	m_pressure.reserve(newCount);
+
+	for (int y = 0; y < rows; y++)
+	{
+		for (int x = 0; x < columns; x++)
+		{
+			AddParticle(min + glm::vec2(x, y) * spacing, velocity);
+		}
+	}
+}
+
+void Fluid::Clear()
+{
+	m_posX.clear();
+	m_posY.clear();
+	m_velX.clear();
+	m_velY.clear();
+	m_accX.clear();
+	m_accY.clear();
+	m_density.clear();
+	m_pressure.clear();
+}
+
+void Fluid::FixedUpdate(glm::vec2 gravity, float timeStep)
+{
+	int count = GetParticleCount();
+	if (count == 0)
+		return;
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// gather the boundaries the fluid can collide with
+	m_planes.clear();
+	m_boxes.clear();
+	for (int i = 0; i < m_scene->GetActorCount(); i++)
+	{
+		PhysicsObject* actor = m_scene->GetActor(i);
+		if (actor->GetShapeID() == PLANE)
+			m_planes.push_back(static_cast<Plane*>(actor));
+		else if (actor->GetShapeID() == BOX && !static_cast<Box*>(actor)->IsTrigger())
+			m_boxes.push_back(static_cast<Box*>(actor));
+	}
+
+	BuildGrid();
+
+	// one chunk per worker, as long as each has enough particles to be worth it
+	int chunkCount = 1;
+	if (count >= 2 * MIN_PARTICLES_PER_CHUNK && m_threadCount != 1)
+	{
+		if (m_jobSystem == nullptr)
+			m_jobSystem = new aie::JobSystem(std::max(m_threadCount, 0));
+		chunkCount = std::min((int)m_jobSystem->getThreadCount(), count / MIN_PARTICLES_PER_CHUNK);
+	}
+
+	ParallelFor(count, chunkCount, [this](int begin, int end, int) {
+		ComputeDensity(begin, end);
+	});
+
+	ParallelFor(count, chunkCount, [this, gravity](int begin, int end, int) {
+		ComputeForces(begin, end, gravity);
+	});
+
+	// each chunk accumulates the impulses it applies to boxes separately so the
+	// workers never write to the same memory
+	int boxCount = (int)m_boxes.size();
+	std::vector<glm::vec3> boxImpulses(boxCount * chunkCount, glm::vec3(0));
+	ParallelFor(count, chunkCount, [this, timeStep, boxCount, &boxImpulses](int begin, int end, int chunk) {
+		Integrate(begin, end, timeStep, boxCount > 0 ? &boxImpulses[chunk * boxCount] : nullptr);
+	});
+
+	for (int b = 0; b < boxCount; b++)
+	{
+		glm::vec3 impulse(0);
+		for (int chunk = 0; chunk < chunkCount; chunk++)
+			impulse += boxImpulses[chunk * boxCount + b];
+
+		glm::vec2 linear(impulse.x, impulse.y);
+		float lengthSq = glm::dot(linear, linear);
+		if (lengthSq <= 0)
+			continue;
+
+		// pick the point of application that reproduces the summed torque
+		glm::vec2 arm = glm::vec2(linear.y, -linear.x) * (impulse.z / lengthSq);
+		m_boxes[b]->ApplyForce(linear, arm);
+	}
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	m_lastStepTime = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+}
+
+/// <summary>
+/// Bins every particle into a uniform grid of smoothing radius sized cells and
+/// sorts the particle arrays by cell, so the particles of neighbouring cells in a row
+/// are contiguous.
+/// </summary>
+void Fluid::BuildGrid()
+{
+	int count = GetParticleCount();
+	float h = m_smoothingRadius;
+
+	glm::vec2 min(m_posX[0], m_posY[0]);
+	glm::vec2 max = min;
+	for (int i = 1; i < count; i++)
+	{
+		min.x = std::min(min.x, m_posX[i]);
+		min.y = std::min(min.y, m_posY[i]);
+		max.x = std::max(max.x, m_posX[i]);
+		max.y = std::max(max.y, m_posY[i]);
+	}
+
+	m_gridOrigin = min;
+	m_gridWidth = std::min((int)((max.x - min.x) / h) + 1, MAX_GRID_DIMENSION);
+	m_gridHeight = std::min((int)((max.y - min.y) / h) + 1, MAX_GRID_DIMENSION);
+	int cellCount = m_gridWidth * m_gridHeight;
+
+	// counting sort on the cell index
+	m_cellStart.assign(cellCount + 1, 0);
+	m_particleCell.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		int cellX = std::min((int)((m_posX[i] - min.x) / h), m_gridWidth - 1);
+		int cellY = std::min((int)((m_posY[i] - min.y) / h), m_gridHeight - 1);
+		int cell = cellY * m_gridWidth + cellX;
+		m_particleCell[i] = cell;
+		m_cellStart[cell + 1]++;
+	}
+
+	for (int c = 0; c < cellCount; c++)
+		m_cellStart[c + 1] += m_cellStart[c];
+
+	std::vector<int> order(count);
+	std::vector<int> offsets(m_cellStart.begin(), m_cellStart.end() - 1);
+	for (int i = 0; i < count; i++)
+		order[offsets[m_particleCell[i]]++] = i;
+
+	m_scratch.resize(count);
+	auto reorder = [this, count, &order](std::vector<float>& values) {
+		for (int i = 0; i < count; i++)
+			m_scratch[i] = values[order[i]];
+		values.swap(m_scratch);
+	};
+	reorder(m_posX);
+	reorder(m_posY);
+	reorder(m_velX);
+	reorder(m_velY);
+
+	// the sorted particles' cells, reusing the permutation's storage
+	for (int i = 0; i < count; i++)
+		order[i] = m_particleCell[order[i]];
+	m_particleCell.swap(order);
+}
+
+void Fluid::GetRowRange(int cellX, int cellY, int& begin, int& end) const
+{
+	int x0 = std::max(cellX - 1, 0);
+	int x1 = std::min(cellX + 1, m_gridWidth - 1);
+	begin = m_cellStart[cellY * m_gridWidth + x0];
+	end = m_cellStart[cellY * m_gridWidth + x1 + 1];
+}
+
+void Fluid::ComputeDensity(int begin, int end)
+{
+	float h2 = m_smoothingRadius * m_smoothingRadius;
+	const float* posX = m_posX.data();
+	const float* posY = m_posY.data();
+	__m128 vh2 = _mm_set1_ps(h2);
+	__m128 zero = _mm_setzero_ps();
+
+	for (int i = begin; i < end; i++)
+	{
+		int cellX = m_particleCell[i] % m_gridWidth;
+		int cellY = m_particleCell[i] / m_gridWidth;
+		__m128 xi = _mm_set1_ps(posX[i]);
+		__m128 yi = _mm_set1_ps(posY[i]);
+		__m128 sum4 = zero;
+		float sum = 0;
+
+		for (int row = std::max(cellY - 1, 0); row <= std::min(cellY + 1, m_gridHeight - 1); row++)
+		{
+			int j, rowEnd;
+			GetRowRange(cellX, row, j, rowEnd);
+
+			// four neighbours at a time, W = (h^2 - r^2)^3 inside the support
+			for (; j + 4 <= rowEnd; j += 4)
+			{
+				__m128 dx = _mm_sub_ps(xi, _mm_loadu_ps(posX + j));
+				__m128 dy = _mm_sub_ps(yi, _mm_loadu_ps(posY + j));
+				__m128 r2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+				__m128 t = _mm_max_ps(_mm_sub_ps(vh2, r2), zero);
+				sum4 = _mm_add_ps(sum4, _mm_mul_ps(_mm_mul_ps(t, t), t));
+			}
+			for (; j < rowEnd; j++)
+			{
+				float dx = posX[i] - posX[j];
+				float dy = posY[i] - posY[j];
+				float t = h2 - (dx * dx + dy * dy);
+				if (t > 0)
+					sum += t * t * t;
+			}
+		}
+
+		float density = m_particleMass * m_poly6 * (sum + HorizontalSum(sum4));
+		m_density[i] = density;
+		// clamp so particles only push each other apart
+		m_pressure[i] = std::max(m_stiffness * (density - m_restDensity), 0.0f);
+	}
+}
+
+void Fluid::ComputeForces(int begin, int end, glm::vec2 gravity)
+{
+	float h = m_smoothingRadius;
+	float h2 = h * h;
+	const float* posX = m_posX.data();
+	const float* posY = m_posY.data();
+	const float* velX = m_velX.data();
+	const float* velY = m_velY.data();
+	const float* density = m_density.data();
+	const float* pressure = m_pressure.data();
+
+	__m128 vh = _mm_set1_ps(h);
+	__m128 vh2 = _mm_set1_ps(h2);
+	__m128 epsilon = _mm_set1_ps(1e-12f);
+	__m128 pressureScale = _mm_set1_ps(0.5f * m_particleMass * m_spikyGrad);
+	__m128 viscScale = _mm_set1_ps(m_viscosity * m_particleMass * m_viscLaplacian);
+
+	for (int i = begin; i < end; i++)
+	{
+		int cellX = m_particleCell[i] % m_gridWidth;
+		int cellY = m_particleCell[i] / m_gridWidth;
+		__m128 xi = _mm_set1_ps(posX[i]);
+		__m128 yi = _mm_set1_ps(posY[i]);
+		__m128 vxi = _mm_set1_ps(velX[i]);
+		__m128 vyi = _mm_set1_ps(velY[i]);
+		__m128 pi = _mm_set1_ps(pressure[i]);
+		__m128 fx4 = _mm_setzero_ps();
+		__m128 fy4 = _mm_setzero_ps();
+		float fx = 0, fy = 0;
+
+		for (int row = std::max(cellY - 1, 0); row <= std::min(cellY + 1, m_gridHeight - 1); row++)
+		{
+			int j, rowEnd;
+			GetRowRange(cellX, row, j, rowEnd);
+
+			for (; j + 4 <= rowEnd; j += 4)
+			{
+				__m128 dx = _mm_sub_ps(xi, _mm_loadu_ps(posX + j));
+				__m128 dy = _mm_sub_ps(yi, _mm_loadu_ps(posY + j));
+				__m128 r2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+				// inside the support and not this particle itself
+				__m128 mask = _mm_and_ps(_mm_cmplt_ps(r2, vh2), _mm_cmpgt_ps(r2, epsilon));
+				if (_mm_movemask_ps(mask) == 0)
+					continue;
+
+				__m128 r = _mm_sqrt_ps(_mm_max_ps(r2, epsilon));
+				__m128 q = _mm_sub_ps(vh, r);
+				__m128 invDensity = _mm_div_ps(_mm_set1_ps(1.0f), _mm_loadu_ps(density + j));
+
+				// pressure: m (pi + pj) / (2 rhoj) * spiky'(r) * dir
+				__m128 pij = _mm_add_ps(pi, _mm_loadu_ps(pressure + j));
+				__m128 pressureTerm = _mm_mul_ps(_mm_mul_ps(pressureScale, pij),
+					_mm_mul_ps(_mm_mul_ps(q, q), _mm_div_ps(invDensity, r)));
+
+				// viscosity: mu m (vj - vi) / rhoj * visc''(r)
+				__m128 viscTerm = _mm_mul_ps(viscScale, _mm_mul_ps(q, invDensity));
+				__m128 dvx = _mm_sub_ps(_mm_loadu_ps(velX + j), vxi);
+				__m128 dvy = _mm_sub_ps(_mm_loadu_ps(velY + j), vyi);
+
+				__m128 forceX = _mm_add_ps(_mm_mul_ps(pressureTerm, dx), _mm_mul_ps(viscTerm, dvx));
+				__m128 forceY = _mm_add_ps(_mm_mul_ps(pressureTerm, dy), _mm_mul_ps(viscTerm, dvy));
+				fx4 = _mm_add_ps(fx4, _mm_and_ps(mask, forceX));
+				fy4 = _mm_add_ps(fy4, _mm_and_ps(mask, forceY));
+			}
+			for (; j < rowEnd; j++)
+			{
+				float dx = posX[i] - posX[j];
+				float dy = posY[i] - posY[j];
+				float r2 = dx * dx + dy * dy;
+				if (r2 >= h2 || r2 <= 1e-12f)
+					continue;
+
+				float r = sqrtf(r2);
+				float q = h - r;
+				float invDensity = 1.0f / density[j];
+				float pressureTerm = 0.5f * m_particleMass * m_spikyGrad *
+					(pressure[i] + pressure[j]) * q * q * invDensity / r;
+				float viscTerm = m_viscosity * m_particleMass * m_viscLaplacian * q * invDensity;
+
+				fx += pressureTerm * dx + viscTerm * (velX[j] - velX[i]);
+				fy += pressureTerm * dy + viscTerm * (velY[j] - velY[i]);
+			}
+		}
+
+		fx += HorizontalSum(fx4);
+		fy += HorizontalSum(fy4);
+
+		m_accX[i] = fx / density[i] + gravity.x;
+		m_accY[i] = fy / density[i] + gravity.y;
+	}
+}
+
+void Fluid::Integrate(int begin, int end, float timeStep, glm::vec3* boxImpulses)
+{
+	float radius = m_particleRadius;
+
+	for (int i = begin; i < end; i++)
+	{
+		glm::vec2 velocity(m_velX[i] + m_accX[i] * timeStep, m_velY[i] + m_accY[i] * timeStep);
+		glm::vec2 position(m_posX[i] + velocity.x * timeStep, m_posY[i] + velocity.y * timeStep);
+
+		for (Plane* plane : m_planes)
+		{
+			glm::vec2 normal = plane->GetNormal();
+			float distance = glm::dot(position, normal) - plane->GetDistance();
+			if (distance >= radius)
+				continue;
+
+			position += normal * (radius - distance);
+			float velocityIntoPlane = glm::dot(velocity, normal);
+			if (velocityIntoPlane < 0)
+			{
+				float e = (m_elasticity + plane->GetElasticity()) / 2.0f;
+				velocity -= (1 + e) * velocityIntoPlane * normal;
+			}
+		}
+
+		for (int b = 0; b < (int)m_boxes.size(); b++)
+		{
+			Box* box = m_boxes[b];
+
+			// transform the particle into the box's coordinate space
+			glm::vec2 offset = position - box->GetPosition();
+			glm::vec2 local(glm::dot(offset, box->GetLocalX()), glm::dot(offset, box->GetLocalY()));
+			glm::vec2 extents = box->GetExtents() + glm::vec2(radius);
+			if (fabsf(local.x) >= extents.x || fabsf(local.y) >= extents.y)
+				continue;
+
+			// push out along the axis of least penetration
+			float penX = extents.x - fabsf(local.x);
+			float penY = extents.y - fabsf(local.y);
+			glm::vec2 normal;
+			float pen;
+			if (penX < penY)
+			{
+				normal = box->GetLocalX() * (local.x < 0 ? -1.0f : 1.0f);
+				pen = penX;
+			}
+			else
+			{
+				normal = box->GetLocalY() * (local.y < 0 ? -1.0f : 1.0f);
+				pen = penY;
+			}
+			position += normal * pen;
+
+			// the velocity of the box's surface at the contact
+			glm::vec2 arm = position - box->GetPosition();
+			glm::vec2 surfaceVelocity = box->GetVelocity() + box->GetAngularVelocity() * glm::vec2(-arm.y, arm.x);
+			float velocityIntoBox = glm::dot(velocity - surfaceVelocity, normal);
+			if (velocityIntoBox < 0)
+			{
+				float e = (m_elasticity + box->GetElasticity()) / 2.0f;
+				glm::vec2 deltaV = -(1 + e) * velocityIntoBox * normal;
+				velocity += deltaV;
+
+				// equal and opposite impulse on the box, z holds its torque
+				glm::vec2 impulse = -deltaV * m_particleMass;
+				boxImpulses[b] += glm::vec3(impulse, arm.x * impulse.y - arm.y * impulse.x);
+			}
+		}
+
+		m_velX[i] = velocity.x;
+		m_velY[i] = velocity.y;
+		m_posX[i] = position.x;
+		m_posY[i] = position.y;
+	}
+}
+
+void Fluid::Draw(float alpha)
+{
+	int count = GetParticleCount();
+	for (int i = 0; i < count; i++)
+	{
+		aie::Gizmos::add2DCircle(glm::vec2(m_posX[i], m_posY[i]), m_particleRadius, 6, m_color);
+	}
+}
+
+float Fluid::GetKineticEnergy()
+{
+	float total = 0;
+	int count = GetParticleCount();
+	for (int i = 0; i < count; i++)
+		total += m_velX[i] * m_velX[i] + m_velY[i] * m_velY[i];
+	return 0.5f * m_particleMass * total;
+}
+
+float Fluid::GetPotentialEnergy()
+{
+	glm::vec2 gravity = PhysicsScene::GetGravity();
+	float total = 0;
+	int count = GetParticleCount();
+	for (int i = 0; i < count; i++)
+		total += gravity.x * m_posX[i] + gravity.y * m_posY[i];
+	return -m_particleMass * total;
+}
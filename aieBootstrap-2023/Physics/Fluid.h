@@ -0,0 +1,105 @@
+#pragma once
+
+#include "PhysicsObject.h"
+
+#include <glm/glm.hpp>
+#include <functional>
+#include <vector>
+
+namespace aie { class JobSystem; }
+
+class PhysicsScene;
+class Plane;
+class Box;
+
+// A smoothed-particle hydrodynamics (SPH) fluid. Particles are stored as
+// structure-of-arrays and re-sorted into a uniform neighbour grid every step
+// so that the density and force kernels can walk contiguous memory.
+// Boundaries are the Planes and Boxes held by the owning scene.
+class Fluid : public PhysicsObject
+{
+public:
+	Fluid(PhysicsScene* scene, float smoothingRadius, float restDensity,
+		float stiffness, float viscosity, float elasticity, glm::vec4 color);
+	~Fluid();
+
+	virtual void FixedUpdate(glm::vec2 gravity, float timeStep);
+	virtual void Draw(float alpha);
+
+	void AddParticle(glm::vec2 position, glm::vec2 velocity = glm::vec2(0));
+	void AddBlock(glm::vec2 min, glm::vec2 max, glm::vec2 velocity = glm::vec2(0));
+	void Clear();
+
+	virtual float GetKineticEnergy();
+	float GetPotentialEnergy();
+	virtual float GetEnergy() { return GetKineticEnergy() + GetPotentialEnergy(); }
+
+	// Getters
+	int GetParticleCount() const { return (int)m_posX.size(); }
+	glm::vec2 GetParticlePosition(int index) const { return glm::vec2(m_posX[index], m_posY[index]); }
+	glm::vec2 GetParticleVelocity(int index) const { return glm::vec2(m_velX[index], m_velY[index]); }
+	float GetParticleDensity(int index) const { return m_density[index]; }
+	float GetSmoothingRadius() const { return m_smoothingRadius; }
+	float GetParticleMass() const { return m_particleMass; }
+	float GetLastStepTime() const { return m_lastStepTime; } // milliseconds
+
+	// Setters
+	void SetStiffness(float stiffness) { m_stiffness = stiffness; }
+	void SetViscosity(float viscosity) { m_viscosity = viscosity; }
+	// rescales the particle mass too, so the fluid settles at the new density
+	void SetRestDensity(float restDensity);
+	void SetThreadCount(int threadCount);
+
+protected:
+	void BuildGrid();
+	void ComputeDensity(int begin, int end);
+	void ComputeForces(int begin, int end, glm::vec2 gravity);
+	void Integrate(int begin, int end, float timeStep, glm::vec3* boxImpulses);
+
+	// splits [0, count) into chunkCount ranges and runs them on the workers,
+	// the calling thread included
+	void ParallelFor(int count, int chunkCount, const std::function<void(int, int, int)>& func);
+
+	// returns the [begin, end) particle range covering cells x-1..x+1 of a grid row
+	void GetRowRange(int cellX, int cellY, int& begin, int& end) const;
+
+	PhysicsScene* m_scene;
+
+	// boundaries gathered from the scene at the start of each step
+	std::vector<Plane*> m_planes;
+	std::vector<Box*> m_boxes;
+
+	float m_smoothingRadius;
+	float m_particleRadius;
+	float m_particleMass;
+	float m_restDensity;
+	float m_stiffness;
+	float m_viscosity;
+
+	// precomputed kernel constants for the current smoothing radius
+	float m_poly6;
+	float m_spikyGrad;
+	float m_viscLaplacian;
+
+	// particle data, sorted by grid cell after every BuildGrid()
+	std::vector<float> m_posX, m_posY;
+	std::vector<float> m_velX, m_velY;
+	std::vector<float> m_accX, m_accY;
+	std::vector<float> m_density;
+	std::vector<float> m_pressure;
+
+	// neighbour grid, rebuilt each step over the particles' bounding box
+	glm::vec2 m_gridOrigin;
+	int m_gridWidth;
+	int m_gridHeight;
+	std::vector<int> m_cellStart; // m_gridWidth * m_gridHeight + 1 prefix offsets
+	std::vector<int> m_particleCell;
+	std::vector<float> m_scratch;
+
+	int m_threadCount; // 0 = use every hardware thread
+
+	// kept between steps so the workers aren't started each time, created
+	// by the first step that has enough particles to share out
+	aie::JobSystem* m_jobSystem;
+	float m_lastStepTime;
+};
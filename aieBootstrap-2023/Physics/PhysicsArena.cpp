@@ -0,0 +1,64 @@
+#include "PhysicsArena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+PhysicsArena::PhysicsArena(size_t blockSize)
+{
+	m_blockSize = blockSize > 0 ? blockSize : 4096;
+}
+
+PhysicsArena::~PhysicsArena()
+{
+	for (auto& block : m_blocks)
+	{
+		::operator delete(block.memory);
+	}
+}
+
+/// <summary>
+/// Returns uninitialised memory from the current block, starting a new block when it is full.
+/// </summary>
+/// <param name="size">: The number of bytes required </param>
+/// <param name="alignment">: The required alignment, must be a power of two </param>
+void* PhysicsArena::Allocate(size_t size, size_t alignment)
+{
+	if (!m_blocks.empty())
+	{
+		Block& block = m_blocks.back();
+		uintptr_t address = (uintptr_t)(block.memory + block.used);
+		size_t padding = (alignment - (address & (alignment - 1))) & (alignment - 1);
+		if (block.used + padding + size <= block.size)
+		{
+			block.used += padding + size;
+			return block.memory + block.used - size;
+		}
+	}
+
+	// operator new returns memory aligned for any fundamental type
+	Block block;
+	block.size = std::max(m_blockSize, size);
+	block.memory = (char*)::operator new(block.size);
+	block.used = size;
+	m_blocks.push_back(block);
+	return block.memory;
+}
+
+bool PhysicsArena::Owns(const void* pointer) const
+{
+	const char* address = (const char*)pointer;
+	for (auto& block : m_blocks)
+	{
+		if (address >= block.memory && address < block.memory + block.size)
+			return true;
+	}
+	return false;
+}
+
+size_t PhysicsArena::GetBytesUsed() const
+{
+	size_t total = 0;
+	for (auto& block : m_blocks)
+		total += block.used;
+	return total;
+}
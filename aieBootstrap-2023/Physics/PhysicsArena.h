@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// A bump allocator for bulk creating actors. Memory is handed out from large
+// blocks and only released when the arena is destroyed, so actors created here
+// must have their destructors called explicitly (PhysicsScene does this for
+// the arenas it owns).
+class PhysicsArena
+{
+public:
+	PhysicsArena(size_t blockSize);
+	~PhysicsArena();
+
+	void* Allocate(size_t size, size_t alignment);
+
+	template <typename T, typename... Args>
+	T* Create(Args&&... args)
+		{ return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...); }
+
+	bool Owns(const void* pointer) const;
+
+	// Getters
+	size_t GetBytesUsed() const;
+	int GetBlockCount() const { return (int)m_blocks.size(); }
+
+protected:
+	struct Block {
+		char* memory;
+		size_t size;
+		size_t used;
+	};
+
+	std::vector<Block> m_blocks;
+	size_t m_blockSize;
+};
@@ -3,6 +3,7 @@
 #include <glm/glm.hpp>
 
 enum ShapeType {
+	FLUID = -2,
 	JOINT = -1,
 	PLANE = 0,
 	CIRCLE,
@@ -16,6 +17,8 @@ protected:
 	PhysicsObject(ShapeType a_shapeID, float elasticity, glm::vec4 a_color) : m_shapeID(a_shapeID), m_color(a_color), m_elasticity(elasticity) {}
 
 public:
+	virtual ~PhysicsObject() {}
+
 	virtual void FixedUpdate(glm::vec2 gravity, float timeStep) = 0;
 	virtual void Draw(float alpha) = 0;
 	virtual void ResetPosition() {};
@@ -26,6 +29,7 @@ public:
 	// Getter
 	ShapeType GetShapeID() { return m_shapeID; }
 	float GetElasticity() { return m_elasticity; }
+	glm::vec4 GetColor() { return m_color; }
 
 	// Setter
 	void SetColor(glm::vec4 color) { m_color = color; }
@@ -3,6 +3,7 @@
 #include "Circle.h"
 #include "Box.h"
 #include "Plane.h"
+#include "PhysicsArena.h"
 
 #include <glm/glm.hpp>
 
@@ -18,7 +19,26 @@ PhysicsScene::~PhysicsScene()
 {
 	for (auto pActor : m_actors)
 	{
-		delete pActor;
+		bool inArena = false;
+		for (auto pArena : m_arenas)
+		{
+			if (pArena->Owns(pActor))
+			{
+				inArena = true;
+				break;
+			}
+		}
+
+		// arena memory is released with the arena itself
+		if (inArena)
+			pActor->~PhysicsObject();
+		else
+			delete pActor;
+	}
+
+	for (auto pArena : m_arenas)
+	{
+		delete pArena;
 	}
 }
 
@@ -28,6 +48,12 @@ void PhysicsScene::AddActor(PhysicsObject* actor)
 		m_actors.push_back(actor);
 }
 
+void PhysicsScene::AddArena(PhysicsArena* arena)
+{
+	if (arena != nullptr)
+		m_arenas.push_back(arena);
+}
+
 void PhysicsScene::RemoveActor(PhysicsObject* actor)
 {
 	if (actor != nullptr)
@@ -82,7 +108,11 @@ void PhysicsScene::Draw()
 
 void PhysicsScene::CheckForCollision()
 {
+	// which circle/circle and plane/circle pairs touched at the start of the step
+	FindBatchedContacts();
+
 	int actorCount = m_actors.size();
+	int circleCount = m_circles.size();
 
 	// need to check for collisions against all objects except this one.
 	for (int outer = 0; outer < actorCount - 1; outer++)
@@ -97,6 +127,25 @@ void PhysicsScene::CheckForCollision()
 			if (shapeId1 < 0 || shapeId2 < 0)
 				continue;
 
+			// a pair the kernels found apart can only touch now if an earlier
+			// pair has moved one of its circles. Any other pair is tested again
+			// below against the live state, as earlier pairs may have separated it
+			if (shapeId1 == CIRCLE && shapeId2 == CIRCLE)
+			{
+				size_t first = m_shapeIndex[outer];
+				size_t second = m_shapeIndex[inner];
+				size_t pair = first * (2 * circleCount - first - 1) / 2 + (second - first - 1);
+				if (!m_circlePairTouching[pair] && !CircleMoved(first) && !CircleMoved(second))
+					continue;
+			}
+			else if ((shapeId1 == PLANE && shapeId2 == CIRCLE) || (shapeId1 == CIRCLE && shapeId2 == PLANE))
+			{
+				int plane = m_shapeIndex[shapeId1 == PLANE ? outer : inner];
+				int circle = m_shapeIndex[shapeId1 == PLANE ? inner : outer];
+				if (!m_planePairTouching[plane * circleCount + circle] && !CircleMoved(circle))
+					continue;
+			}
+
 			// using function pointers
 			int functionIdx = (shapeId1 * SHAPE_COUNT) + shapeId2;
 			fn collisionFunctionPtr = collisionFunctionArray[functionIdx];
@@ -109,6 +158,113 @@ void PhysicsScene::CheckForCollision()
 	}
 }
 
+/// <summary>
+/// Gathers every circle and plane into flat arrays and marks which of their pairs
+/// touch with the SIMD kernels. Nothing is resolved here, CheckForCollision resolves
+/// pairs in actor order against the live state as the unbatched loop did. The only
+/// difference left is rounding, a pair whose kernel test and per-pair function disagree
+/// on a graze of about zero penetration can be skipped.
+/// </summary>
+void PhysicsScene::FindBatchedContacts()
+{
+	m_circles.clear();
+	m_planes.clear();
+	m_shapeIndex.resize(m_actors.size());
+	for (size_t i = 0; i < m_actors.size(); i++)
+	{
+		PhysicsObject* pActor = m_actors[i];
+		m_shapeIndex[i] = -1;
+		if (pActor->GetShapeID() == CIRCLE)
+		{
+			m_shapeIndex[i] = m_circles.size();
+			m_circles.push_back(static_cast<Circle*>(pActor));
+		}
+		else if (pActor->GetShapeID() == PLANE)
+		{
+			m_shapeIndex[i] = m_planes.size();
+			m_planes.push_back(static_cast<Plane*>(pActor));
+		}
+	}
+
+	int circleCount = m_circles.size();
+	int planeCount = m_planes.size();
+	m_circlePairTouching.assign(circleCount * (circleCount - 1) / 2, 0);
+	m_planePairTouching.assign(planeCount * circleCount, 0);
+	if (circleCount == 0)
+		return;
+
+	for (auto& data : m_circleData)
+		data.resize(circleCount);
+	for (int i = 0; i < circleCount; i++)
+	{
+		Circle* circle = m_circles[i];
+		m_circleData[0][i] = circle->GetPosition().x;
+		m_circleData[1][i] = circle->GetPosition().y;
+		m_circleData[2][i] = circle->GetVelocity().x;
+		m_circleData[3][i] = circle->GetVelocity().y;
+		m_circleData[4][i] = circle->GetRadius();
+	}
+	CircleArrays circles = { m_circleData[0].data(), m_circleData[1].data(),
+		m_circleData[2].data(), m_circleData[3].data(), m_circleData[4].data() };
+
+	// planes against circles, pair p * circleCount + c
+	if (planeCount > 0)
+	{
+		for (auto& data : m_planeData)
+			data.resize(planeCount);
+		for (int i = 0; i < planeCount; i++)
+		{
+			m_planeData[0][i] = m_planes[i]->GetNormal().x;
+			m_planeData[1][i] = m_planes[i]->GetNormal().y;
+			m_planeData[2][i] = m_planes[i]->GetDistance();
+		}
+		PlaneArrays planes = { m_planeData[0].data(), m_planeData[1].data(), m_planeData[2].data() };
+
+		m_pairFirst.clear();
+		m_pairSecond.clear();
+		for (int p = 0; p < planeCount; p++)
+		{
+			for (int c = 0; c < circleCount; c++)
+			{
+				m_pairFirst.push_back(p);
+				m_pairSecond.push_back(c);
+			}
+		}
+
+		m_contacts.resize(m_pairFirst.size());
+		int contactCount = ContactKernels::Plane2Circle(planes, circles, m_pairFirst.data(),
+			m_pairSecond.data(), m_pairFirst.size(), m_contacts.data());
+		for (int i = 0; i < contactCount; i++)
+			m_planePairTouching[m_contacts[i].pair] = 1;
+	}
+
+	// circles against circles, in the same order as the actor loop
+	m_pairFirst.clear();
+	m_pairSecond.clear();
+	for (int outer = 0; outer < circleCount - 1; outer++)
+	{
+		for (int inner = outer + 1; inner < circleCount; inner++)
+		{
+			m_pairFirst.push_back(outer);
+			m_pairSecond.push_back(inner);
+		}
+	}
+
+	m_contacts.resize(m_pairFirst.size());
+	int contactCount = ContactKernels::Circle2Circle(circles, m_pairFirst.data(), m_pairSecond.data(),
+		m_pairFirst.size(), m_contacts.data());
+	for (int i = 0; i < contactCount; i++)
+		m_circlePairTouching[m_contacts[i].pair] = 1;
+}
+
+// whether a circle's position or velocity has changed since FindBatchedContacts
+bool PhysicsScene::CircleMoved(int index)
+{
+	Circle* circle = m_circles[index];
+	return circle->GetPosition().x != m_circleData[0][index] || circle->GetPosition().y != m_circleData[1][index] ||
+		circle->GetVelocity().x != m_circleData[2][index] || circle->GetVelocity().y != m_circleData[3][index];
+}
+
 void PhysicsScene::ApplyContactForces(Rigidbody* body1, Rigidbody* body2, glm::vec2 norm, float pen)
 {
 	if ((body1 && body1->IsTrigger()) || (body2 && body2->IsTrigger()))
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "ContactKernels.h"
+
 #include <glm/vec2.hpp>
 #include <vector>
 
@@ -11,6 +13,9 @@
 
 class PhysicsObject;
 class Rigidbody;
+class PhysicsArena;
+class Circle;
+class Plane;
 
 class PhysicsScene
 {
@@ -25,8 +30,14 @@ public:
 	void AddActor(PhysicsObject* actor);
 	void RemoveActor(PhysicsObject* actor);
 	PhysicsObject* GetActor(int index) { return *(m_actors.begin() + index); }
+	int GetActorCount() { return m_actors.size(); }
+	void ReserveActors(int count) { m_actors.reserve(count); }
+
+	// the scene takes ownership of the arena and destroys the actors created in it
+	void AddArena(PhysicsArena* arena);
 
 	void CheckForCollision();
+	void FindBatchedContacts();
 	static void ApplyContactForces(Rigidbody* body1, Rigidbody* body2, glm::vec2 norm, float pen);
 
 	static bool Plane2Plane(PhysicsObject*, PhysicsObject*);
@@ -54,4 +65,20 @@ protected:
 	static glm::vec2 m_gravity;
 	float m_timeStep;
 	std::vector<PhysicsObject*> m_actors;
+	std::vector<PhysicsArena*> m_arenas;
+
+	bool CircleMoved(int index);
+
+	// scratch arrays for the batched circle and plane contact kernels, kept
+	// between steps so they only allocate when the scene grows
+	std::vector<int> m_shapeIndex;		// each actor's index in m_circles or m_planes
+	std::vector<Circle*> m_circles;
+	std::vector<Plane*> m_planes;
+	std::vector<float> m_circleData[5];	// posX, posY, velX, velY, radius
+	std::vector<float> m_planeData[3];	// normalX, normalY, distance
+	std::vector<int> m_pairFirst;
+	std::vector<int> m_pairSecond;
+	std::vector<Contact> m_contacts;
+	std::vector<unsigned char> m_circlePairTouching;	// by circle pair, as the kernels order them
+	std::vector<unsigned char> m_planePairTouching;		// by plane * circleCount + circle
 };
\ No newline at end of file
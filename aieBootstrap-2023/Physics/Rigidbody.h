@@ -36,6 +36,7 @@ public:
 	glm::vec2 GetLastPosition()	{ return m_lastPosition; }
 	glm::vec2 GetVelocity()	{ return m_velocity; }
 	float GetMass()	{ return m_isKinematic ? INT_MAX : m_mass; }
+	float GetUnscaledMass() { return m_mass; } // ignores the kinematic state
 
 	float GetOrientation() { return m_orientation; }
 	float GetLastOrientation() { return m_lastOrientation; }
@@ -0,0 +1,769 @@
+#include "SceneFile.h"
+#include "PhysicsScene.h"
+#include "PhysicsArena.h"
+#include "Plane.h"
+#include "Circle.h"
+#include "Box.h"
+#include "Spring.h"
+#include "SoftBody.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+static const char SCENE_MAGIC[4] = { 'P', 'H', 'Y', 'S' };
+static const uint32_t SCENE_VERSION = 1;
+
+enum RecordType : uint32_t {
+	RECORD_MATERIAL = 1,
+	RECORD_PLANE,
+	RECORD_CIRCLE,
+	RECORD_BOX,
+	RECORD_SPRING,
+	RECORD_SOFTBODY,
+};
+
+enum BodyFlags : uint32_t {
+	FLAG_KINEMATIC = 1 << 0,
+	FLAG_TRIGGER = 1 << 1,
+	FLAG_HIDDEN = 1 << 2,
+};
+
+// every field is 4 bytes wide so the records have no padding
+struct SceneHeader {
+	char magic[4];
+	uint32_t version;
+	float gravity[2];
+	float timeStep;
+	uint32_t recordCount;
+	uint32_t actorCount;	// upper bound, used to reserve the scene's actor list
+	uint32_t arenaBytes;	// upper bound, used to size the arena
+};
+
+struct MaterialRecord {
+	float elasticity;
+	float color[4];
+};
+
+struct PlaneRecord {
+	uint32_t material;
+	float normal[2];
+	float distance;
+};
+
+struct BodyRecord {
+	uint32_t material;
+	uint32_t flags;
+	float position[2];
+	float velocity[2];
+	float orientation;
+	float angularVelocity;
+	float mass;
+	float linearDrag;
+	float angularDrag;
+};
+
+struct CircleRecord {
+	BodyRecord body;
+	float radius;
+};
+
+struct BoxRecord {
+	BodyRecord body;
+	float extents[2];
+};
+
+struct SpringRecord {
+	int32_t body1;	// index of the body record, -1 for none
+	int32_t body2;
+	float springCoefficient;
+	float damping;
+	float restLength;	// 0 to measure from the bodies
+	float contact1[2];
+	float contact2[2];
+};
+
+// followed by stringCount * stringLength characters, padded to 4 bytes
+struct SoftBodyRecord {
+	float position[2];
+	float damping;
+	float springForce;
+	float spacing;
+	uint32_t stringCount;
+	uint32_t stringLength;
+};
+
+template <typename T>
+static uint32_t ArenaSize() { return (uint32_t)(sizeof(T) + alignof(T)); }
+
+static size_t Padded(size_t size) { return (size + 3) & ~(size_t)3; }
+
+// the most actors and arena bytes a byte of scene data can ask for, a soft body
+// character making a circle and up to eight springs. The header's totals are
+// capped to these so a corrupt one can't make the load allocate more
+static const uint32_t MAX_ACTORS_PER_BYTE = 9;
+static size_t MaxArenaBytesPerByte() { return ArenaSize<Circle>() + 8 * ArenaSize<Spring>(); }
+
+// appends records to a binary scene buffer and tracks the header totals
+class SceneWriter
+{
+public:
+	SceneWriter() : m_recordCount(0), m_actorCount(0), m_arenaBytes(0), m_gravity(0), m_timeStep(0.01f) {}
+
+	void SetGravity(glm::vec2 gravity) { m_gravity = gravity; }
+	void SetTimeStep(float timeStep) { m_timeStep = timeStep; }
+
+	void AddMaterial(const MaterialRecord& record) { AddRecord(RECORD_MATERIAL, record); }
+	void AddPlane(const PlaneRecord& record)
+		{ AddRecord(RECORD_PLANE, record); AddActors(1, ArenaSize<Plane>()); }
+	void AddCircle(const CircleRecord& record)
+		{ AddRecord(RECORD_CIRCLE, record); AddActors(1, ArenaSize<Circle>()); }
+	void AddBox(const BoxRecord& record)
+		{ AddRecord(RECORD_BOX, record); AddActors(1, ArenaSize<Box>()); }
+	void AddSpring(const SpringRecord& record)
+		{ AddRecord(RECORD_SPRING, record); AddActors(1, ArenaSize<Spring>()); }
+
+	void AddSoftBody(SoftBodyRecord record, const std::vector<std::string>& strings)
+	{
+		record.stringCount = (uint32_t)strings.size();
+		record.stringLength = strings.empty() ? 0 : (uint32_t)strings[0].length();
+		AddRecord(RECORD_SOFTBODY, record);
+
+		uint32_t circles = 0;
+		for (auto& line : strings)
+		{
+			Append(line.data(), record.stringLength);
+			for (char c : line)
+				circles += c == '0';
+		}
+		size_t characters = (size_t)record.stringCount * record.stringLength;
+		m_body.resize(m_body.size() + Padded(characters) - characters, 0);
+
+		// a soft body adds at most eight springs per circle
+		AddActors(circles * 9, circles * (ArenaSize<Circle>() + 8 * ArenaSize<Spring>()));
+	}
+
+	void Finish(std::vector<char>& buffer)
+	{
+		SceneHeader header;
+		memcpy(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC));
+		header.version = SCENE_VERSION;
+		header.gravity[0] = m_gravity.x;
+		header.gravity[1] = m_gravity.y;
+		header.timeStep = m_timeStep;
+		header.recordCount = m_recordCount;
+		header.actorCount = m_actorCount;
+		header.arenaBytes = m_arenaBytes;
+
+		buffer.resize(sizeof(SceneHeader) + m_body.size());
+		memcpy(buffer.data(), &header, sizeof(SceneHeader));
+		if (!m_body.empty())
+			memcpy(buffer.data() + sizeof(SceneHeader), m_body.data(), m_body.size());
+	}
+
+protected:
+	template <typename T>
+	void AddRecord(RecordType type, const T& record)
+	{
+		uint32_t tag = type;
+		Append(&tag, sizeof(tag));
+		Append(&record, sizeof(T));
+		m_recordCount++;
+	}
+
+	void Append(const void* data, size_t size)
+	{
+		const char* bytes = (const char*)data;
+		m_body.insert(m_body.end(), bytes, bytes + size);
+	}
+
+	void AddActors(uint32_t count, uint32_t bytes)
+	{
+		m_actorCount += count;
+		m_arenaBytes += bytes;
+	}
+
+	std::vector<char> m_body;
+	uint32_t m_recordCount;
+	uint32_t m_actorCount;
+	uint32_t m_arenaBytes;
+	glm::vec2 m_gravity;
+	float m_timeStep;
+};
+
+// reads records back out of a binary scene buffer with bounds checking
+class SceneReader
+{
+public:
+	SceneReader(const void* data, size_t size) : m_data((const char*)data), m_size(size), m_offset(0) {}
+
+	template <typename T>
+	bool Read(T& value) { return Read(&value, sizeof(T)); }
+
+	bool Read(void* out, size_t size)
+	{
+		if (m_offset + size > m_size)
+			return false;
+		memcpy(out, m_data + m_offset, size);
+		m_offset += size;
+		return true;
+	}
+
+	bool ReadStrings(const SoftBodyRecord& record, std::vector<std::string>& strings)
+	{
+		// checked by division so a corrupt count and length can't wrap, and
+		// the count is capped by the bytes left even for empty strings
+		size_t remaining = m_size - m_offset;
+		if (record.stringCount > remaining ||
+			(record.stringLength != 0 && record.stringCount > remaining / record.stringLength))
+			return false;
+		size_t characters = (size_t)record.stringCount * record.stringLength;
+		if (Padded(characters) > remaining)
+			return false;
+		strings.resize(record.stringCount);
+		for (uint32_t i = 0; i < record.stringCount; i++)
+			strings[i].assign(m_data + m_offset + (size_t)i * record.stringLength, record.stringLength);
+		m_offset += Padded(characters);
+		return true;
+	}
+
+protected:
+	const char* m_data;
+	size_t m_size;
+	size_t m_offset;
+};
+
+static void ApplyBodyRecord(Rigidbody* body, const BodyRecord& record)
+{
+	body->SetOrientation(record.orientation);
+	body->SetAngularVelocity(record.angularVelocity);
+	body->SetLinearDrag(record.linearDrag);
+	body->SetAngularDrag(record.angularDrag);
+	body->SetKinematic((record.flags & FLAG_KINEMATIC) != 0);
+	body->SetTrigger((record.flags & FLAG_TRIGGER) != 0);
+	body->SetHidden((record.flags & FLAG_HIDDEN) != 0);
+	body->CalculateAxes();
+}
+
+static BodyRecord MakeBodyRecord(Rigidbody* body, uint32_t material)
+{
+	BodyRecord record;
+	record.material = material;
+	record.flags = (body->IsKinematic() ? FLAG_KINEMATIC : 0) |
+		(body->IsTrigger() ? FLAG_TRIGGER : 0) | (body->IsHidden() ? FLAG_HIDDEN : 0);
+	record.position[0] = body->GetPosition().x;
+	record.position[1] = body->GetPosition().y;
+	record.velocity[0] = body->GetVelocity().x;
+	record.velocity[1] = body->GetVelocity().y;
+	record.orientation = body->GetOrientation();
+	record.angularVelocity = body->GetAngularVelocity();
+	record.mass = body->GetUnscaledMass();
+	record.linearDrag = body->GetLinearDrag();
+	record.angularDrag = body->GetAngularDrag();
+	return record;
+}
+
+static bool ReadFile(const char* filename, std::vector<char>& data)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open())
+		return false;
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+/// <summary>
+/// Loads a binary or text scene file and adds its actors to the scene.
+/// </summary>
+/// <param name="scene">: The scene to add the actors to </param>
+/// <param name="filename">: The scene file to load </param>
+bool SceneFile::Load(PhysicsScene* scene, const char* filename)
+{
+	std::vector<char> data;
+	if (!ReadFile(filename, data))
+	{
+		printf("Failed to open scene file %s\n", filename);
+		return false;
+	}
+
+	if (data.size() >= sizeof(SCENE_MAGIC) && memcmp(data.data(), SCENE_MAGIC, sizeof(SCENE_MAGIC)) == 0)
+		return LoadFromMemory(scene, data.data(), data.size());
+
+	data.push_back(0);
+	std::vector<char> binary;
+	if (!CompileText(data.data(), binary))
+	{
+		printf("Failed to parse scene file %s\n", filename);
+		return false;
+	}
+	return LoadFromMemory(scene, binary.data(), binary.size());
+}
+
+/// <summary>
+/// Creates every actor of a binary scene in a single arena, in one pass over the buffer.
+/// </summary>
+/// <param name="scene">: The scene to add the actors to, it takes ownership of the arena </param>
+/// <param name="data">: The binary scene data </param>
+/// <param name="size">: The size of the data in bytes </param>
+bool SceneFile::LoadFromMemory(PhysicsScene* scene, const void* data, size_t size)
+{
+	SceneReader reader(data, size);
+
+	SceneHeader header;
+	if (!reader.Read(header) || memcmp(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC)) != 0)
+	{
+		printf("Scene data is not a physics scene!\n");
+		return false;
+	}
+	if (header.version != SCENE_VERSION)
+	{
+		printf("Scene version %u is not supported!\n", header.version);
+		return false;
+	}
+
+	scene->SetGravity(glm::vec2(header.gravity[0], header.gravity[1]));
+	scene->SetTimeStep(header.timeStep);
+
+	// the arena grows past its first block if the records need more
+	size_t recordBytes = size - sizeof(SceneHeader);
+	size_t actorCount = std::min((size_t)header.actorCount, recordBytes * MAX_ACTORS_PER_BYTE);
+	size_t arenaBytes = std::min((size_t)header.arenaBytes, recordBytes * MaxArenaBytesPerByte());
+	scene->ReserveActors(scene->GetActorCount() + (int)actorCount);
+
+	// hand the arena over first so a partially loaded scene still cleans up
+	PhysicsArena* arena = new PhysicsArena(arenaBytes);
+	scene->AddArena(arena);
+
+	std::vector<MaterialRecord> materials;
+	std::vector<Rigidbody*> bodies; // indexed by plane/circle/box/softbody record
+
+	for (uint32_t i = 0; i < header.recordCount; i++)
+	{
+		uint32_t type = 0;
+		if (!reader.Read(type))
+		{
+			printf("Scene data is truncated!\n");
+			return false;
+		}
+
+		switch (type) {
+		case RECORD_MATERIAL: {
+			MaterialRecord record;
+			if (!reader.Read(record))
+				break;
+			materials.push_back(record);
+			continue;
+		}
+		case RECORD_PLANE: {
+			PlaneRecord record;
+			if (!reader.Read(record))
+				break;
+			if (record.material >= materials.size())
+			{
+				printf("Scene plane uses missing material %u!\n", record.material);
+				return false;
+			}
+			const MaterialRecord& material = materials[record.material];
+			scene->AddActor(arena->Create<Plane>(glm::vec2(record.normal[0], record.normal[1]),
+				record.distance, material.elasticity, glm::make_vec4(material.color)));
+			bodies.push_back(nullptr);
+			continue;
+		}
+		case RECORD_CIRCLE: {
+			CircleRecord record;
+			if (!reader.Read(record))
+				break;
+			if (record.body.material >= materials.size())
+			{
+				printf("Scene circle uses missing material %u!\n", record.body.material);
+				return false;
+			}
+			const MaterialRecord& material = materials[record.body.material];
+			Circle* circle = arena->Create<Circle>(glm::make_vec2(record.body.position),
+				glm::make_vec2(record.body.velocity), record.body.mass, record.radius,
+				material.elasticity, glm::make_vec4(material.color));
+			ApplyBodyRecord(circle, record.body);
+			scene->AddActor(circle);
+			bodies.push_back(circle);
+			continue;
+		}
+		case RECORD_BOX: {
+			BoxRecord record;
+			if (!reader.Read(record))
+				break;
+			if (record.body.material >= materials.size())
+			{
+				printf("Scene box uses missing material %u!\n", record.body.material);
+				return false;
+			}
+			const MaterialRecord& material = materials[record.body.material];
+			Box* box = arena->Create<Box>(glm::make_vec2(record.body.position),
+				glm::make_vec2(record.body.velocity), record.body.orientation, record.body.mass,
+				glm::make_vec2(record.extents), material.elasticity, glm::make_vec4(material.color));
+			ApplyBodyRecord(box, record.body);
+			scene->AddActor(box);
+			bodies.push_back(box);
+			continue;
+		}
+		case RECORD_SPRING: {
+			SpringRecord record;
+			if (!reader.Read(record))
+				break;
+			// -1 anchors that end of the spring to the world
+			if (record.body1 < -1 || record.body1 >= (int)bodies.size() ||
+				record.body2 < -1 || record.body2 >= (int)bodies.size())
+			{
+				printf("Scene spring between bodies %d and %d skipped, there are only %d bodies!\n",
+					record.body1, record.body2, (int)bodies.size());
+				continue;
+			}
+			Rigidbody* body1 = record.body1 >= 0 ? bodies[record.body1] : nullptr;
+			Rigidbody* body2 = record.body2 >= 0 ? bodies[record.body2] : nullptr;
+			scene->AddActor(arena->Create<Spring>(body1, body2, record.springCoefficient, record.damping,
+				record.restLength, glm::make_vec2(record.contact1), glm::make_vec2(record.contact2)));
+			continue;
+		}
+		case RECORD_SOFTBODY: {
+			SoftBodyRecord record;
+			std::vector<std::string> strings;
+			if (!reader.Read(record) || !reader.ReadStrings(record, strings))
+				break;
+			if (!strings.empty() && record.stringLength > 0)
+				SoftBody::Build(scene, glm::make_vec2(record.position), record.damping,
+					record.springForce, record.spacing, strings, arena);
+			bodies.push_back(nullptr);
+			continue;
+		}
+		default:
+			printf("Scene record type %u is unknown!\n", type);
+			return false;
+		}
+
+		printf("Scene data is truncated!\n");
+		return false;
+	}
+
+	return true;
+}
+
+/// <summary>
+/// Writes the scene's planes, circles, boxes and springs to a binary or text scene file.
+/// Soft bodies are saved as the circles and springs they are made of.
+/// </summary>
+/// <param name="scene">: The scene to save </param>
+/// <param name="filename">: The file to write </param>
+/// <param name="asText">: Write the text format instead of the binary format </param>
+bool SceneFile::Save(PhysicsScene* scene, const char* filename, bool asText)
+{
+	SceneWriter writer;
+	writer.SetGravity(PhysicsScene::GetGravity());
+	writer.SetTimeStep(scene->GetTimeStep());
+
+	std::vector<MaterialRecord> materials;
+	auto getMaterial = [&](PhysicsObject* actor) {
+		MaterialRecord record;
+		record.elasticity = actor->GetElasticity();
+		glm::vec4 color = actor->GetColor();
+		memcpy(record.color, &color[0], sizeof(record.color));
+
+		for (uint32_t m = 0; m < materials.size(); m++)
+		{
+			if (memcmp(&materials[m], &record, sizeof(MaterialRecord)) == 0)
+				return m;
+		}
+		materials.push_back(record);
+		writer.AddMaterial(record);
+		return (uint32_t)materials.size() - 1;
+	};
+
+	// bodies first, so springs can always refer back to them
+	std::unordered_map<PhysicsObject*, int32_t> bodyIndices;
+	int32_t bodyCount = 0;
+	std::vector<Spring*> springs;
+	for (int i = 0; i < scene->GetActorCount(); i++)
+	{
+		PhysicsObject* actor = scene->GetActor(i);
+		switch (actor->GetShapeID()) {
+		case PLANE: {
+			Plane* plane = static_cast<Plane*>(actor);
+			PlaneRecord record;
+			record.material = getMaterial(plane);
+			record.normal[0] = plane->GetNormal().x;
+			record.normal[1] = plane->GetNormal().y;
+			record.distance = plane->GetDistance();
+			writer.AddPlane(record);
+			bodyIndices[actor] = bodyCount++;
+			break;
+		}
+		case CIRCLE: {
+			Circle* circle = static_cast<Circle*>(actor);
+			CircleRecord record;
+			record.body = MakeBodyRecord(circle, getMaterial(circle));
+			record.radius = circle->GetRadius();
+			writer.AddCircle(record);
+			bodyIndices[actor] = bodyCount++;
+			break;
+		}
+		case BOX: {
+			Box* box = static_cast<Box*>(actor);
+			BoxRecord record;
+			record.body = MakeBodyRecord(box, getMaterial(box));
+			record.extents[0] = box->GetExtents().x;
+			record.extents[1] = box->GetExtents().y;
+			writer.AddBox(record);
+			bodyIndices[actor] = bodyCount++;
+			break;
+		}
+		case JOINT:
+			if (Spring* spring = dynamic_cast<Spring*>(actor))
+				springs.push_back(spring);
+			break;
+		default:
+			printf("Actor %d has no scene file record and was not saved\n", i);
+			break;
+		}
+	}
+
+	for (Spring* spring : springs)
+	{
+		auto body1 = bodyIndices.find(spring->GetBody1());
+		auto body2 = bodyIndices.find(spring->GetBody2());
+
+		SpringRecord record;
+		record.body1 = body1 != bodyIndices.end() ? body1->second : -1;
+		record.body2 = body2 != bodyIndices.end() ? body2->second : -1;
+		record.springCoefficient = spring->GetSpringCoefficient();
+		record.damping = spring->GetDamping();
+		record.restLength = spring->GetRestLength();
+		record.contact1[0] = spring->GetLocalContact1().x;
+		record.contact1[1] = spring->GetLocalContact1().y;
+		record.contact2[0] = spring->GetLocalContact2().x;
+		record.contact2[1] = spring->GetLocalContact2().y;
+		writer.AddSpring(record);
+	}
+
+	std::vector<char> binary;
+	writer.Finish(binary);
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open())
+	{
+		printf("Failed to open %s for writing\n", filename);
+		return false;
+	}
+
+	if (!asText)
+	{
+		file.write(binary.data(), binary.size());
+		return file.good();
+	}
+
+	// write the text format by walking the records we just built
+	SceneReader reader(binary.data(), binary.size());
+	SceneHeader header;
+	reader.Read(header);
+
+	file.precision(9);
+	file << "gravity " << header.gravity[0] << " " << header.gravity[1] << "\n";
+	file << "timestep " << header.timeStep << "\n";
+
+	auto writeFlags = [&file](uint32_t flags) {
+		if (flags == 0)
+		{
+			file << "-";
+			return;
+		}
+		const char* separator = "";
+		if (flags & FLAG_KINEMATIC) { file << separator << "kinematic"; separator = "|"; }
+		if (flags & FLAG_TRIGGER) { file << separator << "trigger"; separator = "|"; }
+		if (flags & FLAG_HIDDEN) { file << separator << "hidden"; }
+	};
+
+	for (uint32_t i = 0; i < header.recordCount; i++)
+	{
+		uint32_t type = 0;
+		reader.Read(type);
+		switch (type) {
+		case RECORD_MATERIAL: {
+			MaterialRecord r;
+			reader.Read(r);
+			file << "material " << r.elasticity << " " << r.color[0] << " " << r.color[1] << " "
+				<< r.color[2] << " " << r.color[3] << "\n";
+			break;
+		}
+		case RECORD_PLANE: {
+			PlaneRecord r;
+			reader.Read(r);
+			file << "plane " << r.material << " " << r.normal[0] << " " << r.normal[1] << " " << r.distance << "\n";
+			break;
+		}
+		case RECORD_CIRCLE: {
+			CircleRecord r;
+			reader.Read(r);
+			file << "circle " << r.body.material << " ";
+			writeFlags(r.body.flags);
+			file << " " << r.body.position[0] << " " << r.body.position[1] << " " << r.body.velocity[0]
+				<< " " << r.body.velocity[1] << " " << r.body.mass << " " << r.radius << "\n";
+			break;
+		}
+		case RECORD_BOX: {
+			BoxRecord r;
+			reader.Read(r);
+			file << "box " << r.body.material << " ";
+			writeFlags(r.body.flags);
+			file << " " << r.body.position[0] << " " << r.body.position[1] << " " << r.body.velocity[0]
+				<< " " << r.body.velocity[1] << " " << r.body.orientation << " " << r.body.mass << " "
+				<< r.extents[0] << " " << r.extents[1] << "\n";
+			break;
+		}
+		case RECORD_SPRING: {
+			SpringRecord r;
+			reader.Read(r);
+			file << "spring " << r.body1 << " " << r.body2 << " " << r.springCoefficient << " "
+				<< r.damping << " " << r.restLength << " " << r.contact1[0] << " " << r.contact1[1] << " "
+				<< r.contact2[0] << " " << r.contact2[1] << "\n";
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	return file.good();
+}
+
+static bool ParseFlags(const std::string& token, uint32_t& flags)
+{
+	flags = 0;
+	if (token == "-")
+		return true;
+
+	std::stringstream names(token);
+	std::string name;
+	while (std::getline(names, name, '|'))
+	{
+		if (name == "kinematic") flags |= FLAG_KINEMATIC;
+		else if (name == "trigger") flags |= FLAG_TRIGGER;
+		else if (name == "hidden") flags |= FLAG_HIDDEN;
+		else return false;
+	}
+	return true;
+}
+
+static void InitialiseBodyRecord(BodyRecord& body)
+{
+	memset(&body, 0, sizeof(BodyRecord));
+	body.linearDrag = LINEAR_DRAG;
+	body.angularDrag = ANGULAR_DRAG;
+}
+
+bool SceneFile::CompileText(const char* text, std::vector<char>& binary)
+{
+	SceneWriter writer;
+	writer.SetGravity(glm::vec2(0));
+
+	std::istringstream lines(text);
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(lines, line))
+	{
+		lineNumber++;
+		std::istringstream tokens(line);
+		std::string keyword;
+		if (!(tokens >> keyword) || keyword[0] == '#')
+			continue;
+
+		bool valid = true;
+		if (keyword == "gravity")
+		{
+			glm::vec2 gravity;
+			valid = (bool)(tokens >> gravity.x >> gravity.y);
+			writer.SetGravity(gravity);
+		}
+		else if (keyword == "timestep")
+		{
+			float timeStep = 0;
+			valid = (bool)(tokens >> timeStep) && timeStep > 0;
+			writer.SetTimeStep(timeStep);
+		}
+		else if (keyword == "material")
+		{
+			MaterialRecord r;
+			valid = (bool)(tokens >> r.elasticity >> r.color[0] >> r.color[1] >> r.color[2] >> r.color[3]);
+			writer.AddMaterial(r);
+		}
+		else if (keyword == "plane")
+		{
+			PlaneRecord r;
+			valid = (bool)(tokens >> r.material >> r.normal[0] >> r.normal[1] >> r.distance);
+			writer.AddPlane(r);
+		}
+		else if (keyword == "circle")
+		{
+			CircleRecord r;
+			InitialiseBodyRecord(r.body);
+			std::string flags;
+			valid = (bool)(tokens >> r.body.material >> flags >> r.body.position[0] >> r.body.position[1]
+				>> r.body.velocity[0] >> r.body.velocity[1] >> r.body.mass >> r.radius)
+				&& ParseFlags(flags, r.body.flags);
+			writer.AddCircle(r);
+		}
+		else if (keyword == "box")
+		{
+			BoxRecord r;
+			InitialiseBodyRecord(r.body);
+			std::string flags;
+			valid = (bool)(tokens >> r.body.material >> flags >> r.body.position[0] >> r.body.position[1]
+				>> r.body.velocity[0] >> r.body.velocity[1] >> r.body.orientation >> r.body.mass
+				>> r.extents[0] >> r.extents[1]) && ParseFlags(flags, r.body.flags);
+			writer.AddBox(r);
+		}
+		else if (keyword == "spring")
+		{
+			SpringRecord r;
+			memset(&r, 0, sizeof(SpringRecord));
+			valid = (bool)(tokens >> r.body1 >> r.body2 >> r.springCoefficient >> r.damping);
+			// the rest length and contacts are optional, but the contacts come
+			// as a pair of points or not at all
+			if (valid && tokens >> r.restLength && tokens >> r.contact1[0])
+				valid = (bool)(tokens >> r.contact1[1] >> r.contact2[0] >> r.contact2[1]);
+			writer.AddSpring(r);
+		}
+		else if (keyword == "softbody")
+		{
+			SoftBodyRecord r;
+			std::vector<std::string> strings;
+			std::string row;
+			valid = (bool)(tokens >> r.position[0] >> r.position[1] >> r.damping >> r.springForce >> r.spacing);
+			while (tokens >> row)
+			{
+				if (!strings.empty() && row.length() != strings[0].length())
+					valid = false;
+				strings.push_back(row);
+			}
+			valid = valid && !strings.empty();
+			writer.AddSoftBody(r, strings);
+		}
+		else
+		{
+			valid = false;
+		}
+
+		if (!valid)
+		{
+			printf("Scene text line %d is invalid: %s\n", lineNumber, line.c_str());
+			return false;
+		}
+	}
+
+	writer.Finish(binary);
+	return true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+class PhysicsScene;
+
+// Loads and saves PhysicsScene levels. The binary format is a header followed
+// by a stream of tagged records (materials, planes, circles, boxes, springs and
+// soft bodies). The header carries the number of bytes the actors need, so a
+// load allocates them all from a single PhysicsArena in one pass.
+//
+// The text format has one record per line and is compiled to the binary
+// format before loading:
+//   gravity <x> <y>
+//   timestep <seconds>
+//   material <elasticity> <r> <g> <b> <a>
+//   plane <material> <normalX> <normalY> <distance>
+//   circle <material> <flags> <x> <y> <vx> <vy> <mass> <radius>
+//   box <material> <flags> <x> <y> <vx> <vy> <orientation> <mass> <extentX> <extentY>
+//   spring <body1> <body2> <coefficient> <damping> [restLength [c1x c1y c2x c2y]]
+//   softbody <x> <y> <damping> <springForce> <spacing> <row> [row ...]
+// flags are "-" or any of "kinematic|trigger|hidden", bodies are the zero based
+// index of the plane/circle/box/softbody line (-1 for none), and soft body rows
+// use '0' for a circle. A spring's contacts are local to its bodies, or world
+// positions for an end with no body.
+class SceneFile
+{
+public:
+	static bool Load(PhysicsScene* scene, const char* filename);
+	static bool LoadFromMemory(PhysicsScene* scene, const void* data, size_t size);
+
+	static bool Save(PhysicsScene* scene, const char* filename, bool asText = false);
+
+	// converts the text format into the binary format
+	static bool CompileText(const char* text, std::vector<char>& binary);
+};
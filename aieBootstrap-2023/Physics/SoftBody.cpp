@@ -3,6 +3,17 @@
 #include "PhysicsScene.h"
 #include "Circle.h"
 #include "Spring.h"
+#include "PhysicsArena.h"
+
+// creates the spring in the arena when one is provided, otherwise on the heap
+static void AddSpring(PhysicsScene* scene, PhysicsArena* arena, Circle* body1, Circle* body2,
+	float springCoefficient, float damping, float restLength)
+{
+	if (arena)
+		scene->AddActor(arena->Create<Spring>(body1, body2, springCoefficient, damping, restLength));
+	else
+		scene->AddActor(new Spring(body1, body2, springCoefficient, damping, restLength));
+}
 
 /// <summary>
 /// Builds a softbody with the provided information.
@@ -13,8 +24,9 @@
 /// <param name="springForce">: </param>
 /// <param name="spacing">: </param>
 /// <param name="strings">: </param>
+/// <param name="arena">: Optional arena to create the circles and springs in, owned by the scene </param>
 void SoftBody::Build(PhysicsScene* scene, glm::vec2 position, float damping, 
-	float springForce, float spacing, std::vector<std::string>& strings)
+	float springForce, float spacing, std::vector<std::string>& strings, PhysicsArena* arena)
 {
 	int numColumns = strings.size();
 	int numRows = strings[0].length();
@@ -27,8 +39,13 @@ void SoftBody::Build(PhysicsScene* scene, glm::vec2 position, float damping,
 		{
 			if (strings[j][i] == '0')
 			{
-				circles[i * numColumns + j] = new Circle(position + glm::vec2(i, j) * spacing, 
-					glm::vec2(0, 0), 1.0f, 2.0f, 1, glm::vec4(1, 0, 0, 1));
+				glm::vec2 circlePosition = position + glm::vec2(i, j) * spacing;
+				if (arena)
+					circles[i * numColumns + j] = arena->Create<Circle>(circlePosition,
+						glm::vec2(0, 0), 1.0f, 2.0f, 1.0f, glm::vec4(1, 0, 0, 1));
+				else
+					circles[i * numColumns + j] = new Circle(circlePosition,
+						glm::vec2(0, 0), 1.0f, 2.0f, 1.0f, glm::vec4(1, 0, 0, 1));
 				scene->AddActor(circles[i * numColumns + j]);
 			}
 			else
@@ -50,18 +67,18 @@ void SoftBody::Build(PhysicsScene* scene, glm::vec2 position, float damping,
 
 			// make springs to cardinal neighbours
 			if (s11 && s01)
-				scene->AddActor(new Spring(s11, s01, damping, springForce, spacing));
+				AddSpring(scene, arena, s11, s01, damping, springForce, spacing);
 			if (s11 && s10)
-				scene->AddActor(new Spring(s11, s10, damping, springForce, spacing));
+				AddSpring(scene, arena, s11, s10, damping, springForce, spacing);
 			if (s10 && s00)
-				scene->AddActor(new Spring(s10, s00, damping, springForce, spacing));
+				AddSpring(scene, arena, s10, s00, damping, springForce, spacing);
 			if (s01 && s00)
-				scene->AddActor(new Spring(s01, s00, damping, springForce, spacing));
+				AddSpring(scene, arena, s01, s00, damping, springForce, spacing);
 
 			if(s11 && s00)
-				scene->AddActor(new Spring(s11, s00, damping, springForce, spacing * sqrt(2.0f)));
+				AddSpring(scene, arena, s11, s00, damping, springForce, spacing * sqrt(2.0f));
 			if (s01 && s10)
-				scene->AddActor(new Spring(s01, s10, damping, springForce, spacing * sqrt(2.0f)));
+				AddSpring(scene, arena, s01, s10, damping, springForce, spacing * sqrt(2.0f));
 
 			bool endOfJ = j == numColumns - 1;
 			bool endOfI = i == numRows - 1;
@@ -71,11 +88,12 @@ void SoftBody::Build(PhysicsScene* scene, glm::vec2 position, float damping,
 			Circle* s20 = !endOfI ? circles[(i + 1) * numColumns + j - 1] : nullptr;
 
 			if (s00 && s02)
-				scene->AddActor(new Spring(s00, s02, damping, springForce, spacing * 2.0f));
+				AddSpring(scene, arena, s00, s02, damping, springForce, spacing * 2.0f);
 			if (s22 && s20)
-				scene->AddActor(new Spring(s22, s20, damping, springForce, spacing * 2.0f));
+				AddSpring(scene, arena, s22, s20, damping, springForce, spacing * 2.0f);
 		}
 
 	}
 
+	delete[] circles;
 }
@@ -5,11 +5,13 @@
 #include <string>
 
 class PhysicsScene;
+class PhysicsArena;
 
 class SoftBody
 {
 public:
 	static void Build(PhysicsScene* scene, glm::vec2 position, float damping, 
-		float springForce, float spacing, std::vector<std::string>& strings);
+		float springForce, float spacing, std::vector<std::string>& strings,
+		PhysicsArena* arena = nullptr);
 };
 
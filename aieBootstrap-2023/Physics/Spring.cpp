@@ -29,8 +29,9 @@ Spring::~Spring()
 
 void Spring::FixedUpdate(glm::vec2 gravity, float timeStep)
 {
-	m_body1->CalculateSmoothedPosition(1);
-	m_body2->CalculateSmoothedPosition(1);
+	// a null body anchors that end of the spring to the world
+	if (m_body1) m_body1->CalculateSmoothedPosition(1);
+	if (m_body2) m_body2->CalculateSmoothedPosition(1);
 
 	// Get the world coordinates of the ends of the springs
 	glm::vec2 p1 = GetContact1(1);
@@ -40,7 +41,9 @@ void Spring::FixedUpdate(glm::vec2 gravity, float timeStep)
 	glm::vec2 direction = glm::normalize(p2 - p1);
 
 	// apply damping
-	glm::vec2 relativeVelocity = m_body2->GetVelocity() - m_body1->GetVelocity();
+	glm::vec2 velocity1 = m_body1 ? m_body1->GetVelocity() : glm::vec2(0);
+	glm::vec2 velocity2 = m_body2 ? m_body2->GetVelocity() : glm::vec2(0);
+	glm::vec2 relativeVelocity = velocity2 - velocity1;
 
 	// F = -kX - bv
 	glm::vec2 force = direction * m_springCoefficient * (m_restLength - length) - m_damping * relativeVelocity;
@@ -51,8 +54,8 @@ void Spring::FixedUpdate(glm::vec2 gravity, float timeStep)
 	if (forceMag > threshold)
 		force *= threshold / forceMag;
 
-	m_body1->ApplyForce(-force * timeStep, p1 - m_body1->GetPosition());
-	m_body2->ApplyForce(force * timeStep, p2 - m_body2->GetPosition());
+	if (m_body1) m_body1->ApplyForce(-force * timeStep, p1 - m_body1->GetPosition());
+	if (m_body2) m_body2->ApplyForce(force * timeStep, p2 - m_body2->GetPosition());
 }
 
 void Spring::Draw(float alpha)
@@ -23,6 +23,13 @@ public:
 		{ return m_body1 ? m_body1->ToWorldSmoothed(m_contact1) : m_contact1; }
 	glm::vec2 GetContact2(float alpha) 
 		{ return m_body2 ? m_body2->ToWorldSmoothed(m_contact2) : m_contact2; }
+	Rigidbody* GetBody1() { return m_body1; }
+	Rigidbody* GetBody2() { return m_body2; }
+	glm::vec2 GetLocalContact1() { return m_contact1; }
+	glm::vec2 GetLocalContact2() { return m_contact2; }
+	float GetDamping() { return m_damping; }
+	float GetRestLength() { return m_restLength; }
+	float GetSpringCoefficient() { return m_springCoefficient; }
 
 protected:
 	Rigidbody* m_body1;
@@ -0,0 +1,298 @@
+#include "ContactKernelsTest.h"
+
+#include <Box.h>
+#include <Circle.h>
+#include <ContactKernels.h>
+#include <PhysicsScene.h>
+#include <Plane.h>
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#define CIRCLE_COUNT 64
+#define PLANE_COUNT 8
+
+// every count from empty to a few packets, so each tail length is run after
+// zero, one and two full packets, then one long run
+static const int PAIR_COUNTS[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 1001 };
+
+// how the pair indices are laid out, the SIMD kernels load packets of the same
+// or consecutive indices differently to scattered ones
+enum PairLayout { LAYOUT_RANDOM, LAYOUT_SAME, LAYOUT_CONSECUTIVE, LAYOUT_COUNT };
+static const char* LAYOUT_NAMES[] = { "random", "same", "consecutive" };
+
+struct CircleData
+{
+	std::vector<float> posX, posY, velX, velY, radius;
+
+	CircleArrays GetArrays() const
+	{
+		return { posX.data(), posY.data(), velX.data(), velY.data(), radius.data() };
+	}
+};
+
+struct PlaneData
+{
+	std::vector<float> normalX, normalY, distance;
+
+	PlaneArrays GetArrays() const
+	{
+		return { normalX.data(), normalY.data(), distance.data() };
+	}
+};
+
+// circles packed in to a box about as wide as four of them, so roughly half of
+// the random pairs overlap and half don't
+static CircleData MakeCircles(std::mt19937& random)
+{
+	std::uniform_real_distribution<float> position(-4, 4);
+	std::uniform_real_distribution<float> velocity(-5, 5);
+	std::uniform_real_distribution<float> radius(0.25f, 2);
+
+	CircleData circles;
+	for (int i = 0; i < CIRCLE_COUNT; i++)
+	{
+		circles.posX.push_back(position(random));
+		circles.posY.push_back(position(random));
+		circles.velX.push_back(velocity(random));
+		circles.velY.push_back(velocity(random));
+		circles.radius.push_back(radius(random));
+	}
+	return circles;
+}
+
+// planes through the circles' box, so circles sit on both sides of them
+static PlaneData MakePlanes(std::mt19937& random)
+{
+	std::uniform_real_distribution<float> angle(0, 6.2831853f);
+	std::uniform_real_distribution<float> distance(-2, 2);
+
+	PlaneData planes;
+	for (int i = 0; i < PLANE_COUNT; i++)
+	{
+		float a = angle(random);
+		planes.normalX.push_back(cosf(a));
+		planes.normalY.push_back(sinf(a));
+		planes.distance.push_back(distance(random));
+	}
+	return planes;
+}
+
+static void MakePairs(std::mt19937& random, PairLayout layout, int count, int firstRange, int secondRange,
+	std::vector<int>& first, std::vector<int>& second)
+{
+	std::uniform_int_distribution<int> firstIndex(0, firstRange - 1);
+	std::uniform_int_distribution<int> secondIndex(0, secondRange - 1);
+
+	first.resize(count);
+	second.resize(count);
+	int same = firstIndex(random);
+	int start = secondIndex(random);
+	for (int i = 0; i < count; i++)
+	{
+		switch (layout)
+		{
+		case LAYOUT_SAME:
+			first[i] = same;
+			second[i] = secondIndex(random);
+			break;
+		case LAYOUT_CONSECUTIVE:
+			first[i] = firstIndex(random);
+			second[i] = (start + i) % secondRange;
+			break;
+		default:
+			first[i] = firstIndex(random);
+			second[i] = secondIndex(random);
+			break;
+		}
+	}
+}
+
+// the kernels promise bit identical results, so exact comparison is intended
+static bool CompareContacts(const char* kernel, const char* layout, int pairCount,
+	const Contact* simd, int simdCount, const Contact* scalar, int scalarCount)
+{
+	if (simdCount != scalarCount)
+	{
+		printf("  %s, %s pairs, %d pairs: %d contacts but scalar found %d\n",
+			kernel, layout, pairCount, simdCount, scalarCount);
+		return false;
+	}
+
+	for (int i = 0; i < simdCount; i++)
+	{
+		if (simd[i].pair != scalar[i].pair || simd[i].penetration != scalar[i].penetration ||
+			simd[i].point != scalar[i].point)
+		{
+			printf("  %s, %s pairs, %d pairs: contact %d differs, pair %d (%g) and pair %d (%g)\n",
+				kernel, layout, pairCount, i, simd[i].pair, simd[i].penetration,
+				scalar[i].pair, scalar[i].penetration);
+			return false;
+		}
+	}
+	return true;
+}
+
+int RunContactKernelsTest()
+{
+	printf("Contact kernels, SIMD against scalar\n");
+
+	std::mt19937 random(1234);
+	int failures = 0;
+	int cases = 0;
+	int touching = 0;
+	int pairsTested = 0;
+
+	std::vector<int> first, second;
+	std::vector<Contact> simd, scalar;
+
+	// a fresh set of circles and planes for each round, the same pairs go
+	// through both versions of a kernel
+	for (int round = 0; round < 20; round++)
+	{
+		CircleData circles = MakeCircles(random);
+		PlaneData planes = MakePlanes(random);
+
+		for (int layout = 0; layout < LAYOUT_COUNT; layout++)
+		{
+			for (int pairCount : PAIR_COUNTS)
+			{
+				simd.assign(pairCount, Contact());
+				scalar.assign(pairCount, Contact());
+
+				MakePairs(random, (PairLayout)layout, pairCount, CIRCLE_COUNT, CIRCLE_COUNT, first, second);
+				int simdCount = ContactKernels::Circle2Circle(circles.GetArrays(),
+					first.data(), second.data(), pairCount, simd.data());
+				int scalarCount = ContactKernels::Circle2CircleScalar(circles.GetArrays(),
+					first.data(), second.data(), pairCount, scalar.data());
+				if (!CompareContacts("Circle2Circle", LAYOUT_NAMES[layout], pairCount,
+					simd.data(), simdCount, scalar.data(), scalarCount))
+					failures++;
+				touching += scalarCount;
+				pairsTested += pairCount;
+				cases++;
+
+				MakePairs(random, (PairLayout)layout, pairCount, PLANE_COUNT, CIRCLE_COUNT, first, second);
+				simdCount = ContactKernels::Plane2Circle(planes.GetArrays(), circles.GetArrays(),
+					first.data(), second.data(), pairCount, simd.data());
+				scalarCount = ContactKernels::Plane2CircleScalar(planes.GetArrays(), circles.GetArrays(),
+					first.data(), second.data(), pairCount, scalar.data());
+				if (!CompareContacts("Plane2Circle", LAYOUT_NAMES[layout], pairCount,
+					simd.data(), simdCount, scalar.data(), scalarCount))
+					failures++;
+				touching += scalarCount;
+				pairsTested += pairCount;
+				cases++;
+			}
+		}
+	}
+
+	// a test that only ever saw one outcome wouldn't show much
+	if (touching == 0 || touching == pairsTested)
+	{
+		printf("  %d of %d pairs touched, the random pairs need both outcomes\n", touching, pairsTested);
+		failures++;
+	}
+
+	printf("%d of %d cases passed, %d of %d pairs touching\n\n",
+		cases - failures, cases, touching, pairsTested);
+	return failures;
+}
+
+// the scene both versions step, planes, circles and boxes interleaved so the
+// actor order mixes every kind of pair
+static void MakeScene(PhysicsScene& scene)
+{
+	std::mt19937 random(99);
+	std::uniform_real_distribution<float> x(-8, 8);
+	std::uniform_real_distribution<float> y(2, 30);
+	std::uniform_real_distribution<float> radius(0.5f, 1.5f);
+
+	scene.AddActor(new Plane(glm::normalize(glm::vec2(0.6f, 0.8f)), 0, 0.6f, glm::vec4(1)));
+	for (int i = 0; i < 60; i++)
+	{
+		if (i == 20)
+			scene.AddActor(new Plane(glm::normalize(glm::vec2(-0.6f, 0.8f)), 0, 0.6f, glm::vec4(1)));
+		if (i % 15 == 7)
+			scene.AddActor(new Box(glm::vec2(x(random), y(random)), glm::vec2(0), 0.3f, 2,
+				glm::vec2(1, 0.5f), 0.6f, glm::vec4(1)));
+		scene.AddActor(new Circle(glm::vec2(x(random), y(random)), glm::vec2(0), 1, radius(random),
+			0.6f, glm::vec4(1)));
+	}
+}
+
+// PhysicsScene::CheckForCollision before the kernels, every pair in actor order
+static void CheckEveryPair(PhysicsScene& scene)
+{
+	typedef bool(*fn)(PhysicsObject*, PhysicsObject*);
+	static fn functions[] =
+	{
+		PhysicsScene::Plane2Plane,  PhysicsScene::Plane2Circle,  PhysicsScene::Plane2Box,
+		PhysicsScene::Circle2Plane, PhysicsScene::Circle2Circle, PhysicsScene::Circle2Box,
+		PhysicsScene::Box2Plane,    PhysicsScene::Box2Circle,    PhysicsScene::Box2Box,
+	};
+
+	int actorCount = scene.GetActorCount();
+	for (int outer = 0; outer < actorCount - 1; outer++)
+	{
+		for (int inner = outer + 1; inner < actorCount; inner++)
+		{
+			PhysicsObject* object1 = scene.GetActor(outer);
+			PhysicsObject* object2 = scene.GetActor(inner);
+			if (object1->GetShapeID() < 0 || object2->GetShapeID() < 0)
+				continue;
+			functions[object1->GetShapeID() * SHAPE_COUNT + object2->GetShapeID()](object1, object2);
+		}
+	}
+}
+
+int RunBatchedCollisionTest()
+{
+	printf("Batched collision, against every pair in actor order\n");
+
+	PhysicsScene batched, unbatched;
+	batched.SetGravity(glm::vec2(0, -30));
+	MakeScene(batched);
+	MakeScene(unbatched);
+
+	const float timeStep = 0.01f;
+	int contacts = 0;
+	for (int step = 0; step < 500; step++)
+	{
+		for (int i = 0; i < batched.GetActorCount(); i++)
+		{
+			batched.GetActor(i)->FixedUpdate(PhysicsScene::GetGravity(), timeStep);
+			unbatched.GetActor(i)->FixedUpdate(PhysicsScene::GetGravity(), timeStep);
+		}
+		batched.CheckForCollision();
+		CheckEveryPair(unbatched);
+
+		for (int i = 0; i < batched.GetActorCount(); i++)
+		{
+			Rigidbody* a = dynamic_cast<Rigidbody*>(batched.GetActor(i));
+			Rigidbody* b = dynamic_cast<Rigidbody*>(unbatched.GetActor(i));
+			if (!a)
+				continue;
+			if (a->GetPosition() != b->GetPosition() || a->GetVelocity() != b->GetVelocity())
+			{
+				printf("  step %d, actor %d at (%g, %g) but unbatched at (%g, %g)\n", step, i,
+					a->GetPosition().x, a->GetPosition().y, b->GetPosition().x, b->GetPosition().y);
+				printf("\n");
+				return 1;
+			}
+			contacts += a->GetPosition().y < 2;
+		}
+	}
+
+	// the pile has to have settled in to the planes and each other
+	if (contacts == 0)
+	{
+		printf("  nothing reached the planes\n\n");
+		return 1;
+	}
+
+	printf("500 of 500 steps matched\n\n");
+	return 0;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+// Runs the SIMD contact kernels and their scalar versions over the same random
+// candidate pairs and checks they find identical contacts. Prints each mismatch
+// and returns the number of failed cases.
+int RunContactKernelsTest();
+
+// Steps a pile of circles and boxes in a V of planes twice, once through
+// PhysicsScene::CheckForCollision and once through the unbatched pair loop,
+// and checks every body ends up in the same place. Returns 1 on a mismatch.
+int RunBatchedCollisionTest();
@@ -0,0 +1,67 @@
+#include "FluidBenchmark.h"
+
+#include <Fluid.h>
+#include <Plane.h>
+#include <PhysicsScene.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+// steps run before timing, so the fluid has started to move and the grid
+// and scratch arrays have grown to their working size
+#define WARMUP_STEPS 10
+#define TIMED_STEPS 50
+
+static const int PARTICLE_COUNTS[] = { 10000, 25000, 50000, 100000, 200000 };
+
+static const float TIME_STEP = 0.01f;
+static const float SMOOTHING_RADIUS = 1.0f;
+
+void RunFluidBenchmark(int threadCount)
+{
+	printf("Fluid step, %s\n", threadCount == 1 ? "single threaded" : "multi-threaded");
+	printf("%10s %12s %12s %16s\n", "particles", "mean (ms)", "best (ms)", "particles/ms");
+
+	for (int count : PARTICLE_COUNTS)
+	{
+		PhysicsScene scene;
+		scene.SetGravity(glm::vec2(0, -10));
+		scene.SetTimeStep(TIME_STEP);
+
+		// a square block of particles, in a tank twice its width with room
+		// above for it to slump in to
+		float spacing = SMOOTHING_RADIUS * 0.5f;
+		int columns = (int)ceilf(sqrtf((float)count));
+		float width = columns * spacing;
+		scene.AddActor(new Plane(glm::vec2(0, 1), 0, 0.3f, glm::vec4(1)));
+		scene.AddActor(new Plane(glm::vec2(1, 0), 0, 0.3f, glm::vec4(1)));
+		scene.AddActor(new Plane(glm::vec2(-1, 0), -width * 2, 0.3f, glm::vec4(1)));
+
+		Fluid* fluid = new Fluid(&scene, SMOOTHING_RADIUS, 1000, 2000, 0.5f, 0.3f, glm::vec4(0, 0, 1, 1));
+		fluid->SetThreadCount(threadCount);
+		for (int i = 0; i < count; i++)
+			fluid->AddParticle(glm::vec2((i % columns) + 0.5f, (i / columns) + 0.5f) * spacing);
+		scene.AddActor(fluid);
+
+		for (int step = 0; step < WARMUP_STEPS; step++)
+			fluid->FixedUpdate(scene.GetGravity(), TIME_STEP);
+
+		float total = 0;
+		float best = 0;
+		for (int step = 0; step < TIMED_STEPS; step++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			fluid->FixedUpdate(scene.GetGravity(), TIME_STEP);
+			auto end = std::chrono::high_resolution_clock::now();
+
+			float time = std::chrono::duration<float, std::milli>(end - start).count();
+			total += time;
+			best = step == 0 ? time : std::min(best, time);
+		}
+
+		float mean = total / TIMED_STEPS;
+		printf("%10d %12.2f %12.2f %16.0f\n", count, mean, best, count / mean);
+	}
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Steps an SPH fluid of 10k to 200k particles settling in a walled tank and
+// prints the average and best time per step for each size. A threadCount of
+// 0 uses every hardware thread, 1 keeps the whole step on this thread.
+void RunFluidBenchmark(int threadCount);
@@ -0,0 +1,150 @@
+#include "SceneFileTest.h"
+
+#include <Circle.h>
+#include <PhysicsScene.h>
+#include <SceneFile.h>
+#include <Spring.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#define SCENE_TEST_FILE "SceneFileTest.scene"
+
+static bool Near(glm::vec2 a, glm::vec2 b) { return glm::distance(a, b) < 1e-4f; }
+
+static std::vector<Spring*> GetSprings(PhysicsScene& scene)
+{
+	std::vector<Spring*> springs;
+	for (int i = 0; i < scene.GetActorCount(); i++)
+	{
+		if (Spring* spring = dynamic_cast<Spring*>(scene.GetActor(i)))
+			springs.push_back(spring);
+	}
+	return springs;
+}
+
+// one spring anchored at a world position and one between offset points on
+// two circles, saved and loaded back in the given format
+static bool TestRoundTrip(bool asText)
+{
+	const char* format = asText ? "text" : "binary";
+
+	PhysicsScene scene;
+	Circle* circle1 = new Circle(glm::vec2(0, 10), glm::vec2(0), 1, 1, 0.5f, glm::vec4(1));
+	Circle* circle2 = new Circle(glm::vec2(4, 10), glm::vec2(0), 1, 1, 0.5f, glm::vec4(1));
+	scene.AddActor(circle1);
+	scene.AddActor(circle2);
+	scene.AddActor(new Spring(nullptr, circle1, 10, 1, 3, glm::vec2(2.5f, 14), glm::vec2(0.5f, 0)));
+	scene.AddActor(new Spring(circle1, circle2, 20, 2, 5, glm::vec2(0, 0.75f), glm::vec2(-0.25f, 0)));
+
+	if (!SceneFile::Save(&scene, SCENE_TEST_FILE, asText))
+	{
+		printf("  %s: save failed\n", format);
+		return false;
+	}
+
+	PhysicsScene loaded;
+	bool result = SceneFile::Load(&loaded, SCENE_TEST_FILE);
+	remove(SCENE_TEST_FILE);
+	if (!result)
+	{
+		printf("  %s: load failed\n", format);
+		return false;
+	}
+
+	std::vector<Spring*> before = GetSprings(scene);
+	std::vector<Spring*> after = GetSprings(loaded);
+	if (before.size() != after.size())
+	{
+		printf("  %s: %d springs saved but %d loaded\n", format, (int)before.size(), (int)after.size());
+		return false;
+	}
+
+	for (size_t i = 0; i < before.size(); i++)
+	{
+		Spring* a = before[i];
+		Spring* b = after[i];
+		if ((a->GetBody1() == nullptr) != (b->GetBody1() == nullptr) ||
+			(a->GetBody2() == nullptr) != (b->GetBody2() == nullptr) ||
+			!Near(a->GetLocalContact1(), b->GetLocalContact1()) ||
+			!Near(a->GetLocalContact2(), b->GetLocalContact2()) ||
+			fabsf(a->GetRestLength() - b->GetRestLength()) > 1e-4f)
+		{
+			printf("  %s: spring %d loaded as contacts (%g, %g) (%g, %g), saved as (%g, %g) (%g, %g)\n",
+				format, (int)i, b->GetLocalContact1().x, b->GetLocalContact1().y,
+				b->GetLocalContact2().x, b->GetLocalContact2().y, a->GetLocalContact1().x,
+				a->GetLocalContact1().y, a->GetLocalContact2().x, a->GetLocalContact2().y);
+			return false;
+		}
+	}
+	return true;
+}
+
+// springs written before the contacts were saved still load, with them at 0
+static bool TestOldSpringLine()
+{
+	const char* text =
+		"material 0.5 1 1 1 1\n"
+		"circle 0 - 0 10 0 0 1 1\n"
+		"spring -1 0 10 1\n"
+		"spring -1 0 10 1 3\n";
+
+	std::vector<char> binary;
+	PhysicsScene scene;
+	if (!SceneFile::CompileText(text, binary) || !SceneFile::LoadFromMemory(&scene, binary.data(), binary.size()))
+	{
+		printf("  springs without contacts failed to load\n");
+		return false;
+	}
+
+	std::vector<Spring*> springs = GetSprings(scene);
+	if (springs.size() != 2 || !Near(springs[0]->GetLocalContact1(), glm::vec2(0)) ||
+		springs[1]->GetRestLength() != 3)
+	{
+		printf("  springs without contacts loaded wrongly\n");
+		return false;
+	}
+	return true;
+}
+
+// a soft body whose string count and length multiply to a wrapped 32 bit size
+static bool TestCorruptSoftBody()
+{
+	std::vector<char> binary;
+	if (!SceneFile::CompileText("softbody 0 0 1 1 1 00\n", binary))
+	{
+		printf("  soft body failed to compile\n");
+		return false;
+	}
+
+	// the record ends with its count and length, then two characters padded to 4
+	uint32_t corrupt = 65536;
+	memcpy(binary.data() + binary.size() - 12, &corrupt, sizeof(corrupt));
+	memcpy(binary.data() + binary.size() - 8, &corrupt, sizeof(corrupt));
+
+	PhysicsScene scene;
+	if (SceneFile::LoadFromMemory(&scene, binary.data(), binary.size()))
+	{
+		printf("  soft body of %u strings of %u characters loaded from %d bytes\n",
+			corrupt, corrupt, (int)binary.size());
+		return false;
+	}
+	return true;
+}
+
+int RunSceneFileTest()
+{
+	printf("Scene files\n");
+
+	int failures = 0;
+	failures += !TestRoundTrip(false);
+	failures += !TestRoundTrip(true);
+	failures += !TestOldSpringLine();
+	failures += !TestCorruptSoftBody();
+
+	printf("%d of %d cases passed\n\n", 4 - failures, 4);
+	return failures;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// Saves scenes with springs as text and binary and loads them back, checking
+// world anchored springs and offset contacts survive, and that corrupt binary
+// records are rejected. Prints each failure and returns the number of failed
+// cases.
+int RunSceneFileTest();
@@ -0,0 +1,42 @@
+#include "ContactKernelsTest.h"
+#include "FluidBenchmark.h"
+#include "SceneFileTest.h"
+
+#include <cstdlib>
+#include <cstring>
+
+// Runs the Physics library's tests and benchmarks from the command line:
+//   PhysicsTests [test] [bench] [-threads N]
+// With no arguments both are run. Returns the number of failed test cases.
+int main(int argc, char* argv[])
+{
+	bool tests = argc < 2;
+	bool benchmarks = argc < 2;
+	int threadCount = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "test") == 0)
+			tests = true;
+		else if (strcmp(argv[i], "bench") == 0)
+			benchmarks = true;
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+			threadCount = atoi(argv[++i]);
+	}
+
+	int failures = 0;
+	if (tests)
+	{
+		failures += RunContactKernelsTest();
+		failures += RunBatchedCollisionTest();
+		failures += RunSceneFileTest();
+	}
+
+	if (benchmarks)
+	{
+		RunFluidBenchmark(1);
+		if (threadCount != 1)
+			RunFluidBenchmark(threadCount);
+	}
+
+	return failures;
+}
@@ -18,6 +18,20 @@ bool Application2D::startup() {
 	m_texture = new aie::Texture("./textures/numbered_grid.tga");
 	m_shipTexture = new aie::Texture("./textures/ship.png");
 
+	m_atlas = new aie::TextureAtlas();
+	const char* sprites[] = {
+		"./textures/tankBeige.png", "./textures/tankBlue.png", "./textures/tankGreen.png", "./textures/tankRed.png",
+		"./textures/barrelBeige.png", "./textures/barrelBlue.png", "./textures/barrelGreen.png", "./textures/barrelRed.png",
+		"./textures/rock_small.png", "./textures/rock_medium.png", "./textures/rock_large.png",
+		"./textures/ball.png", "./textures/bullet.png", "./textures/car.png",
+	};
+	for (auto sprite : sprites) {
+		const aie::TextureRegion* region = m_atlas->add(sprite);
+		if (region != nullptr)
+			m_atlasSprites.push_back(region);
+	}
+	m_atlas->build();
+
 	m_font = new aie::Font("./font/consolas.ttf", 32);
 	
 	m_timer = 0;
@@ -30,6 +44,7 @@ void Application2D::shutdown() {
 	delete m_font;
 	delete m_texture;
 	delete m_shipTexture;
+	delete m_atlas;
 	delete m_2dRenderer;
 }
 
@@ -80,6 +95,15 @@ void Application2D::draw() {
 	m_2dRenderer->setUVRect(0,0,1,1);
 	m_2dRenderer->drawSprite(m_shipTexture, 600, 400, 0, 0, m_timer, 1);
 
+	// a grid of atlas sprites, every one shares the same texture so the
+	// whole grid goes in the same batch. Skipped if none of the images loaded
+	int gridCount = m_atlasSprites.empty() ? 0 : 40 * 10;
+	for (int i = 0; i < gridCount; ++i) {
+		const aie::TextureRegion* region = m_atlasSprites[i % m_atlasSprites.size()];
+		m_2dRenderer->drawSprite(*region, 20.0f + (i % 40) * 32.0f, 20.0f + (i / 40) * 12.0f,
+			24, 24, m_timer + i * 0.1f, 50);
+	}
+
 	// draw a thin line
 	m_2dRenderer->drawLine(300, 300, 600, 400, 2, 1);
 
@@ -2,6 +2,9 @@
 
 #include "Application.h"
 #include "Renderer2D.h"
+#include "TextureAtlas.h"
+
+#include <vector>
 
 class Application2D : public aie::Application {
 public:
@@ -20,6 +23,10 @@ protected:
 	aie::Renderer2D*	m_2dRenderer;
 	aie::Texture*		m_texture;
 	aie::Texture*		m_shipTexture;
+
+	// the small sprites packed together so they draw in one batch
+	aie::TextureAtlas*	m_atlas;
+	std::vector<const aie::TextureRegion*>	m_atlasSprites;
 	aie::Font*			m_font;
 
 	float m_timer;
@@ -3,7 +3,11 @@
  layout(location = 0) in vec4 Position;
  uniform mat4 ProjectionViewModel;
 
+ // Decode quantised positions, left as they are for full and packed meshes
+ uniform vec3 PositionScale = vec3(1);
+ uniform vec3 PositionOffset = vec3(0);
+
  void main()
  {
-    gl_Position = ProjectionViewModel * Position;
+    gl_Position = ProjectionViewModel * vec4(Position.xyz * PositionScale + PositionOffset, 1);
  }
\ No newline at end of file
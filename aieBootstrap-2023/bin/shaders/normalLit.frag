@@ -9,10 +9,12 @@ in vec3 vBiTangent;
 
 out vec4 FragColor;
 
-uniform bool hasTexture;
-
-// Camera Data
-uniform vec3 CameraPosition;
+layout(std140) uniform DrawData
+{
+    mat4 ProjectionViewModel;
+    mat4 ModelMatrix; // To transform the normal
+    bool hasTexture;
+};
 
 // Texture Data
 uniform sampler2D diffuseTexture;
@@ -24,16 +26,21 @@ uniform vec3 Ka; // The ambient material color
 uniform vec3 Kd; // The diffuse material color
 uniform vec3 Ks; // The specular material color
 uniform float specularPower; // The specular power of Ks
+uniform float opacity = 1; // Only blended when the instance is transparent
 
-// Light Data
-uniform vec3 AmbientColor;
-uniform vec3 LightColor;
-uniform vec3 LightDirection;
-
+// Camera and Light Data, shared by every draw this frame
 const int MAX_LIGHTS = 4;
-uniform int numLights;
-uniform vec3 PointLightPositions[MAX_LIGHTS];
-uniform vec3 PointLightColors[MAX_LIGHTS];
+layout(std140) uniform FrameData
+{
+    mat4 ProjectionView;
+    vec3 CameraPosition;
+    int numLights;
+    vec3 AmbientColor;
+    vec3 LightDirection;
+    vec3 LightColor;
+    vec3 PointLightPositions[MAX_LIGHTS];
+    vec3 PointLightColors[MAX_LIGHTS];
+};
 
 vec3 Diffuse(vec3 direction, vec3 color, vec3 normal) 
 {
@@ -113,5 +120,5 @@ void main()
     }
 
     //FragColor = vec4(N, 1);
-    FragColor = vec4(ambient + diffuse + specular, 1);
+    FragColor = vec4(ambient + diffuse + specular, opacity);
 }
\ No newline at end of file
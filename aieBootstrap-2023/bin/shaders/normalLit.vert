@@ -11,16 +11,38 @@
  out vec3 vTangent;
  out vec3 vBiTangent;
 
- uniform mat4 ProjectionViewModel;
- uniform mat4 ModelMatrix; // To transform the normal
+ layout(std140) uniform DrawData
+ {
+     mat4 ProjectionViewModel;
+     mat4 ModelMatrix; // To transform the normal
+     bool hasTexture;
+ };
+
+ // Decode quantised positions, left as they are for full and packed meshes
+ uniform vec3 PositionScale = vec3(1);
+ uniform vec3 PositionOffset = vec3(0);
+
+ // Packed normals and tangents are octahedral, marked by the normal's w being 1
+ vec3 OctDecode(vec2 e)
+ {
+   vec3 v = vec3(e, 1 - abs(e.x) - abs(e.y));
+   float t = max(-v.z, 0);
+   v.xy += mix(vec2(t), vec2(-t), greaterThanEqual(v.xy, vec2(0)));
+   return normalize(v);
+ }
 
  void main()
  {
-   vPosition = ModelMatrix * Position;
-   vNormal = (ModelMatrix * Normal).xyz;
+   vec4 position = vec4(Position.xyz * PositionScale + PositionOffset, 1);
+   bool packedNormals = Normal.w > 0.5;
+   vec4 normal = vec4(packedNormals ? OctDecode(Normal.xy) : Normal.xyz, 0);
+   vec4 tangent = vec4(packedNormals ? OctDecode(Tangent.xy) : Tangent.xyz, 0);
+
+   vPosition = ModelMatrix * position;
+   vNormal = (ModelMatrix * normal).xyz;
    vTexCoord = TexCoord;
-   vTangent = (ModelMatrix * Tangent).xyz;
+   vTangent = (ModelMatrix * tangent).xyz;
    vBiTangent = cross(vNormal, vTangent) * Tangent.w;
 
-   gl_Position = ProjectionViewModel * Position;
+   gl_Position = ProjectionViewModel * position;
  }
\ No newline at end of file
@@ -0,0 +1,64 @@
+// Our phong shader, drawn instanced with a transform per instance
+#version 410
+ layout(location = 0) in vec4 Position;
+ layout(location = 1) in vec4 Normal;
+ layout(location = 2) in vec2 TexCoord;
+ layout(location = 3) in vec4 Tangent;
+ layout(location = 4) in uint InstanceIndex;
+ 
+ out vec4 vPosition;
+ out vec3 vNormal;
+ out vec2 vTexCoord;
+ out vec3 vTangent;
+ out vec3 vBiTangent;
+
+ const int MAX_LIGHTS = 4;
+ layout(std140) uniform FrameData
+ {
+     mat4 ProjectionView;
+     vec3 CameraPosition;
+     int numLights;
+     vec3 AmbientColor;
+     vec3 LightDirection;
+     vec3 LightColor;
+     vec3 PointLightPositions[MAX_LIGHTS];
+     vec3 PointLightColors[MAX_LIGHTS];
+ };
+
+ // Every instance's transform, four texels each
+ uniform samplerBuffer InstanceTransforms;
+
+ // Decode quantised positions, left as they are for full and packed meshes
+ uniform vec3 PositionScale = vec3(1);
+ uniform vec3 PositionOffset = vec3(0);
+
+ // Packed normals and tangents are octahedral, marked by the normal's w being 1
+ vec3 OctDecode(vec2 e)
+ {
+   vec3 v = vec3(e, 1 - abs(e.x) - abs(e.y));
+   float t = max(-v.z, 0);
+   v.xy += mix(vec2(t), vec2(-t), greaterThanEqual(v.xy, vec2(0)));
+   return normalize(v);
+ }
+
+ void main()
+ {
+   vec4 position = vec4(Position.xyz * PositionScale + PositionOffset, 1);
+   bool packedNormals = Normal.w > 0.5;
+   vec4 normal = vec4(packedNormals ? OctDecode(Normal.xy) : Normal.xyz, 0);
+   vec4 tangent = vec4(packedNormals ? OctDecode(Tangent.xy) : Tangent.xyz, 0);
+
+   int texel = int(InstanceIndex) * 4;
+   mat4 InstanceTransform = mat4(texelFetch(InstanceTransforms, texel),
+                                 texelFetch(InstanceTransforms, texel + 1),
+                                 texelFetch(InstanceTransforms, texel + 2),
+                                 texelFetch(InstanceTransforms, texel + 3));
+
+   vPosition = InstanceTransform * position;
+   vNormal = (InstanceTransform * normal).xyz;
+   vTexCoord = TexCoord;
+   vTangent = (InstanceTransform * tangent).xyz;
+   vBiTangent = cross(vNormal, vTangent) * Tangent.w;
+
+   gl_Position = ProjectionView * vPosition;
+ }
\ No newline at end of file
@@ -1,15 +1,27 @@
-// Our simple shader
+// Particles drawn instanced, each one's quad is built here facing the camera
 #version 410
 
-in vec4 Position;
-in vec4 Color;
+layout(location = 0) in vec4 PositionSize;
+layout(location = 1) in vec4 Color;
 
 out vec4 vColor;
 
 uniform mat4 ProjectionViewModel;
+uniform vec3 CameraPosition;
+uniform vec3 CameraUp;
 
 void main()
 {
+   // the corner of a 4 vertex strip from the vertex index
+   vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) - 0.5;
+
+   // billboarded towards the camera
+   vec3 zAxis = normalize(CameraPosition - PositionSize.xyz);
+   vec3 xAxis = normalize(cross(CameraUp, zAxis));
+   vec3 yAxis = cross(zAxis, xAxis);
+
+   vec3 position = PositionSize.xyz + (xAxis * corner.x + yAxis * corner.y) * PositionSize.w;
+
    vColor = Color;
-   gl_Position = ProjectionViewModel * Position;
-}
\ No newline at end of file
+   gl_Position = ProjectionViewModel * vec4(position, 1);
+}
@@ -6,18 +6,26 @@ in vec3 vNormal;
 
 out vec4 FragColor;
 
-uniform vec3 CameraPosition;
-
 // Model Data
 uniform vec3 Ka; // The ambient material color
 uniform vec3 Kd; // The diffuse material color
 uniform vec3 Ks; // The specular material color
 uniform float specularPower; // The specular power of Ks
+uniform float opacity = 1; // Only blended when the instance is transparent
 
-// Light Data
-uniform vec3 AmbientColor;
-uniform vec3 LightColor;
-uniform vec3 LightDirection;
+// Camera and Light Data, shared by every draw this frame
+const int MAX_LIGHTS = 4;
+layout(std140) uniform FrameData
+{
+    mat4 ProjectionView;
+    vec3 CameraPosition;
+    int numLights;
+    vec3 AmbientColor;
+    vec3 LightDirection;
+    vec3 LightColor;
+    vec3 PointLightPositions[MAX_LIGHTS];
+    vec3 PointLightColors[MAX_LIGHTS];
+};
 
 void main()
 {
@@ -41,5 +49,5 @@ void main()
     vec3 diffuse = LightColor * Kd * lambertTerm;
     vec3 specular = LightColor * Ks * specularTerm;
 
-    FragColor = vec4(ambient + diffuse + specular, 1);
+    FragColor = vec4(ambient + diffuse + specular, opacity);
 }
\ No newline at end of file
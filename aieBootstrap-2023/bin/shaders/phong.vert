@@ -6,12 +6,32 @@
  out vec4 vPosition;
  out vec3 vNormal;
 
- uniform mat4 ProjectionViewModel;
- uniform mat4 ModelMatrix; // To transform the normal
+ layout(std140) uniform DrawData
+ {
+     mat4 ProjectionViewModel;
+     mat4 ModelMatrix; // To transform the normal
+     bool hasTexture;
+ };
+
+ // Decode quantised positions, left as they are for full and packed meshes
+ uniform vec3 PositionScale = vec3(1);
+ uniform vec3 PositionOffset = vec3(0);
+
+ // Packed normals are octahedral, marked by the normal's w being 1
+ vec3 OctDecode(vec2 e)
+ {
+   vec3 v = vec3(e, 1 - abs(e.x) - abs(e.y));
+   float t = max(-v.z, 0);
+   v.xy += mix(vec2(t), vec2(-t), greaterThanEqual(v.xy, vec2(0)));
+   return normalize(v);
+ }
 
  void main()
  {
-   vPosition = ModelMatrix * Position;
-   vNormal = (ModelMatrix * Normal).xyz;
-   gl_Position = ProjectionViewModel * Position;
+   vec4 position = vec4(Position.xyz * PositionScale + PositionOffset, 1);
+   vec4 normal = vec4(Normal.w > 0.5 ? OctDecode(Normal.xy) : Normal.xyz, 0);
+
+   vPosition = ModelMatrix * position;
+   vNormal = (ModelMatrix * normal).xyz;
+   gl_Position = ProjectionViewModel * position;
  }
\ No newline at end of file
@@ -5,10 +5,19 @@ layout(location = 2) in vec2 TexCoord;
 
 out vec2 vTexCoord;
 
-uniform mat4 ProjectionViewModel;
+layout(std140) uniform DrawData
+{
+    mat4 ProjectionViewModel;
+    mat4 ModelMatrix; // To transform the normal
+    bool hasTexture;
+};
+
+// Decode quantised positions, left as they are for full and packed meshes
+uniform vec3 PositionScale = vec3(1);
+uniform vec3 PositionOffset = vec3(0);
 
 void main()
 {
     vTexCoord = TexCoord;
-    gl_Position = ProjectionViewModel * Position;
+    gl_Position = ProjectionViewModel * vec4(Position.xyz * PositionScale + PositionOffset, 1);
 }
\ No newline at end of file
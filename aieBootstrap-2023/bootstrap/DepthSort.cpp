@@ -0,0 +1,219 @@
+#include "DepthSort.h"
+#include <glm/vec4.hpp>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define DEPTHSORT_USE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace aie {
+
+// three passes of 11 bits cover a 32 bit key
+static const unsigned int RADIX_BITS = 11;
+static const unsigned int RADIX_BUCKETS = 1 << RADIX_BITS;
+static const unsigned int RADIX_PASSES = 3;
+
+// a float's bits rearranged so unsigned order matches float order, then
+// inverted so the largest comes first
+static unsigned int radixKey(float key) {
+	unsigned int bits;
+	memcpy(&bits, &key, sizeof(bits));
+	bits ^= (bits >> 31) ? 0xFFFFFFFF : 0x80000000;
+	return ~bits;
+}
+
+DepthSort::DepthSort()
+	: m_resumeAt(0) {
+}
+
+void DepthSort::computeKeys(const float* points, unsigned int stride, unsigned int count,
+							const glm::vec4& plane, float* keys, bool accumulate /* = false */) {
+	const char* base = (const char*)points;
+	unsigned int i = 0;
+
+#ifdef DEPTHSORT_USE_SSE
+	// each point is loaded as four floats, so the fourth has to be within
+	// its stride. Four loads transposed give the x, y and z of four points
+	if (stride >= 4 * sizeof(float)) {
+		__m128 planeX = _mm_set1_ps(plane.x);
+		__m128 planeY = _mm_set1_ps(plane.y);
+		__m128 planeZ = _mm_set1_ps(plane.z);
+		__m128 planeW = _mm_set1_ps(plane.w);
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 x = _mm_loadu_ps((const float*)(base + (size_t)i * stride));
+			__m128 y = _mm_loadu_ps((const float*)(base + (size_t)(i + 1) * stride));
+			__m128 z = _mm_loadu_ps((const float*)(base + (size_t)(i + 2) * stride));
+			__m128 w = _mm_loadu_ps((const float*)(base + (size_t)(i + 3) * stride));
+			_MM_TRANSPOSE4_PS(x, y, z, w);
+
+			__m128 key = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, planeX), _mm_mul_ps(y, planeY)),
+									_mm_add_ps(_mm_mul_ps(z, planeZ), planeW));
+			if (accumulate)
+				key = _mm_add_ps(key, _mm_loadu_ps(keys + i));
+			_mm_storeu_ps(keys + i, key);
+		}
+	}
+#endif
+
+	// grouped like the SSE path so both give the same keys
+	for (; i < count; ++i) {
+		const float* p = (const float*)(base + (size_t)i * stride);
+		float key = (p[0] * plane.x + p[1] * plane.y) + (p[2] * plane.z + plane.w);
+		keys[i] = accumulate ? keys[i] + key : key;
+	}
+}
+
+const unsigned int* DepthSort::sort(const float* keys, unsigned int count) {
+	m_order.resize(count);
+	m_orderScratch.resize(count);
+	m_radixKeys.resize(count);
+	m_radixScratch.resize(count);
+	m_resumeAt = 0;
+
+	unsigned int i = 0;
+#ifdef DEPTHSORT_USE_SSE
+	const __m128i signBit = _mm_set1_epi32((int)0x80000000);
+	const __m128i allBits = _mm_set1_epi32(-1);
+	for (; i + 4 <= count; i += 4) {
+		__m128i bits = _mm_castps_si128(_mm_loadu_ps(keys + i));
+		__m128i flip = _mm_or_si128(_mm_srai_epi32(bits, 31), signBit);
+		_mm_storeu_si128((__m128i*)(m_radixKeys.data() + i), _mm_xor_si128(_mm_xor_si128(bits, flip), allBits));
+	}
+#endif
+	for (; i < count; ++i)
+		m_radixKeys[i] = radixKey(keys[i]);
+
+	for (i = 0; i < count; ++i)
+		m_order[i] = i;
+
+	// every pass's histogram from one read of the keys
+	std::vector<unsigned int> histograms(RADIX_PASSES * RADIX_BUCKETS, 0);
+	for (i = 0; i < count; ++i) {
+		unsigned int key = m_radixKeys[i];
+		for (unsigned int pass = 0; pass < RADIX_PASSES; ++pass)
+			histograms[pass * RADIX_BUCKETS + ((key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1))]++;
+	}
+
+	for (unsigned int pass = 0; pass < RADIX_PASSES; ++pass) {
+		unsigned int* histogram = histograms.data() + pass * RADIX_BUCKETS;
+		unsigned int shift = pass * RADIX_BITS;
+
+		// nothing moves if every key shares these bits, common for the top
+		// bits when the keys span a small range
+		if (count == 0 || histogram[(m_radixKeys[0] >> shift) & (RADIX_BUCKETS - 1)] == count)
+			continue;
+
+		unsigned int offset = 0;
+		for (unsigned int b = 0; b < RADIX_BUCKETS; ++b) {
+			unsigned int size = histogram[b];
+			histogram[b] = offset;
+			offset += size;
+		}
+
+		for (i = 0; i < count; ++i) {
+			unsigned int key = m_radixKeys[i];
+			unsigned int slot = histogram[(key >> shift) & (RADIX_BUCKETS - 1)]++;
+			m_radixScratch[slot] = key;
+			m_orderScratch[slot] = m_order[i];
+		}
+
+		m_radixKeys.swap(m_radixScratch);
+		m_order.swap(m_orderScratch);
+	}
+
+	return m_order.data();
+}
+
+const unsigned int* DepthSort::resort(const float* keys, unsigned int count, unsigned int maxMoves) {
+	if (m_order.empty())
+		return sort(keys, count);
+
+	// keep the indices still in range, in their old order, and put any new
+	// ones after them
+	unsigned int kept = 0;
+	for (unsigned int index : m_order) {
+		if (index < count)
+			m_order[kept++] = index;
+	}
+	m_order.resize(count);
+	for (unsigned int i = kept; i < count; ++i)
+		m_order[i] = i;
+
+	refine(keys, maxMoves);
+	return m_order.data();
+}
+
+const unsigned int* DepthSort::sort(const float* keys, const unsigned int* indices, unsigned int count) {
+	m_keyScratch.resize(count);
+	for (unsigned int i = 0; i < count; ++i)
+		m_keyScratch[i] = keys[indices[i]];
+
+	sort(m_keyScratch.data(), count);
+	for (unsigned int i = 0; i < count; ++i)
+		m_order[i] = indices[m_order[i]];
+	return m_order.data();
+}
+
+const unsigned int* DepthSort::resort(const float* keys, const unsigned int* indices, unsigned int count,
+									  unsigned int maxMoves) {
+	if (m_order.empty())
+		return sort(keys, indices, count);
+
+	// 1 for every index in the set, then 2 once the old order has kept it
+	unsigned int range = 0;
+	for (unsigned int i = 0; i < count; ++i)
+		range = indices[i] >= range ? indices[i] + 1 : range;
+	if (m_inSet.size() < range)
+		m_inSet.resize(range, 0);
+	for (unsigned int i = 0; i < count; ++i)
+		m_inSet[indices[i]] = 1;
+
+	unsigned int kept = 0;
+	for (unsigned int index : m_order) {
+		if (index < range && m_inSet[index] == 1) {
+			m_order[kept++] = index;
+			m_inSet[index] = 2;
+		}
+	}
+	m_order.resize(count);
+	for (unsigned int i = 0; i < count; ++i) {
+		if (m_inSet[indices[i]] == 1)
+			m_order[kept++] = indices[i];
+		m_inSet[indices[i]] = 0;
+	}
+
+	refine(keys, maxMoves);
+	return m_order.data();
+}
+
+void DepthSort::refine(const float* keys, unsigned int maxMoves) {
+	unsigned int count = (unsigned int)m_order.size();
+
+	// an insertion sort, largest key first, until the moves run out
+	unsigned int moves = 0;
+	unsigned int i = m_resumeAt < count ? m_resumeAt : 0;
+	for (; i < count; ++i) {
+		unsigned int index = m_order[i];
+		float key = keys[index];
+
+		unsigned int j = i;
+		while (j > 0 && moves < maxMoves && keys[m_order[j - 1]] < key) {
+			m_order[j] = m_order[j - 1];
+			--j;
+			++moves;
+		}
+		m_order[j] = index;
+
+		if (moves >= maxMoves) {
+			++i;
+			break;
+		}
+	}
+
+	// a pass that finished starts again from the front next time
+	m_resumeAt = i < count ? i : 0;
+}
+
+} // namespace aie
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm/fwd.hpp>
+#include <vector>
+
+namespace aie {
+
+// orders large arrays of primitives by their distance along a view, farthest
+// first, for drawing blended geometry back to front. Keys are made four at a
+// time with SSE and sorted with an LSD radix sort. A sorter keeps its last
+// order so a later frame can refine it rather than sort from scratch
+class DepthSort {
+public:
+
+	DepthSort();
+	~DepthSort() {}
+
+	// writes dot(plane.xyz, point) + plane.w for count points, stride bytes
+	// apart, in to keys, or adds it to what's there when accumulating. A
+	// triangle's key is the sum over its corners, which orders the same as
+	// its centroid
+	static void computeKeys(const float* points, unsigned int stride, unsigned int count,
+							const glm::vec4& plane, float* keys, bool accumulate = false);
+
+	// the indices below count ordered by key, largest first
+	const unsigned int* sort(const float* keys, unsigned int count);
+
+	// refines the last order against new keys with an insertion sort that
+	// moves at most maxMoves indices, carrying on next time from where it
+	// stopped. Indices no longer in range are dropped and new ones go on the
+	// end, so it suits primitives that mostly keep their index from frame
+	// to frame. Falls back to a full sort when there is no order to refine
+	const unsigned int* resort(const float* keys, unsigned int count, unsigned int maxMoves);
+
+	// as above for primitives named by indices other than 0 to count - 1,
+	// such as slots in a pool, so the order survives primitives coming and
+	// going around them. keys is indexed by them, and the order holds the
+	// indices themselves
+	const unsigned int* sort(const float* keys, const unsigned int* indices, unsigned int count);
+	const unsigned int* resort(const float* keys, const unsigned int* indices, unsigned int count,
+							   unsigned int maxMoves);
+
+	const unsigned int* getOrder() const { return m_order.data(); }
+
+protected:
+
+	// the insertion sort shared by both resorts, over m_order as it stands
+	void refine(const float* keys, unsigned int maxMoves);
+
+	std::vector<unsigned int>	m_order;
+	std::vector<unsigned int>	m_orderScratch;
+	std::vector<unsigned int>	m_radixKeys;
+	std::vector<unsigned int>	m_radixScratch;
+	std::vector<float>			m_keyScratch;	// an index set's keys packed for sort
+	std::vector<unsigned char>	m_inSet;		// by index, for resort to find who came and went
+
+	unsigned int				m_resumeAt;		// where the last resort stopped
+};
+
+} // namespace aie
@@ -1,44 +1,24 @@
 #include "Gizmos.h"
+#include "DepthSort.h"
 #include "gl_core_4_4.h"
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
 namespace aie {
 
-Gizmos* Gizmos::sm_singleton = nullptr;
+// template detail, fixed as every instance shares the one mesh
+static const unsigned int SHAPE_SEGMENTS = 24;
+static const unsigned int SHAPE_ROWS = 12;
 
-Gizmos::Gizmos(unsigned int maxLines, unsigned int maxTris,
-			   unsigned int max2DLines, unsigned int max2DTris)
-	: m_maxLines(maxLines),
-	m_lineCount(0),
-	m_lines(new GizmoLine[maxLines]),
-	m_maxTris(maxTris),
-	m_triCount(0),
-	m_tris(new GizmoTri[maxTris]),
-	m_transparentTriCount(0),
-	m_transparentTris(new GizmoTri[maxTris]),
-	m_max2DLines(max2DLines),
-	m_2DlineCount(0),
-	m_2Dlines(new GizmoLine[max2DLines]),
-	m_max2DTris(max2DTris),
-	m_2DtriCount(0),
-	m_2Dtris(new GizmoTri[max2DTris]) {
-
-	// create shaders
-	const char* vsSource = "#version 150\n \
-					 in vec4 Position; \
-					 in vec4 Colour; \
-					 out vec4 vColour; \
-					 uniform mat4 ProjectionView; \
-					 void main() { vColour = Colour; gl_Position = ProjectionView * Position; }";
+Gizmos* Gizmos::sm_singleton = nullptr;
 
-	const char* fsSource = "#version 150\n \
-					 in vec4 vColour; \
-                     out vec4 FragColor; \
-					 void main()	{ FragColor = vColour; }";
-    
-    
+// links a program from the two sources, binding each named attribute to its location
+static unsigned int linkProgram(const char* vsSource, const char* fsSource,
+								const char* const* attributes, const unsigned int* locations,
+								unsigned int attributeCount) {
 	unsigned int vs = glCreateShader(GL_VERTEX_SHADER);
 	unsigned int fs = glCreateShader(GL_FRAGMENT_SHADER);
 
@@ -48,84 +28,94 @@ Gizmos::Gizmos(unsigned int maxLines, unsigned int maxTris,
 	glShaderSource(fs, 1, (const char**)&fsSource, 0);
 	glCompileShader(fs);
 
-	m_shader = glCreateProgram();
-	glAttachShader(m_shader, vs);
-	glAttachShader(m_shader, fs);
-	glBindAttribLocation(m_shader, 0, "Position");
-	glBindAttribLocation(m_shader, 1, "Colour");
-	glLinkProgram(m_shader);
+	unsigned int program = glCreateProgram();
+	glAttachShader(program, vs);
+	glAttachShader(program, fs);
+	for (unsigned int i = 0; i < attributeCount; ++i)
+		glBindAttribLocation(program, locations[i], attributes[i]);
+	glLinkProgram(program);
     
 	int success = GL_FALSE;
-    glGetProgramiv(m_shader, GL_LINK_STATUS, &success);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
 	if (success == GL_FALSE) {
 		int infoLogLength = 0;
-		glGetProgramiv(m_shader, GL_INFO_LOG_LENGTH, &infoLogLength);
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLogLength);
 		char* infoLog = new char[infoLogLength + 1];
         
-		glGetProgramInfoLog(m_shader, infoLogLength, 0, infoLog);
+		glGetProgramInfoLog(program, infoLogLength, 0, infoLog);
 		printf("Error: Failed to link Gizmo shader program!\n%s\n", infoLog);
 		delete[] infoLog;
 	}
 
 	glDeleteShader(vs);
 	glDeleteShader(fs);
-    
-    // create VBOs
-	glGenBuffers( 1, &m_lineVBO );
-	glBindBuffer(GL_ARRAY_BUFFER, m_lineVBO);
-	glBufferData(GL_ARRAY_BUFFER, m_maxLines * sizeof(GizmoLine), m_lines, GL_DYNAMIC_DRAW);
-
-	glGenBuffers( 1, &m_triVBO );
-	glBindBuffer(GL_ARRAY_BUFFER, m_triVBO);
-	glBufferData(GL_ARRAY_BUFFER, m_maxTris * sizeof(GizmoTri), m_tris, GL_DYNAMIC_DRAW);
-
-	glGenBuffers( 1, &m_transparentTriVBO );
-	glBindBuffer(GL_ARRAY_BUFFER, m_transparentTriVBO);
-	glBufferData(GL_ARRAY_BUFFER, m_maxTris * sizeof(GizmoTri), m_transparentTris, GL_DYNAMIC_DRAW);
-
-	glGenBuffers( 1, &m_2DlineVBO );
-	glBindBuffer(GL_ARRAY_BUFFER, m_2DlineVBO);
-	glBufferData(GL_ARRAY_BUFFER, m_max2DLines * sizeof(GizmoLine), m_2Dlines, GL_DYNAMIC_DRAW);
-
-	glGenBuffers( 1, &m_2DtriVBO );
-	glBindBuffer(GL_ARRAY_BUFFER, m_2DtriVBO);
-	glBufferData(GL_ARRAY_BUFFER, m_max2DTris * sizeof(GizmoTri), m_2Dtris, GL_DYNAMIC_DRAW);
-
-	glGenVertexArrays(1, &m_lineVAO);
-	glBindVertexArray(m_lineVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_lineVBO);
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), (void*)16);
 
-	glGenVertexArrays(1, &m_triVAO);
-	glBindVertexArray(m_triVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_triVBO);
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), (void*)16);
+	return program;
+}
 
-	glGenVertexArrays(1, &m_transparentTriVAO);
-	glBindVertexArray(m_transparentTriVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_transparentTriVBO);
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), (void*)16);
+Gizmos::Gizmos(unsigned int maxLines, unsigned int maxTris,
+			   unsigned int max2DLines, unsigned int max2DTris)
+	: m_maxLines(maxLines),
+	m_maxTris(maxTris),
+	m_sortTransparent(true),
+	m_transparentResortBudget(0),
+	m_transparentSort(new DepthSort()),
+	m_retaining(false),
+	m_retainedDirty(false),
+	m_shapeSort(new DepthSort()),
+	m_max2DLines(max2DLines),
+	m_max2DTris(max2DTris),
+	m_ringVBO(0),
+	m_ringMapping(nullptr),
+	m_ringMapped(false),
+	m_ringRegion(0),
+	m_ringOffset(0),
+	m_ringRegionReady(false),
+	m_ringUnfenced(false),
+	m_ringBytesStreamed(0),
+	m_ringFenceWaits(0) {
+
+	memset(m_ringFences, 0, sizeof(m_ringFences));
+	memset(&m_stats, 0, sizeof(m_stats));
+
+	m_lines.reserve(maxLines);
+	m_tris.reserve(maxTris);
+	m_transparentTris.reserve(maxTris);
+	m_2Dlines.reserve(max2DLines);
+	m_2Dtris.reserve(max2DTris);
+
+	// create shaders
+	const char* vsSource = "#version 150\n \
+					 in vec4 Position; \
+					 in vec4 Colour; \
+					 out vec4 vColour; \
+					 uniform mat4 ProjectionView; \
+					 void main() { vColour = Colour; gl_Position = ProjectionView * Position; }";
 
-	glGenVertexArrays(1, &m_2DlineVAO);
-	glBindVertexArray(m_2DlineVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_2DlineVBO);
+	const char* fsSource = "#version 150\n \
+					 in vec4 vColour; \
+                     out vec4 FragColor; \
+					 void main()	{ FragColor = vColour; }";
+    
+	const char* attributes[] = { "Position", "Colour" };
+	const unsigned int locations[] = { 0, 1 };
+	m_shader = linkProgram(vsSource, fsSource, attributes, locations, 2);
+
+	// retained data is only sent when it changes
+	glGenBuffers( 1, &m_retainedLineVBO );
+	glGenBuffers( 1, &m_retainedTriVBO );
+
+	glGenVertexArrays(1, &m_retainedLineVAO);
+	glBindVertexArray(m_retainedLineVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, m_retainedLineVBO);
 	glEnableVertexAttribArray(0);
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
 	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), (void*)16);
 
-	glGenVertexArrays(1, &m_2DtriVAO);
-	glBindVertexArray(m_2DtriVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_2DtriVBO);
+	glGenVertexArrays(1, &m_retainedTriVAO);
+	glBindVertexArray(m_retainedTriVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, m_retainedTriVBO);
 	glEnableVertexAttribArray(0);
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
@@ -133,24 +123,28 @@ Gizmos::Gizmos(unsigned int maxLines, unsigned int maxTris,
 
 	glBindVertexArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	createShapes();
+
+	// a region fits a frame of what create() was asked for
+	glGenVertexArrays(1, &m_ringVAO);
+	createRing((maxLines + max2DLines) * sizeof(GizmoLine) +
+			   (maxTris * 2 + max2DTris) * sizeof(GizmoTri));
 }
 
 Gizmos::~Gizmos() {
-	delete[] m_lines;
-	delete[] m_tris;
-	delete[] m_transparentTris;
-	glDeleteBuffers( 1, &m_lineVBO );
-	glDeleteBuffers( 1, &m_triVBO );
-	glDeleteBuffers( 1, &m_transparentTriVBO );
-	glDeleteVertexArrays( 1, &m_lineVAO );
-	glDeleteVertexArrays( 1, &m_triVAO );
-	glDeleteVertexArrays( 1, &m_transparentTriVAO );
-	delete[] m_2Dlines;
-	delete[] m_2Dtris;
-	glDeleteBuffers( 1, &m_2DlineVBO );
-	glDeleteBuffers( 1, &m_2DtriVBO );
-	glDeleteVertexArrays( 1, &m_2DlineVAO );
-	glDeleteVertexArrays( 1, &m_2DtriVAO );
+	destroyRing();
+	delete m_transparentSort;
+	delete m_shapeSort;
+	glDeleteVertexArrays( 1, &m_ringVAO );
+	glDeleteBuffers( 1, &m_retainedLineVBO );
+	glDeleteBuffers( 1, &m_retainedTriVBO );
+	glDeleteVertexArrays( 1, &m_retainedLineVAO );
+	glDeleteVertexArrays( 1, &m_retainedTriVAO );
+	glDeleteBuffers( 1, &m_shapeVBO );
+	glDeleteBuffers( 1, &m_shapeIBO );
+	glDeleteVertexArrays( 1, &m_shapeVAO );
+	glDeleteProgram(m_shapeShader);
 	glDeleteProgram(m_shader);
 }
 
@@ -165,12 +159,80 @@ void Gizmos::destroy() {
 	sm_singleton = nullptr;
 }
 
+Gizmos::Stats Gizmos::getStats() {
+	Stats stats = sm_singleton->m_stats;
+	stats.lines = sm_singleton->m_lines.size();
+	stats.tris = sm_singleton->m_tris.size();
+	stats.transparentTris = sm_singleton->m_transparentTris.size();
+	stats.lines2D = sm_singleton->m_2Dlines.size();
+	stats.tris2D = sm_singleton->m_2Dtris.size();
+
+	stats.shapeInstances = 0;
+	for (unsigned int shape = 0; shape < SHAPE_COUNT; ++shape) {
+		for (unsigned int pass = 0; pass < SHAPE_PASS_COUNT; ++pass)
+			stats.shapeInstances += (unsigned int)sm_singleton->m_shapeInstances[shape][pass].size();
+	}
+
+	// the triangle count is shared between the opaque and blended ones
+	stats.overflow = 0;
+	if (stats.lines > sm_singleton->m_maxLines)
+		stats.overflow += stats.lines - sm_singleton->m_maxLines;
+	if (stats.tris + stats.transparentTris > sm_singleton->m_maxTris)
+		stats.overflow += stats.tris + stats.transparentTris - sm_singleton->m_maxTris;
+	if (stats.lines2D > sm_singleton->m_max2DLines)
+		stats.overflow += stats.lines2D - sm_singleton->m_max2DLines;
+	if (stats.tris2D > sm_singleton->m_max2DTris)
+		stats.overflow += stats.tris2D - sm_singleton->m_max2DTris;
+
+	return stats;
+}
+
+void Gizmos::setTransparentSorting(bool sort, unsigned int resortBudget /* = 0 */) {
+	sm_singleton->m_sortTransparent = sort;
+	sm_singleton->m_transparentResortBudget = resortBudget;
+}
+
 void Gizmos::clear() {
-	sm_singleton->m_lineCount = 0;
-	sm_singleton->m_triCount = 0;
-	sm_singleton->m_transparentTriCount = 0;
-	sm_singleton->m_2DlineCount = 0;
-	sm_singleton->m_2DtriCount = 0;
+	sm_singleton->m_lines.clear();
+	sm_singleton->m_tris.clear();
+	sm_singleton->m_transparentTris.clear();
+	sm_singleton->m_2Dlines.clear();
+	sm_singleton->m_2Dtris.clear();
+
+	// a new frame streams in to the next region
+	sm_singleton->fenceRegion();
+	sm_singleton->nextRegion();
+
+	// the frame just finished is the one reported
+	sm_singleton->m_stats.bytesStreamed = sm_singleton->m_ringBytesStreamed;
+	sm_singleton->m_stats.fenceWaits = sm_singleton->m_ringFenceWaits;
+	sm_singleton->m_ringBytesStreamed = 0;
+	sm_singleton->m_ringFenceWaits = 0;
+
+	for (unsigned int shape = 0; shape < SHAPE_COUNT; ++shape) {
+		for (unsigned int pass = 0; pass < SHAPE_PASS_COUNT; ++pass)
+			sm_singleton->m_shapeInstances[shape][pass].clear();
+	}
+}
+
+void Gizmos::beginRetained() {
+	sm_singleton->m_retaining = true;
+}
+
+void Gizmos::endRetained() {
+	sm_singleton->m_retaining = false;
+}
+
+void Gizmos::clearRetained() {
+	sm_singleton->m_retainedLines.clear();
+	sm_singleton->m_retainedTris.clear();
+	sm_singleton->m_retainedTransparentTris.clear();
+	sm_singleton->m_retainedDirty = true;
+
+	for (unsigned int shape = 0; shape < SHAPE_COUNT; ++shape) {
+		for (unsigned int pass = 0; pass < SHAPE_PASS_COUNT; ++pass)
+			sm_singleton->m_retainedShapeInstances[shape][pass].clear();
+	}
 }
 
 // Adds 3 unit-length lines (red,green,blue) representing the 3 axis of a transform, 
@@ -681,6 +743,105 @@ void Gizmos::addCapsule(const glm::vec3& center, float height, float radius,
 	}
 }
 
+// where a template goes for the arguments the immediate gizmos take, the
+// transform's translation added to center and the rest applied to the shape
+static glm::mat4 shapeTransform(const glm::vec3& center, const glm::vec3& scale, const glm::mat4* transform) {
+	glm::mat4 m = transform != nullptr ? *transform : glm::mat4(1);
+	glm::vec3 tempCenter = transform != nullptr ? glm::vec3((*transform)[3]) + center : center;
+
+	m[0] *= scale.x;
+	m[1] *= scale.y;
+	m[2] *= scale.z;
+	m[3] = glm::vec4(tempCenter, 1);
+	return m;
+}
+
+void Gizmos::addShape(Shape shape, const glm::mat4& transform, const glm::vec4& fillColour,
+					  const glm::vec4& lineColour, float stretch /* = 0 */) {
+	if (sm_singleton == nullptr || shape >= SHAPE_COUNT)
+		return;
+
+	std::vector<ShapeInstance>* instances = sm_singleton->m_retaining ?
+		sm_singleton->m_retainedShapeInstances[shape] : sm_singleton->m_shapeInstances[shape];
+
+	ShapeInstance instance;
+	memcpy(instance.transform, glm::value_ptr(transform), sizeof(instance.transform));
+	instance.stretch = stretch;
+
+	if (lineColour.a != 0) {
+		instance.r = lineColour.r;
+		instance.g = lineColour.g;
+		instance.b = lineColour.b;
+		instance.a = lineColour.a;
+		instances[SHAPE_PASS_LINES].push_back(instance);
+	}
+
+	if (fillColour.a != 0) {
+		instance.r = fillColour.r;
+		instance.g = fillColour.g;
+		instance.b = fillColour.b;
+		instance.a = fillColour.a;
+		instances[fillColour.a == 1 ? SHAPE_PASS_OPAQUE : SHAPE_PASS_TRANSPARENT].push_back(instance);
+	}
+}
+
+void Gizmos::addAABBInstanced(const glm::vec3& center, const glm::vec3& extents,
+							  const glm::vec4& colour, const glm::mat4* transform) {
+	addShape(SHAPE_AABB, shapeTransform(center, extents, transform), glm::vec4(0), colour);
+}
+
+void Gizmos::addAABBFilledInstanced(const glm::vec3& center, const glm::vec3& extents,
+									const glm::vec4& fillColour, const glm::mat4* transform) {
+	addShape(SHAPE_AABB, shapeTransform(center, extents, transform), fillColour, glm::vec4(1));
+}
+
+void Gizmos::addCylinderFilledInstanced(const glm::vec3& center, float radius, float halfLength,
+										const glm::vec4& fillColour, const glm::mat4* transform) {
+	addShape(SHAPE_CYLINDER, shapeTransform(center, glm::vec3(radius, halfLength, radius), transform),
+			 fillColour, glm::vec4(1));
+}
+
+void Gizmos::addRingInstanced(const glm::vec3& center, float innerRadius, float outerRadius,
+							  const glm::vec4& fillColour, const glm::mat4* transform) {
+	glm::vec4 vSolid = fillColour;
+	vSolid.w = 1;
+
+	glm::mat4 m = shapeTransform(center, glm::vec3(outerRadius), transform);
+	float stretch = innerRadius / outerRadius;
+
+	if (fillColour.w != 0)
+		addShape(SHAPE_RING, m, fillColour, glm::vec4(0), stretch);
+	else
+		addShape(SHAPE_RING, m, glm::vec4(0), vSolid, stretch);
+}
+
+void Gizmos::addDiskInstanced(const glm::vec3& center, float radius,
+							  const glm::vec4& fillColour, const glm::mat4* transform) {
+	glm::vec4 vSolid = fillColour;
+	vSolid.w = 1;
+
+	glm::mat4 m = shapeTransform(center, glm::vec3(radius), transform);
+
+	if (fillColour.w != 0)
+		addShape(SHAPE_DISK, m, fillColour, glm::vec4(0));
+	else
+		addShape(SHAPE_DISK, m, glm::vec4(0), vSolid);
+}
+
+void Gizmos::addSphereInstanced(const glm::vec3& center, float radius,
+								const glm::vec4& fillColour, const glm::mat4* transform) {
+	addShape(SHAPE_SPHERE, shapeTransform(center, glm::vec3(radius), transform), fillColour, glm::vec4(1));
+}
+
+void Gizmos::addCapsuleInstanced(const glm::vec3& center, float height, float radius,
+								 const glm::vec4& fillColour, const glm::mat4* rotation) {
+	// the distance from the middle to each half's center, in its radius
+	float stretch = (height * 0.5f - radius) / radius;
+
+	addShape(SHAPE_CAPSULE, shapeTransform(center, glm::vec3(radius), rotation),
+			 fillColour, glm::vec4(1), stretch);
+}
+
 void Gizmos::addHermiteSpline(const glm::vec3& start, const glm::vec3& end,
 	const glm::vec3& tangentStart, const glm::vec3& tangentEnd, unsigned int segments, const glm::vec4& colour) {
 
@@ -709,96 +870,45 @@ void Gizmos::addLine(const glm::vec3& v0,  const glm::vec3& v1, const glm::vec4&
 }
 
 void Gizmos::addLine(const glm::vec3& v0, const glm::vec3& v1, const glm::vec4& colour0, const glm::vec4& colour1) {
+	if (sm_singleton == nullptr)
+		return;
 
-	if (sm_singleton != nullptr &&
-		sm_singleton->m_lineCount < sm_singleton->m_maxLines) {
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.x = v0.x;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.y = v0.y;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.z = v0.z;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.w = 1;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.r = colour0.r;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.g = colour0.g;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.b = colour0.b;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.a = colour0.a;
-
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v1.x = v1.x;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v1.y = v1.y;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v1.z = v1.z;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v1.w = 1;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v1.r = colour1.r;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v1.g = colour1.g;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v1.b = colour1.b;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v1.a = colour1.a;
-
-		sm_singleton->m_lineCount++;
+	GizmoLine line = {
+		{ v0.x, v0.y, v0.z, 1, colour0.r, colour0.g, colour0.b, colour0.a },
+		{ v1.x, v1.y, v1.z, 1, colour1.r, colour1.g, colour1.b, colour1.a }
+	};
+
+	if (sm_singleton->m_retaining) {
+		sm_singleton->m_retainedLines.push_back(line);
+		sm_singleton->m_retainedDirty = true;
 	}
+	else
+		sm_singleton->m_lines.add() = line;
 }
 
 void Gizmos::addTri(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const glm::vec4& colour) {
-	if (sm_singleton != nullptr) {
+	if (sm_singleton == nullptr)
+		return;
+
+	GizmoTri tri = {
+		{ v0.x, v0.y, v0.z, 1, colour.r, colour.g, colour.b, colour.a },
+		{ v1.x, v1.y, v1.z, 1, colour.r, colour.g, colour.b, colour.a },
+		{ v2.x, v2.y, v2.z, 1, colour.r, colour.g, colour.b, colour.a }
+	};
+
+	if (sm_singleton->m_retaining) {
+		// the blended ones are sorted in with each frame's
 		if (colour.w == 1) {
-			if (sm_singleton->m_triCount < sm_singleton->m_maxTris) {
-				sm_singleton->m_tris[sm_singleton->m_triCount].v0.x = v0.x;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v0.y = v0.y;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v0.z = v0.z;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v0.w = 1;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v1.x = v1.x;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v1.y = v1.y;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v1.z = v1.z;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v1.w = 1;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v2.x = v2.x;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v2.y = v2.y;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v2.z = v2.z;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v2.w = 1;
-
-				sm_singleton->m_tris[sm_singleton->m_triCount].v0.r = colour.r;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v0.g = colour.g;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v0.b = colour.b;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v0.a = colour.a;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v1.r = colour.r;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v1.g = colour.g;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v1.b = colour.b;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v1.a = colour.a;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v2.r = colour.r;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v2.g = colour.g;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v2.b = colour.b;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v2.a = colour.a;
-
-				sm_singleton->m_triCount++;
-			}
-		}
-		else {
-			if (sm_singleton->m_transparentTriCount < sm_singleton->m_maxTris) {
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.x = v0.x;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.y = v0.y;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.z = v0.z;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.w = 1;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v1.x = v1.x;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v1.y = v1.y;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v1.z = v1.z;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v1.w = 1;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v2.x = v2.x;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v2.y = v2.y;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v2.z = v2.z;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v2.w = 1;
-
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.r = colour.r;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.g = colour.g;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.b = colour.b;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.a = colour.a;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v1.r = colour.r;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v1.g = colour.g;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v1.b = colour.b;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v1.a = colour.a;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v2.r = colour.r;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v2.g = colour.g;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v2.b = colour.b;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v2.a = colour.a;
-
-				sm_singleton->m_transparentTriCount++;
-			}
+			sm_singleton->m_retainedTris.push_back(tri);
+			sm_singleton->m_retainedDirty = true;
 		}
+		else
+			sm_singleton->m_retainedTransparentTris.push_back(tri);
 	}
+	else if (colour.w == 1)
+		sm_singleton->m_tris.add() = tri;
+	else
+		sm_singleton->m_transparentTris.add() = tri;
 }
 
 void Gizmos::add2DAABB(const glm::vec2& center, const glm::vec2& extents, const glm::vec4& colour, const glm::mat4* transform /*= nullptr*/) {	
@@ -872,27 +982,14 @@ void Gizmos::add2DLine(const glm::vec2& rv0,  const glm::vec2& rv1, const glm::v
 }
 
 void Gizmos::add2DLine(const glm::vec2& rv0, const glm::vec2& rv1, const glm::vec4& colour0, const glm::vec4& colour1) {
-	if (sm_singleton != nullptr &&
-		sm_singleton->m_2DlineCount < sm_singleton->m_max2DLines) {
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.x = rv0.x;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.y = rv0.y;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.z = 1;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.w = 1;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.r = colour0.r;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.g = colour0.g;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.b = colour0.b;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.a = colour0.a;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.x = rv1.x;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.y = rv1.y;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.z = 1;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.w = 1;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.r = colour1.r;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.g = colour1.g;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.b = colour1.b;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.a = colour1.a;
-
-		sm_singleton->m_2DlineCount++;
-	}
+	if (sm_singleton == nullptr)
+		return;
+
+	GizmoLine line = {
+		{ rv0.x, rv0.y, 1, 1, colour0.r, colour0.g, colour0.b, colour0.a },
+		{ rv1.x, rv1.y, 1, 1, colour1.r, colour1.g, colour1.b, colour1.a }
+	};
+	sm_singleton->m_2Dlines.add() = line;
 }
 
 void Gizmos::add2DTri(const glm::vec2& rv0, const glm::vec2& rv1, const glm::vec2& rv2, const glm::vec4& colour) {
@@ -900,36 +997,15 @@ void Gizmos::add2DTri(const glm::vec2& rv0, const glm::vec2& rv1, const glm::vec
 }
 
 void Gizmos::add2DTri(const glm::vec2& rv0, const glm::vec2& rv1, const glm::vec2& rv2, const glm::vec4& colour0, const glm::vec4& colour1, const glm::vec4& colour2) {
-	if (sm_singleton != nullptr) {
-		if (sm_singleton->m_2DtriCount < sm_singleton->m_max2DTris) {
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.x = rv0.x;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.y = rv0.y;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.z = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.w = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.x = rv1.x;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.y = rv1.y;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.z = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.w = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.x = rv2.x;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.y = rv2.y;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.z = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.w = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.r = colour0.r;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.g = colour0.g;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.b = colour0.b;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.a = colour0.a;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.r = colour1.r;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.g = colour1.g;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.b = colour1.b;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.a = colour1.a;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.r = colour2.r;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.g = colour2.g;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.b = colour2.b;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.a = colour2.a;
-
-			sm_singleton->m_2DtriCount++;
-		}
-	}
+	if (sm_singleton == nullptr)
+		return;
+
+	GizmoTri tri = {
+		{ rv0.x, rv0.y, 1, 1, colour0.r, colour0.g, colour0.b, colour0.a },
+		{ rv1.x, rv1.y, 1, 1, colour1.r, colour1.g, colour1.b, colour1.a },
+		{ rv2.x, rv2.y, 1, 1, colour2.r, colour2.g, colour2.b, colour2.a }
+	};
+	sm_singleton->m_2Dtris.add() = tri;
 }
 
 void Gizmos::draw(const glm::mat4& projection, const glm::mat4& view) {
@@ -937,10 +1013,90 @@ void Gizmos::draw(const glm::mat4& projection, const glm::mat4& view) {
 }
 
 void Gizmos::draw(const glm::mat4& projectionView) {
-	if ( sm_singleton != nullptr && 
-		(sm_singleton->m_lineCount > 0 || 
-		 sm_singleton->m_triCount > 0 || 
-		 sm_singleton->m_transparentTriCount > 0)) {
+	if (sm_singleton == nullptr)
+		return;
+
+	sm_singleton->uploadRetained();
+
+	unsigned int lineCount = sm_singleton->m_lines.size();
+	unsigned int triCount = sm_singleton->m_tris.size();
+	unsigned int immediateTransparentCount = sm_singleton->m_transparentTris.size();
+
+	unsigned int retainedLineCount = (unsigned int)sm_singleton->m_retainedLines.size();
+	unsigned int retainedTriCount = (unsigned int)sm_singleton->m_retainedTris.size();
+	unsigned int retainedTransparentTriCount = (unsigned int)sm_singleton->m_retainedTransparentTris.size();
+	unsigned int transparentCount = immediateTransparentCount + retainedTransparentTriCount;
+
+	unsigned int shapeCount = 0;
+	for (unsigned int shape = 0; shape < SHAPE_COUNT; ++shape) {
+		for (unsigned int pass = 0; pass < SHAPE_PASS_COUNT; ++pass)
+			shapeCount += (unsigned int)(sm_singleton->m_retainedShapeInstances[shape][pass].size() +
+										 sm_singleton->m_shapeInstances[shape][pass].size());
+	}
+
+	// everything streamed this draw goes in one region, with room to align
+	// each of the four kinds
+	if (lineCount > 0 || triCount > 0 || transparentCount > 0 || shapeCount > 0)
+		sm_singleton->reserveRing(lineCount * sizeof(GizmoLine) +
+								  (triCount + transparentCount) * sizeof(GizmoTri) +
+								  shapeCount * sizeof(ShapeInstance) + 4 * sizeof(GizmoTri));
+
+	bool shapes = sm_singleton->uploadShapes(projectionView);
+
+	unsigned int lineFirst = 0, triFirst = 0, transparentFirst = 0;
+	lineCount = sm_singleton->stream(sm_singleton->m_lines, lineFirst);
+	triCount = sm_singleton->stream(sm_singleton->m_tris, triFirst);
+
+	// this frame's triangles then the retained ones
+	if (transparentCount > 0) {
+		const ChunkedBuffer<GizmoTri>& tris = sm_singleton->m_transparentTris;
+		const GizmoTri* retained = sm_singleton->m_retainedTransparentTris.data();
+
+		GizmoTri* destination = (GizmoTri*)sm_singleton->allocate(transparentCount, sizeof(GizmoTri), transparentFirst);
+		if (destination == nullptr)
+			transparentCount = 0;
+		else if (sm_singleton->m_sortTransparent && transparentCount > 1) {
+			// clip space z grows with distance for perspective and
+			// orthographic projections alike, summed over the corners
+			glm::vec4 depthPlane(projectionView[0][2], projectionView[1][2], projectionView[2][2], projectionView[3][2]);
+			std::vector<float>& keys = sm_singleton->m_transparentKeys;
+			keys.resize(transparentCount);
+			for (unsigned int c = 0; c < tris.chunkCount(); ++c) {
+				const GizmoTri* chunk = tris.chunk(c);
+				unsigned int size = tris.chunkSize(c);
+				float* chunkKeys = keys.data() + c * ChunkedBuffer<GizmoTri>::CHUNK_SIZE;
+				DepthSort::computeKeys(&chunk[0].v0.x, sizeof(GizmoTri), size, depthPlane, chunkKeys);
+				DepthSort::computeKeys(&chunk[0].v1.x, sizeof(GizmoTri), size, depthPlane, chunkKeys, true);
+				DepthSort::computeKeys(&chunk[0].v2.x, sizeof(GizmoTri), size, depthPlane, chunkKeys, true);
+			}
+			if (retainedTransparentTriCount > 0) {
+				float* retainedKeys = keys.data() + immediateTransparentCount;
+				DepthSort::computeKeys(&retained[0].v0.x, sizeof(GizmoTri), retainedTransparentTriCount, depthPlane, retainedKeys);
+				DepthSort::computeKeys(&retained[0].v1.x, sizeof(GizmoTri), retainedTransparentTriCount, depthPlane, retainedKeys, true);
+				DepthSort::computeKeys(&retained[0].v2.x, sizeof(GizmoTri), retainedTransparentTriCount, depthPlane, retainedKeys, true);
+			}
+
+			DepthSort* sort = sm_singleton->m_transparentSort;
+			const unsigned int* order = sm_singleton->m_transparentResortBudget > 0 ?
+				sort->resort(keys.data(), transparentCount, sm_singleton->m_transparentResortBudget) :
+				sort->sort(keys.data(), transparentCount);
+
+			for (unsigned int i = 0; i < transparentCount; ++i) {
+				unsigned int index = order[i];
+				destination[i] = index < immediateTransparentCount ? tris[index] : retained[index - immediateTransparentCount];
+			}
+		}
+		else {
+			tris.copyTo(destination);
+			std::copy(retained, retained + retainedTransparentTriCount, destination + immediateTransparentCount);
+		}
+		sm_singleton->endWrite();
+	}
+
+	if (shapes ||
+		lineCount > 0 || retainedLineCount > 0 ||
+		triCount > 0 || retainedTriCount > 0 ||
+		transparentCount > 0) {
 		int shader = 0;
 		glGetIntegerv(GL_CURRENT_PROGRAM, &shader);
 
@@ -949,23 +1105,30 @@ void Gizmos::draw(const glm::mat4& projectionView) {
 		unsigned int projectionViewUniform = glGetUniformLocation(sm_singleton->m_shader,"ProjectionView");
 		glUniformMatrix4fv(projectionViewUniform, 1, false, glm::value_ptr(projectionView));
 
-		if (sm_singleton->m_lineCount > 0) {
-			glBindBuffer(GL_ARRAY_BUFFER, sm_singleton->m_lineVBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sm_singleton->m_lineCount * sizeof(GizmoLine), sm_singleton->m_lines);
+		if (lineCount > 0) {
+			glBindVertexArray(sm_singleton->m_ringVAO);
+			glDrawArrays(GL_LINES, lineFirst * 2, lineCount * 2);
+		}
 
-			glBindVertexArray(sm_singleton->m_lineVAO);
-			glDrawArrays(GL_LINES, 0, sm_singleton->m_lineCount * 2);
+		if (retainedLineCount > 0) {
+			glBindVertexArray(sm_singleton->m_retainedLineVAO);
+			glDrawArrays(GL_LINES, 0, retainedLineCount * 2);
 		}
 
-		if (sm_singleton->m_triCount > 0) {
-			glBindBuffer(GL_ARRAY_BUFFER, sm_singleton->m_triVBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sm_singleton->m_triCount * sizeof(GizmoTri), sm_singleton->m_tris);
+		if (triCount > 0) {
+			glBindVertexArray(sm_singleton->m_ringVAO);
+			glDrawArrays(GL_TRIANGLES, triFirst * 3, triCount * 3);
+		}
 
-			glBindVertexArray(sm_singleton->m_triVAO);
-			glDrawArrays(GL_TRIANGLES, 0, sm_singleton->m_triCount * 3);
+		if (retainedTriCount > 0) {
+			glBindVertexArray(sm_singleton->m_retainedTriVAO);
+			glDrawArrays(GL_TRIANGLES, 0, retainedTriCount * 3);
 		}
+
+		if (shapes)
+			sm_singleton->drawShapes(projectionView, false);
 		
-		if (sm_singleton->m_transparentTriCount > 0) {
+		if (shapes || transparentCount > 0) {
 			// not ideal to store these, but Gizmos must work stand-alone
 			GLboolean blendEnabled = glIsEnabled(GL_BLEND);
 			GLboolean depthMask = GL_TRUE;
@@ -981,11 +1144,15 @@ void Gizmos::draw(const glm::mat4& projectionView) {
 			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 			glDepthMask(GL_FALSE);
 
-			glBindBuffer(GL_ARRAY_BUFFER, sm_singleton->m_transparentTriVBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sm_singleton->m_transparentTriCount * sizeof(GizmoTri), sm_singleton->m_transparentTris);
+			if (transparentCount > 0) {
+				glUseProgram(sm_singleton->m_shader);
+				glBindVertexArray(sm_singleton->m_ringVAO);
+				glDrawArrays(GL_TRIANGLES, transparentFirst * 3, transparentCount * 3);
+			}
 
-			glBindVertexArray(sm_singleton->m_transparentTriVAO);
-			glDrawArrays(GL_TRIANGLES, 0, sm_singleton->m_transparentTriCount * 3);
+			// blended shapes are sorted amongst their own kind only
+			if (shapes)
+				sm_singleton->drawShapes(projectionView, true);
 
 			// reset state
 			glDepthMask(depthMask);
@@ -994,8 +1161,11 @@ void Gizmos::draw(const glm::mat4& projectionView) {
 				glDisable(GL_BLEND);
 		}
 
+		glBindVertexArray(0);
 		glUseProgram(shader);
 	}
+
+	sm_singleton->fenceRegion();
 }
 
 void Gizmos::draw2D(float screenWidth, float screenHeight) {
@@ -1003,9 +1173,21 @@ void Gizmos::draw2D(float screenWidth, float screenHeight) {
 }
 
 void Gizmos::draw2D(const glm::mat4& projection) {
-	if ( sm_singleton != nullptr && 
-		(sm_singleton->m_2DlineCount > 0 || 
-		 sm_singleton->m_2DtriCount > 0)) {
+	if (sm_singleton == nullptr)
+		return;
+
+	unsigned int lineCount = sm_singleton->m_2Dlines.size();
+	unsigned int triCount = sm_singleton->m_2Dtris.size();
+	if (lineCount == 0 && triCount == 0)
+		return;
+
+	sm_singleton->reserveRing(lineCount * sizeof(GizmoLine) + triCount * sizeof(GizmoTri) + 2 * sizeof(GizmoTri));
+
+	unsigned int lineFirst = 0, triFirst = 0;
+	lineCount = sm_singleton->stream(sm_singleton->m_2Dlines, lineFirst);
+	triCount = sm_singleton->stream(sm_singleton->m_2Dtris, triFirst);
+
+	if (lineCount > 0 || triCount > 0) {
 		int shader = 0;
 		glGetIntegerv(GL_CURRENT_PROGRAM, &shader);
 
@@ -1014,15 +1196,12 @@ void Gizmos::draw2D(const glm::mat4& projection) {
 		unsigned int projectionViewUniform = glGetUniformLocation(sm_singleton->m_shader,"ProjectionView");
 		glUniformMatrix4fv(projectionViewUniform, 1, false, glm::value_ptr(projection));
 
-		if (sm_singleton->m_2DlineCount > 0) {
-			glBindBuffer(GL_ARRAY_BUFFER, sm_singleton->m_2DlineVBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sm_singleton->m_2DlineCount * sizeof(GizmoLine), sm_singleton->m_2Dlines);
+		glBindVertexArray(sm_singleton->m_ringVAO);
 
-			glBindVertexArray(sm_singleton->m_2DlineVAO);
-			glDrawArrays(GL_LINES, 0, sm_singleton->m_2DlineCount * 2);
-		}
+		if (lineCount > 0)
+			glDrawArrays(GL_LINES, lineFirst * 2, lineCount * 2);
 
-		if (sm_singleton->m_2DtriCount > 0) {
+		if (triCount > 0) {
 			GLboolean blendEnabled = glIsEnabled(GL_BLEND);
 
 			GLboolean depthMask = GL_TRUE;
@@ -1039,11 +1218,7 @@ void Gizmos::draw2D(const glm::mat4& projection) {
 
 			glDepthMask(GL_FALSE);
 
-			glBindBuffer(GL_ARRAY_BUFFER, sm_singleton->m_2DtriVBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sm_singleton->m_2DtriCount * sizeof(GizmoTri), sm_singleton->m_2Dtris);
-
-			glBindVertexArray(sm_singleton->m_2DtriVAO);
-			glDrawArrays(GL_TRIANGLES, 0, sm_singleton->m_2DtriCount * 3);
+			glDrawArrays(GL_TRIANGLES, triFirst * 3, triCount * 3);
 
 			glDepthMask(depthMask);
 
@@ -1053,8 +1228,475 @@ void Gizmos::draw2D(const glm::mat4& projection) {
 				glDisable(GL_BLEND);
 		}
 
+		glBindVertexArray(0);
 		glUseProgram(shader);
 	}
+
+	sm_singleton->fenceRegion();
+}
+
+void Gizmos::createShapes() {
+	const char* vsSource = "#version 150\n \
+					 in vec3 Position; \
+					 in vec3 Morph; \
+					 in mat4 Transform; \
+					 in vec4 Colour; \
+					 in float Stretch; \
+					 out vec4 vColour; \
+					 uniform mat4 ProjectionView; \
+					 void main() { vColour = Colour; gl_Position = ProjectionView * Transform * vec4(Position + Morph * Stretch, 1); }";
+
+	const char* fsSource = "#version 150\n \
+					 in vec4 vColour; \
+                     out vec4 FragColor; \
+					 void main()	{ FragColor = vColour; }";
+
+	const char* attributes[] = { "Position", "Morph", "Transform", "Colour", "Stretch" };
+	const unsigned int locations[] = { 0, 1, 2, 6, 7 };
+	m_shapeShader = linkProgram(vsSource, fsSource, attributes, locations, 5);
+
+	// every template in one vertex and index buffer, each shape's
+	// triangles then its lines, indexed from its own first vertex
+	std::vector<ShapeVertex> vertices;
+	std::vector<unsigned int> indices, tris, lines;
+	unsigned int baseVertex = 0;
+
+	auto vertex = [&](float x, float y, float z, float mx, float my, float mz) {
+		ShapeVertex v = { x, y, z, mx, my, mz };
+		vertices.push_back(v);
+	};
+	auto tri = [&](unsigned int a, unsigned int b, unsigned int c) {
+		tris.push_back(a);
+		tris.push_back(b);
+		tris.push_back(c);
+	};
+	auto line = [&](unsigned int a, unsigned int b) {
+		lines.push_back(a);
+		lines.push_back(b);
+	};
+	auto finish = [&](Shape shape) {
+		ShapeMesh& mesh = m_shapeMeshes[shape];
+		mesh.baseVertex = baseVertex;
+		mesh.firstTriIndex = (unsigned int)indices.size();
+		mesh.triIndexCount = (unsigned int)tris.size();
+		indices.insert(indices.end(), tris.begin(), tris.end());
+		mesh.firstLineIndex = (unsigned int)indices.size();
+		mesh.lineIndexCount = (unsigned int)lines.size();
+		indices.insert(indices.end(), lines.begin(), lines.end());
+
+		baseVertex = (unsigned int)vertices.size();
+		tris.clear();
+		lines.clear();
+	};
+
+	// rows of vertices from the bottom up, each row's last column wrapping
+	// to its first, faced the way addSphere does
+	auto faceRows = [&](unsigned int rows, unsigned int columns) {
+		for (unsigned int face = 0; face < rows * columns; ++face) {
+			unsigned int nextFace = face + 1;
+			if (nextFace % columns == 0)
+				nextFace -= columns;
+
+			line(face, face + columns);
+			line(nextFace + columns, face + columns);
+			tri(nextFace + columns, face, nextFace);
+			tri(nextFace + columns, face + columns, face);
+		}
+	};
+
+	float pi = glm::pi<float>();
+	float segmentSize = (2 * pi) / SHAPE_SEGMENTS;
+
+	// sphere
+	for (unsigned int row = 0; row <= SHAPE_ROWS; ++row) {
+		float latitude = (float(row) / SHAPE_ROWS - 0.5f) * pi;
+		for (unsigned int col = 0; col < SHAPE_SEGMENTS; ++col) {
+			float theta = col * segmentSize;
+			vertex(-cosf(latitude) * sinf(theta), sinf(latitude), -cosf(latitude) * cosf(theta), 0, 0, 0);
+		}
+	}
+	faceRows(SHAPE_ROWS, SHAPE_SEGMENTS);
+	finish(SHAPE_SPHERE);
+
+	// cylinder, the centers of its ends then a top and bottom vertex per segment
+	vertex(0, 1, 0, 0, 0, 0);
+	vertex(0, -1, 0, 0, 0, 0);
+	for (unsigned int i = 0; i < SHAPE_SEGMENTS; ++i) {
+		vertex(sinf(i * segmentSize), 1, cosf(i * segmentSize), 0, 0, 0);
+		vertex(sinf(i * segmentSize), -1, cosf(i * segmentSize), 0, 0, 0);
+	}
+	for (unsigned int i = 0; i < SHAPE_SEGMENTS; ++i) {
+		unsigned int v1top = 2 + i * 2, v1bottom = v1top + 1;
+		unsigned int v2top = 2 + ((i + 1) % SHAPE_SEGMENTS) * 2, v2bottom = v2top + 1;
+
+		tri(0, v1top, v2top);
+		tri(1, v2bottom, v1bottom);
+		tri(v2top, v1top, v1bottom);
+		tri(v1bottom, v2bottom, v2top);
+
+		line(v1top, v2top);
+		line(v1top, v1bottom);
+		line(v1bottom, v2bottom);
+	}
+	finish(SHAPE_CYLINDER);
+
+	// capsule, a sphere split at its equator with the row there doubled so
+	// the faces between them make its middle. Each half moves away from
+	// the other as it's stretched
+	for (unsigned int row = 0; row <= SHAPE_ROWS + 1; ++row) {
+		bool top = row > SHAPE_ROWS / 2;
+		float latitude = (float(top ? row - 1 : row) / SHAPE_ROWS - 0.5f) * pi;
+		for (unsigned int col = 0; col < SHAPE_SEGMENTS; ++col) {
+			float theta = col * segmentSize;
+			vertex(-cosf(latitude) * sinf(theta), sinf(latitude), -cosf(latitude) * cosf(theta),
+				   0, top ? 1.0f : -1.0f, 0);
+		}
+	}
+	faceRows(SHAPE_ROWS + 1, SHAPE_SEGMENTS);
+	finish(SHAPE_CAPSULE);
+
+	// aabb, the same corners and faces as addAABBFilled
+	vertex(-1, -1, -1, 0, 0, 0);
+	vertex(-1, -1, 1, 0, 0, 0);
+	vertex(1, -1, 1, 0, 0, 0);
+	vertex(1, -1, -1, 0, 0, 0);
+	vertex(-1, 1, -1, 0, 0, 0);
+	vertex(-1, 1, 1, 0, 0, 0);
+	vertex(1, 1, 1, 0, 0, 0);
+	vertex(1, 1, -1, 0, 0, 0);
+
+	for (unsigned int i = 0; i < 4; ++i) {
+		line(i, (i + 1) % 4);
+		line(4 + i, 4 + (i + 1) % 4);
+		line(i, 4 + i);
+	}
+
+	tri(2, 1, 0);	tri(3, 2, 0);
+	tri(5, 6, 4);	tri(6, 7, 4);
+	tri(4, 3, 0);	tri(7, 3, 4);
+	tri(1, 2, 5);	tri(2, 6, 5);
+	tri(0, 1, 4);	tri(1, 5, 4);
+	tri(2, 3, 7);	tri(6, 2, 7);
+	finish(SHAPE_AABB);
+
+	// disk, double-sided around its center
+	vertex(0, 0, 0, 0, 0, 0);
+	for (unsigned int i = 0; i < SHAPE_SEGMENTS; ++i)
+		vertex(sinf(i * segmentSize), 0, cosf(i * segmentSize), 0, 0, 0);
+	for (unsigned int i = 0; i < SHAPE_SEGMENTS; ++i) {
+		unsigned int v1outer = 1 + i;
+		unsigned int v2outer = 1 + (i + 1) % SHAPE_SEGMENTS;
+
+		tri(0, v1outer, v2outer);
+		tri(v2outer, v1outer, 0);
+		line(v1outer, v2outer);
+	}
+	finish(SHAPE_DISK);
+
+	// ring, double-sided, its inner vertices start at the center and move
+	// out to the stretch
+	for (unsigned int i = 0; i < SHAPE_SEGMENTS; ++i) {
+		vertex(sinf(i * segmentSize), 0, cosf(i * segmentSize), 0, 0, 0);
+		vertex(0, 0, 0, sinf(i * segmentSize), 0, cosf(i * segmentSize));
+	}
+	for (unsigned int i = 0; i < SHAPE_SEGMENTS; ++i) {
+		unsigned int v1outer = i * 2, v1inner = v1outer + 1;
+		unsigned int v2outer = ((i + 1) % SHAPE_SEGMENTS) * 2, v2inner = v2outer + 1;
+
+		tri(v2outer, v1outer, v1inner);
+		tri(v1inner, v2inner, v2outer);
+		tri(v1inner, v1outer, v2outer);
+		tri(v2outer, v2inner, v1inner);
+
+		line(v1inner, v2inner);
+		line(v1outer, v2outer);
+	}
+	finish(SHAPE_RING);
+
+	glGenVertexArrays(1, &m_shapeVAO);
+	glBindVertexArray(m_shapeVAO);
+
+	glGenBuffers(1, &m_shapeVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, m_shapeVBO);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(ShapeVertex), vertices.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ShapeVertex), 0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(ShapeVertex), (void*)12);
+
+	glGenBuffers(1, &m_shapeIBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_shapeIBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+	// the instances are read from the ring, pointed at by createRing()
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void Gizmos::uploadRetained() {
+	if (!m_retainedDirty)
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_retainedLineVBO);
+	glBufferData(GL_ARRAY_BUFFER, m_retainedLines.size() * sizeof(GizmoLine), m_retainedLines.data(), GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_retainedTriVBO);
+	glBufferData(GL_ARRAY_BUFFER, m_retainedTris.size() * sizeof(GizmoTri), m_retainedTris.data(), GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	m_retainedDirty = false;
+}
+
+bool Gizmos::uploadShapes(const glm::mat4& projectionView) {
+	unsigned int total = 0;
+	for (unsigned int shape = 0; shape < SHAPE_COUNT; ++shape) {
+		for (unsigned int pass = 0; pass < SHAPE_PASS_COUNT; ++pass)
+			total += (unsigned int)(m_retainedShapeInstances[shape][pass].size() + m_shapeInstances[shape][pass].size());
+	}
+	if (total == 0)
+		return false;
+
+	// the ring has already been reserved for them by draw()
+	unsigned int ringFirst = 0;
+	ShapeInstance* buffer = (ShapeInstance*)allocate(total, sizeof(ShapeInstance), ringFirst);
+	if (buffer == nullptr)
+		return false;
+
+	// blended instances are ordered by the clip space z of their centers
+	glm::vec4 depthPlane(projectionView[0][2], projectionView[1][2], projectionView[2][2], projectionView[3][2]);
+
+	unsigned int first = 0;
+	for (unsigned int shape = 0; shape < SHAPE_COUNT; ++shape) {
+		for (unsigned int pass = 0; pass < SHAPE_PASS_COUNT; ++pass) {
+			const std::vector<ShapeInstance>& retained = m_retainedShapeInstances[shape][pass];
+			const std::vector<ShapeInstance>& instances = m_shapeInstances[shape][pass];
+			unsigned int retainedCount = (unsigned int)retained.size();
+			unsigned int count = retainedCount + (unsigned int)instances.size();
+
+			m_shapeFirst[shape][pass] = ringFirst + first;
+			ShapeInstance* destination = buffer + first;
+			first += count;
+
+			if (pass != SHAPE_PASS_TRANSPARENT || !m_sortTransparent || count < 2) {
+				std::copy(retained.begin(), retained.end(), destination);
+				std::copy(instances.begin(), instances.end(), destination + retainedCount);
+				continue;
+			}
+
+			m_shapeKeys.resize(count);
+			if (retainedCount > 0)
+				DepthSort::computeKeys(&retained[0].transform[12], sizeof(ShapeInstance), retainedCount,
+									   depthPlane, m_shapeKeys.data());
+			if (count > retainedCount)
+				DepthSort::computeKeys(&instances[0].transform[12], sizeof(ShapeInstance), count - retainedCount,
+									   depthPlane, m_shapeKeys.data() + retainedCount);
+
+			const unsigned int* order = m_shapeSort->sort(m_shapeKeys.data(), count);
+			for (unsigned int i = 0; i < count; ++i) {
+				unsigned int index = order[i];
+				destination[i] = index < retainedCount ? retained[index] : instances[index - retainedCount];
+			}
+		}
+	}
+
+	endWrite();
+	return true;
+}
+
+void Gizmos::drawShapes(const glm::mat4& projectionView, bool transparent) {
+	glUseProgram(m_shapeShader);
+
+	unsigned int projectionViewUniform = glGetUniformLocation(m_shapeShader, "ProjectionView");
+	glUniformMatrix4fv(projectionViewUniform, 1, false, glm::value_ptr(projectionView));
+
+	glBindVertexArray(m_shapeVAO);
+
+	for (unsigned int shape = 0; shape < SHAPE_COUNT; ++shape) {
+		const ShapeMesh& mesh = m_shapeMeshes[shape];
+
+		for (unsigned int pass = 0; pass < SHAPE_PASS_COUNT; ++pass) {
+			if ((pass == SHAPE_PASS_TRANSPARENT) != transparent)
+				continue;
+
+			unsigned int count = (unsigned int)(m_retainedShapeInstances[shape][pass].size() +
+												m_shapeInstances[shape][pass].size());
+			if (count == 0)
+				continue;
+
+			if (pass == SHAPE_PASS_LINES)
+				glDrawElementsInstancedBaseVertexBaseInstance(GL_LINES, mesh.lineIndexCount, GL_UNSIGNED_INT,
+					(void*)(mesh.firstLineIndex * sizeof(unsigned int)), count, mesh.baseVertex, m_shapeFirst[shape][pass]);
+			else
+				glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, mesh.triIndexCount, GL_UNSIGNED_INT,
+					(void*)(mesh.firstTriIndex * sizeof(unsigned int)), count, mesh.baseVertex, m_shapeFirst[shape][pass]);
+		}
+	}
+}
+
+void Gizmos::reserveRing(unsigned int bytes) {
+	if (m_ringOffset + bytes > m_ringRegionSize) {
+		if (bytes > m_ringRegionSize) {
+			// the GL keeps the old buffer alive until draws reading it finish
+			destroyRing();
+			createRing(std::max(bytes, m_ringRegionSize * 2));
+			m_stats.ringGrowths++;
+		}
+		else {
+			fenceRegion();
+			nextRegion();
+		}
+	}
+
+	if (m_ringRegionReady)
+		return;
+
+	// only stalls when the CPU is a whole ring ahead of the GPU
+	GLsync fence = (GLsync)m_ringFences[m_ringRegion];
+	if (fence != nullptr) {
+		GLenum result = glClientWaitSync(fence, 0, 0);
+		if (result == GL_TIMEOUT_EXPIRED) {
+			m_ringFenceWaits++;
+			while (result == GL_TIMEOUT_EXPIRED)
+				result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		}
+		glDeleteSync(fence);
+		m_ringFences[m_ringRegion] = nullptr;
+	}
+	m_ringRegionReady = true;
+}
+
+void* Gizmos::allocate(unsigned int count, unsigned int stride, unsigned int& first) {
+	// aligned to the stride so draws can index the elements from the
+	// start of the buffer
+	unsigned int regionStart = m_ringRegion * m_ringRegionSize;
+	unsigned int offset = (regionStart + m_ringOffset + stride - 1) / stride * stride;
+	unsigned int bytes = count * stride;
+	if (offset + bytes > regionStart + m_ringRegionSize)
+		return nullptr;
+
+	first = offset / stride;
+	m_ringOffset = offset + bytes - regionStart;
+	m_ringUnfenced = true;
+	m_ringBytesStreamed += bytes;
+
+	if (m_ringMapping != nullptr)
+		return m_ringMapping + offset;
+
+	// without persistent mapping just the range is mapped, unsynchronised
+	// as the region's fence has already been waited on
+	glBindBuffer(GL_ARRAY_BUFFER, m_ringVBO);
+	void* buffer = glMapBufferRange(GL_ARRAY_BUFFER, offset, bytes,
+									GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	m_ringMapped = buffer != nullptr;
+	if (!m_ringMapped)
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return buffer;
+}
+
+void Gizmos::endWrite() {
+	if (!m_ringMapped)
+		return;
+
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	m_ringMapped = false;
+}
+
+template <typename T>
+unsigned int Gizmos::stream(const ChunkedBuffer<T>& buffer, unsigned int& first) {
+	if (buffer.size() == 0)
+		return 0;
+
+	T* destination = (T*)allocate(buffer.size(), sizeof(T), first);
+	if (destination == nullptr)
+		return 0;
+
+	buffer.copyTo(destination);
+	endWrite();
+	return buffer.size();
+}
+
+void Gizmos::fenceRegion() {
+	if (!m_ringUnfenced)
+		return;
+
+	if (m_ringFences[m_ringRegion] != nullptr)
+		glDeleteSync((GLsync)m_ringFences[m_ringRegion]);
+	m_ringFences[m_ringRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_ringUnfenced = false;
+}
+
+void Gizmos::nextRegion() {
+	m_ringRegion = (m_ringRegion + 1) % RING_REGIONS;
+	m_ringOffset = 0;
+	m_ringRegionReady = false;
+}
+
+void Gizmos::createRing(unsigned int regionSize) {
+	m_ringRegionSize = (std::max(regionSize, 1u) + 255) & ~255u;
+	unsigned int size = m_ringRegionSize * RING_REGIONS;
+
+	glGenBuffers(1, &m_ringVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, m_ringVBO);
+
+	// mapped once and written straight in to when buffer storage is
+	// supported, coherent so nothing needs flushing
+	if (glBufferStorage != nullptr) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+		m_ringMapping = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+	}
+	else {
+		glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+		m_ringMapping = nullptr;
+	}
+
+	glBindVertexArray(m_ringVAO);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), (void*)16);
+
+	// the shape instances, alongside the template's vertices
+	glBindVertexArray(m_shapeVAO);
+	for (unsigned int column = 0; column < 4; ++column) {
+		glEnableVertexAttribArray(2 + column);
+		glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance), ((char*)0) + column * 16);
+		glVertexAttribDivisor(2 + column, 1);
+	}
+	glEnableVertexAttribArray(6);
+	glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance), (void*)64);
+	glVertexAttribDivisor(6, 1);
+	glEnableVertexAttribArray(7);
+	glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance), (void*)80);
+	glVertexAttribDivisor(7, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	m_ringRegion = 0;
+	m_ringOffset = 0;
+	m_ringRegionReady = true;
+	m_ringUnfenced = false;
+}
+
+void Gizmos::destroyRing() {
+	if (m_ringMapping != nullptr) {
+		glBindBuffer(GL_ARRAY_BUFFER, m_ringVBO);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		m_ringMapping = nullptr;
+	}
+	glDeleteBuffers(1, &m_ringVBO);
+	m_ringVBO = 0;
+
+	for (unsigned int region = 0; region < RING_REGIONS; ++region) {
+		if (m_ringFences[region] != nullptr)
+			glDeleteSync((GLsync)m_ringFences[region]);
+		m_ringFences[region] = nullptr;
+	}
 }
 
 } // namespace aie
\ No newline at end of file
@@ -1,24 +1,67 @@
 #pragma once
 
 #include <glm/fwd.hpp>
+#include <algorithm>
+#include <vector>
 
 namespace aie {
 
+class DepthSort;
+
 // a singleton class for rendering immediate-mode 3-D primitives
 class Gizmos {
 public:
 
+	// unit shapes built once as meshes on the GPU, drawn instanced with a
+	// transform and colour each rather than rebuilt triangle by triangle
+	enum Shape : unsigned int {
+		SHAPE_SPHERE = 0,	// radius 1
+		SHAPE_CYLINDER,		// radius 1 and half length 1 along the Y-axis
+		SHAPE_CAPSULE,		// radius 1, its halves stretched apart along the Y-axis
+		SHAPE_AABB,			// extents of 1
+		SHAPE_DISK,			// radius 1 in the XZ axis
+		SHAPE_RING,			// outer radius 1 in the XZ axis, stretch is the inner radius
+
+		SHAPE_COUNT
+	};
+
+	// what was added since the last clear(), and what it took to stream it
+	struct Stats {
+		unsigned int	lines, tris, transparentTris;
+		unsigned int	lines2D, tris2D;
+		unsigned int	shapeInstances;
+		unsigned int	overflow;		// primitives past the counts given to create()
+		unsigned int	bytesStreamed;	// by the last frame, from one clear() to the next
+		unsigned int	fenceWaits;		// times the last frame waited for the GPU to finish with a region
+		unsigned int	ringGrowths;	// times the stream buffer has grown to fit a frame
+	};
+
+	// the counts are allocated up front. More can be added, they're held in
+	// extra chunks and reported as overflow in the stats
 	static void		create(unsigned int maxLines, unsigned int maxTris,
 						   unsigned int max2DLines, unsigned int max2DTris);
 	static void		destroy();
 
-	// removes all Gizmos
+	static Stats	getStats();
+
+	// removes all Gizmos, other than those retained
 	static void		clear();
 
+	// 3D gizmos added between these are kept across clear() until
+	// clearRetained(), and uploaded once rather than every frame
+	static void		beginRetained();
+	static void		endRetained();
+	static void		clearRetained();
+
 	// draws current Gizmo buffers, either using a combined (projection * view) matrix, or separate matrices
 	static void		draw(const glm::mat4& projectionView);
 	static void		draw(const glm::mat4& projection, const glm::mat4& view);
 	
+	// transparent triangles are sorted back to front before they're drawn,
+	// which is on by default. With a resort budget the last frame's order is
+	// refined instead, moving at most that many triangles a frame
+	static void		setTransparentSorting(bool sort, unsigned int resortBudget = 0);
+
 	// the projection matrix here should ideally be orthographic with a near of -1 and far of 1
 	static void		draw2D(const glm::mat4& projection);
 	static void		draw2D(float screenWidth, float screenHeight);
@@ -78,6 +121,29 @@ public:
 	static void		addCapsule(const glm::vec3& center, float height, float radius,
 							   int rows, int cols, const glm::vec4& fillColour, const glm::mat4* rotation = nullptr);
 
+	// adds an instance of a shape template. Its triangles are drawn in fillColour and
+	// its lines in lineColour, either is skipped if its alpha is 0. Stretch moves
+	// the capsule's halves apart and is the ring's inner radius, in the shape's units
+	static void		addShape(Shape shape, const glm::mat4& transform, const glm::vec4& fillColour,
+							 const glm::vec4& lineColour, float stretch = 0);
+
+	// instanced versions of the shapes above, drawn the same way but from
+	// the templates, so their segments, rows and columns are fixed
+	static void		addAABBInstanced(const glm::vec3& center, const glm::vec3& extents,
+									 const glm::vec4& colour, const glm::mat4* transform = nullptr);
+	static void		addAABBFilledInstanced(const glm::vec3& center, const glm::vec3& extents,
+										   const glm::vec4& fillColour, const glm::mat4* transform = nullptr);
+	static void		addCylinderFilledInstanced(const glm::vec3& center, float radius, float halfLength,
+											   const glm::vec4& fillColour, const glm::mat4* transform = nullptr);
+	static void		addRingInstanced(const glm::vec3& center, float innerRadius, float outerRadius,
+									 const glm::vec4& fillColour, const glm::mat4* transform = nullptr);
+	static void		addDiskInstanced(const glm::vec3& center, float radius,
+									 const glm::vec4& fillColour, const glm::mat4* transform = nullptr);
+	static void		addSphereInstanced(const glm::vec3& center, float radius,
+									   const glm::vec4& fillColour, const glm::mat4* transform = nullptr);
+	static void		addCapsuleInstanced(const glm::vec3& center, float height, float radius,
+										const glm::vec4& fillColour, const glm::mat4* rotation = nullptr);
+
 	// adds a single Hermite spline curve
 	static void		addHermiteSpline(const glm::vec3& start, const glm::vec3& end,
 									 const glm::vec3& tangentStart, const glm::vec3& tangentEnd, unsigned int segments, const glm::vec4& colour);
@@ -113,45 +179,190 @@ private:
 		GizmoVertex v2;
 	};
 
+	// a shape template's vertex, moved along morph by the instance's stretch
+	struct ShapeVertex {
+		float x, y, z;
+		float mx, my, mz;
+	};
+
+	struct ShapeInstance {
+		float transform[16];
+		float r, g, b, a;
+		float stretch;
+	};
+
+	// each shape's instances are drawn as lines, opaque triangles, then
+	// blended triangles sorted back to front
+	enum ShapePass : unsigned int {
+		SHAPE_PASS_LINES = 0,
+		SHAPE_PASS_OPAQUE,
+		SHAPE_PASS_TRANSPARENT,
+
+		SHAPE_PASS_COUNT
+	};
+
+	// a template's range of the shared shape buffers
+	struct ShapeMesh {
+		unsigned int	baseVertex;
+		unsigned int	firstTriIndex, triIndexCount;
+		unsigned int	firstLineIndex, lineIndexCount;
+	};
+
+	// builds every template in to the shared buffers
+	void			createShapes();
+
+	// sends the retained lines and triangles if they've changed
+	void			uploadRetained();
+
+	// writes every instance in to this frame's instance buffer, the blended
+	// ones sorted, returning false if there were none
+	bool			uploadShapes(const glm::mat4& projectionView);
+	void			drawShapes(const glm::mat4& projectionView, bool transparent);
+
+	// primitives kept in fixed size chunks, so adding more never moves or
+	// copies those already added. Chunks are kept when it's cleared
+	template <typename T>
+	class ChunkedBuffer {
+	public:
+
+		enum { CHUNK_SHIFT = 12, CHUNK_SIZE = 1 << CHUNK_SHIFT };
+
+		ChunkedBuffer() : m_count(0) {}
+		ChunkedBuffer(const ChunkedBuffer&) = delete;
+		~ChunkedBuffer() {
+			for (T* chunk : m_chunks)
+				delete[] chunk;
+		}
+
+		// allocates chunks for at least capacity
+		void reserve(unsigned int capacity) {
+			while (m_chunks.size() * CHUNK_SIZE < capacity)
+				m_chunks.push_back(new T[CHUNK_SIZE]);
+		}
+
+		T& add() {
+			reserve(m_count + 1);
+			unsigned int i = m_count++;
+			return m_chunks[i >> CHUNK_SHIFT][i & (CHUNK_SIZE - 1)];
+		}
+
+		const T& operator[](unsigned int i) const { return m_chunks[i >> CHUNK_SHIFT][i & (CHUNK_SIZE - 1)]; }
+
+		// the chunks in use, all full other than the last
+		unsigned int chunkCount() const { return (m_count + CHUNK_SIZE - 1) >> CHUNK_SHIFT; }
+		const T* chunk(unsigned int i) const { return m_chunks[i]; }
+		unsigned int chunkSize(unsigned int i) const {
+			return m_count - i * CHUNK_SIZE < CHUNK_SIZE ? m_count - i * CHUNK_SIZE : CHUNK_SIZE;
+		}
+
+		void copyTo(T* destination) const {
+			for (unsigned int i = 0; i < chunkCount(); ++i)
+				std::copy(m_chunks[i], m_chunks[i] + chunkSize(i), destination + i * CHUNK_SIZE);
+		}
+
+		unsigned int size() const { return m_count; }
+		void clear() { m_count = 0; }
+
+	private:
+
+		std::vector<T*>	m_chunks;
+		unsigned int	m_count;
+	};
+
+	// every frame's primitives are streamed in to one buffer split in to
+	// regions, the CPU filling one while the GPU may still read the others
+	enum { RING_REGIONS = 3 };
+
+	// makes room in the current region for bytes more, moving on to the
+	// next region when this one's full and growing the ring if they can't
+	// hold it. Waits if the GPU hasn't finished reading the region
+	void			reserveRing(unsigned int bytes);
+
+	// count elements of stride bytes from what was reserved, returning
+	// where to write them and setting the index of the first in the ring
+	void*			allocate(unsigned int count, unsigned int stride, unsigned int& first);
+	void			endWrite();
+
+	// copies the buffer in to what was reserved, returning how many were
+	// written and setting the index of the first
+	template <typename T>
+	unsigned int	stream(const ChunkedBuffer<T>& buffer, unsigned int& first);
+
+	// marks the current region in use by the draws issued so far
+	void			fenceRegion();
+
+	// starts writing at the front of the next region, waited on when
+	// it's first reserved
+	void			nextRegion();
+
+	void			createRing(unsigned int regionSize);
+	void			destroyRing();
+
 	unsigned int	m_shader;
 
 	// line data
 	unsigned int	m_maxLines;
-	unsigned int	m_lineCount;
-	GizmoLine*		m_lines;
-
-	unsigned int	m_lineVAO;
-	unsigned int 	m_lineVBO;
+	ChunkedBuffer<GizmoLine>	m_lines;
 
 	// triangle data
 	unsigned int	m_maxTris;
-	unsigned int	m_triCount;
-	GizmoTri*		m_tris;
-
-	unsigned int	m_triVAO;
-	unsigned int 	m_triVBO;
-	
-	unsigned int	m_transparentTriCount;
-	GizmoTri*		m_transparentTris;
-
-	unsigned int	m_transparentTriVAO;
-	unsigned int 	m_transparentTriVBO;
+	ChunkedBuffer<GizmoTri>	m_tris;
+	ChunkedBuffer<GizmoTri>	m_transparentTris;
+
+	bool			m_sortTransparent;
+	unsigned int	m_transparentResortBudget;
+	std::vector<float>	m_transparentKeys;
+	DepthSort*		m_transparentSort;
+
+	// retained data, drawn every frame until cleared
+	bool			m_retaining;
+	bool			m_retainedDirty;
+	std::vector<GizmoLine>	m_retainedLines;
+	std::vector<GizmoTri>	m_retainedTris;
+	std::vector<GizmoTri>	m_retainedTransparentTris;
+
+	unsigned int	m_retainedLineVAO;
+	unsigned int	m_retainedLineVBO;
+	unsigned int	m_retainedTriVAO;
+	unsigned int	m_retainedTriVBO;
+
+	// shape templates and their instances, the retained ones drawn first
+	unsigned int	m_shapeShader;
+	ShapeMesh		m_shapeMeshes[SHAPE_COUNT];
+	std::vector<ShapeInstance>	m_shapeInstances[SHAPE_COUNT][SHAPE_PASS_COUNT];
+	std::vector<ShapeInstance>	m_retainedShapeInstances[SHAPE_COUNT][SHAPE_PASS_COUNT];
+	unsigned int	m_shapeFirst[SHAPE_COUNT][SHAPE_PASS_COUNT];	// in to the ring, as instances
+
+	unsigned int	m_shapeVAO;
+	unsigned int	m_shapeVBO;
+	unsigned int	m_shapeIBO;
+	std::vector<float>	m_shapeKeys;
+	DepthSort*		m_shapeSort;
 	
 	// 2D line data
 	unsigned int	m_max2DLines;
-	unsigned int	m_2DlineCount;
-	GizmoLine*		m_2Dlines;
-
-	unsigned int	m_2DlineVAO;
-	unsigned int 	m_2DlineVBO;
+	ChunkedBuffer<GizmoLine>	m_2Dlines;
 
 	// 2D triangle data
 	unsigned int	m_max2DTris;
-	unsigned int	m_2DtriCount;
-	GizmoTri*		m_2Dtris;
-
-	unsigned int	m_2DtriVAO;
-	unsigned int 	m_2DtriVBO;
+	ChunkedBuffer<GizmoTri>	m_2Dtris;
+
+	// the ring everything is streamed through, and a VAO reading vertices
+	// from it. Mapped once for good when the driver supports it
+	unsigned int	m_ringVBO;
+	unsigned int	m_ringVAO;
+	unsigned int	m_ringRegionSize;
+	char*			m_ringMapping;
+	bool			m_ringMapped;					// by the write in progress, without persistent mapping
+	unsigned int	m_ringRegion;
+	unsigned int	m_ringOffset;					// in to the region
+	bool			m_ringRegionReady;				// its fence has been waited on
+	void*			m_ringFences[RING_REGIONS];		// GLsync, when the GPU is done with each region
+	bool			m_ringUnfenced;					// draws read the region since its fence
+	unsigned int	m_ringBytesStreamed;			// by this frame so far
+	unsigned int	m_ringFenceWaits;
+
+	Stats			m_stats;
 
 	static Gizmos*	sm_singleton;
 };
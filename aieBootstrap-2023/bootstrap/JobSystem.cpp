@@ -0,0 +1,82 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+namespace aie {
+
+JobSystem::JobSystem(unsigned int threadCount /* = 0 */)
+	: m_next(0) {
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+	m_workers.reserve(threadCount - 1);
+	for (unsigned int i = 1; i < threadCount; ++i)
+		m_workers.emplace_back(&JobSystem::runWorker, this);
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+
+	for (auto& worker : m_workers)
+		worker.join();
+}
+
+void JobSystem::parallelFor(unsigned int count, const std::function<void(unsigned int)>& task) {
+	if (count == 0)
+		return;
+
+	// not worth waking anyone for
+	if (count == 1 || m_workers.empty()) {
+		for (unsigned int i = 0; i < count; ++i)
+			task(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_task = &task;
+		m_count = count;
+		m_next = 0;
+		m_busy = (unsigned int)m_workers.size();
+		++m_generation;
+	}
+	m_wake.notify_all();
+
+	runTasks();
+
+	// every worker has to check in, even those that found nothing left, so
+	// none can still be looking at this task when the next one is set
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this]() { return m_busy == 0; });
+	m_task = nullptr;
+}
+
+void JobSystem::runWorker() {
+	unsigned int generation = 0;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&]() { return m_quit || m_generation != generation; });
+			if (m_quit)
+				return;
+			generation = m_generation;
+		}
+
+		runTasks();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_busy == 0)
+			m_done.notify_one();
+	}
+}
+
+void JobSystem::runTasks() {
+	for (unsigned int i = m_next++; i < m_count; i = m_next++)
+		(*m_task)(i);
+}
+
+} // namespace aie
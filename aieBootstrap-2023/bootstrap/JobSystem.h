@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace aie {
+
+// a pool of worker threads kept for the life of the system, for splitting a
+// frame's work across cores without starting threads each time. Only one
+// thread may hand it work at once
+class JobSystem {
+public:
+
+	// a threadCount of 0 uses one thread per core, the calling thread included
+	JobSystem(unsigned int threadCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// runs task for every index below count, on the workers and the calling
+	// thread, and returns once they have all run
+	void parallelFor(unsigned int count, const std::function<void(unsigned int)>& task);
+
+	// the workers and the calling thread
+	unsigned int getThreadCount() const { return (unsigned int)m_workers.size() + 1; }
+
+protected:
+
+	void runWorker();
+
+	// takes indices until there are none left
+	void runTasks();
+
+	std::vector<std::thread>	m_workers;
+	std::mutex					m_mutex;
+	std::condition_variable		m_wake;
+	std::condition_variable		m_done;
+
+	const std::function<void(unsigned int)>*	m_task = nullptr;
+	unsigned int								m_count = 0;
+	std::atomic<unsigned int>					m_next;
+
+	unsigned int	m_generation = 0;	// bumped for each parallelFor so workers know there is work
+	unsigned int	m_busy = 0;			// workers yet to finish the current one
+	bool			m_quit = false;
+};
+
+} // namespace aie
@@ -2,6 +2,7 @@
 #include <GLFW/glfw3.h>
 #include "Renderer2D.h"
 #include "Texture.h"
+#include "TextureAtlas.h"
 #include "Font.h"
 #include <glm/ext.hpp>
 #include <stb_truetype.h>
@@ -521,6 +522,51 @@ void Renderer2D::drawSpriteTransformed4x4(Texture * texture,
 	m_indices[m_currentIndex++] = (index + 2);
 }
 
+void Renderer2D::drawSprite(const TextureRegion& region,
+							 float xPos, float yPos,
+							 float width, float height,
+							 float rotation, float depth, float xOrigin, float yOrigin) {
+	float uvX = m_uvX, uvY = m_uvY, uvW = m_uvW, uvH = m_uvH;
+	setUVRect(region.uvX, region.uvY, region.uvW, region.uvH);
+
+	drawSprite(region.texture, xPos, yPos,
+			   width == 0.0f ? (float)region.width : width,
+			   height == 0.0f ? (float)region.height : height,
+			   rotation, depth, xOrigin, yOrigin);
+
+	setUVRect(uvX, uvY, uvW, uvH);
+}
+
+void Renderer2D::drawSpriteTransformed3x3(const TextureRegion& region,
+										   float* transformMat3x3,
+										   float width, float height, float depth,
+										   float xOrigin, float yOrigin) {
+	float uvX = m_uvX, uvY = m_uvY, uvW = m_uvW, uvH = m_uvH;
+	setUVRect(region.uvX, region.uvY, region.uvW, region.uvH);
+
+	drawSpriteTransformed3x3(region.texture, transformMat3x3,
+							 width == 0.0f ? (float)region.width : width,
+							 height == 0.0f ? (float)region.height : height,
+							 depth, xOrigin, yOrigin);
+
+	setUVRect(uvX, uvY, uvW, uvH);
+}
+
+void Renderer2D::drawSpriteTransformed4x4(const TextureRegion& region,
+										   float* transformMat4x4,
+										   float width, float height, float depth,
+										   float xOrigin, float yOrigin) {
+	float uvX = m_uvX, uvY = m_uvY, uvW = m_uvW, uvH = m_uvH;
+	setUVRect(region.uvX, region.uvY, region.uvW, region.uvH);
+
+	drawSpriteTransformed4x4(region.texture, transformMat4x4,
+							 width == 0.0f ? (float)region.width : width,
+							 height == 0.0f ? (float)region.height : height,
+							 depth, xOrigin, yOrigin);
+
+	setUVRect(uvX, uvY, uvW, uvH);
+}
+
 void Renderer2D::drawLine(float x1, float y1, float x2, float y2, float thickness, float depth) {
 
 	float xDiff = x2 - x1;
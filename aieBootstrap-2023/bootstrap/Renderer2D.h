@@ -4,6 +4,7 @@ namespace aie {
 
 class Texture;
 class Font;
+struct TextureRegion;
 
 // a class for rendering 2D sprites and font
 class Renderer2D {
@@ -26,6 +27,12 @@ public:
 	virtual void drawSpriteTransformed3x3(Texture* texture, float* transformMat3x3, float width = 0.0f, float height = 0.0f, float depth = 0.0f, float xOrigin = 0.5f, float yOrigin = 0.5f);
 	virtual void drawSpriteTransformed4x4(Texture* texture, float* transformMat4x4, float width = 0.0f, float height = 0.0f, float depth = 0.0f, float xOrigin = 0.5f, float yOrigin = 0.5f);
 
+	// draws part of a texture atlas, using the region's uvs for this sprite
+	// only rather than the uv rect, and its size if no width or height is given
+	virtual void drawSprite(const TextureRegion& region, float xPos, float yPos, float width = 0.0f, float height = 0.0f, float rotation = 0.0f, float depth = 0.0f, float xOrigin = 0.5f, float yOrigin = 0.5f);
+	virtual void drawSpriteTransformed3x3(const TextureRegion& region, float* transformMat3x3, float width = 0.0f, float height = 0.0f, float depth = 0.0f, float xOrigin = 0.5f, float yOrigin = 0.5f);
+	virtual void drawSpriteTransformed4x4(const TextureRegion& region, float* transformMat4x4, float width = 0.0f, float height = 0.0f, float depth = 0.0f, float xOrigin = 0.5f, float yOrigin = 0.5f);
+
 	// draws a simple coloured line with a given thickness
 	// depth is in the range [0,100] with lower being closer to the viewer
 	virtual void drawLine(float x1, float y1, float x2, float y2, float thickness = 1.0f, float depth = 0.0f );
@@ -72,8 +79,8 @@ protected:
 	// represents colour in red, green, blue and alpha 0.0-1.0 range
 	float				m_r, m_g, m_b, m_a;
 
-	// sprite handling
-	enum { MAX_SPRITES = 512 };
+	// sprite handling, as many as an atlas lets share a batch
+	enum { MAX_SPRITES = 2048 };
 	struct SBVertex {
 		float pos[4];
 		float color[4];
@@ -1,18 +1,53 @@
 #include "gl_core_4_4.h"
 #include "Texture.h"
+#include "TextureData.h"
+#include <cstdio>
+#include <sys/stat.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+// S3TC is an extension rather than core, but every desktop driver has it
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// BPTC is core since 4.2, but the loader only has the view classes
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
 namespace aie {
 
+static bool getFileStamp(const char* filename, unsigned long long& size, long long& modified) {
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(filename, &info) != 0)
+		return false;
+#else
+	struct stat info;
+	if (stat(filename, &info) != 0)
+		return false;
+#endif
+
+	size = (unsigned long long)info.st_size;
+	modified = (long long)info.st_mtime;
+	return true;
+}
+
 Texture::Texture() 
 	: m_filename("none"),
 	m_width(0),
 	m_height(0),
 	m_glHandle(0),
 	m_format(0),
-	m_loadedPixels(nullptr) {
+	m_loadedPixels(nullptr),
+	m_data(nullptr),
+	m_loadFlags(0),
+	m_size(0) {
 }
 
 Texture::Texture(const char * filename)
@@ -21,7 +56,10 @@ Texture::Texture(const char * filename)
 	m_height(0),
 	m_glHandle(0),
 	m_format(0),
-	m_loadedPixels(nullptr) {
+	m_loadedPixels(nullptr),
+	m_data(nullptr),
+	m_loadFlags(0),
+	m_size(0) {
 
 	load(filename);
 }
@@ -30,8 +68,12 @@ Texture::Texture(unsigned int width, unsigned int height, Format format, unsigne
 	: m_filename("none"),
 	m_width(width),
 	m_height(height),
+	m_glHandle(0),
 	m_format(format),
-	m_loadedPixels(nullptr) {
+	m_loadedPixels(nullptr),
+	m_data(nullptr),
+	m_loadFlags(0),
+	m_size(0) {
 
 	create(width, height, format, pixels);
 }
@@ -39,11 +81,10 @@ Texture::Texture(unsigned int width, unsigned int height, Format format, unsigne
 Texture::~Texture() {
 	if (m_glHandle != 0)
 		glDeleteTextures(1, &m_glHandle);
-	if (m_loadedPixels != nullptr)
-		stbi_image_free(m_loadedPixels);
+	freePixels();
 }
 
-bool Texture::load(const char* filename) {
+bool Texture::load(const char* filename, unsigned int flags /* = 0 */) {
 
 	if (m_glHandle != 0) {
 		glDeleteTextures(1, &m_glHandle);
@@ -53,45 +94,161 @@ bool Texture::load(const char* filename) {
 		m_filename = "none";
 	}
 
+	return decode(filename, flags) && upload();
+}
+
+bool Texture::decode(const char* filename, unsigned int flags /* = 0 */) {
+
+	freePixels();
+	m_loadFlags = flags;
+
+	bool processed = (flags & (LOAD_MIPMAPS | LOAD_COMPRESS)) != 0;
+	unsigned int options = 0;
+	if (flags & LOAD_MIPMAPS)
+		options |= TextureData::BUILD_MIPMAPS;
+	if (flags & LOAD_COMPRESS)
+		options |= TextureData::BUILD_COMPRESS;
+	if ((flags & (LOAD_COMPRESS | LOAD_BC7)) == (LOAD_COMPRESS | LOAD_BC7))
+		options |= TextureData::BUILD_BC7;
+	std::string cacheFile = std::string(filename) + ".texcache";
+	unsigned long long sourceSize = 0;
+	long long sourceModified = 0;
+	bool hasStamp = processed && (flags & LOAD_CACHE) && getFileStamp(filename, sourceSize, sourceModified);
+
+	// a cache built from this exact image skips decoding entirely
+	if (hasStamp) {
+		TextureData* data = new TextureData();
+		if (data->load(cacheFile.c_str(), sourceSize, sourceModified, options)) {
+			m_data = data;
+			m_format = data->getChannels();
+			m_width = data->getWidth();
+			m_height = data->getHeight();
+			m_size = data->getSize();
+			m_filename = filename;
+			return true;
+		}
+		delete data;
+	}
+
 	int x = 0, y = 0, comp = 0;
 	m_loadedPixels = stbi_load(filename, &x, &y, &comp, STBI_default);
 
+	if (m_loadedPixels == nullptr)
+		return false;
+
+	switch (comp) {
+	case STBI_grey:			m_format = RED;		break;
+	case STBI_grey_alpha:	m_format = RG;		break;
+	case STBI_rgb:			m_format = RGB;		break;
+	default:				m_format = RGBA;	break;
+	};
+	m_width = (unsigned int)x;
+	m_height = (unsigned int)y;
+	m_filename = filename;
+
+	// opengl's mips add about a third
+	m_size = m_width * m_height * m_format * 4 / 3;
+
+	if (processed) {
+		m_data = new TextureData();
+		m_data->build(m_loadedPixels, m_width, m_height, m_format, options);
+		m_size = m_data->getSize();
+
+		// a failed write only costs the next load a decode
+		if (hasStamp && m_data->save(cacheFile.c_str(), sourceSize, sourceModified) == false)
+			printf("Failed to write texture cache %s\n", cacheFile.c_str());
+	}
+	return true;
+}
+
+void Texture::freePixels() {
 	if (m_loadedPixels != nullptr) {
-		glGenTextures(1, &m_glHandle);
-		glBindTexture(GL_TEXTURE_2D, m_glHandle);
-		switch (comp) {
-		case STBI_grey:
-			m_format = RED;
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, x, y,
-						 0, GL_RED, GL_UNSIGNED_BYTE, m_loadedPixels);
-			break;
-		case STBI_grey_alpha:
-			m_format = RG;
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RG, x, y,
-						 0, GL_RG, GL_UNSIGNED_BYTE, m_loadedPixels);
-			break;
-		case STBI_rgb:
-			m_format = RGB;
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, x, y,
-						 0, GL_RGB, GL_UNSIGNED_BYTE, m_loadedPixels);
-			break;
-		case STBI_rgb_alpha:
-			m_format = RGBA;
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, x, y,
-						 0, GL_RGBA, GL_UNSIGNED_BYTE, m_loadedPixels);
-			break;
-		default:	break;
-		};
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		stbi_image_free(m_loadedPixels);
+		m_loadedPixels = nullptr;
+	}
+	delete m_data;
+	m_data = nullptr;
+}
+
+bool Texture::upload() {
+
+	if (m_loadedPixels == nullptr && m_data == nullptr)
+		return false;
+
+	if (m_glHandle != 0)
+		glDeleteTextures(1, &m_glHandle);
+
+	glGenTextures(1, &m_glHandle);
+	glBindTexture(GL_TEXTURE_2D, m_glHandle);
+
+	if (m_data != nullptr) {
+		uploadLevels();
 		glBindTexture(GL_TEXTURE_2D, 0);
-		m_width = (unsigned int)x;
-		m_height = (unsigned int)y;
-		m_filename = filename;
+
+		if (m_loadFlags & LOAD_FREE_PIXELS)
+			freePixels();
 		return true;
 	}
-	return false;
+
+	switch (m_format) {
+	case RED:
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, m_width, m_height,
+					 0, GL_RED, GL_UNSIGNED_BYTE, m_loadedPixels);
+		break;
+	case RG:
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG, m_width, m_height,
+					 0, GL_RG, GL_UNSIGNED_BYTE, m_loadedPixels);
+		break;
+	case RGB:
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, m_width, m_height,
+					 0, GL_RGB, GL_UNSIGNED_BYTE, m_loadedPixels);
+		break;
+	case RGBA:
+	default:
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_width, m_height,
+					 0, GL_RGBA, GL_UNSIGNED_BYTE, m_loadedPixels);
+		break;
+	};
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (m_loadFlags & LOAD_FREE_PIXELS)
+		freePixels();
+	return true;
+}
+
+void Texture::uploadLevels() {
+	static const unsigned int formats[5] = { 0, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+	static const unsigned int compressedFormats[6] = {
+		0,
+		GL_COMPRESSED_RGB_S3TC_DXT1_EXT,	// BC1
+		GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,	// BC3
+		GL_COMPRESSED_RED_RGTC1,			// BC4
+		GL_COMPRESSED_RG_RGTC2,				// BC5
+		GL_COMPRESSED_RGBA_BPTC_UNORM,		// BC7
+	};
+
+	// rows of the small levels aren't 4 byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	unsigned int levelCount = m_data->getLevelCount();
+	for (unsigned int i = 0; i < levelCount; ++i) {
+		const TextureData::Level& level = m_data->getLevel(i);
+		if (m_data->getCompression() == TextureData::NONE)
+			glTexImage2D(GL_TEXTURE_2D, i, formats[m_format], level.width, level.height,
+						 0, formats[m_format], GL_UNSIGNED_BYTE, m_data->getLevelData(i));
+		else
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, compressedFormats[m_data->getCompression()], level.width, level.height,
+								   0, level.size, m_data->getLevelData(i));
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
 }
 
 void Texture::create(unsigned int width, unsigned int height, Format format, unsigned char* pixels) {
@@ -4,6 +4,8 @@
 
 namespace aie {
 
+class TextureData;
+
 // a class for wrapping up an opengl texture image
 class Texture {
 public:
@@ -15,13 +17,36 @@ public:
 		RGBA
 	};
 
+	// how a file is loaded. Without any, the full image is uploaded and
+	// opengl generates its mips
+	enum LoadFlags : unsigned int {
+		LOAD_MIPMAPS		= 1 << 0,	// build a filtered mip chain on the cpu
+		LOAD_COMPRESS		= 1 << 1,	// block compress it too, BC4/BC5/BC1/BC3 by channel count
+		LOAD_CACHE			= 1 << 2,	// keep the result in filename + ".texcache" and load that next time
+										// it's loaded with the same flags, with either of the above.
+										// getPixels is nullptr when it's used
+		LOAD_FREE_PIXELS	= 1 << 3,	// free the cpu copy once uploaded, getPixels then returns nullptr
+		LOAD_BC7			= 1 << 4,	// with LOAD_COMPRESS, rgb and rgba images use BC7 instead of BC1
+										// and BC3. BC1's size doubles but it bands far less
+	};
+
 	Texture();
 	Texture(const char* filename);
 	Texture(unsigned int width, unsigned int height, Format format, unsigned char* pixels = nullptr);
 	virtual ~Texture();
 
 	// load a jpg, bmp, png or tga
-	bool load(const char* filename);
+	bool load(const char* filename, unsigned int flags = 0);
+
+	// the two halves of load, for loading in the background. decode reads
+	// the file in to pixels, and does any processing, without touching
+	// opengl so it can run on any thread, then upload creates the texture
+	// from them on the gl thread
+	bool decode(const char* filename, unsigned int flags = 0);
+	bool upload();
+
+	// frees the cpu copy of the pixels, the texture itself is unaffected
+	void freePixels();
 
 	// creates a texture that can be filled in with pixels
 	void create(unsigned int width, unsigned int height, Format format, unsigned char* pixels = nullptr);
@@ -40,14 +65,23 @@ public:
 	unsigned int getFormat() const { return m_format; }
 	const unsigned char* getPixels() const { return m_loadedPixels; }
 
+	// roughly what the texture takes in video memory, mips included
+	unsigned int getSize() const { return m_size; }
+
 protected:
 
+	// uploads every level of m_data to the bound texture
+	void uploadLevels();
+
 	std::string		m_filename;
 	unsigned int	m_width;
 	unsigned int	m_height;
 	unsigned int	m_glHandle;
 	unsigned int	m_format;
 	unsigned char*	m_loadedPixels;
+	TextureData*	m_data;		// processed levels, when loaded with mipmaps or compression
+	unsigned int	m_loadFlags;
+	unsigned int	m_size;
 };
 
 } // namespace aie
\ No newline at end of file
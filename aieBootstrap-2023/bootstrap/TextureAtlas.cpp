@@ -0,0 +1,271 @@
+#include "gl_core_4_4.h"
+#include "TextureAtlas.h"
+#include "Texture.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stb_image.h>
+
+namespace aie {
+
+TextureAtlas::TextureAtlas(unsigned int pageWidth, unsigned int pageHeight, unsigned int padding)
+	: m_pageWidth(pageWidth),
+	m_pageHeight(pageHeight),
+	m_padding(padding) {
+}
+
+TextureAtlas::~TextureAtlas() {
+	for (auto& page : m_pages)
+		delete page.texture;
+	for (auto region : m_regions)
+		delete region;
+}
+
+const TextureRegion* TextureAtlas::add(const char* filename) {
+
+	auto it = m_named.find(filename);
+	if (it != m_named.end())
+		return it->second;
+
+	int width = 0, height = 0, channels = 0;
+	unsigned char* pixels = stbi_load(filename, &width, &height, &channels, STBI_rgb_alpha);
+	if (pixels == nullptr)
+		return nullptr;
+
+	std::vector<unsigned char> rgba(pixels, pixels + width * height * 4);
+	stbi_image_free(pixels);
+
+	TextureRegion* region = queue(rgba, width, height);
+	if (region != nullptr)
+		m_named[filename] = region;
+	return region;
+}
+
+const TextureRegion* TextureAtlas::add(const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int channels) {
+
+	if (pixels == nullptr || channels < 1 || channels > 4)
+		return nullptr;
+
+	// expanded the way stb_image does, grey with or without alpha, then rgb
+	std::vector<unsigned char> rgba(width * height * 4);
+	for (unsigned int i = 0; i < width * height; ++i) {
+		const unsigned char* src = pixels + i * channels;
+		unsigned char* dst = rgba.data() + i * 4;
+		switch (channels) {
+		case 1:	dst[0] = dst[1] = dst[2] = src[0]; dst[3] = 255; break;
+		case 2:	dst[0] = dst[1] = dst[2] = src[0]; dst[3] = src[1]; break;
+		case 3:	dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = 255; break;
+		default: memcpy(dst, src, 4); break;
+		};
+	}
+
+	return queue(rgba, width, height);
+}
+
+TextureRegion* TextureAtlas::queue(std::vector<unsigned char>& pixels, unsigned int width, unsigned int height) {
+
+	if (width == 0 || height == 0 ||
+		width + m_padding * 2 > m_pageWidth ||
+		height + m_padding * 2 > m_pageHeight)
+		return nullptr;
+
+	TextureRegion* region = new TextureRegion();
+	region->texture = nullptr;
+	region->uvX = region->uvY = 0;
+	region->uvW = region->uvH = 1;
+	region->width = width;
+	region->height = height;
+	m_regions.push_back(region);
+
+	PendingImage image;
+	image.region = region;
+	image.pixels.swap(pixels);
+	m_pending.push_back(std::move(image));
+
+	return region;
+}
+
+bool TextureAtlas::build() {
+
+	if (m_pending.empty())
+		return true;
+
+	// tallest first keeps the skyline flat, so less space is lost under it
+	std::stable_sort(m_pending.begin(), m_pending.end(), [](const PendingImage& a, const PendingImage& b) {
+		if (a.region->height != b.region->height)
+			return a.region->height > b.region->height;
+		return a.region->width > b.region->width;
+	});
+
+	bool success = true;
+
+	for (auto& image : m_pending) {
+		unsigned int width = image.region->width + m_padding * 2;
+		unsigned int height = image.region->height + m_padding * 2;
+
+		// the earlier pages are the fullest, so try them in order
+		Page* page = nullptr;
+		unsigned int x = 0, y = 0, node = 0;
+		for (auto& candidate : m_pages) {
+			if (findPosition(candidate, width, height, x, y, node)) {
+				page = &candidate;
+				break;
+			}
+		}
+		if (page == nullptr) {
+			page = &addPage();
+			if (findPosition(*page, width, height, x, y, node) == false) {
+				success = false;
+				continue;
+			}
+		}
+
+		addSkylineNode(*page, node, x, y, width, height);
+		blit(*page, image, x, y);
+		page->usedArea += (unsigned long long)width * height;
+
+		TextureRegion* region = image.region;
+		region->texture = page->texture;
+		region->uvX = (x + m_padding) / (float)m_pageWidth;
+		region->uvY = (y + m_padding) / (float)m_pageHeight;
+		region->uvW = region->width / (float)m_pageWidth;
+		region->uvH = region->height / (float)m_pageHeight;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	m_pending.clear();
+
+	return success;
+}
+
+const TextureRegion* TextureAtlas::getRegion(const char* filename) const {
+	auto it = m_named.find(filename);
+	return it != m_named.end() ? it->second : nullptr;
+}
+
+float TextureAtlas::getOccupancy() const {
+	if (m_pages.empty())
+		return 0;
+
+	unsigned long long used = 0;
+	for (auto& page : m_pages)
+		used += page.usedArea;
+	return used / ((float)m_pageWidth * m_pageHeight * m_pages.size());
+}
+
+bool TextureAtlas::findPosition(const Page& page, unsigned int width, unsigned int height,
+								unsigned int& x, unsigned int& y, unsigned int& node) const {
+
+	unsigned int bestY = UINT_MAX;
+	unsigned int bestWidth = UINT_MAX;
+
+	const auto& skyline = page.skyline;
+	for (unsigned int i = 0; i < skyline.size(); ++i) {
+		if (skyline[i].x + width > m_pageWidth)
+			break;
+
+		// the image rests on the highest node it spans
+		unsigned int top = 0;
+		unsigned int covered = 0;
+		for (unsigned int j = i; covered < width; ++j) {
+			top = std::max(top, skyline[j].y);
+			covered += skyline[j].width;
+		}
+		if (top + height > m_pageHeight)
+			continue;
+
+		if (top < bestY ||
+			(top == bestY && skyline[i].width < bestWidth)) {
+			bestY = top;
+			bestWidth = skyline[i].width;
+			x = skyline[i].x;
+			y = top;
+			node = i;
+		}
+	}
+
+	return bestY != UINT_MAX;
+}
+
+void TextureAtlas::addSkylineNode(Page& page, unsigned int node, unsigned int x, unsigned int y,
+								  unsigned int width, unsigned int height) {
+
+	auto& skyline = page.skyline;
+
+	SkylineNode top = { x, y + height, width };
+	skyline.insert(skyline.begin() + node, top);
+
+	// trim the nodes the image now covers
+	for (unsigned int i = node + 1; i < skyline.size();) {
+		unsigned int previousEnd = skyline[i - 1].x + skyline[i - 1].width;
+		if (skyline[i].x >= previousEnd)
+			break;
+
+		unsigned int shrink = previousEnd - skyline[i].x;
+		if (skyline[i].width <= shrink) {
+			skyline.erase(skyline.begin() + i);
+			continue;
+		}
+		skyline[i].x += shrink;
+		skyline[i].width -= shrink;
+		break;
+	}
+
+	// and merge neighbours at the same height
+	for (unsigned int i = 0; i + 1 < skyline.size();) {
+		if (skyline[i].y == skyline[i + 1].y) {
+			skyline[i].width += skyline[i + 1].width;
+			skyline.erase(skyline.begin() + i + 1);
+		}
+		else
+			++i;
+	}
+}
+
+void TextureAtlas::blit(Page& page, const PendingImage& image, unsigned int x, unsigned int y) {
+
+	unsigned int width = image.region->width;
+	unsigned int height = image.region->height;
+	unsigned int paddedWidth = width + m_padding * 2;
+	unsigned int paddedHeight = height + m_padding * 2;
+
+	std::vector<unsigned char> padded(paddedWidth * paddedHeight * 4);
+	for (unsigned int row = 0; row < paddedHeight; ++row) {
+		unsigned int srcRow = (unsigned int)std::min(std::max((int)row - (int)m_padding, 0), (int)height - 1);
+		const unsigned char* src = image.pixels.data() + srcRow * width * 4;
+		unsigned char* dst = padded.data() + row * paddedWidth * 4;
+
+		for (unsigned int i = 0; i < m_padding; ++i) {
+			memcpy(dst + i * 4, src, 4);
+			memcpy(dst + (m_padding + width + i) * 4, src + (width - 1) * 4, 4);
+		}
+		memcpy(dst + m_padding * 4, src, width * 4);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, page.texture->getHandle());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, paddedWidth, paddedHeight, GL_RGBA, GL_UNSIGNED_BYTE, padded.data());
+}
+
+TextureAtlas::Page& TextureAtlas::addPage() {
+
+	Page page;
+	page.texture = new Texture(m_pageWidth, m_pageHeight, Texture::RGBA);
+	page.usedArea = 0;
+
+	SkylineNode floor = { 0, 0, m_pageWidth };
+	page.skyline.push_back(floor);
+
+	// filtered like a loaded texture, but without mips as they would blend
+	// neighbouring images together, and clamped as sprites don't tile
+	glBindTexture(GL_TEXTURE_2D, page.texture->getHandle());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	m_pages.push_back(page);
+	return m_pages.back();
+}
+
+} // namespace aie
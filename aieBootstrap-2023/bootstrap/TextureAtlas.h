@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace aie {
+
+class Texture;
+
+// part of an atlas page. Renderer2D::drawSprite takes one directly and uses
+// its uvs in place of the uv rect
+struct TextureRegion {
+	Texture*		texture;	// the page it was packed in to, nullptr until the atlas is built
+	float			uvX, uvY, uvW, uvH;
+	unsigned int	width;		// of the source image, the sprite's size when none is given
+	unsigned int	height;
+};
+
+// packs many small images in to a few large textures so sprites using them
+// can share a batch rather than flushing each time the renderer runs out
+// of texture slots. Images are packed with a skyline packer, each with a
+// border of its own edge pixels so filtering doesn't bleed between them
+class TextureAtlas {
+public:
+
+	TextureAtlas(unsigned int pageWidth = 2048, unsigned int pageHeight = 2048, unsigned int padding = 2);
+	virtual ~TextureAtlas();
+
+	// queues an image to be packed and returns its region, which is filled
+	// in by build. Adding a file again returns the same region. Returns
+	// nullptr if the image can't be loaded or won't fit in a page
+	const TextureRegion* add(const char* filename);
+	const TextureRegion* add(const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int channels);
+
+	// packs everything added since the last build, tallest first, in to
+	// the existing pages, starting new ones when they are full. Must be
+	// called on the gl thread before the regions are drawn
+	bool build();
+
+	// the region a file was added as, or nullptr
+	const TextureRegion* getRegion(const char* filename) const;
+
+	unsigned int getPageCount() const { return (unsigned int)m_pages.size(); }
+	Texture* getPage(unsigned int page) const { return m_pages[page].texture; }
+
+	// the fraction of the pages' area holding images, padding included
+	float getOccupancy() const;
+
+protected:
+
+	// the top edge of the packed images across part of a page
+	struct SkylineNode {
+		unsigned int x, y, width;
+	};
+
+	struct Page {
+		Texture*					texture;
+		std::vector<SkylineNode>	skyline;
+		unsigned long long			usedArea;
+	};
+
+	struct PendingImage {
+		TextureRegion*				region;
+		std::vector<unsigned char>	pixels;	// rgba
+	};
+
+	// takes the rgba pixels and queues them for the next build
+	TextureRegion* queue(std::vector<unsigned char>& pixels, unsigned int width, unsigned int height);
+
+	// finds the lowest place on the page the padded image fits, returning
+	// false if there is none
+	bool findPosition(const Page& page, unsigned int width, unsigned int height,
+					  unsigned int& x, unsigned int& y, unsigned int& node) const;
+	void addSkylineNode(Page& page, unsigned int node, unsigned int x, unsigned int y,
+						unsigned int width, unsigned int height);
+
+	// copies the image in to the page with its edges extruded in to the padding
+	void blit(Page& page, const PendingImage& image, unsigned int x, unsigned int y);
+
+	Page& addPage();
+
+	unsigned int								m_pageWidth;
+	unsigned int								m_pageHeight;
+	unsigned int								m_padding;
+
+	std::vector<Page>							m_pages;
+	std::vector<TextureRegion*>					m_regions;
+	std::vector<PendingImage>					m_pending;
+	std::unordered_map<std::string, TextureRegion*>	m_named;
+};
+
+} // namespace aie
@@ -0,0 +1,722 @@
+#include "TextureData.h"
+#include <algorithm>
+#include <climits>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define TEXTURE_USE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace aie {
+
+// texture cache layout:
+//	TextureFileHeader
+//	Level[levelCount]
+//	every level's data
+static const char s_textureMagic[4] = { 'T', 'E', 'X', 'C' };
+static const unsigned int s_textureVersion = 2;
+
+struct TextureFileHeader {
+	char				magic[4];
+	unsigned int		version;
+	unsigned long long	sourceSize;
+	long long			sourceModified;
+	unsigned int		options;
+	unsigned int		width;
+	unsigned int		height;
+	unsigned int		channels;
+	unsigned int		compression;
+	unsigned int		levelCount;
+	unsigned int		dataSize;
+};
+
+static unsigned int getBlockSize(TextureData::Compression compression) {
+	switch (compression) {
+	case TextureData::BC1:
+	case TextureData::BC4:	return 8;
+	case TextureData::BC3:
+	case TextureData::BC5:
+	case TextureData::BC7:	return 16;
+	default:				return 0;
+	}
+}
+
+// halves each side that's bigger than 1, every output pixel weighing the
+// four source pixels around its centre 1, 3, 3, 1, clamped at the edges
+static void downsample(const unsigned char* source, unsigned int width, unsigned int height, unsigned int channels,
+					   std::vector<unsigned char>& destination, unsigned int& newWidth, unsigned int& newHeight) {
+	newWidth = std::max(width / 2, 1u);
+	newHeight = std::max(height / 2, 1u);
+	static const int weights[4] = { 1, 3, 3, 1 };
+
+	// horizontally first, keeping 3 more bits for the vertical pass
+	std::vector<unsigned short> rows(newWidth * height * channels);
+	for (unsigned int y = 0; y < height; ++y) {
+		for (unsigned int x = 0; x < newWidth; ++x) {
+			int first = width > 1 ? (int)x * 2 - 1 : 0;
+			for (unsigned int c = 0; c < channels; ++c) {
+				int sum = 0;
+				for (int tap = 0; tap < 4; ++tap) {
+					int sx = std::min(std::max(first + tap, 0), (int)width - 1);
+					sum += weights[tap] * source[(y * width + sx) * channels + c];
+				}
+				rows[(y * newWidth + x) * channels + c] = (unsigned short)sum;
+			}
+		}
+	}
+
+	destination.resize(newWidth * newHeight * channels);
+	for (unsigned int y = 0; y < newHeight; ++y) {
+		int first = height > 1 ? (int)y * 2 - 1 : 0;
+		for (unsigned int x = 0; x < newWidth; ++x) {
+			for (unsigned int c = 0; c < channels; ++c) {
+				int sum = 0;
+				for (int tap = 0; tap < 4; ++tap) {
+					int sy = std::min(std::max(first + tap, 0), (int)height - 1);
+					sum += weights[tap] * rows[(sy * newWidth + x) * channels + c];
+				}
+				destination[(y * newWidth + x) * channels + c] = (unsigned char)((sum + 32) / 64);
+			}
+		}
+	}
+}
+
+static unsigned short packColour565(const float* colour) {
+	int r = std::min(std::max((int)(colour[0] * 31 / 255 + 0.5f), 0), 31);
+	int g = std::min(std::max((int)(colour[1] * 63 / 255 + 0.5f), 0), 63);
+	int b = std::min(std::max((int)(colour[2] * 31 / 255 + 0.5f), 0), 31);
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static void unpackColour565(unsigned short packed, int* colour) {
+	int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+	colour[0] = (r << 3) | (r >> 2);
+	colour[1] = (g << 2) | (g >> 4);
+	colour[2] = (b << 3) | (b >> 2);
+}
+
+// block holds 16 pixels of 4 bytes. The endpoints are the extremes of the
+// pixels along their principal axis, and each pixel takes the nearest of
+// the four colours between them. Always uses four colour mode, as BC3 must
+static void encodeBC1(const unsigned char* block, unsigned char* output) {
+	float mean[3] = {};
+	for (int i = 0; i < 16; ++i)
+		for (int c = 0; c < 3; ++c)
+			mean[c] += block[i * 4 + c] / 16.0f;
+
+	float covariance[6] = {};
+	for (int i = 0; i < 16; ++i) {
+		float r = block[i * 4 + 0] - mean[0], g = block[i * 4 + 1] - mean[1], b = block[i * 4 + 2] - mean[2];
+		covariance[0] += r * r;	covariance[1] += r * g;	covariance[2] += r * b;
+		covariance[3] += g * g;	covariance[4] += g * b;	covariance[5] += b * b;
+	}
+
+	// a few power iterations are plenty to find the main axis
+	float axis[3] = { 1, 1, 1 };
+	for (int iteration = 0; iteration < 4; ++iteration) {
+		float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+		float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+		float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+		float largest = std::max(std::max(fabsf(x), fabsf(y)), fabsf(z));
+		if (largest <= 0)
+			break;
+		axis[0] = x / largest;	axis[1] = y / largest;	axis[2] = z / largest;
+	}
+
+	float minT = 0, maxT = 0;
+	for (int i = 0; i < 16; ++i) {
+		float t = (block[i * 4 + 0] - mean[0]) * axis[0] +
+			(block[i * 4 + 1] - mean[1]) * axis[1] +
+			(block[i * 4 + 2] - mean[2]) * axis[2];
+		minT = std::min(minT, t);
+		maxT = std::max(maxT, t);
+	}
+
+	float axisLength = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	float high[3], low[3];
+	for (int c = 0; c < 3; ++c) {
+		high[c] = mean[c] + axis[c] * maxT / std::max(axisLength, 1e-6f);
+		low[c] = mean[c] + axis[c] * minT / std::max(axisLength, 1e-6f);
+	}
+
+	unsigned short colour0 = packColour565(high);
+	unsigned short colour1 = packColour565(low);
+	if (colour0 < colour1)
+		std::swap(colour0, colour1);
+
+	unsigned int indices = 0;
+	if (colour0 != colour1) {
+		int palette[4][3];
+		unpackColour565(colour0, palette[0]);
+		unpackColour565(colour1, palette[1]);
+		for (int c = 0; c < 3; ++c) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; ++i) {
+			int best = 0, bestDistance = INT_MAX;
+			for (int p = 0; p < 4; ++p) {
+				int r = block[i * 4 + 0] - palette[p][0];
+				int g = block[i * 4 + 1] - palette[p][1];
+				int b = block[i * 4 + 2] - palette[p][2];
+				int distance = r * r + g * g + b * b;
+				if (distance < bestDistance) {
+					bestDistance = distance;
+					best = p;
+				}
+			}
+			indices |= best << (i * 2);
+		}
+	}
+
+	output[0] = (unsigned char)(colour0 & 0xff);
+	output[1] = (unsigned char)(colour0 >> 8);
+	output[2] = (unsigned char)(colour1 & 0xff);
+	output[3] = (unsigned char)(colour1 >> 8);
+	memcpy(output + 4, &indices, 4);
+}
+
+// one channel of a block, every 4th byte from values. The endpoints are its
+// range, with the six values between them (eight value mode)
+static void encodeBC4(const unsigned char* values, unsigned char* output) {
+	int high = 0, low = 255;
+	for (int i = 0; i < 16; ++i) {
+		high = std::max(high, (int)values[i * 4]);
+		low = std::min(low, (int)values[i * 4]);
+	}
+
+	output[0] = (unsigned char)high;
+	output[1] = (unsigned char)low;
+
+	unsigned long long indices = 0;
+	if (high != low) {
+		int range = high - low;
+		for (int i = 0; i < 16; ++i) {
+			// steps up from low, which is index 1, to high, index 0, with 7 to 2 between
+			int step = ((values[i * 4] - low) * 14 + range) / (range * 2);
+			unsigned long long index = step == 7 ? 0 : step == 0 ? 1 : 8 - step;
+			indices |= index << (i * 3);
+		}
+	}
+
+	for (int i = 0; i < 6; ++i)
+		output[2 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+// BC7 is encoded in one of two single subset modes. Mode 6 has 7 bit rgba
+// endpoints that each get their own low bit (the p-bit), and 4 bit indices
+// in to the 16 colours between them. It suits most blocks, but alpha shares
+// its indices, so blocks with both colour and alpha edges use mode 5, whose
+// rgb and alpha have their own 2 bit indices
+static const int s_bc7Weights2[4] = { 0, 21, 43, 64 };
+static const int s_bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// writes fields from the lowest bit up, in to a zeroed block
+struct BC7Writer {
+	unsigned char*	output;
+	unsigned int	position;
+
+	void write(unsigned int value, unsigned int bits) {
+		for (unsigned int i = 0; i < bits; ++i, ++position)
+			output[position >> 3] |= (unsigned char)(((value >> i) & 1) << (position & 7));
+	}
+};
+
+static inline int interpolateBC7(int low, int high, int weight) {
+	return ((64 - weight) * low + weight * high + 32) >> 6;
+}
+
+// picks each pixel's nearest palette colour, pixels are by channel then
+// pixel. Returns the summed squared error, which is exact as every term is
+// a whole number, so both paths give the same indices
+static float selectIndicesBC7(const float pixels[4][16], const float palette[16][4], int paletteSize,
+							  unsigned char* indices) {
+#ifdef TEXTURE_USE_SSE
+	// four pixels at a time against every colour
+	__m128 total = _mm_setzero_ps();
+	for (int group = 0; group < 16; group += 4) {
+		__m128 r = _mm_loadu_ps(pixels[0] + group);
+		__m128 g = _mm_loadu_ps(pixels[1] + group);
+		__m128 b = _mm_loadu_ps(pixels[2] + group);
+		__m128 a = _mm_loadu_ps(pixels[3] + group);
+
+		__m128 best = _mm_set1_ps(FLT_MAX);
+		__m128i bestIndex = _mm_setzero_si128();
+		for (int p = 0; p < paletteSize; ++p) {
+			__m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[p][0]));
+			__m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[p][1]));
+			__m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[p][2]));
+			__m128 da = _mm_sub_ps(a, _mm_set1_ps(palette[p][3]));
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)),
+										 _mm_add_ps(_mm_mul_ps(db, db), _mm_mul_ps(da, da)));
+
+			__m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+			bestIndex = _mm_or_si128(_mm_andnot_si128(closer, bestIndex), _mm_and_si128(closer, _mm_set1_epi32(p)));
+			best = _mm_min_ps(distance, best);
+		}
+		total = _mm_add_ps(total, best);
+
+		alignas(16) int lanes[4];
+		_mm_store_si128((__m128i*)lanes, bestIndex);
+		for (int i = 0; i < 4; ++i)
+			indices[group + i] = (unsigned char)lanes[i];
+	}
+
+	alignas(16) float sums[4];
+	_mm_store_ps(sums, total);
+	return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+#else
+	float sums[4] = {};
+	for (int i = 0; i < 16; ++i) {
+		float best = FLT_MAX;
+		int bestIndex = 0;
+		for (int p = 0; p < paletteSize; ++p) {
+			float distance = 0;
+			for (int c = 0; c < 4; ++c) {
+				float d = pixels[c][i] - palette[p][c];
+				distance += d * d;
+			}
+			if (distance < best) {
+				best = distance;
+				bestIndex = p;
+			}
+		}
+		indices[i] = (unsigned char)bestIndex;
+		sums[i & 3] += best;
+	}
+	return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+#endif
+}
+
+// the extremes of the pixels along the principal axis of their first
+// channelCount channels, found as encodeBC1 does
+static void findBC7Endpoints(const float pixels[4][16], int channelCount, float* low, float* high) {
+	float mean[4] = {};
+	for (int c = 0; c < channelCount; ++c)
+		for (int i = 0; i < 16; ++i)
+			mean[c] += pixels[c][i] / 16.0f;
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; ++i)
+		for (int row = 0; row < channelCount; ++row)
+			for (int column = 0; column < channelCount; ++column)
+				covariance[row][column] += (pixels[row][i] - mean[row]) * (pixels[column][i] - mean[column]);
+
+	float axis[4] = { 1, 1, 1, 1 };
+	for (int iteration = 0; iteration < 4; ++iteration) {
+		float next[4] = {};
+		float largest = 0;
+		for (int row = 0; row < channelCount; ++row) {
+			for (int column = 0; column < channelCount; ++column)
+				next[row] += covariance[row][column] * axis[column];
+			largest = std::max(largest, fabsf(next[row]));
+		}
+		if (largest <= 0)
+			break;
+		for (int c = 0; c < channelCount; ++c)
+			axis[c] = next[c] / largest;
+	}
+
+	float minT = 0, maxT = 0, axisLength = 0;
+	for (int c = 0; c < channelCount; ++c)
+		axisLength += axis[c] * axis[c];
+	for (int i = 0; i < 16; ++i) {
+		float t = 0;
+		for (int c = 0; c < channelCount; ++c)
+			t += (pixels[c][i] - mean[c]) * axis[c];
+		minT = std::min(minT, t);
+		maxT = std::max(maxT, t);
+	}
+
+	axisLength = std::max(axisLength, 1e-6f);
+	for (int c = 0; c < 4; ++c) {
+		low[c] = c < channelCount ? std::min(std::max(mean[c] + axis[c] * minT / axisLength, 0.0f), 255.0f) : 0;
+		high[c] = c < channelCount ? std::min(std::max(mean[c] + axis[c] * maxT / axisLength, 0.0f), 255.0f) : 0;
+	}
+}
+
+// the endpoints that best fit the pixels for the given indices, by least
+// squares. Fails when every pixel uses the same weight
+static bool solveBC7Endpoints(const float pixels[4][16], const unsigned char* indices, const int* weights,
+							  float* low, float* high) {
+	float aa = 0, bb = 0, ab = 0;
+	float ax[4] = {}, bx[4] = {};
+	for (int i = 0; i < 16; ++i) {
+		float b = weights[indices[i]] / 64.0f;
+		float a = 1 - b;
+		aa += a * a;	bb += b * b;	ab += a * b;
+		for (int c = 0; c < 4; ++c) {
+			ax[c] += a * pixels[c][i];
+			bx[c] += b * pixels[c][i];
+		}
+	}
+
+	float determinant = aa * bb - ab * ab;
+	if (fabsf(determinant) < 1e-6f)
+		return false;
+
+	for (int c = 0; c < 4; ++c) {
+		low[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+		high[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+	}
+	return true;
+}
+
+struct BC7Mode6 {
+	int				endpoints[2][4];	// 7 bits
+	int				pbits[2];
+	unsigned char	indices[16];
+	float			error;
+};
+
+// rounds the endpoints to 7 bits under every combination of p-bits and
+// keeps whichever fits the pixels best
+static void fitBC7Mode6(const float pixels[4][16], const float* low, const float* high, BC7Mode6& result) {
+	const float* ends[2] = { low, high };
+	BC7Mode6 candidate;
+	result.error = FLT_MAX;
+
+	for (int combination = 0; combination < 4; ++combination) {
+		int values[2][4];
+		for (int e = 0; e < 2; ++e) {
+			int pbit = (combination >> e) & 1;
+			candidate.pbits[e] = pbit;
+			for (int c = 0; c < 4; ++c) {
+				int q = (int)((ends[e][c] - pbit) * 0.5f + 0.5f);
+				candidate.endpoints[e][c] = std::min(std::max(q, 0), 127);
+				values[e][c] = candidate.endpoints[e][c] * 2 + pbit;
+			}
+		}
+
+		float palette[16][4];
+		for (int p = 0; p < 16; ++p)
+			for (int c = 0; c < 4; ++c)
+				palette[p][c] = (float)interpolateBC7(values[0][c], values[1][c], s_bc7Weights4[p]);
+
+		candidate.error = selectIndicesBC7(pixels, palette, 16, candidate.indices);
+		if (candidate.error < result.error)
+			result = candidate;
+	}
+}
+
+// the endpoints start at the extremes along the principal axis, then are
+// refitted to the indices they chose while that lowers the error
+static float encodeBC7Mode6(const float pixels[4][16], unsigned char* output) {
+	float low[4], high[4];
+	findBC7Endpoints(pixels, 4, low, high);
+
+	BC7Mode6 best, refined;
+	fitBC7Mode6(pixels, low, high, best);
+	for (int iteration = 0; iteration < 2 && best.error > 0; ++iteration) {
+		if (solveBC7Endpoints(pixels, best.indices, s_bc7Weights4, low, high) == false)
+			break;
+		fitBC7Mode6(pixels, low, high, refined);
+		if (refined.error >= best.error)
+			break;
+		best = refined;
+	}
+
+	// the first pixel's index is stored without its top bit, so it has to be below 8
+	if (best.indices[0] >= 8) {
+		for (int c = 0; c < 4; ++c)
+			std::swap(best.endpoints[0][c], best.endpoints[1][c]);
+		std::swap(best.pbits[0], best.pbits[1]);
+		for (int i = 0; i < 16; ++i)
+			best.indices[i] = (unsigned char)(15 - best.indices[i]);
+	}
+
+	memset(output, 0, 16);
+	BC7Writer writer = { output, 0 };
+	writer.write(1 << 6, 7);
+	for (int c = 0; c < 4; ++c) {
+		writer.write(best.endpoints[0][c], 7);
+		writer.write(best.endpoints[1][c], 7);
+	}
+	writer.write(best.pbits[0], 1);
+	writer.write(best.pbits[1], 1);
+	for (int i = 0; i < 16; ++i)
+		writer.write(best.indices[i], i == 0 ? 3 : 4);
+	return best.error;
+}
+
+struct BC7Mode5 {
+	int				colour[2][3];	// 7 bits
+	unsigned char	colourIndices[16];
+	float			error;			// of the colour alone
+};
+
+static void fitBC7Mode5(const float colours[4][16], const float* low, const float* high, BC7Mode5& result) {
+	const float* ends[2] = { low, high };
+	float palette[16][4] = {};
+	int values[2][3];
+	for (int e = 0; e < 2; ++e) {
+		for (int c = 0; c < 3; ++c) {
+			int q = std::min(std::max((int)(ends[e][c] * 127 / 255 + 0.5f), 0), 127);
+			result.colour[e][c] = q;
+			values[e][c] = (q << 1) | (q >> 6);
+		}
+	}
+	for (int p = 0; p < 4; ++p)
+		for (int c = 0; c < 3; ++c)
+			palette[p][c] = (float)interpolateBC7(values[0][c], values[1][c], s_bc7Weights2[p]);
+
+	result.error = selectIndicesBC7(colours, palette, 4, result.colourIndices);
+}
+
+// rgb is fitted as mode 6 fits rgba, and alpha's endpoints are its range
+static float encodeBC7Mode5(const float pixels[4][16], unsigned char* output) {
+	float colours[4][16];
+	memcpy(colours, pixels, sizeof(float) * 3 * 16);
+	memset(colours[3], 0, sizeof(colours[3]));
+
+	float low[4], high[4];
+	findBC7Endpoints(colours, 3, low, high);
+
+	BC7Mode5 best, refined;
+	fitBC7Mode5(colours, low, high, best);
+	for (int iteration = 0; iteration < 2 && best.error > 0; ++iteration) {
+		if (solveBC7Endpoints(colours, best.colourIndices, s_bc7Weights2, low, high) == false)
+			break;
+		fitBC7Mode5(colours, low, high, refined);
+		if (refined.error >= best.error)
+			break;
+		best = refined;
+	}
+
+	int alpha[2] = { 255, 0 };
+	for (int i = 0; i < 16; ++i) {
+		alpha[0] = std::min(alpha[0], (int)pixels[3][i]);
+		alpha[1] = std::max(alpha[1], (int)pixels[3][i]);
+	}
+	unsigned char alphaIndices[16];
+	float alphaError = 0;
+	for (int i = 0; i < 16; ++i) {
+		int bestIndex = 0;
+		float bestDistance = FLT_MAX;
+		for (int p = 0; p < 4; ++p) {
+			float d = pixels[3][i] - interpolateBC7(alpha[0], alpha[1], s_bc7Weights2[p]);
+			if (d * d < bestDistance) {
+				bestDistance = d * d;
+				bestIndex = p;
+			}
+		}
+		alphaIndices[i] = (unsigned char)bestIndex;
+		alphaError += bestDistance;
+	}
+
+	// as in mode 6, the first pixel's indices lose their top bit
+	if (best.colourIndices[0] >= 2) {
+		for (int c = 0; c < 3; ++c)
+			std::swap(best.colour[0][c], best.colour[1][c]);
+		for (int i = 0; i < 16; ++i)
+			best.colourIndices[i] = (unsigned char)(3 - best.colourIndices[i]);
+	}
+	if (alphaIndices[0] >= 2) {
+		std::swap(alpha[0], alpha[1]);
+		for (int i = 0; i < 16; ++i)
+			alphaIndices[i] = (unsigned char)(3 - alphaIndices[i]);
+	}
+
+	// no channel rotation
+	memset(output, 0, 16);
+	BC7Writer writer = { output, 0 };
+	writer.write(1 << 5, 6);
+	writer.write(0, 2);
+	for (int c = 0; c < 3; ++c) {
+		writer.write(best.colour[0][c], 7);
+		writer.write(best.colour[1][c], 7);
+	}
+	writer.write(alpha[0], 8);
+	writer.write(alpha[1], 8);
+	for (int i = 0; i < 16; ++i)
+		writer.write(best.colourIndices[i], i == 0 ? 1 : 2);
+	for (int i = 0; i < 16; ++i)
+		writer.write(alphaIndices[i], i == 0 ? 1 : 2);
+	return best.error + alphaError;
+}
+
+// block holds 16 pixels of 4 bytes
+static void encodeBC7(const unsigned char* block, unsigned char* output) {
+	float pixels[4][16];
+	bool constantAlpha = true;
+	for (int i = 0; i < 16; ++i) {
+		for (int c = 0; c < 4; ++c)
+			pixels[c][i] = block[i * 4 + c];
+		constantAlpha &= block[i * 4 + 3] == block[3];
+	}
+
+	// mode 6 does as well as mode 5 for blocks with no alpha edges
+	float error = encodeBC7Mode6(pixels, output);
+	if (constantAlpha || error == 0)
+		return;
+
+	unsigned char mode5[16];
+	if (encodeBC7Mode5(pixels, mode5) < error)
+		memcpy(output, mode5, 16);
+}
+
+TextureData::TextureData()
+	: m_width(0),
+	m_height(0),
+	m_channels(0),
+	m_options(0),
+	m_compression(NONE) {
+}
+
+void TextureData::build(const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int channels,
+						unsigned int options) {
+
+	static const Compression compressionByChannels[5] = { NONE, BC4, BC5, BC1, BC3 };
+
+	m_width = width;
+	m_height = height;
+	m_channels = channels;
+	m_options = options;
+	m_compression = NONE;
+	if (options & BUILD_COMPRESS)
+		m_compression = (options & BUILD_BC7) && channels >= 3 ? BC7 : compressionByChannels[channels];
+	m_levels.clear();
+	m_data.clear();
+
+	addLevel(pixels, width, height);
+	if ((options & BUILD_MIPMAPS) == 0)
+		return;
+
+	std::vector<unsigned char> level, next;
+	const unsigned char* source = pixels;
+	while (width > 1 || height > 1) {
+		downsample(source, width, height, channels, next, width, height);
+		level.swap(next);
+		source = level.data();
+		addLevel(source, width, height);
+	}
+}
+
+void TextureData::addLevel(const unsigned char* pixels, unsigned int width, unsigned int height) {
+	Level level;
+	level.width = width;
+	level.height = height;
+	level.offset = (unsigned int)m_data.size();
+
+	if (m_compression == NONE) {
+		level.size = width * height * m_channels;
+		m_data.insert(m_data.end(), pixels, pixels + level.size);
+		m_levels.push_back(level);
+		return;
+	}
+
+	// blocks hang over the edge of sizes that aren't a multiple of 4, those pixels repeat the last
+	unsigned int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	unsigned int blockSize = getBlockSize(m_compression);
+	level.size = blocksX * blocksY * blockSize;
+	m_data.resize(level.offset + level.size);
+
+	unsigned char* output = m_data.data() + level.offset;
+	unsigned char block[16 * 4];
+	for (unsigned int by = 0; by < blocksY; ++by) {
+		for (unsigned int bx = 0; bx < blocksX; ++bx) {
+			for (unsigned int i = 0; i < 16; ++i) {
+				unsigned int x = std::min(bx * 4 + (i & 3), width - 1);
+				unsigned int y = std::min(by * 4 + (i >> 2), height - 1);
+				const unsigned char* pixel = pixels + (y * width + x) * m_channels;
+				for (unsigned int c = 0; c < 4; ++c)
+					block[i * 4 + c] = c < m_channels ? pixel[c] : 255;
+			}
+
+			switch (m_compression) {
+			case BC1:	encodeBC1(block, output);	break;
+			case BC3:	encodeBC4(block + 3, output);	encodeBC1(block, output + 8);	break;
+			case BC4:	encodeBC4(block, output);	break;
+			case BC5:	encodeBC4(block, output);	encodeBC4(block + 1, output + 8);	break;
+			case BC7:	encodeBC7(block, output);	break;
+			default:	break;
+			}
+			output += blockSize;
+		}
+	}
+
+	m_levels.push_back(level);
+}
+
+bool TextureData::save(const char* filename, unsigned long long sourceSize, long long sourceModified) const {
+
+	TextureFileHeader header = {};
+	memcpy(header.magic, s_textureMagic, sizeof(s_textureMagic));
+	header.version = s_textureVersion;
+	header.sourceSize = sourceSize;
+	header.sourceModified = sourceModified;
+	header.options = m_options;
+	header.width = m_width;
+	header.height = m_height;
+	header.channels = m_channels;
+	header.compression = m_compression;
+	header.levelCount = (unsigned int)m_levels.size();
+	header.dataSize = (unsigned int)m_data.size();
+
+	FILE* file = fopen(filename, "wb");
+	if (file == nullptr)
+		return false;
+
+	bool success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(m_levels.data(), sizeof(Level), m_levels.size(), file) == m_levels.size() &&
+		fwrite(m_data.data(), 1, m_data.size(), file) == m_data.size();
+	fclose(file);
+
+	// never leave a half written file behind
+	if (success == false)
+		remove(filename);
+	return success;
+}
+
+bool TextureData::load(const char* filename, unsigned long long sourceSize, long long sourceModified,
+					   unsigned int options) {
+
+	FILE* file = fopen(filename, "rb");
+	if (file == nullptr)
+		return false;
+
+	// anything that doesn't match means the image, the options or this build have changed since it was written
+	TextureFileHeader header;
+	bool success = fread(&header, sizeof(header), 1, file) == 1 &&
+		memcmp(header.magic, s_textureMagic, sizeof(s_textureMagic)) == 0 &&
+		header.version == s_textureVersion &&
+		header.sourceSize == sourceSize &&
+		header.sourceModified == sourceModified &&
+		header.options == options &&
+		header.channels >= 1 && header.channels <= 4 &&
+		header.compression <= BC7 &&
+		header.levelCount >= 1 && header.levelCount <= 32;
+
+	std::vector<Level> levels;
+	std::vector<unsigned char> data;
+	if (success) {
+		levels.resize(header.levelCount);
+		data.resize(header.dataSize);
+		success = fread(levels.data(), sizeof(Level), levels.size(), file) == levels.size() &&
+			fread(data.data(), 1, data.size(), file) == data.size();
+	}
+	fclose(file);
+
+	// make sure every level lies inside the data before handing any of it to opengl
+	for (size_t i = 0; i < levels.size() && success; ++i)
+		success = (unsigned long long)levels[i].offset + levels[i].size <= data.size();
+
+	if (success == false)
+		return false;
+
+	m_width = header.width;
+	m_height = header.height;
+	m_channels = header.channels;
+	m_options = header.options;
+	m_compression = (Compression)header.compression;
+	m_levels.swap(levels);
+	m_data.swap(data);
+	return true;
+}
+
+} // namespace aie
\ No newline at end of file
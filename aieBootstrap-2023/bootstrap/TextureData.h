@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+
+namespace aie {
+
+// a texture's pixels laid out ready for opengl, a filtered mip chain that
+// may also be block compressed, which can be saved to a container file so
+// later runs skip decoding and processing the source image
+class TextureData {
+public:
+
+	enum Compression : unsigned int {
+		NONE = 0,
+		BC1,	// rgb, 8 bytes per 4x4 block
+		BC3,	// rgba, 16 bytes per block
+		BC4,	// red, 8 bytes per block
+		BC5,	// red and green, 16 bytes per block
+		BC7,	// rgba at a higher quality than BC1 and BC3, 16 bytes per block
+	};
+
+	// how build processes the image. They're stored in the cache file, so a
+	// load asking for different ones misses rather than getting the wrong levels
+	enum BuildOptions : unsigned int {
+		BUILD_MIPMAPS	= 1 << 0,
+		BUILD_COMPRESS	= 1 << 1,
+		BUILD_BC7		= 1 << 2,	// with BUILD_COMPRESS, rgb and rgba images use BC7 instead of BC1 and BC3
+	};
+
+	struct Level {
+		unsigned int	width;
+		unsigned int	height;
+		unsigned int	offset;	// in to the data
+		unsigned int	size;
+	};
+
+	TextureData();
+	~TextureData() {}
+
+	// builds the levels from 8 bit pixels with 1 to 4 channels. Each mip is
+	// filtered from the one above with a separable [1 3 3 1] tent, and when
+	// compressing the format follows the channel count: BC4, BC5, BC1 or BC7,
+	// BC3 or BC7
+	void build(const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int channels,
+			   unsigned int options);
+
+	// the source's size and modification time and the build options are
+	// stored, and a load fails if they don't match, or the file was written
+	// by another version
+	bool save(const char* filename, unsigned long long sourceSize, long long sourceModified) const;
+	bool load(const char* filename, unsigned long long sourceSize, long long sourceModified, unsigned int options);
+
+	unsigned int getWidth() const { return m_width; }
+	unsigned int getHeight() const { return m_height; }
+	unsigned int getChannels() const { return m_channels; }
+	Compression getCompression() const { return m_compression; }
+
+	unsigned int getLevelCount() const { return (unsigned int)m_levels.size(); }
+	const Level& getLevel(unsigned int level) const { return m_levels[level]; }
+	const unsigned char* getLevelData(unsigned int level) const { return m_data.data() + m_levels[level].offset; }
+
+	// every level's bytes together
+	unsigned int getSize() const { return (unsigned int)m_data.size(); }
+
+protected:
+
+	void addLevel(const unsigned char* pixels, unsigned int width, unsigned int height);
+
+	unsigned int				m_width;
+	unsigned int				m_height;
+	unsigned int				m_channels;
+	unsigned int				m_options;
+	Compression					m_compression;
+	std::vector<Level>			m_levels;
+	std::vector<unsigned char>	m_data;
+};
+
+} // namespace aie
\ No newline at end of file